@@ -0,0 +1,200 @@
+/*
+ * AudioReactive.cpp
+ * Created by Jose Rivera, Aug 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include "AudioReactive.h"
+#include <Arduino.h>
+
+/**
+ * Constructor of the class.
+ * @param pin Analog input of the audio signal
+ */
+AudioReactive::AudioReactive(uint8_t pin)
+{
+  this->_pin = pin;
+}
+
+/**
+ * Store a sample in the ring, it replaces the oldest one.
+ */
+void AudioReactive::push(uint16_t value)
+{
+  this->_samples[this->_head] = value;
+  this->_head = (this->_head + 1) % AUDIO_FFT_SIZE;
+  if(this->_count < AUDIO_FFT_SIZE)
+  {
+    this->_count++;
+  }
+}
+
+/**
+ * Prepare the analog input.
+ */
+void AudioReactive::begin(void)
+{
+  pinMode(this->_pin, INPUT);
+}
+
+/**
+ * Take a sample if the time of the next one is reached, it must be called
+ * more often than AUDIO_SAMPLE_RATE (from the loop and while it waits). A
+ * sample late by a whole period is a gap, the samples before it are
+ * discarded.
+ * @param now Current time in us
+ * @return  true when a sample was taken
+ */
+bool AudioReactive::sample(uint32_t now)
+{
+  uint32_t elapsed = now - this->_last_sample;
+  if(elapsed < AUDIO_SAMPLE_PERIOD)
+  {
+    return false;
+  }
+  if(elapsed < 2 * AUDIO_SAMPLE_PERIOD)
+  {
+    this->_last_sample += AUDIO_SAMPLE_PERIOD;
+  }
+  else
+  {
+    this->_count = 0;
+    this->_last_sample = now;
+  }
+  this->push(analogRead(this->_pin));
+  return true;
+}
+
+/**
+ * Analyze the last AUDIO_FFT_SIZE samples, once there are enough samples
+ * since the last analysis.
+ * @param now Current time in ms
+ * @return  true when a new analysis was done
+ */
+bool AudioReactive::analyze(uint64_t now)
+{
+  if(this->_count < AUDIO_FFT_SIZE)
+  {
+    return false;
+  }
+  this->_count = 0;
+
+  // Copy the samples from the oldest one and remove the DC offset of the input
+  int32_t sum = 0;
+  for(uint16_t i = 0; i < AUDIO_FFT_SIZE; i++)
+  {
+    uint16_t value = this->_samples[(this->_head + i) % AUDIO_FFT_SIZE];
+    this->_re[i] = value;
+    sum += value;
+  }
+  int16_t mean = sum >> AUDIO_FFT_BITS;
+  for(uint16_t i = 0; i < AUDIO_FFT_SIZE; i++)
+  {
+    // 10 bits samples to Q15
+    this->_re[i] = (this->_re[i] - mean) << 5;
+    this->_im[i] = 0;
+  }
+  fixedWindow(this->_re, AUDIO_FFT_BITS);
+  fixedFFT(this->_re, this->_im, AUDIO_FFT_BITS);
+
+  // Bass up to 1/16 of the sample rate, mid up to 1/5 and the rest is treble
+  uint32_t bands[3] = { 0, 0, 0 };
+  for(uint16_t i = 1; i < AUDIO_FFT_SIZE / 2; i++)
+  {
+    uint16_t magnitude = fixedMagnitude(this->_re[i], this->_im[i]);
+    if(i <= AUDIO_FFT_SIZE / 16)
+    {
+      bands[AudioBand::BASS] += magnitude;
+    }
+    else if(i <= AUDIO_FFT_SIZE / 5)
+    {
+      bands[AudioBand::MID] += magnitude;
+    }
+    else
+    {
+      bands[AudioBand::TREBLE] += magnitude;
+    }
+  }
+
+  // Automatic gain, the peak decays slowly towards the noise floor
+  this->_peak -= this->_peak >> 6;
+  for(uint8_t i = 0; i < 3; i++)
+  {
+    this->_bands[i] = bands[i];
+    if(bands[i] > this->_peak)
+    {
+      this->_peak = bands[i];
+    }
+  }
+  if(this->_peak < AUDIO_NOISE_FLOOR)
+  {
+    this->_peak = AUDIO_NOISE_FLOOR;
+  }
+
+  // Beat when the bass energy is 1.5 times its average
+  uint32_t bass = bands[AudioBand::BASS];
+  this->_beat = bass > AUDIO_NOISE_FLOOR &&
+    bass > this->_bass_average + (this->_bass_average >> 1) &&
+    (now - this->_last_beat) > AUDIO_BEAT_HOLD;
+  this->_bass_average += ((int32_t) bass - (int32_t) this->_bass_average) >> 3;
+  if(this->_beat)
+  {
+    this->_last_beat = now;
+    this->_brightness = 255;
+  }
+  else if(this->_brightness > AUDIO_MIN_BRIGHTNESS + 16)
+  {
+    this->_brightness -= 16;
+  }
+  else
+  {
+    this->_brightness = AUDIO_MIN_BRIGHTNESS;
+  }
+  return true;
+}
+
+/**
+ * It allows to obtain the energy of a band relative to the peak (0-255).
+ */
+uint8_t AudioReactive::getBand(AudioBand band)
+{
+  return (this->_bands[band] * 255) / this->_peak;
+}
+
+bool AudioReactive::isBeat(void)
+{
+  return this->_beat;
+}
+
+/**
+ * Color with the bass in red, the mid in green and the treble in blue, scaled
+ * so the strongest band is at the pulse brightness.
+ */
+uint32_t AudioReactive::getColor(void)
+{
+  uint32_t max = this->_bands[0];
+  for(uint8_t i = 1; i < 3; i++)
+  {
+    if(this->_bands[i] > max)
+    {
+      max = this->_bands[i];
+    }
+  }
+  if(max == 0)
+  {
+    return 0;
+  }
+  uint32_t red = (this->_bands[AudioBand::BASS] * this->_brightness) / max;
+  uint32_t green = (this->_bands[AudioBand::MID] * this->_brightness) / max;
+  uint32_t blue = (this->_bands[AudioBand::TREBLE] * this->_brightness) / max;
+  return (red << 16) | (green << 8) | blue;
+}
+
+/**
+ * Brightness that pulses to full intensity on each beat.
+ */
+uint8_t AudioReactive::getBrightness(void)
+{
+  return this->_brightness;
+}
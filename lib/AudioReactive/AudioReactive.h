@@ -0,0 +1,71 @@
+/*
+ * AudioReactive.h
+ * Created by Jose Rivera, Aug 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+
+#include <inttypes.h>
+#include "FixedFFT.h"
+
+#ifndef AUDIO_REACTIVE_H_
+#define AUDIO_REACTIVE_H_
+
+#define AUDIO_SAMPLE_RATE 4000
+#define AUDIO_FFT_BITS 6
+#define AUDIO_FFT_SIZE (1 << AUDIO_FFT_BITS)
+#define AUDIO_SAMPLE_PERIOD (1000000UL / AUDIO_SAMPLE_RATE)
+#define AUDIO_BEAT_HOLD 200
+#define AUDIO_NOISE_FLOOR 32
+#define AUDIO_MIN_BRIGHTNESS 64
+
+enum AudioBand
+{
+  BASS,
+  MID,
+  TREBLE
+};
+
+/**
+ * AudioReactive samples an analog input in bursts of AUDIO_FFT_SIZE samples
+ * and analyzes each burst with a fixed point FFT. The energy of the bass, mid
+ * and treble bands is mapped to a color and the beats detected in the bass
+ * band are mapped to pulses of brightness.
+ *
+ * The samples are taken one at a time from the loop (sample(), it never
+ * waits) when the time of the next one is reached, the analog input of the
+ * ESP8266 is too slow to be read from an interrupt. They are kept in a ring,
+ * the analysis uses the last AUDIO_FFT_SIZE samples taken without a gap.
+ * push() allows to feed the samples from another source.
+ */
+class AudioReactive
+{
+  private:
+    uint8_t _pin;
+    uint16_t _samples[AUDIO_FFT_SIZE];
+    uint16_t _head = 0;
+    uint16_t _count = 0;
+    uint32_t _last_sample = 0;
+    int16_t _re[AUDIO_FFT_SIZE];
+    int16_t _im[AUDIO_FFT_SIZE];
+    uint32_t _bands[3] = { 0, 0, 0 };
+    uint32_t _peak = AUDIO_NOISE_FLOOR;
+    uint32_t _bass_average = 0;
+    uint64_t _last_beat = 0;
+    bool _beat = false;
+    uint8_t _brightness = AUDIO_MIN_BRIGHTNESS;
+
+  public:
+    AudioReactive(uint8_t pin);
+    void begin(void);
+    bool sample(uint32_t);
+    void push(uint16_t);
+    bool analyze(uint64_t);
+    uint8_t getBand(AudioBand);
+    bool isBeat(void);
+    uint32_t getColor(void);
+    uint8_t getBrightness(void);
+};
+
+#endif /* AUDIO_REACTIVE_H_ */
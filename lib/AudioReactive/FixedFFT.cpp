@@ -0,0 +1,115 @@
+/*
+ * FixedFFT.cpp
+ * Created by Jose Rivera, Aug 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include "FixedFFT.h"
+#include <Arduino.h>
+
+// One period of the sine in FFT_MAX_SIZE steps (Q15)
+static const int16_t SINE[FFT_MAX_SIZE] PROGMEM = {
+  0, 1608, 3212, 4808, 6393, 7962, 9512, 11039,
+  12539, 14010, 15446, 16846, 18204, 19519, 20787, 22005,
+  23170, 24279, 25329, 26319, 27245, 28105, 28898, 29621,
+  30273, 30852, 31356, 31785, 32137, 32412, 32609, 32728,
+  32767, 32728, 32609, 32412, 32137, 31785, 31356, 30852,
+  30273, 29621, 28898, 28105, 27245, 26319, 25329, 24279,
+  23170, 22005, 20787, 19519, 18204, 16846, 15446, 14010,
+  12539, 11039, 9512, 7962, 6393, 4808, 3212, 1608,
+  0, -1608, -3212, -4808, -6393, -7962, -9512, -11039,
+  -12539, -14010, -15446, -16846, -18204, -19519, -20787, -22005,
+  -23170, -24279, -25329, -26319, -27245, -28105, -28898, -29621,
+  -30273, -30852, -31356, -31785, -32137, -32412, -32609, -32728,
+  -32767, -32728, -32609, -32412, -32137, -31785, -31356, -30852,
+  -30273, -29621, -28898, -28105, -27245, -26319, -25329, -24279,
+  -23170, -22005, -20787, -19519, -18204, -16846, -15446, -14010,
+  -12539, -11039, -9512, -7962, -6393, -4808, -3212, -1608
+};
+
+// Hann window of FFT_MAX_SIZE points (Q15)
+static const int16_t HANN[FFT_MAX_SIZE] PROGMEM = {
+  0, 20, 79, 177, 315, 491, 705, 958,
+  1247, 1573, 1935, 2331, 2761, 3224, 3719, 4244,
+  4799, 5381, 5990, 6624, 7281, 7961, 8660, 9379,
+  10114, 10864, 11628, 12403, 13187, 13980, 14778, 15580,
+  16383, 17187, 17989, 18787, 19580, 20364, 21139, 21903,
+  22653, 23388, 24107, 24806, 25486, 26143, 26777, 27386,
+  27968, 28523, 29048, 29543, 30006, 30436, 30832, 31194,
+  31520, 31809, 32062, 32276, 32452, 32590, 32688, 32747,
+  32767, 32747, 32688, 32590, 32452, 32276, 32062, 31809,
+  31520, 31194, 30832, 30436, 30006, 29543, 29048, 28523,
+  27968, 27386, 26777, 26143, 25486, 24806, 24107, 23388,
+  22653, 21903, 21139, 20364, 19580, 18787, 17989, 17187,
+  16384, 15580, 14778, 13980, 13187, 12403, 11628, 10864,
+  10114, 9379, 8660, 7961, 7281, 6624, 5990, 5381,
+  4799, 4244, 3719, 3224, 2761, 2331, 1935, 1573,
+  1247, 958, 705, 491, 315, 177, 79, 20
+};
+
+void fixedFFT(int16_t *re, int16_t *im, uint8_t bits)
+{
+  uint16_t n = 1 << bits;
+
+  // Bit reversal permutation
+  for(uint16_t i = 1, j = 0; i < n; i++)
+  {
+    uint16_t bit = n >> 1;
+    for(; j & bit; bit >>= 1)
+    {
+      j ^= bit;
+    }
+    j ^= bit;
+    if(i < j)
+    {
+      int16_t t = re[i];
+      re[i] = re[j];
+      re[j] = t;
+      t = im[i];
+      im[i] = im[j];
+      im[j] = t;
+    }
+  }
+
+  // Butterflies, the twiddle factors are taken from the sine table
+  for(uint16_t len = 2; len <= n; len <<= 1)
+  {
+    uint16_t half = len >> 1;
+    uint16_t step = FFT_MAX_SIZE / len;
+    for(uint16_t k = 0; k < half; k++)
+    {
+      int16_t wr = (int16_t) pgm_read_word(&SINE[(k * step + FFT_MAX_SIZE / 4) % FFT_MAX_SIZE]);
+      int16_t wi = -(int16_t) pgm_read_word(&SINE[k * step]);
+      for(uint16_t i = k; i < n; i += len)
+      {
+        uint16_t j = i + half;
+        int32_t tr = ((int32_t) wr * re[j] - (int32_t) wi * im[j]) >> 15;
+        int32_t ti = ((int32_t) wr * im[j] + (int32_t) wi * re[j]) >> 15;
+        re[j] = (re[i] - tr) >> 1;
+        im[j] = (im[i] - ti) >> 1;
+        re[i] = (re[i] + tr) >> 1;
+        im[i] = (im[i] + ti) >> 1;
+      }
+    }
+  }
+}
+
+void fixedWindow(int16_t *samples, uint8_t bits)
+{
+  uint16_t n = 1 << bits;
+  uint16_t step = FFT_MAX_SIZE / n;
+  for(uint16_t i = 0; i < n; i++)
+  {
+    samples[i] = ((int32_t) samples[i] * (int16_t) pgm_read_word(&HANN[i * step])) >> 15;
+  }
+}
+
+uint16_t fixedMagnitude(int16_t re, int16_t im)
+{
+  uint16_t a = re < 0 ? -re : re;
+  uint16_t b = im < 0 ? -im : im;
+  uint16_t max = a > b ? a : b;
+  uint16_t min = a > b ? b : a;
+  return max - (max >> 5) + (min >> 2) + (min >> 3) + (min >> 5);
+}
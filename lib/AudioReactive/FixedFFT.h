@@ -0,0 +1,35 @@
+/*
+ * FixedFFT.h
+ * Created by Jose Rivera, Aug 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+
+#include <inttypes.h>
+
+#ifndef FIXED_FFT_H_
+#define FIXED_FFT_H_
+
+#define FFT_MAX_BITS 7
+#define FFT_MAX_SIZE (1 << FFT_MAX_BITS)
+
+/**
+ * Radix 2 FFT in Q15 fixed point for 2^bits points (up to 128 points). Each
+ * stage divides the values by two, so the output is scaled by 1 / N and it
+ * never overflows.
+ */
+void fixedFFT(int16_t *re, int16_t *im, uint8_t bits);
+
+/**
+ * Apply a Hann window to 2^bits samples (Q15).
+ */
+void fixedWindow(int16_t *samples, uint8_t bits);
+
+/**
+ * Approximation of the magnitude of a complex value (alpha max plus beta min,
+ * error about 4%).
+ */
+uint16_t fixedMagnitude(int16_t re, int16_t im);
+
+#endif /* FIXED_FFT_H_ */
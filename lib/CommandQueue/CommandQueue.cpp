@@ -0,0 +1,118 @@
+/*
+ * CommandQueue.cpp
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include "CommandQueue.h"
+
+/**
+ * Constructor of the class.
+ * @param rate Commands processed per second
+ * @param burst Commands that can be processed at once after a pause
+ */
+CommandQueue::CommandQueue(uint16_t rate, uint8_t burst)
+{
+  this->_rate = rate;
+  this->_burst = burst;
+  // The tokens are thousandths of a command
+  this->_tokens = burst * 1000UL;
+}
+
+/**
+ * Add a command.
+ * @param topic Topic of the command, the key of the coalescing
+ * @param payload Value of the command
+ * @param coalesce true if the command replaces a pending one of the topic
+ * @param due Time in ms to apply the command, 0 to apply it as soon as possible
+ * @return  false if the command was dropped because the queue is full
+ */
+bool CommandQueue::push(const char *topic, const char *payload, bool coalesce, uint64_t due)
+{
+  if(coalesce)
+  {
+    for(uint8_t i = 0; i < this->_count; i++)
+    {
+      QueuedCommand &command = this->_commands[(this->_head + i) % COMMAND_QUEUE_SIZE];
+      if(command.coalesce && command.topic == topic)
+      {
+        command.payload = payload;
+        this->_coalesced++;
+        return true;
+      }
+    }
+  }
+  if(this->_count == COMMAND_QUEUE_SIZE)
+  {
+    this->_dropped++;
+    return false;
+  }
+  QueuedCommand &command = this->_commands[(this->_head + this->_count) % COMMAND_QUEUE_SIZE];
+  command.topic = topic;
+  command.payload = payload;
+  command.coalesce = coalesce;
+  command.due = due;
+  this->_count++;
+  return true;
+}
+
+void CommandQueue::refill(uint64_t now)
+{
+  uint64_t elapsed = now - this->_last_refill;
+  this->_last_refill = now;
+  uint64_t tokens = this->_tokens + elapsed * this->_rate;
+  this->_tokens = tokens > this->_burst * 1000UL ? this->_burst * 1000UL : tokens;
+}
+
+/**
+ * Take the next command when it is due and the rate allows it.
+ * @param now Time in ms
+ * @param topic Topic of the command taken
+ * @param payload Value of the command taken
+ * @return  false if there is no command or it has to wait
+ */
+bool CommandQueue::pop(uint64_t now, String &topic, String &payload)
+{
+  this->refill(now);
+  QueuedCommand &command = this->_commands[this->_head];
+  if(this->_count == 0 || this->_tokens < 1000 || command.due > now)
+  {
+    return false;
+  }
+  this->_tokens -= 1000;
+  topic = command.topic;
+  payload = command.payload;
+  this->_head = (this->_head + 1) % COMMAND_QUEUE_SIZE;
+  this->_count--;
+  this->_processed++;
+  return true;
+}
+
+uint8_t CommandQueue::size(void)
+{
+  return this->_count;
+}
+
+/**
+ * It allows to obtain the number of commands replaced by a later command of
+ * the same topic before they were processed.
+ */
+uint32_t CommandQueue::getCoalesced(void)
+{
+  return this->_coalesced;
+}
+
+/**
+ * It allows to obtain the number of commands dropped because the queue was
+ * full.
+ */
+uint32_t CommandQueue::getDropped(void)
+{
+  return this->_dropped;
+}
+
+uint32_t CommandQueue::getProcessed(void)
+{
+  return this->_processed;
+}
@@ -0,0 +1,64 @@
+/*
+ * CommandQueue.h
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+
+#include <inttypes.h>
+#include <WString.h>
+
+#ifndef COMMAND_QUEUE_H_
+#define COMMAND_QUEUE_H_
+
+#define COMMAND_QUEUE_SIZE 8
+// Commands processed per second and commands that can be processed at once
+#define COMMAND_RATE 10
+#define COMMAND_BURST 5
+
+struct QueuedCommand
+{
+  String topic;
+  String payload;
+  bool coalesce;
+  uint64_t due;
+};
+
+/**
+ * CommandQueue keeps the inbound commands until they are processed. A command
+ * that sets a value replaces the pending command of the same topic (the
+ * latest value wins and it keeps the place of the first one), the other
+ * commands (events) are queued each one. The commands are taken at most at a
+ * rate with bursts (token bucket), so a flood of messages costs a copy of the
+ * payload instead of applying each one.
+ * A command can have a time to be applied (for example to stagger the
+ * commands received by several controllers), the commands after it wait.
+ */
+class CommandQueue
+{
+  private:
+    QueuedCommand _commands[COMMAND_QUEUE_SIZE];
+    uint8_t _head = 0;
+    uint8_t _count = 0;
+    uint16_t _rate;
+    uint8_t _burst;
+    uint32_t _tokens;
+    uint64_t _last_refill = 0;
+    uint32_t _coalesced = 0;
+    uint32_t _dropped = 0;
+    uint32_t _processed = 0;
+
+    void refill(uint64_t);
+
+  public:
+    CommandQueue(uint16_t rate = COMMAND_RATE, uint8_t burst = COMMAND_BURST);
+    bool push(const char*, const char*, bool, uint64_t = 0);
+    bool pop(uint64_t, String&, String&);
+    uint8_t size(void);
+    uint32_t getCoalesced(void);
+    uint32_t getDropped(void);
+    uint32_t getProcessed(void);
+};
+
+#endif /* COMMAND_QUEUE_H_ */
@@ -0,0 +1,98 @@
+/*
+ * ConnectionMonitor.cpp
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include "ConnectionMonitor.h"
+
+/**
+ * Constructor of the class.
+ * @param min_interval Time to the attempt after the first failed one
+ * @param max_interval Longest time between the attempts
+ */
+ConnectionMonitor::ConnectionMonitor(uint32_t min_interval, uint32_t max_interval)
+{
+  this->_min_interval = min_interval;
+  this->_max_interval = max_interval;
+  this->_interval = min_interval;
+}
+
+/**
+ * It must be called while the client is not connected, the first call after
+ * a connection marks the time of the loss.
+ * @param now Current time
+ * @return  true when an attempt to connect must be done
+ */
+bool ConnectionMonitor::poll(uint64_t now)
+{
+  if(this->_connected)
+  {
+    this->_connected = false;
+    this->_lost = true;
+    this->_lost_time = now;
+    this->_next = now;
+  }
+  return now >= this->_next;
+}
+
+/**
+ * The attempt succeeded, the time between the attempts starts again from the
+ * minimum.
+ * @param now Current time
+ */
+void ConnectionMonitor::connected(uint64_t now)
+{
+  this->_attempts++;
+  this->_connected = true;
+  this->_interval = this->_min_interval;
+  if(this->_lost)
+  {
+    this->_lost = false;
+    this->_reconnects++;
+    this->_recovery = now - this->_lost_time;
+  }
+}
+
+/**
+ * The attempt failed, the next one is done after the current interval, which
+ * is doubled.
+ * @param now Current time
+ */
+void ConnectionMonitor::failed(uint64_t now)
+{
+  this->_attempts++;
+  this->_next = now + this->_interval;
+  this->_interval = this->_interval * 2 < this->_max_interval ? this->_interval * 2 : this->_max_interval;
+}
+
+/**
+ * It allows to obtain the time to the next attempt if the current one fails.
+ */
+uint32_t ConnectionMonitor::getRetryInterval(void)
+{
+  return this->_interval;
+}
+
+uint32_t ConnectionMonitor::getAttempts(void)
+{
+  return this->_attempts;
+}
+
+/**
+ * It allows to obtain the number of connections after a loss.
+ */
+uint32_t ConnectionMonitor::getReconnects(void)
+{
+  return this->_reconnects;
+}
+
+/**
+ * It allows to obtain the time from the last loss to the next connection.
+ * @return  The time in ms
+ */
+uint32_t ConnectionMonitor::getRecoveryTime(void)
+{
+  return this->_recovery;
+}
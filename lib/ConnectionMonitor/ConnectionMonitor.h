@@ -0,0 +1,54 @@
+/*
+ * ConnectionMonitor.h
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+
+#include <inttypes.h>
+
+#ifndef CONNECTION_MONITOR_H_
+#define CONNECTION_MONITOR_H_
+
+// The connection is retried after 1 s, doubling the time up to 30 s
+#define CONNECTION_RETRY_MIN_INTERVAL 1000
+#define CONNECTION_RETRY_MAX_INTERVAL 30000
+
+/**
+ * ConnectionMonitor schedules the attempts to connect to a server. After a
+ * loss the first attempt is done at once and the time between the failed
+ * attempts is doubled up to a maximum, so a server that is down is not
+ * flooded and a short loss is recovered quickly. The reconnections and the
+ * time from the loss to the next connection are counted.
+ *
+ * While the client is not connected, poll() tells when to attempt and the
+ * result is given to connected() or failed(). The times are in ms.
+ */
+class ConnectionMonitor
+{
+  private:
+    uint32_t _min_interval;
+    uint32_t _max_interval;
+    uint32_t _interval;
+    uint64_t _next = 0;
+    bool _connected = false;
+    bool _lost = false;
+    uint64_t _lost_time = 0;
+    uint32_t _attempts = 0;
+    uint32_t _reconnects = 0;
+    uint32_t _recovery = 0;
+
+  public:
+    ConnectionMonitor(uint32_t min_interval = CONNECTION_RETRY_MIN_INTERVAL,
+      uint32_t max_interval = CONNECTION_RETRY_MAX_INTERVAL);
+    bool poll(uint64_t);
+    void connected(uint64_t);
+    void failed(uint64_t);
+    uint32_t getRetryInterval(void);
+    uint32_t getAttempts(void);
+    uint32_t getReconnects(void);
+    uint32_t getRecoveryTime(void);
+};
+
+#endif /* CONNECTION_MONITOR_H_ */
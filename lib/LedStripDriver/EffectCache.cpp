@@ -0,0 +1,101 @@
+/*
+ * EffectCache.cpp
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include "EffectCache.h"
+#include <Arduino.h>
+
+static uint8_t lerp8(uint8_t a, uint8_t b, uint8_t amount)
+{
+  return a + ((((int16_t) b - a) * amount) >> 8);
+}
+
+/**
+ * Set the time between the entries of the table.
+ * @param resolution Time in ms
+ */
+void EffectCache::setResolution(uint16_t resolution)
+{
+  this->_resolution = resolution > 0 ? resolution : 1;
+  this->invalidate();
+}
+
+uint16_t EffectCache::getResolution(void)
+{
+  return this->_resolution;
+}
+
+/**
+ * Render the table again on the next frame, for example when a new program
+ * is loaded.
+ */
+void EffectCache::invalidate(void)
+{
+  this->_valid = false;
+}
+
+/**
+ * It allows to know if the whole period is rendered in the table.
+ */
+bool EffectCache::isReady(void)
+{
+  return this->_valid && this->_length > 0 && this->_filled == this->_length;
+}
+
+/**
+ * Obtain the color of a frame of the program, from the table when it is
+ * ready. The program is run when it is not periodic or its period does not
+ * fit in the table at the resolution.
+ * @param program Effect program
+ * @param time Time of the frame in ms
+ * @param color Color of the strip
+ * @param speed Speed of the strip
+ * @return  The color of the frame
+ */
+uint32_t EffectCache::run(EffectVM &program, uint64_t time, uint32_t color, uint16_t speed)
+{
+  uint32_t period = program.getPeriod();
+  uint32_t length = (period + this->_resolution - 1) / this->_resolution;
+  if(period == 0 || length > EFFECT_CACHE_SIZE)
+  {
+    return program.run(time, color, speed);
+  }
+  if(!this->_valid || period != this->_period || color != this->_color || speed != this->_speed)
+  {
+    this->_period = period;
+    this->_color = color;
+    this->_speed = speed;
+    this->_length = length;
+    this->_filled = 0;
+    this->_valid = true;
+  }
+
+  if(this->_filled < this->_length)
+  {
+    for(uint8_t i = 0; i < EFFECT_CACHE_FILL && this->_filled < this->_length; i++)
+    {
+      // The times of the period are the same as the ones of any other period
+      uint32_t sample = ((uint64_t) this->_filled * period) / this->_length;
+      uint32_t hex = program.run(sample, color, speed);
+      this->_table[this->_filled++] = {
+        static_cast<uint8_t>((hex >> 16) & 0xFF),
+        static_cast<uint8_t>((hex >> 8) & 0xFF),
+        static_cast<uint8_t>(hex & 0xFF)
+      };
+    }
+    return program.run(time, color, speed);
+  }
+
+  // Position in the table in 1/256 of entry
+  uint32_t position = ((time % period) * this->_length * 256) / period;
+  uint16_t index = position >> 8;
+  uint8_t amount = position & 0xFF;
+  RGBColor &a = this->_table[index];
+  RGBColor &b = this->_table[(index + 1) % this->_length];
+  return ((uint32_t) lerp8(a.red, b.red, amount) << 16) |
+    ((uint32_t) lerp8(a.green, b.green, amount) << 8) |
+    lerp8(a.blue, b.blue, amount);
+}
@@ -0,0 +1,53 @@
+/*
+ * EffectCache.h
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+
+#include <inttypes.h>
+#include "EffectVM.h"
+#include "RGBColors.h"
+
+#ifndef EFFECT_CACHE_H_
+#define EFFECT_CACHE_H_
+
+#define EFFECT_CACHE_SIZE 128
+#define EFFECT_CACHE_RESOLUTION 20
+// Entries rendered per frame while the cache is filled
+#define EFFECT_CACHE_FILL 8
+
+/**
+ * EffectCache keeps one period of a periodic effect program (see
+ * EffectVM::getPeriod) rendered into a table of colors, one entry each
+ * resolution ms. The frames are interpolated from the table instead of
+ * running the program. The programs whose period needs more than
+ * EFFECT_CACHE_SIZE entries at the resolution are run on each frame.
+ *
+ * The table is rendered again when the color or the speed of the strip
+ * change (the palette of the programs is fixed) or a program is loaded. It is
+ * filled a few entries per frame, the program is run meanwhile, so a change
+ * does not stall the loop.
+ */
+class EffectCache
+{
+  private:
+    RGBColor _table[EFFECT_CACHE_SIZE];
+    uint16_t _resolution = EFFECT_CACHE_RESOLUTION;
+    uint16_t _length = 0;
+    uint16_t _filled = 0;
+    uint32_t _period = 0;
+    uint32_t _color = 0;
+    uint16_t _speed = 0;
+    bool _valid = false;
+
+  public:
+    void setResolution(uint16_t);
+    uint16_t getResolution(void);
+    void invalidate(void);
+    bool isReady(void);
+    uint32_t run(EffectVM&, uint64_t, uint32_t, uint16_t);
+};
+
+#endif /* EFFECT_CACHE_H_ */
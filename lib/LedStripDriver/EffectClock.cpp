@@ -0,0 +1,133 @@
+/*
+ * EffectClock.cpp
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include "EffectClock.h"
+#include <Arduino.h>
+
+#define SPEED_TABLE_BITS 5
+
+// Hundredths of cycles per minute each 32 steps of the knob, 100 * 240^(i/32)
+static const uint16_t SPEED_TABLE[] PROGMEM = {
+  100, 119, 141, 167, 198, 235, 279, 332, 394, 467, 554, 658, 781, 927, 1100,
+  1305, 1549, 1839, 2182, 2590, 3073, 3648, 4329, 5138, 6098, 7237, 8589,
+  10193, 12097, 14357, 17039, 20222, 24000
+};
+
+EffectClock::EffectClock(void)
+{
+  this->setSpeed(SPEED_DEFAULT);
+}
+
+/**
+ * Map a knob value to cycles per minute, interpolating the table.
+ * @param speed Knob value (0-1023)
+ * @return  Hundredths of cycles per minute
+ */
+uint16_t EffectClock::speedToCpm(uint16_t speed)
+{
+  speed = constrain(speed, 0, SPEED_MAX);
+  uint8_t index = speed >> SPEED_TABLE_BITS;
+  uint8_t fraction = speed & ((1 << SPEED_TABLE_BITS) - 1);
+  uint16_t low = pgm_read_word(&SPEED_TABLE[index]);
+  uint16_t high = pgm_read_word(&SPEED_TABLE[index + 1]);
+  return low + (((uint32_t) (high - low) * fraction) >> SPEED_TABLE_BITS);
+}
+
+/**
+ * Map cycles per minute to the nearest knob value.
+ * @param cpm Hundredths of cycles per minute
+ */
+uint16_t EffectClock::cpmToSpeed(uint16_t cpm)
+{
+  uint16_t low = 0;
+  uint16_t high = SPEED_MAX;
+  while(low < high)
+  {
+    uint16_t middle = (low + high) / 2;
+    if(EffectClock::speedToCpm(middle) < cpm)
+    {
+      low = middle + 1;
+    }
+    else
+    {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+/**
+ * Set the speed of the effect, the position in the cycle is kept.
+ * @param speed Knob value (0-1023), 0 is the slowest
+ */
+void EffectClock::setSpeed(uint16_t speed)
+{
+  speed = constrain(speed, 0, SPEED_MAX);
+  this->setCyclesPerMinute(EffectClock::speedToCpm(speed));
+  // The table is not exact, keep the value of the knob
+  this->_speed = speed;
+}
+
+uint16_t EffectClock::getSpeed(void)
+{
+  return this->_speed;
+}
+
+/**
+ * Set the speed of the effect, the position in the cycle is kept.
+ * @param cpm Hundredths of cycles per minute (100-24000)
+ */
+void EffectClock::setCyclesPerMinute(uint16_t cpm)
+{
+  this->_cpm = constrain(cpm, SPEED_MIN_CPM, SPEED_MAX_CPM);
+  this->_speed = EffectClock::cpmToSpeed(this->_cpm);
+  // Fraction of cycle (2^32) per ms
+  this->_rate = ((uint64_t) this->_cpm << 32) / 6000000UL;
+}
+
+uint16_t EffectClock::getCyclesPerMinute(void)
+{
+  return this->_cpm;
+}
+
+/**
+ * Start the effect from the beginning of the cycle.
+ * @param now Time in ms
+ */
+void EffectClock::reset(uint64_t now)
+{
+  this->_last = now;
+  this->_phase = 0;
+  this->_cycles = 0;
+}
+
+/**
+ * Advance the clock to a time.
+ * @param now Time in ms
+ * @return  The position in the cycle (a fraction of 2^32)
+ */
+uint32_t EffectClock::update(uint64_t now)
+{
+  uint64_t position = (uint64_t) this->_rate * (now - this->_last) + this->_phase;
+  this->_last = now;
+  this->_phase = position;
+  this->_cycles += position >> 32;
+  return this->_phase;
+}
+
+uint32_t EffectClock::getPhase(void)
+{
+  return this->_phase;
+}
+
+/**
+ * It allows to obtain the number of cycles completed since the reset.
+ */
+uint32_t EffectClock::getCycles(void)
+{
+  return this->_cycles;
+}
@@ -0,0 +1,55 @@
+/*
+ * EffectClock.h
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+
+#include <inttypes.h>
+
+#ifndef EFFECT_CLOCK_H_
+#define EFFECT_CLOCK_H_
+
+#define SPEED_MAX 1023
+#define SPEED_DEFAULT 512
+// Cycles per minute in hundredths (1 to 240 cycles per minute)
+#define SPEED_MIN_CPM 100
+#define SPEED_MAX_CPM 24000
+
+/**
+ * EffectClock is the time base of the periodic effects (Flash, Fade and the
+ * rainbow of the pixels). It keeps the position inside the cycle of the
+ * effect as a 32 bits fraction and advances it with the elapsed time, so the
+ * effects do not depend on the loop period and a change of the speed only
+ * changes the rate, the effect continues from the same position.
+ *
+ * The speed is a knob value (0-1023) mapped to cycles per minute through an
+ * exponential table, so each step of the knob is the same relative change,
+ * or directly the cycles per minute.
+ */
+class EffectClock
+{
+  private:
+    uint64_t _last = 0;
+    uint32_t _phase = 0;
+    uint32_t _cycles = 0;
+    uint16_t _speed = SPEED_DEFAULT;
+    uint16_t _cpm = 0;
+    uint32_t _rate = 0;
+
+  public:
+    EffectClock(void);
+    static uint16_t speedToCpm(uint16_t);
+    static uint16_t cpmToSpeed(uint16_t);
+    void setSpeed(uint16_t);
+    uint16_t getSpeed(void);
+    void setCyclesPerMinute(uint16_t);
+    uint16_t getCyclesPerMinute(void);
+    void reset(uint64_t);
+    uint32_t update(uint64_t);
+    uint32_t getPhase(void);
+    uint32_t getCycles(void);
+};
+
+#endif /* EFFECT_CLOCK_H_ */
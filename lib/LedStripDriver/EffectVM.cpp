@@ -0,0 +1,467 @@
+/*
+ * EffectVM.cpp
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include "EffectVM.h"
+#include "RGBColors.h"
+#include <Arduino.h>
+
+/**
+ * Size of the immediate value and stack effect of each instruction.
+ */
+struct EffectOpInfo
+{
+  bool valid;
+  uint8_t immediate;
+  uint8_t pops;
+  uint8_t pushes;
+};
+
+static const EffectOpInfo EFFECT_OPS[] = {
+  { true, 0, 1, 0 },  // END
+  { true, 1, 0, 1 },  // PUSH8
+  { true, 2, 0, 1 },  // PUSH16
+  { true, 3, 0, 1 },  // PUSH24
+  { true, 0, 0, 1 },  // TIME
+  { true, 2, 0, 1 },  // PHASE
+  { true, 0, 1, 1 },  // SIN
+  { true, 0, 1, 1 },  // NOISE
+  { true, 0, 2, 1 },  // ADD
+  { true, 0, 2, 1 },  // SUB
+  { true, 0, 2, 1 },  // MUL
+  { true, 0, 2, 1 },  // DIV
+  { true, 0, 2, 1 },  // MOD
+  { true, 0, 2, 1 },  // LT
+  { true, 0, 2, 1 },  // GT
+  { false, 0, 0, 0 },
+  { true, 0, 1, 2 },  // DUP
+  { true, 0, 2, 2 },  // SWAP
+  { true, 0, 1, 0 },  // DROP
+  { true, 0, 1, 1 },  // CLAMP
+  { true, 0, 3, 1 },  // RGB
+  { true, 0, 3, 1 },  // HSV
+  { true, 0, 1, 1 },  // PALETTE
+  { true, 0, 2, 1 },  // SCALE
+  { true, 0, 3, 1 },  // MIX
+  { true, 1, 1, 0 },  // JZ
+  { true, 1, 0, 0 },  // JMP
+  { true, 0, 0, 1 },  // COLOR
+  { true, 0, 0, 1 }   // SPEED
+};
+
+static const uint8_t EFFECT_OPS_LENGTH = array_length(EFFECT_OPS);
+
+// 128 + 127 * sin(2 * PI * x / 256)
+static const uint8_t SINE8[256] PROGMEM = {
+  128, 131, 134, 137, 140, 144, 147, 150, 153, 156, 159, 162, 165, 168, 171, 174,
+  177, 179, 182, 185, 188, 191, 193, 196, 199, 201, 204, 206, 209, 211, 213, 216,
+  218, 220, 222, 224, 226, 228, 230, 232, 234, 235, 237, 239, 240, 241, 243, 244,
+  245, 246, 248, 249, 250, 250, 251, 252, 253, 253, 254, 254, 254, 255, 255, 255,
+  255, 255, 255, 255, 254, 254, 254, 253, 253, 252, 251, 250, 250, 249, 248, 246,
+  245, 244, 243, 241, 240, 239, 237, 235, 234, 232, 230, 228, 226, 224, 222, 220,
+  218, 216, 213, 211, 209, 206, 204, 201, 199, 196, 193, 191, 188, 185, 182, 179,
+  177, 174, 171, 168, 165, 162, 159, 156, 153, 150, 147, 144, 140, 137, 134, 131,
+  128, 125, 122, 119, 116, 112, 109, 106, 103, 100, 97, 94, 91, 88, 85, 82,
+  79, 77, 74, 71, 68, 65, 63, 60, 57, 55, 52, 50, 47, 45, 43, 40,
+  38, 36, 34, 32, 30, 28, 26, 24, 22, 21, 19, 17, 16, 15, 13, 12,
+  11, 10, 8, 7, 6, 6, 5, 4, 3, 3, 2, 2, 2, 1, 1, 1,
+  1, 1, 1, 1, 2, 2, 2, 3, 3, 4, 5, 6, 6, 7, 8, 10,
+  11, 12, 13, 15, 16, 17, 19, 21, 22, 24, 26, 28, 30, 32, 34, 36,
+  38, 40, 43, 45, 47, 50, 52, 55, 57, 60, 63, 65, 68, 71, 74, 77,
+  79, 82, 85, 88, 91, 94, 97, 100, 103, 106, 109, 112, 116, 119, 122, 125
+
+};
+
+static uint8_t sin8(int32_t x)
+{
+  return pgm_read_byte(&SINE8[x & 0xFF]);
+}
+
+static uint8_t hash8(uint32_t x)
+{
+  return (x * 2654435761UL) >> 24;
+}
+
+/**
+ * Value noise with a lattice each 32 steps and smooth interpolation.
+ */
+static uint8_t noise8(int32_t x)
+{
+  uint32_t cell = (uint32_t) x >> 5;
+  uint32_t t = ((uint32_t) x & 31) << 3;
+  t = (t * t * (768 - 2 * t)) >> 16;
+  int32_t a = hash8(cell);
+  int32_t b = hash8(cell + 1);
+  return a + (((b - a) * (int32_t) t) >> 8);
+}
+
+static uint8_t limit8(int32_t x)
+{
+  return x < 0 ? 0 : (x > 255 ? 255 : x);
+}
+
+static uint32_t rgb(int32_t red, int32_t green, int32_t blue)
+{
+  return ((uint32_t) limit8(red) << 16) | ((uint32_t) limit8(green) << 8) | limit8(blue);
+}
+
+static uint32_t mix(uint32_t a, uint32_t b, int32_t amount)
+{
+  uint16_t t = limit8(amount) + 1;
+  uint32_t result = 0;
+  for(uint8_t shift = 0; shift < 24; shift += 8)
+  {
+    uint16_t ca = (a >> shift) & 0xFF;
+    uint16_t cb = (b >> shift) & 0xFF;
+    result |= (uint32_t) ((ca * (256 - t) + cb * t) >> 8) << shift;
+  }
+  return result;
+}
+
+static uint32_t hsv(int32_t hue, int32_t saturation, int32_t value)
+{
+  uint8_t h = hue & 0xFF;
+  uint8_t s = limit8(saturation);
+  uint8_t v = limit8(value);
+  uint8_t region = h / 43;
+  uint8_t remainder = (h - region * 43) * 6;
+  uint8_t p = (v * (255 - s)) >> 8;
+  uint8_t q = (v * (255 - ((s * remainder) >> 8))) >> 8;
+  uint8_t t = (v * (255 - ((s * (255 - remainder)) >> 8))) >> 8;
+  switch (region) {
+    case 0:
+      return rgb(v, t, p);
+    case 1:
+      return rgb(q, v, p);
+    case 2:
+      return rgb(p, v, t);
+    case 3:
+      return rgb(p, q, v);
+    case 4:
+      return rgb(t, p, v);
+    default:
+      return rgb(v, p, q);
+  }
+}
+
+/**
+ * The palette is the sequence of the Flash mode, interpolated.
+ */
+static uint32_t palette(int32_t x)
+{
+  uint16_t position = (x & 0xFF) * FLASH_COLORS_SEQUENCE_LENGTH;
+  uint8_t index = position >> 8;
+  uint8_t next = (index + 1) % FLASH_COLORS_SEQUENCE_LENGTH;
+  return mix(FLASH_COLORS_SEQUENCE[index], FLASH_COLORS_SEQUENCE[next], position & 0xFF);
+}
+
+static uint32_t gcd(uint32_t a, uint32_t b)
+{
+  while(b)
+  {
+    uint32_t r = a % b;
+    a = b;
+    b = r;
+  }
+  return a;
+}
+
+/**
+ * Period of a verified program, the least common multiple of the periods of
+ * its PHASE instructions.
+ * @return  The period in ms, 0 if the program uses TIME or the period is
+ *          longer than EFFECT_MAX_PERIOD
+ */
+static uint32_t period(const uint8_t *program, uint16_t size)
+{
+  uint32_t result = 1;
+  uint16_t pc = EFFECT_HEADER_SIZE;
+  while(pc < size)
+  {
+    uint8_t op = program[pc];
+    if(op == OP_TIME)
+    {
+      return 0;
+    }
+    if(op == OP_PHASE)
+    {
+      uint32_t phase = program[pc + 1] | (program[pc + 2] << 8);
+      if(phase > 0)
+      {
+        uint64_t lcm = (uint64_t) (result / gcd(result, phase)) * phase;
+        if(lcm > EFFECT_MAX_PERIOD)
+        {
+          return 0;
+        }
+        result = lcm;
+      }
+    }
+    pc += 1 + EFFECT_OPS[op].immediate;
+  }
+  return result;
+}
+
+/**
+ * Verify a program: header, valid instructions with their immediate values,
+ * jumps forward to the start of an instruction, the same stack depth on all
+ * the paths that reach an instruction, no stack underflow or overflow, no
+ * unreachable code and all the paths end with END.
+ * @return  true if the program can be run safely
+ */
+bool EffectVM::verify(const uint8_t *program, uint16_t size)
+{
+  if(size <= EFFECT_HEADER_SIZE || size > EFFECT_PROGRAM_SIZE ||
+    program[0] != EFFECT_MAGIC_0 || program[1] != EFFECT_MAGIC_1 ||
+    program[2] != EFFECT_VERSION)
+  {
+    return false;
+  }
+
+  // Stack depth at each offset (-1 not reached yet) and start of instructions
+  int8_t depth[EFFECT_PROGRAM_SIZE];
+  bool start[EFFECT_PROGRAM_SIZE];
+  memset(depth, -1, sizeof(depth));
+  memset(start, 0, sizeof(start));
+  depth[EFFECT_HEADER_SIZE] = 0;
+
+  uint16_t pc = EFFECT_HEADER_SIZE;
+  while(pc < size)
+  {
+    uint8_t op = program[pc];
+    if(op >= EFFECT_OPS_LENGTH || !EFFECT_OPS[op].valid || depth[pc] < 0)
+    {
+      return false;
+    }
+    const EffectOpInfo &info = EFFECT_OPS[op];
+    uint16_t next = pc + 1 + info.immediate;
+    if(next > size || depth[pc] < info.pops)
+    {
+      return false;
+    }
+    int8_t after = depth[pc] - info.pops + info.pushes;
+    if(after > EFFECT_STACK_SIZE)
+    {
+      return false;
+    }
+    start[pc] = true;
+
+    uint16_t targets[2];
+    uint8_t count = 0;
+    if(op == OP_JZ || op == OP_JMP)
+    {
+      targets[count++] = next + program[pc + 1];
+    }
+    if(op != OP_END && op != OP_JMP)
+    {
+      targets[count++] = next;
+    }
+    for(uint8_t i = 0; i < count; i++)
+    {
+      if(targets[i] >= size || (depth[targets[i]] >= 0 && depth[targets[i]] != after))
+      {
+        return false;
+      }
+      depth[targets[i]] = after;
+    }
+    pc = next;
+  }
+
+  for(uint16_t i = EFFECT_HEADER_SIZE; i < size; i++)
+  {
+    if(depth[i] >= 0 && !start[i])
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * Verify and load a program.
+ * @return  true if the program was loaded
+ */
+bool EffectVM::load(const uint8_t *program, uint16_t size)
+{
+  if(!EffectVM::verify(program, size))
+  {
+    return false;
+  }
+  memcpy(this->_program, program, size);
+  this->_size = size;
+  this->_period = period(program, size);
+  return true;
+}
+
+bool EffectVM::isLoaded(void)
+{
+  return this->_size > 0;
+}
+
+void EffectVM::clear(void)
+{
+  this->_size = 0;
+}
+
+/**
+ * Run the program for a frame.
+ * @param time Time of the frame in ms, the whole 64 bits so the phases do not
+ *        jump when the 32 bits time wraps
+ * @param color Color of the strip
+ * @param speed Speed of the strip
+ * @return  The color of the frame, black if the program exceeds
+ *          EFFECT_MAX_STEPS instructions
+ */
+uint32_t EffectVM::run(uint64_t time, uint32_t color, uint16_t speed)
+{
+  if(this->_size == 0)
+  {
+    return color;
+  }
+  const uint8_t *code = this->_program;
+  int32_t *stack = this->_stack;
+  uint16_t pc = EFFECT_HEADER_SIZE;
+  uint8_t sp = 0;
+  int32_t a;
+  int32_t b;
+  for(this->_steps = 0; this->_steps < EFFECT_MAX_STEPS; this->_steps++)
+  {
+    uint8_t op = code[pc++];
+    switch (op) {
+      case OP_END:
+        return stack[sp - 1] & 0xFFFFFF;
+      case OP_PUSH8:
+        stack[sp++] = code[pc++];
+        break;
+      case OP_PUSH16:
+        stack[sp++] = code[pc] | (code[pc + 1] << 8);
+        pc += 2;
+        break;
+      case OP_PUSH24:
+        stack[sp++] = code[pc] | (code[pc + 1] << 8) | ((int32_t) code[pc + 2] << 16);
+        pc += 3;
+        break;
+      case OP_TIME:
+        stack[sp++] = time & 0x7FFFFFFF;
+        break;
+      case OP_PHASE:
+        a = code[pc] | (code[pc + 1] << 8);
+        pc += 2;
+        stack[sp++] = a == 0 ? 0 : ((time % a) * 256) / a;
+        break;
+      case OP_SIN:
+        stack[sp - 1] = sin8(stack[sp - 1]);
+        break;
+      case OP_NOISE:
+        stack[sp - 1] = noise8(stack[sp - 1]);
+        break;
+      case OP_DUP:
+        stack[sp] = stack[sp - 1];
+        sp++;
+        break;
+      case OP_SWAP:
+        a = stack[sp - 1];
+        stack[sp - 1] = stack[sp - 2];
+        stack[sp - 2] = a;
+        break;
+      case OP_DROP:
+        sp--;
+        break;
+      case OP_CLAMP:
+        stack[sp - 1] = limit8(stack[sp - 1]);
+        break;
+      case OP_PALETTE:
+        stack[sp - 1] = palette(stack[sp - 1]);
+        break;
+      case OP_RGB:
+        sp -= 2;
+        stack[sp - 1] = rgb(stack[sp - 1], stack[sp], stack[sp + 1]);
+        break;
+      case OP_HSV:
+        sp -= 2;
+        stack[sp - 1] = hsv(stack[sp - 1], stack[sp], stack[sp + 1]);
+        break;
+      case OP_MIX:
+        sp -= 2;
+        stack[sp - 1] = mix(stack[sp - 1], stack[sp], stack[sp + 1]);
+        break;
+      case OP_SCALE:
+        sp--;
+        stack[sp - 1] = mix(0, stack[sp - 1], stack[sp]);
+        break;
+      case OP_JZ:
+        a = code[pc++];
+        if(stack[--sp] == 0)
+        {
+          pc += a;
+        }
+        break;
+      case OP_JMP:
+        pc += code[pc] + 1;
+        break;
+      case OP_COLOR:
+        stack[sp++] = color;
+        break;
+      case OP_SPEED:
+        stack[sp++] = speed;
+        break;
+      default:
+        // Binary operators
+        b = stack[--sp];
+        a = stack[sp - 1];
+        // The overflows wrap: the arithmetic is done without sign and the
+        // divisions by -1 (INT32_MIN / -1 overflows) are negations
+        switch (op) {
+          case OP_ADD:
+            a = (int32_t) ((uint32_t) a + (uint32_t) b);
+            break;
+          case OP_SUB:
+            a = (int32_t) ((uint32_t) a - (uint32_t) b);
+            break;
+          case OP_MUL:
+            a = (int32_t) ((uint32_t) a * (uint32_t) b);
+            break;
+          case OP_DIV:
+            if(b == -1)
+            {
+              a = (int32_t) (0U - (uint32_t) a);
+            }
+            else
+            {
+              a = b == 0 ? 0 : a / b;
+            }
+            break;
+          case OP_MOD:
+            a = b == 0 || b == -1 ? 0 : a % b;
+            break;
+          case OP_LT:
+            a = a < b;
+            break;
+          default:
+            a = a > b;
+        }
+        stack[sp - 1] = a;
+    }
+  }
+  return COLOR_BLACK;
+}
+
+/**
+ * It allows to obtain the period of the program, the color of the frame at
+ * a time is the same one a period later (for the same color and speed).
+ * @return  The period in ms, 0 if the program is not periodic (it uses TIME)
+ */
+uint32_t EffectVM::getPeriod(void)
+{
+  return this->_size > 0 ? this->_period : 0;
+}
+
+/**
+ * It allows to obtain the number of instructions executed in the last frame.
+ */
+uint32_t EffectVM::getSteps(void)
+{
+  return this->_steps;
+}
@@ -0,0 +1,87 @@
+/*
+ * EffectVM.h
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+
+#include <inttypes.h>
+
+#ifndef EFFECT_VM_H_
+#define EFFECT_VM_H_
+
+#define EFFECT_PROGRAM_SIZE 256
+#define EFFECT_STACK_SIZE 16
+#define EFFECT_MAX_STEPS 256
+#define EFFECT_MAGIC_0 'F'
+#define EFFECT_MAGIC_1 'X'
+#define EFFECT_VERSION 1
+#define EFFECT_HEADER_SIZE 3
+// Longest period of the programs that can be cached (10 minutes)
+#define EFFECT_MAX_PERIOD 600000UL
+
+/**
+ * Instructions of the effect programs. The values are 32 bits integers, the
+ * colors are 0xRRGGBB values and the angles, levels and positions are 0-255.
+ */
+enum EffectOp
+{
+  OP_END = 0x00,      // pop color, end of the program
+  OP_PUSH8 = 0x01,    // push imm8
+  OP_PUSH16 = 0x02,   // push imm16 (little endian)
+  OP_PUSH24 = 0x03,   // push imm24 (little endian), a color
+  OP_TIME = 0x04,     // push time in ms (31 bits, it wraps each 24.8 days)
+  OP_PHASE = 0x05,    // push position (0-255) of the time inside a period imm16 ms
+  OP_SIN = 0x06,      // pop x, push sine of x (0-255)
+  OP_NOISE = 0x07,    // pop x, push smooth noise of x (0-255)
+  OP_ADD = 0x08,      // pop b, pop a, push a + b
+  OP_SUB = 0x09,      // pop b, pop a, push a - b
+  OP_MUL = 0x0A,      // pop b, pop a, push a * b
+  OP_DIV = 0x0B,      // pop b, pop a, push a / b (0 if b is 0, -a if b is -1)
+  OP_MOD = 0x0C,      // pop b, pop a, push a % b (0 if b is 0 or -1)
+  OP_LT = 0x0D,       // pop b, pop a, push a < b
+  OP_GT = 0x0E,       // pop b, pop a, push a > b
+  OP_DUP = 0x10,      // duplicate the top
+  OP_SWAP = 0x11,     // swap the two values of the top
+  OP_DROP = 0x12,     // pop
+  OP_CLAMP = 0x13,    // pop x, push x limited to 0-255
+  OP_RGB = 0x14,      // pop b, pop g, pop r, push color
+  OP_HSV = 0x15,      // pop v, pop s, pop h, push color
+  OP_PALETTE = 0x16,  // pop x, push color of the palette at x
+  OP_SCALE = 0x17,    // pop level, pop color, push color scaled by level
+  OP_MIX = 0x18,      // pop amount, pop b, pop a, push color between a and b
+  OP_JZ = 0x19,       // pop x, jump forward imm8 bytes if x is 0
+  OP_JMP = 0x1A,      // jump forward imm8 bytes
+  OP_COLOR = 0x1B,    // push the color of the strip
+  OP_SPEED = 0x1C     // push the speed of the strip (0-1023)
+};
+
+/**
+ * EffectVM runs small user defined effects. A program is a header ("FX" and
+ * the version) and a sequence of instructions of a stack machine that leaves
+ * the color of the frame on the stack.
+ * The programs are verified when they are loaded (valid instructions, forward
+ * jumps inside the program and stack depth), so the interpreter only checks
+ * the number of instructions executed per frame. No memory is allocated.
+ */
+class EffectVM
+{
+  private:
+    uint8_t _program[EFFECT_PROGRAM_SIZE];
+    uint16_t _size = 0;
+    uint32_t _period = 0;
+    int32_t _stack[EFFECT_STACK_SIZE];
+    uint32_t _steps = 0;
+
+  public:
+    static bool verify(const uint8_t*, uint16_t);
+    bool load(const uint8_t*, uint16_t);
+    bool isLoaded(void);
+    void clear(void);
+    uint32_t run(uint64_t, uint32_t, uint16_t);
+    uint32_t getPeriod(void);
+    uint32_t getSteps(void);
+};
+
+#endif /* EFFECT_VM_H_ */
@@ -0,0 +1,114 @@
+/*
+ * LedCompositor.cpp
+ * Created by Jose Rivera, Aug 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include "LedCompositor.h"
+#include <Arduino.h>
+
+/**
+ * Blend a channel of the overlay with the same channel of the base layer.
+ */
+uint8_t LedCompositor::blend(uint8_t base, uint8_t overlay)
+{
+  uint16_t alpha = this->_overlay_alpha + 1;
+  uint16_t value;
+  switch (this->_overlay_mode) {
+    case LedBlendMode::ADD:
+      value = base + ((overlay * alpha) >> 8);
+      return value > 255 ? 255 : value;
+    case LedBlendMode::MULTIPLY:
+      overlay = (base * (overlay + 1)) >> 8;
+      break;
+    default:
+      break;
+  }
+  return (base * (256 - alpha) + overlay * alpha) >> 8;
+}
+
+/**
+ * Set the master brightness applied after the overlay.
+ */
+void LedCompositor::setBrightness(uint8_t brightness)
+{
+  this->_brightness = brightness;
+}
+
+uint8_t LedCompositor::getBrightness(void)
+{
+  return this->_brightness;
+}
+
+/**
+ * Start an overlay that blinks a color over the base layer.
+ * @param color Color of the overlay
+ * @param count Number of blinks, 0 keeps the overlay until it is cleared
+ * @param mode Blend mode of the overlay
+ * @param alpha Opacity of the overlay (0-255)
+ * @param now Current time in ms
+ */
+void LedCompositor::setOverlay(uint32_t color, uint8_t count, LedBlendMode mode, uint8_t alpha, uint64_t now)
+{
+  this->_overlay_color = {
+    static_cast<uint8_t>((color >> 16) & 0xFF),
+    static_cast<uint8_t>((color >> 8) & 0xFF),
+    static_cast<uint8_t>(color & 0xFF)
+  };
+  this->_overlay_count = count;
+  this->_overlay_mode = mode;
+  this->_overlay_alpha = alpha;
+  this->_overlay_start = now;
+  this->_overlay = true;
+}
+
+/**
+ * Set the time the overlay is shown and hidden in each blink.
+ */
+void LedCompositor::setOverlayTiming(uint16_t on, uint16_t off)
+{
+  this->_overlay_on = on;
+  this->_overlay_off = off;
+}
+
+void LedCompositor::clearOverlay(void)
+{
+  this->_overlay = false;
+}
+
+bool LedCompositor::hasOverlay(void)
+{
+  return this->_overlay;
+}
+
+/**
+ * Compose the layers.
+ * @param base Color of the base layer
+ * @param now Current time in ms
+ * @return  The color to show
+ */
+RGBColor LedCompositor::compose(RGBColor base, uint64_t now)
+{
+  RGBColor color = base;
+  if(this->_overlay)
+  {
+    uint32_t period = this->_overlay_on + this->_overlay_off;
+    uint64_t elapsed = now - this->_overlay_start;
+    if(this->_overlay_count > 0 && elapsed >= period * this->_overlay_count)
+    {
+      this->_overlay = false;
+    }
+    else if(period == 0 || (elapsed % period) < this->_overlay_on)
+    {
+      color.red = this->blend(base.red, this->_overlay_color.red);
+      color.green = this->blend(base.green, this->_overlay_color.green);
+      color.blue = this->blend(base.blue, this->_overlay_color.blue);
+    }
+  }
+  uint16_t brightness = this->_brightness + 1;
+  color.red = (color.red * brightness) >> 8;
+  color.green = (color.green * brightness) >> 8;
+  color.blue = (color.blue * brightness) >> 8;
+  return color;
+}
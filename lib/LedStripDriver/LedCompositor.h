@@ -0,0 +1,61 @@
+/*
+ * LedCompositor.h
+ * Created by Jose Rivera, Aug 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+
+#include <inttypes.h>
+#include "RGBColors.h"
+
+#ifndef LED_COMPOSITOR_H_
+#define LED_COMPOSITOR_H_
+
+/**
+ * How the overlay color is blended with the base color.
+ */
+enum LedBlendMode
+{
+  ALPHA,
+  ADD,
+  MULTIPLY
+};
+
+#define OVERLAY_ON_DELAY 250
+#define OVERLAY_OFF_DELAY 250
+
+/**
+ * LedCompositor stacks three layers: the base layer (the color rendered by the
+ * effect), an overlay layer that blinks a color a number of times (for
+ * example a notification) and the master brightness.
+ * The layers are blended in 8 bits fixed point. The overlay expires by itself
+ * after the last blink, the effect keeps running below it so the base layer
+ * continues without a gap.
+ */
+class LedCompositor
+{
+  private:
+    uint8_t _brightness = 255;
+    bool _overlay = false;
+    RGBColor _overlay_color = { 0, 0, 0 };
+    LedBlendMode _overlay_mode = LedBlendMode::ALPHA;
+    uint8_t _overlay_alpha = 255;
+    uint8_t _overlay_count = 0;
+    uint16_t _overlay_on = OVERLAY_ON_DELAY;
+    uint16_t _overlay_off = OVERLAY_OFF_DELAY;
+    uint64_t _overlay_start = 0;
+
+    uint8_t blend(uint8_t, uint8_t);
+
+  public:
+    void setBrightness(uint8_t);
+    uint8_t getBrightness(void);
+    void setOverlay(uint32_t, uint8_t, LedBlendMode, uint8_t, uint64_t);
+    void setOverlayTiming(uint16_t, uint16_t);
+    void clearOverlay(void);
+    bool hasOverlay(void);
+    RGBColor compose(RGBColor, uint64_t);
+};
+
+#endif /* LED_COMPOSITOR_H_ */
@@ -0,0 +1,237 @@
+/*
+ * LedHistory.cpp
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include "LedHistory.h"
+#include <Arduino.h>
+#include <FS.h>
+#include "MonotonicClock.h"
+
+static const char *const SOURCE_NAMES[SOURCE_COUNT] = {
+  "system", "button", "pot", "mqtt", "blynk", "serial", "rest"
+};
+
+LedHistory::LedHistory(LedZones *zones, TimeSource *time)
+{
+  this->_zones = zones;
+  this->_time = time;
+}
+
+/**
+ * Move half of the ring to a file when it is full instead of overwriting the
+ * oldest records.
+ * @param path File of the records
+ * @param max Records that the file can keep
+ */
+void LedHistory::setSpillFile(const char *path, uint16_t max)
+{
+  this->_file = path;
+  this->_file_max = max;
+  this->_file_sent = 0;
+  this->_file_count = 0;
+  File file = SPIFFS.open(path, "r");
+  if(file)
+  {
+    // The records of the file were not uploaded before the restart
+    this->_file_count = min(file.size() / sizeof(HistoryRecord), (size_t) max);
+    file.close();
+  }
+}
+
+void LedHistory::snapshot(uint8_t zone, uint32_t *values)
+{
+  LedStripRGB *rgb = this->_zones->rgb(zone);
+  LedStrip *white = this->_zones->white(zone);
+  values[ZONE_RGB_STATE] = rgb->getState() == LedStripState::ON;
+  values[ZONE_RGB_MODE] = rgb->getMode();
+  values[ZONE_RGB_COLOR] = rgb->getColor();
+  values[ZONE_RGB_SPEED] = rgb->getSpeed();
+  values[ZONE_BRIGHTNESS] = rgb->getBrightness();
+  values[ZONE_WHITE] = white && white->getState() == LedStripState::ON ? white->getIntensity() : 0;
+}
+
+/**
+ * Take the state of the zones without recording the changes, for the changes
+ * that are not audited (schedules and shows).
+ */
+void LedHistory::sync(void)
+{
+  for(uint8_t i = 0; i < this->_zones->count(); i++)
+  {
+    this->snapshot(i, this->_values[i]);
+  }
+  this->_known = true;
+}
+
+/**
+ * Record the fields of the zones changed since the last record or sync.
+ * @param source Origin of the changes
+ */
+void LedHistory::record(ChangeSource source)
+{
+  if(source < SOURCE_COUNT)
+  {
+    this->_counts[source]++;
+  }
+  if(!this->_known)
+  {
+    this->sync();
+    return;
+  }
+  HistoryRecord record;
+  record.source = source;
+  record.flags = 0;
+  if(this->_time->isValid())
+  {
+    record.time = this->_time->now();
+  }
+  else
+  {
+    record.time = SystemClock.millis64() / 1000;
+    record.flags = HISTORY_UPTIME;
+  }
+  uint32_t values[HISTORY_FIELDS];
+  for(uint8_t i = 0; i < this->_zones->count(); i++)
+  {
+    this->snapshot(i, values);
+    for(uint8_t field = 0; field < HISTORY_FIELDS; field++)
+    {
+      if(values[field] != this->_values[i][field])
+      {
+        record.zone = i;
+        record.field = field;
+        record.value = values[field];
+        this->add(record);
+        this->_values[i][field] = values[field];
+      }
+    }
+  }
+}
+
+void LedHistory::add(HistoryRecord &record)
+{
+  if(this->_count == HISTORY_SIZE && this->_file)
+  {
+    this->spill();
+  }
+  if(this->_count == HISTORY_SIZE)
+  {
+    // The oldest record is overwritten
+    this->_count--;
+    this->_lost++;
+  }
+  this->_records[this->_head] = record;
+  this->_head = (this->_head + 1) % HISTORY_SIZE;
+  this->_count++;
+}
+
+/**
+ * Append the oldest records of the ring to the file.
+ */
+void LedHistory::spill(void)
+{
+  if(this->_file_count + HISTORY_SPILL > this->_file_max)
+  {
+    return;
+  }
+  File file = SPIFFS.open(this->_file, "a");
+  if(!file)
+  {
+    return;
+  }
+  uint16_t tail = (this->_head + HISTORY_SIZE - this->_count) % HISTORY_SIZE;
+  for(uint16_t i = 0; i < HISTORY_SPILL; i++)
+  {
+    file.write((const uint8_t*) &this->_records[(tail + i) % HISTORY_SIZE], sizeof(HistoryRecord));
+  }
+  file.close();
+  this->_file_count += HISTORY_SPILL;
+  this->_count -= HISTORY_SPILL;
+}
+
+/**
+ * It allows to obtain the number of records not uploaded yet.
+ */
+uint16_t LedHistory::available(void)
+{
+  return this->_count + this->_file_count - this->_file_sent;
+}
+
+/**
+ * Copy the oldest records not uploaded, they are removed by ack() once they
+ * were uploaded.
+ * @param records Buffer of the records
+ * @param max Size of the buffer
+ * @return  The number of records copied
+ */
+uint16_t LedHistory::read(HistoryRecord *records, uint16_t max)
+{
+  this->_reading_file = this->_file_count > this->_file_sent;
+  if(this->_reading_file)
+  {
+    File file = SPIFFS.open(this->_file, "r");
+    if(!file || !file.seek(this->_file_sent * sizeof(HistoryRecord), SeekSet))
+    {
+      // The records of the file are lost
+      this->_lost += this->_file_count - this->_file_sent;
+      this->_file_sent = this->_file_count;
+      return 0;
+    }
+    uint16_t count = min(max, (uint16_t) (this->_file_count - this->_file_sent));
+    count = file.read((uint8_t*) records, count * sizeof(HistoryRecord)) / sizeof(HistoryRecord);
+    file.close();
+    return count;
+  }
+  uint16_t count = min(max, this->_count);
+  uint16_t tail = (this->_head + HISTORY_SIZE - this->_count) % HISTORY_SIZE;
+  for(uint16_t i = 0; i < count; i++)
+  {
+    records[i] = this->_records[(tail + i) % HISTORY_SIZE];
+  }
+  return count;
+}
+
+/**
+ * Remove the records read that were uploaded.
+ */
+void LedHistory::ack(uint16_t count)
+{
+  if(this->_reading_file)
+  {
+    this->_file_sent += count;
+    if(this->_file_sent >= this->_file_count)
+    {
+      SPIFFS.remove(this->_file);
+      this->_file_count = 0;
+      this->_file_sent = 0;
+    }
+    return;
+  }
+  this->_count -= min(count, this->_count);
+}
+
+/**
+ * It allows to obtain the number of records overwritten before they were
+ * uploaded.
+ */
+uint32_t LedHistory::getLost(void)
+{
+  return this->_lost;
+}
+
+/**
+ * It allows to obtain the number of changes notified by a source (commands,
+ * button presses...), whether they changed the zones or not.
+ */
+uint32_t LedHistory::getCount(uint8_t source)
+{
+  return source < SOURCE_COUNT ? this->_counts[source] : 0;
+}
+
+const char *LedHistory::sourceName(uint8_t source)
+{
+  return source < SOURCE_COUNT ? SOURCE_NAMES[source] : "";
+}
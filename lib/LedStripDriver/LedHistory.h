@@ -0,0 +1,97 @@
+/*
+ * LedHistory.h
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+
+#include <inttypes.h>
+#include "LedZones.h"
+#include "TimeSource.h"
+
+#ifndef LED_HISTORY_H_
+#define LED_HISTORY_H_
+
+#define HISTORY_SIZE 128
+// Fields of a zone compared, the actions of LedZoneAction
+#define HISTORY_FIELDS 6
+// Part of the ring moved to the file when it is full
+#define HISTORY_SPILL (HISTORY_SIZE / 2)
+
+// The time of the record is the uptime, the clock was not synchronized
+#define HISTORY_UPTIME 0x01
+
+enum ChangeSource
+{
+  SOURCE_SYSTEM = 0,
+  SOURCE_BUTTON = 1,
+  SOURCE_POT = 2,
+  SOURCE_MQTT = 3,
+  SOURCE_BLYNK = 4,
+  SOURCE_SERIAL = 5,
+  SOURCE_REST = 6
+};
+
+#define SOURCE_COUNT 7
+
+/**
+ * Change of a field of a zone, as stored in the ring and in the file.
+ */
+struct HistoryRecord
+{
+  uint32_t time;      // UTC seconds since the epoch or uptime seconds
+  uint8_t source;     // ChangeSource
+  uint8_t zone;
+  uint8_t field;      // LedZoneAction
+  uint8_t flags;
+  uint32_t value;     // new value (as the values of LedZoneAction)
+};
+
+/**
+ * LedHistory keeps the changes of the state of the zones tagged with their
+ * source (who changed what and when) until they are uploaded. The state of
+ * the zones is compared with the last one seen when a change is notified, a
+ * record is added for each field that changed. The changes of the schedules
+ * and the shows are not recorded (sync).
+ *
+ * The records are kept in a ring in RAM, the oldest ones are overwritten when
+ * it is full. Optionally half of the ring is moved to a file when it is full,
+ * the records of the file are read first.
+ */
+class LedHistory
+{
+  private:
+    LedZones *_zones;
+    TimeSource *_time;
+    HistoryRecord _records[HISTORY_SIZE];
+    uint16_t _head = 0;
+    uint16_t _count = 0;
+    uint32_t _values[LED_MAX_ZONES][HISTORY_FIELDS];
+    bool _known = false;
+    uint32_t _lost = 0;
+    uint32_t _counts[SOURCE_COUNT] = { 0 };
+    const char *_file = nullptr;
+    uint16_t _file_max = 0;
+    uint16_t _file_count = 0;
+    uint16_t _file_sent = 0;
+    bool _reading_file = false;
+
+    void snapshot(uint8_t, uint32_t*);
+    void add(HistoryRecord&);
+    void spill(void);
+
+  public:
+    LedHistory(LedZones *zones, TimeSource *time);
+    void setSpillFile(const char*, uint16_t);
+    void record(ChangeSource);
+    void sync(void);
+    uint16_t available(void);
+    uint16_t read(HistoryRecord*, uint16_t);
+    void ack(uint16_t);
+    uint32_t getLost(void);
+    uint32_t getCount(uint8_t);
+    static const char *sourceName(uint8_t);
+};
+
+#endif /* LED_HISTORY_H_ */
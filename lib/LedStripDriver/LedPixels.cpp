@@ -0,0 +1,275 @@
+/*
+ * LedPixels.cpp
+ * Created by Jose Rivera, Aug 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include "LedPixels.h"
+#include "MonotonicClock.h"
+#include <Arduino.h>
+
+/**
+ * Scale the four bytes of a word by scale / 256 (scale 0-256), rounded. The
+ * even and odd bytes are multiplied in two steps so they do not overflow.
+ */
+static inline uint32_t scale4(uint32_t word, uint16_t scale)
+{
+  uint32_t even = (((word & 0x00FF00FF) * scale + 0x00800080) >> 8) & 0x00FF00FF;
+  uint32_t odd = (((word >> 8) & 0x00FF00FF) * scale + 0x00800080) & 0xFF00FF00;
+  return even | odd;
+}
+
+/**
+ * Blend the even bytes of two words (in 16 bit lanes), rounded towards to so
+ * each byte moves at least one step and settles at to.
+ */
+static inline uint32_t blend2(uint32_t from, uint32_t to, uint16_t amount)
+{
+  // 0x100 in the lanes where to >= from, 0xFF of bias to round them up
+  uint32_t up = ((to | 0x01000100) - from) & 0x01000100;
+  return from * (256 - amount) + to * amount + up - (up >> 8);
+}
+
+/**
+ * Blend the four bytes of two words, amount 0 is from and 256 is to.
+ */
+static inline uint32_t blend4(uint32_t from, uint32_t to, uint16_t amount)
+{
+  uint32_t even = (blend2(from & 0x00FF00FF, to & 0x00FF00FF, amount) >> 8) & 0x00FF00FF;
+  uint32_t odd = blend2((from >> 8) & 0x00FF00FF, (to >> 8) & 0x00FF00FF, amount) & 0xFF00FF00;
+  return even | odd;
+}
+
+/**
+ * Color of the color wheel (0-255), red to green to blue and back to red.
+ */
+static RGBColor wheel(uint8_t position)
+{
+  uint8_t step = (position % 85) * 3;
+  if(position < 85)
+  {
+    return { static_cast<uint8_t>(255 - step), step, 0 };
+  }
+  else if(position < 170)
+  {
+    return { 0, static_cast<uint8_t>(255 - step), step };
+  }
+  return { step, 0, static_cast<uint8_t>(255 - step) };
+}
+
+/**
+ * Constructor of the class.
+ * @param count Number of pixels of the strip (up to LED_PIXELS_MAX)
+ */
+LedPixels::LedPixels(uint16_t count)
+{
+  this->_count = count > LED_PIXELS_MAX ? LED_PIXELS_MAX : count;
+  memset(&this->_target, 0, sizeof(this->_target));
+  memset(&this->_output, 0, sizeof(this->_output));
+}
+
+uint16_t LedPixels::count(void)
+{
+  return this->_count;
+}
+
+/**
+ * Fill the target frame with a color, a word (four pixels) at a time.
+ */
+void LedPixels::fill(uint32_t color)
+{
+  uint32_t red = ((color >> 16) & 0xFF) * 0x01010101;
+  uint32_t green = ((color >> 8) & 0xFF) * 0x01010101;
+  uint32_t blue = (color & 0xFF) * 0x01010101;
+  for(uint16_t i = 0; i < LED_PIXELS_WORDS; i++)
+  {
+    this->_target.red[i] = red;
+    this->_target.green[i] = green;
+    this->_target.blue[i] = blue;
+  }
+}
+
+/**
+ * Fill a word (four pixels) of the target frame with a color.
+ */
+void LedPixels::fillWord(uint16_t word, uint32_t color)
+{
+  this->_target.red[word] = ((color >> 16) & 0xFF) * 0x01010101;
+  this->_target.green[word] = ((color >> 8) & 0xFF) * 0x01010101;
+  this->_target.blue[word] = (color & 0xFF) * 0x01010101;
+}
+
+/**
+ * The color wheel spread along the strip, moving one turn each cycle.
+ */
+void LedPixels::rainbow(uint64_t now)
+{
+  uint8_t offset = this->_clock.update(now) >> 24;
+  uint8_t *red = (uint8_t*) this->_target.red;
+  uint8_t *green = (uint8_t*) this->_target.green;
+  uint8_t *blue = (uint8_t*) this->_target.blue;
+  for(uint16_t i = 0; i < this->_count; i++)
+  {
+    RGBColor rgb = wheel(offset + (i * 256) / this->_count);
+    red[i] = rgb.red;
+    green[i] = rgb.green;
+    blue[i] = rgb.blue;
+  }
+}
+
+/**
+ * The flash of the strobe sweeps the strip once per period, each group of
+ * four pixels flashes a part of the period after the previous one.
+ */
+void LedPixels::strobe(uint64_t now)
+{
+  uint64_t period = 100000000UL / Strobe.getFrequency();
+  uint16_t words = (this->_count + 3) / 4;
+  for(uint16_t i = 0; i < words; i++)
+  {
+    bool on = Strobe.isOn(now * 1000 + period - (period * i) / words);
+    this->fillWord(i, on ? this->_color : COLOR_BLACK);
+  }
+}
+
+/**
+ * The color sequence spread along the strip, it moves one color each step.
+ */
+void LedPixels::flash(uint64_t now)
+{
+  uint32_t phase = this->_clock.update(now);
+  uint8_t step = ((uint64_t) phase * FLASH_COLORS_SEQUENCE_LENGTH) >> 32;
+  uint16_t words = (this->_count + 3) / 4;
+  for(uint16_t i = 0; i < words; i++)
+  {
+    uint8_t color = (step + (i * FLASH_COLORS_SEQUENCE_LENGTH) / words) % FLASH_COLORS_SEQUENCE_LENGTH;
+    this->fillWord(i, FLASH_COLORS_SEQUENCE[color]);
+  }
+}
+
+void LedPixels::setState(LedStripState state)
+{
+  this->_state = state == LedStripState::ON;
+}
+
+LedStripState LedPixels::getState(void)
+{
+  return this->_state ? LedStripState::ON : LedStripState::OFF;
+}
+
+void LedPixels::setColor(uint32_t color)
+{
+  this->_color = color;
+}
+
+void LedPixels::setMode(LedStripRgbMode mode)
+{
+  if(mode != this->_mode)
+  {
+    this->_mode = mode;
+    this->_clock.reset(SystemClock.millis64());
+  }
+}
+
+/**
+ * Set the speed of the effects, see EffectClock.
+ * @param speed Knob value (0-1023), 0 is the slowest
+ */
+void LedPixels::setSpeed(uint16_t speed)
+{
+  this->_clock.setSpeed(speed);
+}
+
+/**
+ * @param cpm Hundredths of cycles per minute (100-24000)
+ */
+void LedPixels::setCyclesPerMinute(uint16_t cpm)
+{
+  this->_clock.setCyclesPerMinute(cpm);
+}
+
+void LedPixels::setBrightness(uint8_t brightness)
+{
+  this->_brightness = brightness;
+}
+
+RGBColor LedPixels::getPixel(uint16_t index)
+{
+  return {
+    ((uint8_t*) this->_output.red)[index],
+    ((uint8_t*) this->_output.green)[index],
+    ((uint8_t*) this->_output.blue)[index]
+  };
+}
+
+const uint8_t *LedPixels::getRed(void)
+{
+  return (const uint8_t*) this->_output.red;
+}
+
+const uint8_t *LedPixels::getGreen(void)
+{
+  return (const uint8_t*) this->_output.green;
+}
+
+const uint8_t *LedPixels::getBlue(void)
+{
+  return (const uint8_t*) this->_output.blue;
+}
+
+/**
+ * Render a frame: the effect writes the target frame and the output frame is
+ * blended towards it and scaled by the brightness.
+ * @param now Time of the frame in ms
+ */
+void LedPixels::render(uint64_t now)
+{
+  if(!this->_state)
+  {
+    this->fill(COLOR_BLACK);
+  }
+  else
+  {
+    switch (this->_mode) {
+      case LedStripRgbMode::STROBE:
+        this->strobe(now);
+        break;
+      case LedStripRgbMode::FLASH:
+        this->flash(now);
+        break;
+      case LedStripRgbMode::FADE:
+        this->rainbow(now);
+        break;
+      default:
+        this->fill(this->_color);
+    }
+  }
+
+  // Strobe switches at once, the rest of the modes are smoothed
+  uint16_t amount = this->_mode == LedStripRgbMode::STROBE ? 256 : LED_PIXELS_SMOOTHING;
+  uint16_t brightness = this->_brightness + 1;
+  uint16_t words = (this->_count + 3) / 4;
+  for(uint16_t i = 0; i < words; i++)
+  {
+    this->_output.red[i] = blend4(this->_output.red[i], scale4(this->_target.red[i], brightness), amount);
+    this->_output.green[i] = blend4(this->_output.green[i], scale4(this->_target.green[i], brightness), amount);
+    this->_output.blue[i] = blend4(this->_output.blue[i], scale4(this->_target.blue[i], brightness), amount);
+  }
+}
+
+/**
+ * Render a new frame each LED_PIXELS_FRAME_DELAY ms.
+ * @return  true when a new frame was rendered and must be sent to the strip
+ */
+bool LedPixels::loop(void)
+{
+  uint64_t now = SystemClock.millis64();
+  if((now - this->_last_frame_time) < LED_PIXELS_FRAME_DELAY)
+  {
+    return false;
+  }
+  this->_last_frame_time = now;
+  this->render(now);
+  return true;
+}
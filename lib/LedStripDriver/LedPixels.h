@@ -0,0 +1,82 @@
+/*
+ * LedPixels.h
+ * Created by Jose Rivera, Aug 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+
+#include <inttypes.h>
+#include "LedStrip.h"
+#include "LedStripRGB.h"
+#include "EffectClock.h"
+#include "RGBColors.h"
+
+#ifndef LED_PIXELS_H_
+#define LED_PIXELS_H_
+
+#define LED_PIXELS_MAX 300
+#define LED_PIXELS_WORDS ((LED_PIXELS_MAX + 3) / 4)
+#define LED_PIXELS_FRAME_DELAY 20
+#define LED_PIXELS_SMOOTHING 96
+
+/**
+ * Color planes of a frame, one byte per pixel in each plane. The planes are
+ * stored as words so four pixels are processed at a time.
+ */
+struct PixelPlanes
+{
+  uint32_t red[LED_PIXELS_WORDS];
+  uint32_t green[LED_PIXELS_WORDS];
+  uint32_t blue[LED_PIXELS_WORDS];
+};
+
+/**
+ * LedPixels handles an addressable led strip (WS2812 / SK6812) with the same
+ * modes of LedStripRGB rendered per pixel: NORMAL shows the color in all the
+ * pixels, the flash of STROBE sweeps along the strip, FLASH shows the color
+ * sequence along the strip moving one color each step and FADE is a rainbow
+ * moving along the strip.
+ * The frame buffer is kept in structure of arrays layout; the effect renders
+ * the target frame and the output frame is blended towards it (and scaled by
+ * the brightness) a word at a time in fixed point.
+ */
+class LedPixels
+{
+  private:
+    uint16_t _count;
+    bool _state = false;
+    uint32_t _color = COLOR_BLACK;
+    uint8_t _brightness = 255;
+    LedStripRgbMode _mode = LedStripRgbMode::NORMAL;
+    uint64_t _last_frame_time = 0;
+    EffectClock _clock;
+
+    PixelPlanes _target;
+    PixelPlanes _output;
+
+    void fill(uint32_t);
+    void fillWord(uint16_t, uint32_t);
+    void rainbow(uint64_t);
+    void strobe(uint64_t);
+    void flash(uint64_t);
+
+  public:
+    LedPixels(uint16_t count);
+    uint16_t count(void);
+    void setState(LedStripState);
+    LedStripState getState(void);
+    void setColor(uint32_t);
+    void setMode(LedStripRgbMode);
+    void setSpeed(uint16_t);
+    void setCyclesPerMinute(uint16_t);
+    void setBrightness(uint8_t);
+    RGBColor getPixel(uint16_t);
+    const uint8_t *getRed(void);
+    const uint8_t *getGreen(void);
+    const uint8_t *getBlue(void);
+    void render(uint64_t);
+    bool loop(void);
+};
+
+#endif /* LED_PIXELS_H_ */
@@ -0,0 +1,389 @@
+/*
+ * LedScheduler.cpp
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include "LedScheduler.h"
+#include <Arduino.h>
+#include <FS.h>
+
+#define SECONDS_PER_DAY 86400UL
+
+LedScheduler::LedScheduler(LedZones *zones, TimeSource *time)
+{
+  this->_zones = zones;
+  this->_time = time;
+  memset(this->_entries, 0, sizeof(this->_entries));
+  memset(this->_wheel, SCHEDULE_NONE, sizeof(this->_wheel));
+}
+
+/**
+ * It allows to obtain the next time of the day (and day of the week) of the
+ * entry after a time.
+ * @param entry Scheduled action
+ * @param now Local time in seconds since the epoch
+ */
+uint32_t LedScheduler::nextExpiry(ScheduleEntry &entry, uint32_t now)
+{
+  uint32_t day = now / SECONDS_PER_DAY;
+  for(uint8_t i = 0; i <= 7; i++)
+  {
+    uint32_t expiry = (day + i) * SECONDS_PER_DAY + entry.time;
+    // The epoch was a Thursday
+    uint8_t weekday = (day + i + 4) % 7;
+    if(expiry > now && (entry.days == SCHEDULE_ONCE || entry.days & (1 << weekday)))
+    {
+      return expiry;
+    }
+  }
+  return now + SECONDS_PER_DAY;
+}
+
+/**
+ * Add the entry to the lowest level of the wheel whose period contains both
+ * the current tick and the expiration.
+ */
+void LedScheduler::insert(uint8_t index)
+{
+  if(this->_expiry[index] < this->_tick)
+  {
+    this->_expiry[index] = this->_tick;
+  }
+  uint32_t expiry = this->_expiry[index];
+  uint8_t level = 0;
+  while(level < SCHEDULE_WHEEL_LEVELS - 1 &&
+    (expiry >> (SCHEDULE_WHEEL_BITS * (level + 1))) != (this->_tick >> (SCHEDULE_WHEEL_BITS * (level + 1))))
+  {
+    level++;
+  }
+  uint8_t slot = (expiry >> (SCHEDULE_WHEEL_BITS * level)) & (SCHEDULE_WHEEL_SLOTS - 1);
+  this->_level[index] = level;
+  this->_slot[index] = slot;
+  this->_next[index] = this->_wheel[level][slot];
+  this->_wheel[level][slot] = index;
+}
+
+void LedScheduler::unlink(uint8_t index)
+{
+  uint8_t *link = &this->_wheel[this->_level[index]][this->_slot[index]];
+  while(*link != SCHEDULE_NONE)
+  {
+    if(*link == index)
+    {
+      *link = this->_next[index];
+      return;
+    }
+    link = &this->_next[*link];
+  }
+}
+
+/**
+ * Compute again the next expiration of all the entries, the ramps in progress
+ * are finished.
+ */
+void LedScheduler::rebuild(uint32_t now)
+{
+  memset(this->_wheel, SCHEDULE_NONE, sizeof(this->_wheel));
+  this->_tick = now;
+  for(uint8_t i = 0; i < SCHEDULE_MAX_ENTRIES; i++)
+  {
+    if(this->_entries[i].used)
+    {
+      this->_expiry[i] = this->nextExpiry(this->_entries[i], now);
+      this->insert(i);
+    }
+  }
+  for(uint8_t i = 0; i < this->_ramp_count; i++)
+  {
+    this->_zones->apply(this->_ramps[i].zones, this->_ramps[i].action, this->_ramps[i].to);
+  }
+  this->_ramp_count = 0;
+}
+
+/**
+ * Move the entries of a slot of an upper level to the lower levels.
+ */
+void LedScheduler::cascade(uint8_t level, uint8_t slot)
+{
+  uint8_t index = this->_wheel[level][slot];
+  this->_wheel[level][slot] = SCHEDULE_NONE;
+  while(index != SCHEDULE_NONE)
+  {
+    uint8_t next = this->_next[index];
+    this->insert(index);
+    index = next;
+  }
+}
+
+/**
+ * Move the wheel one second.
+ */
+void LedScheduler::advance(void)
+{
+  this->_tick++;
+  for(uint8_t level = SCHEDULE_WHEEL_LEVELS - 1; level > 0; level--)
+  {
+    uint8_t shift = SCHEDULE_WHEEL_BITS * level;
+    if((this->_tick & ((1UL << shift) - 1)) == 0)
+    {
+      this->cascade(level, (this->_tick >> shift) & (SCHEDULE_WHEEL_SLOTS - 1));
+    }
+  }
+  uint8_t slot = this->_tick & (SCHEDULE_WHEEL_SLOTS - 1);
+  uint8_t index = this->_wheel[0][slot];
+  this->_wheel[0][slot] = SCHEDULE_NONE;
+  while(index != SCHEDULE_NONE)
+  {
+    uint8_t next = this->_next[index];
+    this->fire(index);
+    index = next;
+  }
+}
+
+/**
+ * It allows to obtain the white intensity or the brightness of the first
+ * zone of the mask.
+ */
+uint8_t LedScheduler::current(uint8_t zones, uint8_t action)
+{
+  uint8_t zone = this->_zones->first(zones);
+  if(zone >= this->_zones->count())
+  {
+    return 0;
+  }
+  if(action == ZONE_BRIGHTNESS)
+  {
+    return this->_zones->rgb(zone)->getBrightness();
+  }
+  LedStrip *white = this->_zones->white(zone);
+  return white && white->getState() == LedStripState::ON ? white->getIntensity() : 0;
+}
+
+/**
+ * Apply the action of the entry and schedule its next expiration.
+ */
+void LedScheduler::fire(uint8_t index)
+{
+  ScheduleEntry &entry = this->_entries[index];
+  bool ramp = entry.ramp > 0 && (entry.action == ZONE_WHITE || entry.action == ZONE_BRIGHTNESS);
+  if(ramp)
+  {
+    // A new ramp of the same zones replaces the previous one
+    uint8_t r = 0;
+    while(r < this->_ramp_count &&
+      (this->_ramps[r].zones != entry.zones || this->_ramps[r].action != entry.action))
+    {
+      r++;
+    }
+    if(r == SCHEDULE_MAX_RAMPS)
+    {
+      r = 0;
+    }
+    else if(r == this->_ramp_count)
+    {
+      this->_ramp_count++;
+    }
+    this->_ramps[r] = { entry.zones, entry.action, this->current(entry.zones, entry.action),
+      (uint8_t) constrain(entry.value, 0, 255), this->_tick, entry.ramp };
+  }
+  else
+  {
+    this->_zones->apply(entry.zones, entry.action, entry.value);
+  }
+
+  if(entry.days == SCHEDULE_ONCE)
+  {
+    entry.used = 0;
+    this->_changed = true;
+  }
+  else
+  {
+    this->_expiry[index] = this->nextExpiry(entry, this->_tick);
+    this->insert(index);
+  }
+}
+
+void LedScheduler::updateRamps(void)
+{
+  uint8_t i = 0;
+  while(i < this->_ramp_count)
+  {
+    ScheduleRamp &ramp = this->_ramps[i];
+    uint32_t elapsed = this->_tick - ramp.start;
+    if(elapsed >= ramp.duration)
+    {
+      this->_zones->apply(ramp.zones, ramp.action, ramp.to);
+      this->_ramps[i] = this->_ramps[--this->_ramp_count];
+      continue;
+    }
+    int32_t level = ramp.from + ((int32_t) ramp.to - ramp.from) * (int32_t) elapsed / ramp.duration;
+    this->_zones->apply(ramp.zones, ramp.action, level);
+    i++;
+  }
+}
+
+/**
+ * Set the offset of the local time, the times of the day of the entries are
+ * local times.
+ * @param offset Offset from UTC in seconds
+ */
+void LedScheduler::setTimezone(int32_t offset)
+{
+  this->_timezone = offset;
+  this->_tick = 0;
+}
+
+int32_t LedScheduler::getTimezone(void)
+{
+  return this->_timezone;
+}
+
+/**
+ * Add a scheduled action.
+ * @param entry Days, time of the day, zones, action, value and ramp
+ * @return  The id of the entry or -1 when there is no space
+ */
+int8_t LedScheduler::add(ScheduleEntry entry)
+{
+  for(uint8_t i = 0; i < SCHEDULE_MAX_ENTRIES; i++)
+  {
+    if(!this->_entries[i].used)
+    {
+      entry.used = 1;
+      entry.days &= SCHEDULE_DAILY;
+      entry.time %= SECONDS_PER_DAY;
+      this->_entries[i] = entry;
+      if(this->_tick)
+      {
+        this->_expiry[i] = this->nextExpiry(entry, this->_tick);
+        this->insert(i);
+      }
+      return i;
+    }
+  }
+  return -1;
+}
+
+bool LedScheduler::remove(uint8_t index)
+{
+  if(index >= SCHEDULE_MAX_ENTRIES || !this->_entries[index].used)
+  {
+    return false;
+  }
+  if(this->_tick)
+  {
+    this->unlink(index);
+  }
+  this->_entries[index].used = 0;
+  return true;
+}
+
+void LedScheduler::clear(void)
+{
+  memset(this->_entries, 0, sizeof(this->_entries));
+  memset(this->_wheel, SCHEDULE_NONE, sizeof(this->_wheel));
+  this->_ramp_count = 0;
+}
+
+/**
+ * It allows to obtain an entry.
+ * @return  false if there is no entry with the id
+ */
+bool LedScheduler::get(uint8_t index, ScheduleEntry &entry)
+{
+  if(index >= SCHEDULE_MAX_ENTRIES || !this->_entries[index].used)
+  {
+    return false;
+  }
+  entry = this->_entries[index];
+  return true;
+}
+
+/**
+ * It allows to obtain the next expiration of an entry.
+ * @return  The UTC time in seconds since the epoch, 0 if it is unknown
+ */
+uint32_t LedScheduler::getExpiry(uint8_t index)
+{
+  if(index >= SCHEDULE_MAX_ENTRIES || !this->_entries[index].used || !this->_tick)
+  {
+    return 0;
+  }
+  return this->_expiry[index] - this->_timezone;
+}
+
+/**
+ * Load the entries from a file, the wheel is built on the next loop.
+ */
+bool LedScheduler::load(const char *path)
+{
+  File file = SPIFFS.open(path, "r");
+  if(!file)
+  {
+    return false;
+  }
+  uint16_t header[2];
+  bool valid = file.read((uint8_t*) header, sizeof(header)) == sizeof(header) &&
+    header[0] == SCHEDULE_MAGIC && header[1] == SCHEDULE_VERSION &&
+    file.read((uint8_t*) this->_entries, sizeof(this->_entries)) == sizeof(this->_entries);
+  file.close();
+  if(!valid)
+  {
+    this->clear();
+  }
+  this->_tick = 0;
+  return valid;
+}
+
+bool LedScheduler::save(const char *path)
+{
+  File file = SPIFFS.open(path, "w");
+  if(!file)
+  {
+    return false;
+  }
+  uint16_t header[2] = { SCHEDULE_MAGIC, SCHEDULE_VERSION };
+  file.write((const uint8_t*) header, sizeof(header));
+  file.write((const uint8_t*) this->_entries, sizeof(this->_entries));
+  file.close();
+  this->_changed = false;
+  return true;
+}
+
+/**
+ * It allows to know if entries were removed after they were applied (the
+ * entries that run once) since the last save.
+ */
+bool LedScheduler::isChanged(void)
+{
+  return this->_changed;
+}
+
+/**
+ * Apply the actions due and update the ramps, it should be called on each
+ * loop.
+ */
+void LedScheduler::loop(void)
+{
+  if(!this->_time->isValid())
+  {
+    return;
+  }
+  uint32_t now = this->_time->now() + this->_timezone;
+  if(this->_tick == 0 || now < this->_tick || now - this->_tick > SCHEDULE_MAX_CATCH_UP)
+  {
+    this->rebuild(now);
+    return;
+  }
+  if(this->_tick == now)
+  {
+    return;
+  }
+  while(this->_tick < now)
+  {
+    this->advance();
+  }
+  this->updateRamps();
+}
@@ -0,0 +1,114 @@
+/*
+ * LedScheduler.h
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+
+#include <inttypes.h>
+#include "LedZones.h"
+#include "TimeSource.h"
+
+#ifndef LED_SCHEDULER_H_
+#define LED_SCHEDULER_H_
+
+#define SCHEDULE_MAX_ENTRIES 32
+#define SCHEDULE_MAX_RAMPS 4
+#define SCHEDULE_WHEEL_LEVELS 4
+#define SCHEDULE_WHEEL_BITS 6
+#define SCHEDULE_WHEEL_SLOTS (1 << SCHEDULE_WHEEL_BITS)
+#define SCHEDULE_NONE 0xFF
+#define SCHEDULE_MAX_CATCH_UP 3600
+#define SCHEDULE_MAGIC 0x5343
+#define SCHEDULE_VERSION 1
+
+#define SCHEDULE_ONCE 0x00
+#define SCHEDULE_DAILY 0x7F
+
+/**
+ * Scheduled action as stored in the file system.
+ */
+struct ScheduleEntry
+{
+  uint8_t used;
+  uint8_t days;       // bit 0 Sunday ... bit 6 Saturday, SCHEDULE_ONCE
+  uint8_t zones;      // mask of zones
+  uint8_t action;     // LedZoneAction
+  uint32_t time;      // seconds since midnight (local time)
+  uint32_t value;
+  uint16_t ramp;      // seconds to reach the value (white and brightness)
+  uint16_t reserved;
+};
+
+/**
+ * Change of the white intensity or the brightness in progress.
+ */
+struct ScheduleRamp
+{
+  uint8_t zones;
+  uint8_t action;
+  uint8_t from;
+  uint8_t to;
+  uint32_t start;
+  uint16_t duration;
+};
+
+/**
+ * LedScheduler applies actions to the zones at a time of the day, on some
+ * days of the week or once, without depending on the network. The white
+ * intensity and the brightness can be changed gradually (for example a 30
+ * minutes sunrise).
+ *
+ * The next expiration of each action is kept in a hierarchical timer wheel
+ * with a resolution of one second: four levels of 64 slots (64 s, 68 min,
+ * 72 h and 194 days). Adding an action and expiring it are O(1), the actions
+ * of a slot of the upper levels are moved down when the wheel reaches it.
+ *
+ * When the clock jumps (first SNTP synchronization, changes of the time or
+ * more than SCHEDULE_MAX_CATCH_UP seconds without loop) the next expirations
+ * are computed again and the actions missed are not applied.
+ */
+class LedScheduler
+{
+  private:
+    LedZones *_zones;
+    TimeSource *_time;
+    int32_t _timezone = 0;
+    ScheduleEntry _entries[SCHEDULE_MAX_ENTRIES];
+    uint32_t _expiry[SCHEDULE_MAX_ENTRIES];
+    uint8_t _next[SCHEDULE_MAX_ENTRIES];
+    uint8_t _level[SCHEDULE_MAX_ENTRIES];
+    uint8_t _slot[SCHEDULE_MAX_ENTRIES];
+    uint8_t _wheel[SCHEDULE_WHEEL_LEVELS][SCHEDULE_WHEEL_SLOTS];
+    uint32_t _tick = 0;
+    ScheduleRamp _ramps[SCHEDULE_MAX_RAMPS];
+    uint8_t _ramp_count = 0;
+    bool _changed = false;
+
+    uint32_t nextExpiry(ScheduleEntry&, uint32_t);
+    void insert(uint8_t);
+    void unlink(uint8_t);
+    void rebuild(uint32_t);
+    void cascade(uint8_t, uint8_t);
+    void advance(void);
+    void fire(uint8_t);
+    void updateRamps(void);
+    uint8_t current(uint8_t, uint8_t);
+
+  public:
+    LedScheduler(LedZones *zones, TimeSource *time);
+    void setTimezone(int32_t);
+    int32_t getTimezone(void);
+    int8_t add(ScheduleEntry);
+    bool remove(uint8_t);
+    void clear(void);
+    bool get(uint8_t, ScheduleEntry&);
+    uint32_t getExpiry(uint8_t);
+    bool load(const char*);
+    bool save(const char*);
+    bool isChanged(void);
+    void loop(void);
+};
+
+#endif /* LED_SCHEDULER_H_ */
@@ -18,11 +18,40 @@ LedStrip::LedStrip(uint8_t pin)
 }
 
 /**
- * Set the controller pin as an output.
+ * Constructor of the class for a led strip driven by a PWM backend.
+ * @param backend Backend that generates the PWM signal
+ * @param output Output of the backend towards the led strip
+ */
+LedStrip::LedStrip(PwmBackend *backend, uint8_t output)
+{
+  this->_backend = backend;
+  this->_pin = output;
+}
+
+/**
+ * Write the brightness level to the channel of the output stage.
+ */
+void LedStrip::write(uint8_t level)
+{
+  if(this->_channel < 0)
+  {
+    return;
+  }
+  PwmOut.write(this->_channel, level);
+}
+
+/**
+ * Set the controller pin as a channel of the output stage.
  */
 void LedStrip::setup(void)
 {
-  pinMode(this->_pin, OUTPUT);
+  this->_channel = PwmOut.attach(this->_backend, this->_pin, this->_pwm_frequency);
+  if(this->_channel >= 0)
+  {
+    PwmOut.setInverted(this->_channel, this->_common_anode);
+    PwmOut.setCurrent(this->_channel, this->_current);
+  }
+  this->write(this->_state ? this->_intensity : 0);
 }
 
 /**
@@ -33,6 +62,43 @@ void LedStrip::setup(void)
 void LedStrip::setCommonAnodeEnable(bool enabled)
 {
   this->_common_anode = enabled;
+  if(this->_channel >= 0)
+  {
+    PwmOut.setInverted(this->_channel, enabled);
+  }
+}
+
+/**
+ * Set the PWM frequency used for the LEDs of the strip.
+ * @param frequency Frequency in Hz
+ */
+void LedStrip::setPwmFrequency(uint16_t frequency)
+{
+  this->_pwm_frequency = constrain(frequency, PWM_MIN_FREQUENCY, PWM_MAX_FREQUENCY);
+  if(this->_channel >= 0)
+  {
+    PwmOut.setFrequency(this->_channel, this->_pwm_frequency);
+  }
+}
+
+uint16_t LedStrip::getPwmFrequency(void)
+{
+  return this->_pwm_frequency;
+}
+
+/**
+ * Set the current model of the strip used by the power limiter of the output
+ * stage.
+ * @param current Current drawn by one meter of the strip at full duty in mA
+ * @param length Length of the strip in cm
+ */
+void LedStrip::setCurrentModel(uint16_t current, uint16_t length)
+{
+  this->_current = ((uint32_t) current * length) / 100;
+  if(this->_channel >= 0)
+  {
+    PwmOut.setCurrent(this->_channel, this->_current);
+  }
 }
 
 /**
@@ -46,14 +112,7 @@ void LedStrip::turnOn(void)
     {
       this->_intensity = 255;
     }
-    if(this->_common_anode)
-    {
-      analogWrite(this->_pin, 255 - this->_intensity);
-    }
-    else
-    {
-      analogWrite(this->_pin, this->_intensity);
-    }
+    this->write(this->_intensity);
     this->_state = true;
   }
 }
@@ -65,14 +124,7 @@ void LedStrip::turnOff(void)
 {
   if(this->_state)
   {
-    if(this->_common_anode)
-    {
-      digitalWrite(this->_pin, HIGH);
-    }
-    else
-    {
-      digitalWrite(this->_pin, LOW);
-    }
+    this->write(0);
     this->_state = false;
   }
 }
@@ -136,14 +188,7 @@ void LedStrip::setIntensity(uint8_t intensity)
   }
   else if(this->_state)
   {
-    if(this->_common_anode)
-    {
-      analogWrite(this->_pin, 255 - this->_intensity);
-    }
-    else
-    {
-      analogWrite(this->_pin, this->_intensity);
-    }
+    this->write(this->_intensity);
   }
   else
   {
@@ -157,4 +202,13 @@ void LedStrip::setIntensity(uint8_t intensity)
 uint8_t LedStrip::getIntensity(void)
 {
   return this->_intensity;
-}
\ No newline at end of file
+}
+
+/**
+ * It allows to obtain the channel of the output stage used by the strip, -1
+ * before setup().
+ */
+int8_t LedStrip::getChannel(void)
+{
+  return this->_channel;
+}
@@ -7,6 +7,8 @@
  */
 
 #include <inttypes.h>
+#include "PwmOutput.h"
+#include "PwmNativeBackend.h"
 
 #ifndef LED_STRIP_H_
 #define LED_STRIP_H_
@@ -31,15 +33,25 @@ enum LedStripState
 class LedStrip
 {
   private:
+    PwmBackend *_backend = &PwmNative;
     uint8_t _pin;
+    int8_t _channel = -1;
+    uint16_t _pwm_frequency = PWM_DEFAULT_FREQUENCY;
+    uint16_t _current = 0;
     bool _state = false;
     uint8_t _intensity = 255;
     bool _common_anode = false;
 
+    void write(uint8_t);
+
   public:
     LedStrip(uint8_t pin);
+    LedStrip(PwmBackend *backend, uint8_t output);
     void setup(void);
     void setCommonAnodeEnable(bool);
+    void setPwmFrequency(uint16_t);
+    uint16_t getPwmFrequency(void);
+    void setCurrentModel(uint16_t, uint16_t);
     void turnOn(void);
     void turnOff(void);
     LedStripState toggle(void);
@@ -47,6 +59,7 @@ class LedStrip
     LedStripState getState(void);
     void setIntensity(uint8_t);
     uint8_t getIntensity(void);
+    int8_t getChannel(void);
 };
 
 #endif /* LED_STRIP_H_ */
\ No newline at end of file
@@ -8,11 +8,22 @@
 #include "LedStripRGB.h"
 #include <Arduino.h>
 
+// Names of the modes, in the order of LedStripRgbMode
+static const char *const RGB_MODE_NAMES[RGB_MODE_COUNT] = {
+  "Normal", "Strobe", "Flash", "Fade", "Audio", "Program"
+};
+
 LedStripRGB::LedStripRGB(RGBColor pins)
 {
   this->_pins = pins;
 }
 
+LedStripRGB::LedStripRGB(PwmBackend *backend, RGBColor outputs)
+{
+  this->_backend = backend;
+  this->_pins = outputs;
+}
+
 RGBColor LedStripRGB::hex2rgb(uint32_t hex)
 {
   RGBColor rgb = {
@@ -23,143 +34,193 @@ RGBColor LedStripRGB::hex2rgb(uint32_t hex)
   return rgb;
 }
 
+/**
+ * Set the color of the base layer, the color rendered by the effect.
+ */
+void LedStripRGB::writeColor(RGBColor rgb)
+{
+  this->_base = rgb;
+  this->present();
+}
+
+/**
+ * Compose the base layer with the overlay and the brightness and write the
+ * result to the output stage.
+ */
+void LedStripRGB::present(void)
+{
+  if(!this->_attached)
+  {
+    return;
+  }
+  RGBColor rgb = this->_compositor.compose(this->_base, SystemClock.millis64());
+  PwmOut.write(this->_channels.red, rgb.red);
+  PwmOut.write(this->_channels.green, rgb.green);
+  PwmOut.write(this->_channels.blue, rgb.blue);
+}
+
 void LedStripRGB::showColor(uint32_t color)
 {
-  RGBColor rgb = this->hex2rgb(color);
-  if(this->_common_anode)
+  this->writeColor(this->hex2rgb(color));
+}
+
+/**
+ * Attach the pins to the strobe engine while the strip is on in Strobe mode,
+ * the engine turns them on and off from its timer (GPIO16 cannot be gated,
+ * a strip that uses it follows isOn()).
+ */
+void LedStripRGB::updateStrobe(void)
+{
+  bool strobe = this->_state && this->_mode == LedStripRgbMode::STROBE && this->_attached &&
+    this->_pins.red < PWM_NATIVE_GATED_OUTPUTS && this->_pins.green < PWM_NATIVE_GATED_OUTPUTS &&
+    this->_pins.blue < PWM_NATIVE_GATED_OUTPUTS;
+  if(strobe == this->_strobe_attached || this->_backend != &PwmNative)
   {
-    analogWrite(this->_pins.red, 255 - rgb.red);
-    analogWrite(this->_pins.green, 255 - rgb.green);
-    analogWrite(this->_pins.blue, 255 - rgb.blue);
+    return;
+  }
+  if(strobe)
+  {
+    this->_strobe_attached = Strobe.attach(this->_pins.red, this->_common_anode) &&
+      Strobe.attach(this->_pins.green, this->_common_anode) &&
+      Strobe.attach(this->_pins.blue, this->_common_anode);
   }
   else
   {
-    analogWrite(this->_pins.red, rgb.red);
-    analogWrite(this->_pins.green, rgb.green);
-    analogWrite(this->_pins.blue, rgb.blue);
+    Strobe.detach(this->_pins.red);
+    Strobe.detach(this->_pins.green);
+    Strobe.detach(this->_pins.blue);
+    this->_strobe_attached = false;
   }
 }
 
+/**
+ * When the pins are attached to the strobe engine the color is always shown
+ * (the channels in PWM follow the gate from here), otherwise the strip follows
+ * the engine on each loop.
+ */
 void LedStripRGB::strobe(void)
 {
-  if((millis() - this->_last_sequence_time) > STROBE_DELAY)
+  if(this->_strobe_attached)
   {
-    this->_last_sequence_time = millis();
-    if(this->_strobe_state == true)
-    {
-      this->showColor(this->_color);
-      this->_strobe_state = false;
-    }
-    else
-    {
-      this->showColor(COLOR_BLACK);
-      this->_strobe_state = true;
-    }
+    PwmNative.followGate();
+  }
+  if(this->_strobe_attached || Strobe.isOn(SystemClock.micros64()))
+  {
+    this->showColor(this->_color);
+  }
+  else
+  {
+    this->showColor(COLOR_BLACK);
   }
 }
 
+/**
+ * Show each color of the sequence during a part of the cycle.
+ */
 void LedStripRGB::flash(void)
 {
-  uint16_t delay = FLASH_DELAY + (600 * (this->_speed / 1024));
-  if((millis() - this->_last_sequence_time) > delay)
-  {
-    this->_last_sequence_time = millis();
-    if(this->_flash_counter >= FLASH_COLORS_SEQUENCE_LENGTH)
-    {
-      this->_flash_counter = 0;
-    }
-    this->showColor(FLASH_COLORS_SEQUENCE[this->_flash_counter++]);
-  }
+  uint32_t phase = this->_clock.update(SystemClock.millis64());
+  this->showColor(FLASH_COLORS_SEQUENCE[((uint64_t) phase * FLASH_COLORS_SEQUENCE_LENGTH) >> 32]);
 }
 
+/**
+ * Go around the color wheel once per cycle (blue, magenta, red, yellow, green
+ * and cyan).
+ */
 void LedStripRGB::fade(void)
 {
-  uint16_t delay = FADE_DELAY + (200 * (this->_speed / 1024));
-  if((millis() - this->_last_sequence_time) > delay)
-  {
-    this->_last_sequence_time = millis();
-    if(this->_fade_counter >= 6)
-    {
-      this->_fade_counter = 0;
-    }
-    switch (this->_fade_counter) {
-      case 0:
-        if (this->_fade_iteration < 256)
-        {
-          analogWrite(this->_pins.red, this->_fade_iteration++);
-        }
-        else
-        {
-          this->_fade_counter++;
-        }
-        break;
-      case 1:
-        if (this->_fade_iteration > 0)
-        {
-          analogWrite(this->_pins.blue, this->_fade_iteration--);
-        }
-        else
-        {
-          this->_fade_counter++;
-        }
-        break;
-      case 2:
-        if(this->_fade_iteration < 256)
-        {
-          analogWrite(this->_pins.green, this->_fade_iteration++);
-        }
-        else
-        {
-          this->_fade_counter++;
-        }
-        break;
-      case 3:
-        if(this->_fade_iteration > 0)
-        {
-          analogWrite(this->_pins.red, this->_fade_iteration--);
-        }
-        else
-        {
-          this->_fade_counter++;
-        }
-        break;
-      case 4:
-        if(this->_fade_iteration < 256)
-        {
-          analogWrite(this->_pins.blue, this->_fade_iteration++);
-        }
-        else
-        {
-          this->_fade_counter++;
-        }
-        break;
-      case 5:
-        if(this->_fade_iteration > 0)
-        {
-          analogWrite(this->_pins.green, this->_fade_iteration--);
-        }
-        else
-        {
-          this->_fade_counter++;
-        }
-        break;
-      default:
-        this->_fade_counter = 0;
-        this->_fade_iteration = 0;
-    }
+  uint32_t phase = this->_clock.update(SystemClock.millis64());
+  uint16_t step = ((phase >> 16) * 1536) >> 16;
+  uint8_t level = step & 0xFF;
+  switch (step >> 8) {
+    case 0:
+      this->writeColor({ level, 0, 255 });
+      break;
+    case 1:
+      this->writeColor({ 255, 0, static_cast<uint8_t>(255 - level) });
+      break;
+    case 2:
+      this->writeColor({ 255, level, 0 });
+      break;
+    case 3:
+      this->writeColor({ static_cast<uint8_t>(255 - level), 255, 0 });
+      break;
+    case 4:
+      this->writeColor({ 0, 255, level });
+      break;
+    default:
+      this->writeColor({ 0, static_cast<uint8_t>(255 - level), 255 });
   }
 }
 
 void LedStripRGB::setup(void)
 {
-  pinMode(this->_pins.red, OUTPUT);
-  pinMode(this->_pins.green, OUTPUT);
-  pinMode(this->_pins.blue, OUTPUT);
+  int8_t red = PwmOut.attach(this->_backend, this->_pins.red, this->_pwm_frequency);
+  int8_t green = PwmOut.attach(this->_backend, this->_pins.green, this->_pwm_frequency);
+  int8_t blue = PwmOut.attach(this->_backend, this->_pins.blue, this->_pwm_frequency);
+  if(red < 0 || green < 0 || blue < 0)
+  {
+    return;
+  }
+  this->_channels = {
+    static_cast<uint8_t>(red),
+    static_cast<uint8_t>(green),
+    static_cast<uint8_t>(blue)
+  };
+  this->_attached = true;
+  this->setCommonAnodeEnable(this->_common_anode);
+  PwmOut.setCurrent(this->_channels.red, this->_current);
+  PwmOut.setCurrent(this->_channels.green, this->_current);
+  PwmOut.setCurrent(this->_channels.blue, this->_current);
+  this->showColor(COLOR_BLACK);
 }
 
 void LedStripRGB::setCommonAnodeEnable(bool enabled)
 {
   this->_common_anode = enabled;
+  if(this->_attached)
+  {
+    PwmOut.setInverted(this->_channels.red, enabled);
+    PwmOut.setInverted(this->_channels.green, enabled);
+    PwmOut.setInverted(this->_channels.blue, enabled);
+  }
+}
+
+/**
+ * Set the PWM frequency used for the RGB LEDs of the strip.
+ * @param frequency Frequency in Hz
+ */
+void LedStripRGB::setPwmFrequency(uint16_t frequency)
+{
+  this->_pwm_frequency = constrain(frequency, PWM_MIN_FREQUENCY, PWM_MAX_FREQUENCY);
+  if(this->_attached)
+  {
+    PwmOut.setFrequency(this->_channels.red, this->_pwm_frequency);
+    PwmOut.setFrequency(this->_channels.green, this->_pwm_frequency);
+    PwmOut.setFrequency(this->_channels.blue, this->_pwm_frequency);
+  }
+}
+
+uint16_t LedStripRGB::getPwmFrequency(void)
+{
+  return this->_pwm_frequency;
+}
+
+/**
+ * Set the current model of the strip used by the power limiter of the output
+ * stage, the same current is used for each one of the RGB channels.
+ * @param current Current drawn by one meter of a channel at full duty in mA
+ * @param length Length of the strip in cm
+ */
+void LedStripRGB::setCurrentModel(uint16_t current, uint16_t length)
+{
+  this->_current = ((uint32_t) current * length) / 100;
+  if(this->_attached)
+  {
+    PwmOut.setCurrent(this->_channels.red, this->_current);
+    PwmOut.setCurrent(this->_channels.green, this->_current);
+    PwmOut.setCurrent(this->_channels.blue, this->_current);
+  }
 }
 
 void LedStripRGB::turnOn(void)
@@ -174,18 +235,7 @@ void LedStripRGB::turnOff(void)
 {
   if(this->_state)
   {
-    if (this->_common_anode)
-    {
-      digitalWrite(this->_pins.red, HIGH);
-      digitalWrite(this->_pins.green, HIGH);
-      digitalWrite(this->_pins.blue, HIGH);
-    }
-    else
-    {
-      digitalWrite(this->_pins.red, LOW);
-      digitalWrite(this->_pins.green, LOW);
-      digitalWrite(this->_pins.blue, LOW);
-    }
+    this->showColor(COLOR_BLACK);
     this->_state = false;
   }
 }
@@ -223,11 +273,30 @@ uint32_t LedStripRGB::getColor(void)
   return this->_color;
 }
 
+/**
+ * Set the color shown in the Audio mode, it is rendered instead of the color
+ * of the strip, which is kept (it is the one restored when the mode changes).
+ */
+void LedStripRGB::setAudioColor(uint32_t color)
+{
+  this->_audio_color = color;
+}
+
+uint32_t LedStripRGB::getAudioColor(void)
+{
+  return this->_audio_color;
+}
+
 RGBColor LedStripRGB::getRGBColor(void)
 {
   return this->hex2rgb(this->_color);
 }
 
+RGBColor LedStripRGB::getChannels(void)
+{
+  return this->_channels;
+}
+
 void LedStripRGB::setMode(LedStripRgbMode mode)
 {
   this->_mode = mode;
@@ -238,6 +307,33 @@ LedStripRgbMode LedStripRGB::getMode(void)
   return this->_mode;
 }
 
+/**
+ * It allows to obtain the name of a mode, as shown to the user (for example
+ * the effects of Home Assistant).
+ */
+const char *LedStripRGB::modeName(LedStripRgbMode mode)
+{
+  return mode < RGB_MODE_COUNT ? RGB_MODE_NAMES[mode] : "";
+}
+
+/**
+ * Parse the name of a mode, the case is ignored and the value may continue
+ * after the name (for example "fade\r\n").
+ * @return  false if the name is unknown
+ */
+bool LedStripRGB::parseMode(const char *name, LedStripRgbMode &mode)
+{
+  for(uint8_t i = 0; i < RGB_MODE_COUNT; i++)
+  {
+    if(strncasecmp(name, RGB_MODE_NAMES[i], strlen(RGB_MODE_NAMES[i])) == 0)
+    {
+      mode = (LedStripRgbMode) i;
+      return true;
+    }
+  }
+  return false;
+}
+
 LedStripRgbMode LedStripRGB::nextMode(void)
 {
   switch (this->_mode) {
@@ -256,25 +352,117 @@ LedStripRgbMode LedStripRGB::nextMode(void)
     default:
       this->_mode = LedStripRgbMode::NORMAL;
   }
-  this->_strobe_state = false;
-  this->_flash_counter = 0;
-  this->_fade_counter = 0;
-  this->_fade_iteration = 0;
+  this->_clock.reset(SystemClock.millis64());
   return this->_mode;
 }
 
 uint16_t LedStripRGB::getSpeed(void)
 {
-  return this->_speed;
+  return this->_clock.getSpeed();
 }
 
+/**
+ * Set the speed of the Flash and Fade modes, the effect continues from the
+ * same position with the new speed.
+ * @param speed Knob value (0-1023), 0 is the slowest
+ */
 void LedStripRGB::setSpeed(uint16_t speed)
 {
-  this->_speed = constrain(speed, 0, 1024);
+  this->_clock.setSpeed(speed);
+}
+
+/**
+ * Set the speed of the Flash and Fade modes in cycles per minute (a cycle is
+ * the whole sequence of colors).
+ * @param cpm Hundredths of cycles per minute (100-24000)
+ */
+void LedStripRGB::setCyclesPerMinute(uint16_t cpm)
+{
+  this->_clock.setCyclesPerMinute(cpm);
+}
+
+uint16_t LedStripRGB::getCyclesPerMinute(void)
+{
+  return this->_clock.getCyclesPerMinute();
+}
+
+/**
+ * Set the master brightness of the strip, it is applied over the effect and
+ * the notifications.
+ */
+void LedStripRGB::setBrightness(uint8_t brightness)
+{
+  this->_compositor.setBrightness(brightness);
+}
+
+uint8_t LedStripRGB::getBrightness(void)
+{
+  return this->_compositor.getBrightness();
+}
+
+/**
+ * Blink a color over the current effect, the effect continues when the
+ * notification ends. It is shown even if the strip is turned off.
+ * @param color Color of the notification
+ * @param count Number of blinks, 0 to blink until clearNotification()
+ * @param mode Blend mode of the color over the effect
+ * @param alpha Opacity of the color (0-255)
+ */
+void LedStripRGB::notify(uint32_t color, uint8_t count, LedBlendMode mode, uint8_t alpha)
+{
+  this->_compositor.setOverlay(color, count, mode, alpha, SystemClock.millis64());
+}
+
+void LedStripRGB::clearNotification(void)
+{
+  this->_compositor.clearOverlay();
+}
+
+/**
+ * Load a user defined effect, it is shown in the PROGRAM mode.
+ * @param program Bytecode of the effect (see EffectVM)
+ * @param size Size of the program in bytes
+ * @return  false if the program is not valid, the previous one is kept
+ */
+bool LedStripRGB::loadProgram(const uint8_t *program, uint16_t size)
+{
+  this->_cache.invalidate();
+  return this->_program.load(program, size);
+}
+
+bool LedStripRGB::hasProgram(void)
+{
+  return this->_program.isLoaded();
+}
+
+/**
+ * Enable the cache of the program, the periodic programs are rendered once
+ * per period into a table and the frames are interpolated from it.
+ * @param enabled false to run the program on each frame
+ * @param resolution Time between the entries of the table in ms
+ */
+void LedStripRGB::setProgramCache(bool enabled, uint16_t resolution)
+{
+  this->_cache_enabled = enabled;
+  this->_cache.setResolution(resolution);
+}
+
+/**
+ * Color of the frame of the program.
+ */
+uint32_t LedStripRGB::program(void)
+{
+  uint64_t time = SystemClock.millis64();
+  if(this->_cache_enabled)
+  {
+    return this->_cache.run(this->_program, time, this->_color, this->_clock.getSpeed());
+  }
+  return this->_program.run(time, this->_color, this->_clock.getSpeed());
 }
 
 void LedStripRGB::loop(void)
 {
+  this->updateStrobe();
   if(this->_state)
   {
     switch (this->_mode) {
@@ -290,8 +478,15 @@ void LedStripRGB::loop(void)
       case LedStripRgbMode::FADE:
         this->fade();
         break;
+      case LedStripRgbMode::AUDIO:
+        this->showColor(this->_audio_color);
+        break;
+      case LedStripRgbMode::PROGRAM:
+        this->showColor(this->program());
+        break;
       default:
         this->showColor(this->_color);
     }
   }
+  this->present();
 }
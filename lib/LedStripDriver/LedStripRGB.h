@@ -8,6 +8,14 @@
 
 #include <inttypes.h>
 #include "LedStrip.h"
+#include "PwmOutput.h"
+#include "PwmNativeBackend.h"
+#include "LedCompositor.h"
+#include "EffectVM.h"
+#include "EffectCache.h"
+#include "EffectClock.h"
+#include "MonotonicClock.h"
+#include "StrobeEngine.h"
 #include "RGBColors.h"
 
 #ifndef LED_STRIP_RGB_H_
@@ -18,41 +26,58 @@ enum LedStripRgbMode
   NORMAL,
   STROBE,
   FLASH,
-  FADE
+  FADE,
+  AUDIO,
+  PROGRAM
 };
 
-#define STROBE_DELAY 200
-#define FLASH_DELAY 400
-#define FADE_DELAY 5
+#define RGB_MODE_COUNT 6
 
 class LedStripRGB
 {
   private:
+    PwmBackend *_backend = &PwmNative;
     RGBColor _pins;
+    RGBColor _channels = { 0, 0, 0 };
+    bool _attached = false;
+    uint16_t _pwm_frequency = PWM_DEFAULT_FREQUENCY;
+    uint16_t _current = 0;
     bool _state;
     uint32_t _color;
-    uint16_t _speed;
+    uint32_t _audio_color = COLOR_BLACK;
 
     LedStripRgbMode _mode = LedStripRgbMode::NORMAL;
-    uint32_t _last_sequence_time = 0;
-    bool _strobe_state = false;
-    uint32_t _flash_counter = 0;
-    uint32_t _fade_counter = 0;
-    uint32_t _fade_iteration = 0;
+    bool _strobe_attached = false;
+    EffectClock _clock;
+
+    LedCompositor _compositor;
+    RGBColor _base = { 0, 0, 0 };
+
+    EffectVM _program;
+    EffectCache _cache;
+    bool _cache_enabled = true;
 
     bool _common_anode = false;
 
     RGBColor hex2rgb(uint32_t);
+    void writeColor(RGBColor);
+    void present(void);
     void showColor(uint32_t);
 
+    void updateStrobe(void);
     void strobe(void);
     void flash(void);
     void fade(void);
+    uint32_t program(void);
 
   public:
     LedStripRGB(RGBColor pins);
+    LedStripRGB(PwmBackend *backend, RGBColor outputs);
     void setup(void);
     void setCommonAnodeEnable(bool);
+    void setPwmFrequency(uint16_t);
+    uint16_t getPwmFrequency(void);
+    void setCurrentModel(uint16_t, uint16_t);
     void turnOn(void);
     void turnOff(void);
     LedStripState toggle(void);
@@ -60,12 +85,26 @@ class LedStripRGB
     LedStripState getState(void);
     void setColor(uint32_t);
     uint32_t getColor(void);
+    void setAudioColor(uint32_t);
+    uint32_t getAudioColor(void);
     RGBColor getRGBColor(void);
+    RGBColor getChannels(void);
     void setMode(LedStripRgbMode);
     LedStripRgbMode getMode(void);
     LedStripRgbMode nextMode(void);
+    static const char *modeName(LedStripRgbMode);
+    static bool parseMode(const char*, LedStripRgbMode&);
     void setSpeed(uint16_t);
     uint16_t getSpeed(void);
+    void setCyclesPerMinute(uint16_t);
+    uint16_t getCyclesPerMinute(void);
+    void setBrightness(uint8_t);
+    uint8_t getBrightness(void);
+    void notify(uint32_t, uint8_t, LedBlendMode = LedBlendMode::ALPHA, uint8_t = 255);
+    void clearNotification(void);
+    bool loadProgram(const uint8_t*, uint16_t);
+    bool hasProgram(void);
+    void setProgramCache(bool, uint16_t = EFFECT_CACHE_RESOLUTION);
     void loop(void);
 };
 
@@ -0,0 +1,232 @@
+/*
+ * LedTimeline.cpp
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include "LedTimeline.h"
+#include <Arduino.h>
+
+LedTimeline::LedTimeline(LedZones *zones)
+{
+  this->_zones = zones;
+}
+
+/**
+ * Read the next events of the file into the free space of the buffer.
+ */
+void LedTimeline::fill(void)
+{
+  while(this->_count < TIMELINE_BUFFER_SIZE && this->_next_record < this->_records)
+  {
+    uint8_t tail = (this->_head + this->_count) % TIMELINE_BUFFER_SIZE;
+    uint32_t n = TIMELINE_BUFFER_SIZE - this->_count;
+    n = min(n, (uint32_t) (TIMELINE_BUFFER_SIZE - tail));
+    n = min(n, this->_records - this->_next_record);
+    size_t size = n * sizeof(TimelineEvent);
+    if(this->_file.read((uint8_t*) &this->_buffer[tail], size) != size)
+    {
+      // Truncated file, the show ends here
+      this->_records = this->_next_record;
+      return;
+    }
+    this->_count += n;
+    this->_next_record += n;
+  }
+}
+
+/**
+ * Discard the buffer and continue reading from an event of the file.
+ */
+void LedTimeline::rewind(uint32_t record)
+{
+  this->_file.seek(TIMELINE_HEADER_SIZE + record * sizeof(TimelineEvent), SeekSet);
+  this->_next_record = record;
+  this->_head = 0;
+  this->_count = 0;
+}
+
+/**
+ * Open a show of the file system, the show is stopped.
+ * @param path File of the show
+ * @return  false if the file does not exist or is not a timeline
+ */
+bool LedTimeline::open(const char *path)
+{
+  this->close();
+  this->_file = SPIFFS.open(path, "r");
+  if(!this->_file)
+  {
+    return false;
+  }
+  uint8_t header[TIMELINE_HEADER_SIZE];
+  if(this->_file.read(header, TIMELINE_HEADER_SIZE) != TIMELINE_HEADER_SIZE ||
+    header[0] != TIMELINE_MAGIC_0 || header[1] != TIMELINE_MAGIC_1 ||
+    header[2] != TIMELINE_VERSION)
+  {
+    this->_file.close();
+    return false;
+  }
+  this->_duration = header[4] | (header[5] << 8) | ((uint32_t) header[6] << 16) | ((uint32_t) header[7] << 24);
+  this->_records = (this->_file.size() - TIMELINE_HEADER_SIZE) / sizeof(TimelineEvent);
+  this->rewind(0);
+  this->_open = true;
+  return true;
+}
+
+void LedTimeline::close(void)
+{
+  if(this->_open)
+  {
+    this->_file.close();
+  }
+  this->_open = false;
+  this->_playing = false;
+  this->_records = 0;
+  this->_count = 0;
+}
+
+bool LedTimeline::isOpen(void)
+{
+  return this->_open;
+}
+
+/**
+ * Play the show from the beginning.
+ * @param start Time (SystemClock ms) of the start of the show, it can be in the
+ *        future so several devices start the same show at the same time
+ */
+void LedTimeline::play(uint64_t start)
+{
+  if(!this->_open)
+  {
+    return;
+  }
+  this->rewind(0);
+  this->_start = start;
+  this->_playing = true;
+}
+
+void LedTimeline::stop(void)
+{
+  this->_playing = false;
+}
+
+bool LedTimeline::isPlaying(void)
+{
+  return this->_playing;
+}
+
+/**
+ * When enabled the show starts again at the end of its duration.
+ */
+void LedTimeline::setLoop(bool enabled)
+{
+  this->_loop = enabled;
+}
+
+bool LedTimeline::getLoop(void)
+{
+  return this->_loop;
+}
+
+uint32_t LedTimeline::getDuration(void)
+{
+  return this->_duration;
+}
+
+/**
+ * It allows to obtain the position of the show.
+ * @param now Current time (SystemClock ms)
+ * @return  The position in ms, 0 before the start
+ */
+uint32_t LedTimeline::getPosition(uint64_t now)
+{
+  return this->_playing && now > this->_start ? now - this->_start : 0;
+}
+
+/**
+ * Continue the show from a position, the events before it are skipped.
+ * @param position Position in ms
+ * @param now Current time (SystemClock ms)
+ */
+void LedTimeline::seek(uint32_t position, uint64_t now)
+{
+  if(!this->_open)
+  {
+    return;
+  }
+  // First event at or after the position
+  uint32_t low = 0;
+  uint32_t high = this->_records;
+  while(low < high)
+  {
+    uint32_t middle = (low + high) / 2;
+    uint32_t time = 0;
+    this->_file.seek(TIMELINE_HEADER_SIZE + middle * sizeof(TimelineEvent), SeekSet);
+    this->_file.read((uint8_t*) &time, sizeof(time));
+    if(time < position)
+    {
+      low = middle + 1;
+    }
+    else
+    {
+      high = middle;
+    }
+  }
+  this->rewind(low);
+  this->_start = now - position;
+  this->_playing = true;
+}
+
+/**
+ * Apply the events due, it should be called on each loop.
+ * @param now Current time (SystemClock ms)
+ */
+void LedTimeline::loop(uint64_t now)
+{
+  if(!this->_playing)
+  {
+    return;
+  }
+  if(now < this->_start)
+  {
+    return;
+  }
+  uint64_t elapsed = now - this->_start;
+  while(true)
+  {
+    if(this->_count <= TIMELINE_BUFFER_SIZE / 2)
+    {
+      this->fill();
+    }
+    if(this->_count == 0)
+    {
+      if(elapsed < this->_duration)
+      {
+        return;
+      }
+      if(!this->_loop || this->_duration == 0)
+      {
+        this->_playing = false;
+        return;
+      }
+      // After a stall the whole periods missed are skipped, only the events
+      // of the current period up to the position are applied
+      uint64_t skipped = elapsed - elapsed % this->_duration;
+      this->_start += skipped;
+      elapsed -= skipped;
+      this->rewind(0);
+      continue;
+    }
+    TimelineEvent &event = this->_buffer[this->_head];
+    if(event.time > elapsed)
+    {
+      return;
+    }
+    this->_zones->apply(event.zones, event.action, event.value);
+    this->_head = (this->_head + 1) % TIMELINE_BUFFER_SIZE;
+    this->_count--;
+  }
+}
@@ -0,0 +1,79 @@
+/*
+ * LedTimeline.h
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+
+#include <inttypes.h>
+#include <FS.h>
+#include "LedZones.h"
+
+#ifndef LED_TIMELINE_H_
+#define LED_TIMELINE_H_
+
+#define TIMELINE_MAGIC_0 'T'
+#define TIMELINE_MAGIC_1 'L'
+#define TIMELINE_VERSION 1
+#define TIMELINE_HEADER_SIZE 8
+#define TIMELINE_BUFFER_SIZE 16
+
+/**
+ * Event of the timeline as stored in the file (little endian, 12 bytes).
+ */
+struct TimelineEvent
+{
+  uint32_t time;      // ms since the start of the show
+  uint8_t zones;      // mask of zones
+  uint8_t action;     // LedZoneAction
+  uint16_t reserved;
+  uint32_t value;
+} __attribute__((packed));
+
+/**
+ * LedTimeline plays a show stored in the file system. The file is a header
+ * ("TL", the version, a reserved byte and the duration of the show in ms) and
+ * the events sorted by time. The events are read in chunks into a small ring
+ * buffer, which is filled again when half of it was played, so the shows can
+ * be as long as the file system allows with constant memory.
+ *
+ * Since the events have a fixed size, seek() finds the position with a binary
+ * search in the file. The events before the position are not applied.
+ */
+class LedTimeline
+{
+  private:
+    LedZones *_zones;
+    File _file;
+    bool _open = false;
+    uint32_t _records = 0;
+    uint32_t _duration = 0;
+    uint32_t _next_record = 0;
+    TimelineEvent _buffer[TIMELINE_BUFFER_SIZE];
+    uint8_t _head = 0;
+    uint8_t _count = 0;
+    uint64_t _start = 0;
+    bool _playing = false;
+    bool _loop = false;
+
+    void fill(void);
+    void rewind(uint32_t);
+
+  public:
+    LedTimeline(LedZones *zones);
+    bool open(const char*);
+    void close(void);
+    bool isOpen(void);
+    void play(uint64_t);
+    void stop(void);
+    bool isPlaying(void);
+    void setLoop(bool);
+    bool getLoop(void);
+    uint32_t getDuration(void);
+    uint32_t getPosition(uint64_t);
+    void seek(uint32_t, uint64_t);
+    void loop(uint64_t);
+};
+
+#endif /* LED_TIMELINE_H_ */
@@ -0,0 +1,179 @@
+/*
+ * LedZones.cpp
+ * Created by Jose Rivera, Jul 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include "LedZones.h"
+#include <Arduino.h>
+
+/**
+ * Add a zone.
+ * @param rgb RGB led strip of the zone
+ * @param white White led strip of the zone, NULL if the zone has no white leds
+ * @return  The number of the zone or -1 when there are no free zones
+ */
+int8_t LedZones::add(LedStripRGB *rgb, LedStrip *white)
+{
+  if(this->_count >= LED_MAX_ZONES)
+  {
+    return -1;
+  }
+  this->_zones[this->_count] = { rgb, white };
+  return this->_count++;
+}
+
+uint8_t LedZones::count(void)
+{
+  return this->_count;
+}
+
+/**
+ * It allows to obtain the mask of all the zones.
+ */
+uint8_t LedZones::all(void)
+{
+  return (1 << this->_count) - 1;
+}
+
+LedStripRGB *LedZones::rgb(uint8_t zone)
+{
+  return zone < this->_count ? this->_zones[zone].rgb : NULL;
+}
+
+LedStrip *LedZones::white(uint8_t zone)
+{
+  return zone < this->_count ? this->_zones[zone].white : NULL;
+}
+
+/**
+ * It allows to obtain the first zone of a mask, zone 0 if the mask is empty.
+ */
+uint8_t LedZones::first(uint8_t mask)
+{
+  for(uint8_t i = 0; i < this->_count; i++)
+  {
+    if(mask & (1 << i))
+    {
+      return i;
+    }
+  }
+  return 0;
+}
+
+/**
+ * Parse a list of zones, "all" or the numbers of the zones separated by comma
+ * (for example "0" or "1,3"). The zones not added are ignored.
+ * @return  The mask of the zones, 0 if no valid zone was found or the list is
+ *          not valid (not a number or a zone over LED_MAX_ZONES)
+ */
+uint8_t LedZones::parseMask(const char *zones)
+{
+  if(strcmp(zones, "all") == 0)
+  {
+    return this->all();
+  }
+  uint8_t mask = 0;
+  while(true)
+  {
+    if(*zones < '0' || *zones > '9')
+    {
+      return 0;
+    }
+    char *end;
+    unsigned long zone = strtoul(zones, &end, 10);
+    if(zone >= LED_MAX_ZONES)
+    {
+      return 0;
+    }
+    if(zone < this->_count)
+    {
+      mask |= 1 << zone;
+    }
+    if(*end == '\0')
+    {
+      return mask;
+    }
+    if(*end != ',')
+    {
+      return 0;
+    }
+    zones = end + 1;
+  }
+}
+
+/**
+ * Apply a change to the zones of the mask.
+ * @param zones Mask of zones
+ * @param action LedZoneAction
+ * @param value Value of the action
+ */
+void LedZones::apply(uint8_t zones, uint8_t action, uint32_t value)
+{
+  for(uint8_t i = 0; i < this->_count; i++)
+  {
+    if(!(zones & (1 << i)))
+    {
+      continue;
+    }
+    LedStripRGB *rgb = this->_zones[i].rgb;
+    LedStrip *white = this->_zones[i].white;
+    switch (action) {
+      case ZONE_RGB_STATE:
+        rgb->setState(value ? LedStripState::ON : LedStripState::OFF);
+        break;
+      case ZONE_RGB_MODE:
+        rgb->setMode((LedStripRgbMode) value);
+        rgb->turnOn();
+        break;
+      case ZONE_RGB_COLOR:
+        rgb->setColor(value);
+        break;
+      case ZONE_RGB_SPEED:
+        rgb->setSpeed(value);
+        break;
+      case ZONE_BRIGHTNESS:
+        rgb->setBrightness(value);
+        break;
+      case ZONE_WHITE:
+        if(white && value == 0)
+        {
+          white->turnOff();
+        }
+        else if(white)
+        {
+          white->setIntensity(value);
+          white->turnOn();
+        }
+        break;
+    }
+  }
+}
+
+/**
+ * Setup the strips of all the zones.
+ */
+void LedZones::setup(void)
+{
+  for(uint8_t i = 0; i < this->_count; i++)
+  {
+    if(this->_zones[i].white)
+    {
+      this->_zones[i].white->setup();
+    }
+    this->_zones[i].rgb->setup();
+  }
+}
+
+/**
+ * Render the effects of all the zones and commit the frame.
+ */
+void LedZones::loop(void)
+{
+  for(uint8_t i = 0; i < this->_count; i++)
+  {
+    this->_zones[i].rgb->loop();
+  }
+  PwmOut.commit();
+}
@@ -0,0 +1,65 @@
+/*
+ * LedZones.h
+ * Created by Jose Rivera, Jul 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+
+#include <inttypes.h>
+#include "LedStrip.h"
+#include "LedStripRGB.h"
+
+#ifndef LED_ZONES_H_
+#define LED_ZONES_H_
+
+#define LED_MAX_ZONES 8
+
+/**
+ * Changes that can be applied to a set of zones (by the shows and schedules).
+ */
+enum LedZoneAction
+{
+  ZONE_RGB_STATE = 0,   // 0 off, 1 on
+  ZONE_RGB_MODE = 1,    // LedStripRgbMode, turns on the strip
+  ZONE_RGB_COLOR = 2,   // 0xRRGGBB
+  ZONE_RGB_SPEED = 3,   // 0-1024
+  ZONE_BRIGHTNESS = 4,  // 0-255
+  ZONE_WHITE = 5        // intensity 0-255, 0 turns off the strip
+};
+
+/**
+ * A zone is a RGB led strip with an optional strip of white light.
+ */
+struct LedZone
+{
+  LedStripRGB *rgb;
+  LedStrip *white;
+};
+
+/**
+ * LedZones owns the zones driven by the controller. In each loop the effects
+ * of all the zones are rendered in a single pass into the frame of the output
+ * stage, and the frame is committed to the PWM backends together.
+ * The zones are addressed with a bit mask (bit 0 is the zone 0).
+ */
+class LedZones
+{
+  private:
+    LedZone _zones[LED_MAX_ZONES];
+    uint8_t _count = 0;
+
+  public:
+    int8_t add(LedStripRGB*, LedStrip*);
+    uint8_t count(void);
+    uint8_t all(void);
+    LedStripRGB *rgb(uint8_t);
+    LedStrip *white(uint8_t);
+    uint8_t first(uint8_t);
+    uint8_t parseMask(const char*);
+    void apply(uint8_t, uint8_t, uint32_t);
+    void setup(void);
+    void loop(void);
+};
+
+#endif /* LED_ZONES_H_ */
@@ -0,0 +1,32 @@
+/*
+ * PwmBackend.h
+ * Created by Jose Rivera, Jul 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+
+#include <inttypes.h>
+
+#ifndef PWM_BACKEND_H_
+#define PWM_BACKEND_H_
+
+/**
+ * PwmBackend is the interface of the devices that generate the PWM signals
+ * for the output stage. The writes of a frame are staged with write() and sent
+ * to the device together with flush().
+ */
+class PwmBackend
+{
+  public:
+    virtual ~PwmBackend(void) {}
+    virtual void begin(void) = 0;
+    virtual void attach(uint8_t output) = 0;
+    virtual uint8_t getOutputCount(void) = 0;
+    virtual void setFrequency(uint8_t output, uint16_t frequency) = 0;
+    virtual void write(uint8_t output, uint8_t duty, uint8_t phase) = 0;
+    virtual void flush(void) = 0;
+    virtual uint32_t getWriteCount(void) = 0;
+};
+
+#endif /* PWM_BACKEND_H_ */
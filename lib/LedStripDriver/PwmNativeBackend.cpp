@@ -0,0 +1,319 @@
+/*
+ * PwmNativeBackend.cpp
+ * Created by Jose Rivera, Jul 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include "PwmNativeBackend.h"
+#include "PwmOutput.h"
+#include <Arduino.h>
+
+#if defined(ESP8266)
+#include <core_version.h>
+#include <core_esp8266_waveform.h>
+#endif
+
+PwmNativeBackend PwmNative;
+
+PwmNativeBackend::PwmNativeBackend(void)
+{
+  for(uint8_t i = 0; i < PWM_NATIVE_OUTPUTS; i++)
+  {
+    this->_frequency[i] = PWM_DEFAULT_FREQUENCY;
+    this->_high[i] = 0;
+    this->_low[i] = 0;
+    this->_phase[i] = 0;
+  }
+}
+
+/**
+ * Select the waveforms that can be aligned to another pin.
+ */
+void PwmNativeBackend::begin(void)
+{
+#if defined(ESP8266) && ARDUINO_ESP8266_MAJOR >= 3
+  enablePhaseLockedWaveform();
+#endif
+}
+
+void PwmNativeBackend::attach(uint8_t pin)
+{
+  pinMode(pin, OUTPUT);
+  digitalWrite(pin, LOW);
+}
+
+uint8_t PwmNativeBackend::getOutputCount(void)
+{
+  return PWM_NATIVE_OUTPUTS;
+}
+
+/**
+ * Set the frequency of the pin, the waveform is stopped and started again on
+ * the next write so it is aligned with the new period.
+ */
+void PwmNativeBackend::setFrequency(uint8_t pin, uint16_t frequency)
+{
+  if(pin >= PWM_NATIVE_OUTPUTS)
+  {
+    return;
+  }
+  if(this->_frequency[pin] != frequency)
+  {
+    this->_frequency[pin] = frequency;
+#if defined(ESP8266)
+    if(this->_running & (1UL << pin))
+    {
+      stopWaveform(pin);
+      this->_running &= ~(1UL << pin);
+    }
+#endif
+  }
+}
+
+void PwmNativeBackend::write(uint8_t pin, uint8_t duty, uint8_t phase)
+{
+  if(pin >= PWM_NATIVE_OUTPUTS)
+  {
+    return;
+  }
+  this->_writes++;
+#if defined(ESP8266)
+  uint32_t mask = 1UL << pin;
+  uint32_t period = 1000000UL / this->_frequency[pin];
+  this->_high[pin] = (period * duty) / 255;
+  this->_low[pin] = period - this->_high[pin];
+  if(phase != this->_phase[pin] && (this->_running & mask))
+  {
+    // Aligned again with the new phase
+    stopWaveform(pin);
+    this->_running &= ~mask;
+  }
+  this->_phase[pin] = phase;
+  if(this->_gate_mask & mask)
+  {
+    this->showGated(pin);
+    return;
+  }
+  this->output(pin);
+#else
+  analogWrite(pin, duty);
+#endif
+}
+
+/**
+ * The pins are updated on each write, there is nothing to send.
+ */
+void PwmNativeBackend::flush(void)
+{
+}
+
+uint32_t PwmNativeBackend::getWriteCount(void)
+{
+  return this->_writes;
+}
+
+/**
+ * It allows to obtain a running pin with the same frequency, to align the
+ * waveform of the pin to it.
+ * @return  The pin or -1 if there is none
+ */
+int8_t PwmNativeBackend::reference(uint8_t pin)
+{
+  for(uint8_t i = 0; i < PWM_NATIVE_OUTPUTS; i++)
+  {
+    if(i != pin && (this->_running & (1UL << i)) && this->_frequency[i] == this->_frequency[pin])
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/**
+ * Show the last duty written to the pin, the duties 0 and 255 are constant
+ * levels. It must not be called from an interrupt or with the interrupts
+ * disabled, the waveforms of the core wait for their timer.
+ */
+void PwmNativeBackend::output(uint8_t pin)
+{
+#if defined(ESP8266)
+  uint32_t mask = 1UL << pin;
+  if(this->_high[pin] == 0 || this->_low[pin] == 0)
+  {
+    stopWaveform(pin);
+    digitalWrite(pin, this->_high[pin] == 0 ? LOW : HIGH);
+    this->_running &= ~mask;
+    return;
+  }
+#if ARDUINO_ESP8266_MAJOR >= 3
+  int8_t align = (this->_running & mask) ? -1 : this->reference(pin);
+  if(align >= 0)
+  {
+    uint32_t period = this->_high[pin] + this->_low[pin];
+    uint8_t phase = this->_phase[pin] - this->_phase[align];
+    startWaveform(pin, this->_high[pin], this->_low[pin], 0, align, (period * phase) >> 8);
+  }
+  else
+  {
+    startWaveform(pin, this->_high[pin], this->_low[pin], 0);
+  }
+#else
+  startWaveform(pin, this->_high[pin], this->_low[pin], 0);
+#endif
+  this->_running |= mask;
+#endif
+}
+
+/**
+ * Keep the level of a gated pin while the gate is open, on if its duty is not
+ * 0 (255 for the idle high pins). It must be called with the interrupts
+ * disabled.
+ */
+void PwmNativeBackend::light(uint8_t pin)
+{
+  uint32_t mask = 1UL << pin;
+  bool lit = (this->_gate_idle & mask) ? this->_low[pin] > 0 : this->_high[pin] > 0;
+  if(lit)
+  {
+    this->_gate_lit |= mask;
+  }
+  else
+  {
+    this->_gate_lit &= ~mask;
+  }
+}
+
+/**
+ * Show the last duty written to a gated pin. A constant level (the duties 0
+ * and 255) is set by the interrupt, any other duty keeps its waveform, which
+ * runs while the gate is open.
+ */
+void PwmNativeBackend::showGated(uint8_t pin)
+{
+  uint32_t mask = 1UL << pin;
+  bool pwm = this->_high[pin] > 0 && this->_low[pin] > 0;
+#if defined(ESP8266)
+  if(!pwm && (this->_running & mask))
+  {
+    stopWaveform(pin);
+    this->_running &= ~mask;
+  }
+#endif
+  noInterrupts();
+  if(pwm)
+  {
+    this->_gate_pwm |= mask;
+  }
+  else
+  {
+    this->_gate_pwm &= ~mask;
+  }
+  this->_gate_mask |= mask;
+  this->light(pin);
+  this->gate(this->_gate_open);
+  interrupts();
+  if(pwm)
+  {
+    this->follow(pin, true);
+  }
+}
+
+/**
+ * Start the waveform of a gated pin in PWM while the gate is open, stop it at
+ * the idle level while it is closed.
+ * @param update true to write the duty to a running waveform
+ */
+void PwmNativeBackend::follow(uint8_t pin, bool update)
+{
+#if defined(ESP8266)
+  uint32_t mask = 1UL << pin;
+  bool running = (this->_running & mask) != 0;
+  if(this->_gate_open)
+  {
+    if(update || !running)
+    {
+      this->output(pin);
+    }
+  }
+  else if(running)
+  {
+    stopWaveform(pin);
+    digitalWrite(pin, (this->_gate_idle & mask) ? HIGH : LOW);
+    this->_running &= ~mask;
+  }
+#endif
+}
+
+/**
+ * Make the gated pins in PWM follow the gate, their waveforms cannot be
+ * started or stopped from the interrupt. It should be called on each loop
+ * while pins are gated.
+ */
+void PwmNativeBackend::followGate(void)
+{
+  for(uint8_t pin = 0; pin < PWM_NATIVE_GATED_OUTPUTS; pin++)
+  {
+    if(this->_gate_pwm & (1UL << pin))
+    {
+      this->follow(pin, false);
+    }
+  }
+}
+
+/**
+ * Add or remove a pin from the pins gated by the strobe. While it is gated a
+ * pin at a constant level is set by the interrupt and a pin in PWM follows
+ * the gate from the loop (followGate()).
+ * @param pin Pin of the microcontroller (0-15)
+ * @param enabled true to gate the pin
+ * @param idle_high Level of the pin while the gate is closed (HIGH for the
+ *        common anode strips)
+ */
+void PwmNativeBackend::setGate(uint8_t pin, bool enabled, bool idle_high)
+{
+  if(pin >= PWM_NATIVE_GATED_OUTPUTS)
+  {
+    return;
+  }
+  uint32_t mask = 1UL << pin;
+  noInterrupts();
+  if(idle_high)
+  {
+    this->_gate_idle |= mask;
+  }
+  else
+  {
+    this->_gate_idle &= ~mask;
+  }
+  if(!enabled)
+  {
+    this->_gate_mask &= ~mask;
+    this->_gate_pwm &= ~mask;
+  }
+  interrupts();
+  if(enabled)
+  {
+    this->showGated(pin);
+  }
+  else
+  {
+    this->output(pin);
+  }
+}
+
+/**
+ * Open or close the gate of the gated pins, it is called from the interrupt
+ * of the strobe engine so it only writes the output registers of the pins at
+ * a constant level.
+ */
+void ICACHE_RAM_ATTR PwmNativeBackend::gate(bool open)
+{
+  this->_gate_open = open;
+#if defined(ESP8266)
+  uint32_t pins = this->_gate_mask & ~this->_gate_pwm;
+  uint32_t high = open ? this->_gate_idle ^ this->_gate_lit : this->_gate_idle;
+  GPOS = high & pins;
+  GPOC = ~high & pins;
+#endif
+}
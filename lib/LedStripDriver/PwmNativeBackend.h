@@ -0,0 +1,74 @@
+/*
+ * PwmNativeBackend.h
+ * Created by Jose Rivera, Jul 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+
+#include <inttypes.h>
+#include "PwmBackend.h"
+
+#ifndef PWM_NATIVE_BACKEND_H_
+#define PWM_NATIVE_BACKEND_H_
+
+#define PWM_NATIVE_OUTPUTS 17
+// GPIO16 is not in the output registers, it cannot be gated
+#define PWM_NATIVE_GATED_OUTPUTS 16
+
+/**
+ * PwmNativeBackend generates the PWM signals on the pins of the
+ * microcontroller, the outputs are the pin numbers.
+ * On the ESP8266 each pin runs its own waveform. When the waveform of a pin
+ * is started it is aligned to a running pin of the same frequency, offset by
+ * the difference of their phases (the phase locked waveforms of the core 3.x,
+ * the older cores start it at once); the phases of pins with different
+ * frequencies are not related. A running waveform keeps its phase when the
+ * duty changes.
+ *
+ * The gated pins are turned off and on again by gate(), which is called from
+ * the interrupt of the strobe engine. The interrupt only sets or clears the
+ * pins at a constant level (the duties 0 and 255) in the output registers.
+ * The waveforms of the pins in PWM cannot be started or stopped there, they
+ * keep running and followGate() stops them while the gate is closed, from
+ * the loop: their edges follow the loop rather than the timer, but they keep
+ * their duty instead of flashing at the full level.
+ */
+class PwmNativeBackend : public PwmBackend
+{
+  private:
+    uint16_t _frequency[PWM_NATIVE_OUTPUTS];
+    uint32_t _running = 0;
+    uint32_t _writes = 0;
+    uint32_t _high[PWM_NATIVE_OUTPUTS];
+    uint32_t _low[PWM_NATIVE_OUTPUTS];
+    uint8_t _phase[PWM_NATIVE_OUTPUTS];
+    uint32_t _gate_mask = 0;
+    uint32_t _gate_idle = 0;
+    uint32_t _gate_lit = 0;
+    uint32_t _gate_pwm = 0;
+    volatile bool _gate_open = true;
+
+    int8_t reference(uint8_t);
+    void output(uint8_t);
+    void light(uint8_t);
+    void showGated(uint8_t);
+    void follow(uint8_t, bool);
+
+  public:
+    PwmNativeBackend(void);
+    void begin(void);
+    void attach(uint8_t);
+    uint8_t getOutputCount(void);
+    void setFrequency(uint8_t, uint16_t);
+    void write(uint8_t, uint8_t, uint8_t);
+    void flush(void);
+    uint32_t getWriteCount(void);
+    void setGate(uint8_t, bool, bool);
+    void gate(bool);
+    void followGate(void);
+};
+
+extern PwmNativeBackend PwmNative;
+
+#endif /* PWM_NATIVE_BACKEND_H_ */
@@ -0,0 +1,367 @@
+/*
+ * PwmOutput.cpp
+ * Created by Jose Rivera, Jul 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include "PwmOutput.h"
+#include "PwmNativeBackend.h"
+#include "MonotonicClock.h"
+#include <Arduino.h>
+
+PwmOutput PwmOut;
+
+PwmOutput::PwmOutput(void)
+{
+  for(uint8_t i = 0; i < PWM_MAX_CHANNELS; i++)
+  {
+    this->_duty[i] = 0;
+    this->_applied[i] = 0;
+    this->_phase[i] = 0;
+    this->_current[i] = 0;
+    this->_frequency[i] = PWM_DEFAULT_FREQUENCY;
+    this->_energy_since[i] = 0;
+    this->_energy_acc[i] = 0;
+    this->_energy_rest[i] = 0;
+    this->_energy[i] = 0;
+  }
+}
+
+/**
+ * Spread the start of the channels evenly over the PWM period.
+ */
+void PwmOutput::updatePhases(void)
+{
+  for(uint8_t i = 0; i < this->_channels; i++)
+  {
+    this->_phase[i] = this->_phase_stagger ? (i * 256) / this->_channels : 0;
+  }
+}
+
+/**
+ * Send the brightness level to the backend of the channel.
+ */
+void PwmOutput::apply(uint8_t channel, uint8_t level)
+{
+  uint8_t duty = (this->_inverted & (1UL << channel)) ? 255 - level : level;
+  this->_backends[channel]->write(this->_outputs[channel], duty, this->_phase[channel]);
+  this->_applied[channel] = level;
+  this->_writes++;
+}
+
+/**
+ * Send the writes staged in the backends.
+ */
+void PwmOutput::flush(void)
+{
+  for(uint8_t i = 0; i < this->_device_count; i++)
+  {
+    this->_devices[i]->flush();
+  }
+}
+
+/**
+ * Register a pin of the microcontroller as a channel of the output stage.
+ * @param pin Pin of exit towards the led strip
+ * @param frequency PWM frequency of the channel in Hz
+ * @return  The channel assigned or -1 when there are no free channels
+ */
+int8_t PwmOutput::attach(uint8_t pin, uint16_t frequency)
+{
+  return this->attach(&PwmNative, pin, frequency);
+}
+
+/**
+ * Register an output of a PWM backend as a channel of the output stage.
+ * @param backend Backend that generates the PWM signal
+ * @param output Output of the backend towards the led strip
+ * @param frequency PWM frequency of the channel in Hz
+ * @return  The channel assigned or -1 when there are no free channels
+ */
+int8_t PwmOutput::attach(PwmBackend *backend, uint8_t output, uint16_t frequency)
+{
+  for(uint8_t i = 0; i < this->_channels; i++)
+  {
+    if(this->_backends[i] == backend && this->_outputs[i] == output)
+    {
+      this->setFrequency(i, frequency);
+      return i;
+    }
+  }
+  if(this->_channels >= PWM_MAX_CHANNELS || output >= backend->getOutputCount())
+  {
+    return -1;
+  }
+  bool known = false;
+  for(uint8_t i = 0; i < this->_device_count; i++)
+  {
+    known |= this->_devices[i] == backend;
+  }
+  if(!known)
+  {
+    if(this->_device_count >= PWM_MAX_BACKENDS)
+    {
+      return -1;
+    }
+    this->_devices[this->_device_count++] = backend;
+    backend->begin();
+  }
+  uint8_t channel = this->_channels++;
+  this->_backends[channel] = backend;
+  this->_outputs[channel] = output;
+  this->_energy_since[channel] = SystemClock.millis64();
+  backend->attach(output);
+  this->updatePhases();
+  this->setFrequency(channel, frequency);
+  return channel;
+}
+
+uint8_t PwmOutput::getChannelCount(void)
+{
+  return this->_channels;
+}
+
+/**
+ * Set the PWM frequency of a channel.
+ */
+void PwmOutput::setFrequency(uint8_t channel, uint16_t frequency)
+{
+  if(channel >= this->_channels)
+  {
+    return;
+  }
+  this->_frequency[channel] = constrain(frequency, PWM_MIN_FREQUENCY, PWM_MAX_FREQUENCY);
+  this->_backends[channel]->setFrequency(this->_outputs[channel], this->_frequency[channel]);
+  this->apply(channel, this->_applied[channel]);
+  this->flush();
+}
+
+uint16_t PwmOutput::getFrequency(uint8_t channel)
+{
+  return channel < this->_channels ? this->_frequency[channel] : 0;
+}
+
+/**
+ * Enable or disable the phase offset between the channels (enabled by
+ * default).
+ */
+void PwmOutput::setPhaseStagger(bool enabled)
+{
+  this->_phase_stagger = enabled;
+  this->updatePhases();
+  for(uint8_t i = 0; i < this->_channels; i++)
+  {
+    this->apply(i, this->_applied[i]);
+  }
+  this->flush();
+}
+
+/**
+ * Allows to indicate that the channel drives a common anode led strip, the
+ * levels written to the channel are inverted when sent to the pin.
+ */
+void PwmOutput::setInverted(uint8_t channel, bool inverted)
+{
+  if(channel >= this->_channels)
+  {
+    return;
+  }
+  if(inverted)
+  {
+    this->_inverted |= 1UL << channel;
+  }
+  else
+  {
+    this->_inverted &= ~(1UL << channel);
+  }
+  this->apply(channel, this->_applied[channel]);
+  this->flush();
+}
+
+/**
+ * Set the current drawn by the channel at full duty.
+ * @param channel Channel of the output stage
+ * @param current Current in mA
+ */
+void PwmOutput::setCurrent(uint8_t channel, uint16_t current)
+{
+  if(channel < this->_channels)
+  {
+    this->_current[channel] = current;
+  }
+}
+
+uint16_t PwmOutput::getCurrent(uint8_t channel)
+{
+  return channel < this->_channels ? this->_current[channel] : 0;
+}
+
+/**
+ * Set the maximum current that the power supply can provide to the strips,
+ * zero disables the limiter.
+ * @param budget Current in mA
+ */
+void PwmOutput::setCurrentBudget(uint16_t budget)
+{
+  this->_current_budget = budget;
+}
+
+uint16_t PwmOutput::getCurrentBudget(void)
+{
+  return this->_current_budget;
+}
+
+/**
+ * It allows to obtain the current estimated for the last frame committed,
+ * before the limiter is applied.
+ * @return  The current in mA
+ */
+uint32_t PwmOutput::getCurrentEstimate(void)
+{
+  return this->_current_estimate;
+}
+
+/**
+ * It allows to know if the last frame was scaled down to fit the budget.
+ */
+bool PwmOutput::isLimiting(void)
+{
+  return this->_current_scale < 256;
+}
+
+/**
+ * Set the voltage of the power supply used to compute the power of the
+ * channels.
+ * @param voltage Voltage in mV
+ */
+void PwmOutput::setVoltage(uint16_t voltage)
+{
+  for(uint8_t i = 0; i < this->_channels; i++)
+  {
+    this->getEnergy(i);
+  }
+  this->_voltage = voltage;
+}
+
+uint16_t PwmOutput::getVoltage(void)
+{
+  return this->_voltage;
+}
+
+/**
+ * Add the time the current level was held to the accumulator of the channel.
+ */
+void PwmOutput::integrate(uint8_t channel)
+{
+  uint64_t now = SystemClock.millis64();
+  this->_energy_acc[channel] += (uint64_t) this->_applied[channel] * (now - this->_energy_since[channel]);
+  this->_energy_since[channel] = now;
+}
+
+/**
+ * It allows to obtain the energy consumed by the channel. The accumulator is
+ * converted to mWh keeping the remainder, so no energy is lost between reads.
+ * It should be read at least once a month to avoid overflows.
+ * @return  The energy in mWh
+ */
+uint32_t PwmOutput::getEnergy(uint8_t channel)
+{
+  if(channel >= this->_channels)
+  {
+    return 0;
+  }
+  // level (0-255) * uW (mA * mV) * ms -> mWh
+  const uint64_t divisor = 255ULL * 1000ULL * 3600000ULL;
+  this->integrate(channel);
+  uint64_t total = this->_energy_rest[channel] +
+    this->_energy_acc[channel] * this->_current[channel] * this->_voltage;
+  this->_energy[channel] += total / divisor;
+  this->_energy_rest[channel] = total % divisor;
+  this->_energy_acc[channel] = 0;
+  return this->_energy[channel];
+}
+
+/**
+ * Set the energy counter of the channel, for example to restore the value
+ * saved before a restart.
+ * @param energy Energy in mWh
+ */
+void PwmOutput::setEnergy(uint8_t channel, uint32_t energy)
+{
+  if(channel < this->_channels)
+  {
+    this->integrate(channel);
+    this->_energy_acc[channel] = 0;
+    this->_energy_rest[channel] = 0;
+    this->_energy[channel] = energy;
+  }
+}
+
+/**
+ * Set the duty of a channel in the current frame, the pin is updated on the
+ * next commit().
+ */
+void PwmOutput::write(uint8_t channel, uint8_t duty)
+{
+  if(channel < this->_channels)
+  {
+    this->_duty[channel] = duty;
+  }
+}
+
+uint8_t PwmOutput::read(uint8_t channel)
+{
+  return channel < this->_channels ? this->_duty[channel] : 0;
+}
+
+/**
+ * Send the frame to the backends, only the channels that changed are written.
+ * The frame is scaled down (8 bits fixed point) when its estimated current
+ * exceeds the budget.
+ */
+void PwmOutput::commit(void)
+{
+  this->_commits++;
+  uint32_t load = 0;
+  for(uint8_t i = 0; i < this->_channels; i++)
+  {
+    load += (uint32_t) this->_duty[i] * this->_current[i];
+  }
+  this->_current_estimate = load / 255;
+
+  uint32_t limit = (uint32_t) this->_current_budget * 255;
+  this->_current_scale = 256;
+  if(this->_current_budget > 0 && load > limit)
+  {
+    this->_current_scale = (limit << 8) / load;
+  }
+
+  for(uint8_t i = 0; i < this->_channels; i++)
+  {
+    uint8_t level = (this->_duty[i] * this->_current_scale) >> 8;
+    if(level != this->_applied[i])
+    {
+      this->integrate(i);
+      this->apply(i, level);
+    }
+  }
+  this->flush();
+}
+
+/**
+ * It allows to obtain the number of levels written to the backends, the
+ * channels whose level did not change in a frame are not written.
+ */
+uint32_t PwmOutput::getWriteCount(void)
+{
+  return this->_writes;
+}
+
+/**
+ * It allows to obtain the number of frames committed.
+ */
+uint32_t PwmOutput::getCommitCount(void)
+{
+  return this->_commits;
+}
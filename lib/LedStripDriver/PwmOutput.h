@@ -0,0 +1,102 @@
+/*
+ * PwmOutput.h
+ * Created by Jose Rivera, Jul 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+
+#include <inttypes.h>
+#include "PwmBackend.h"
+
+#ifndef PWM_OUTPUT_H_
+#define PWM_OUTPUT_H_
+
+#define PWM_MAX_CHANNELS 20
+#define PWM_MAX_BACKENDS 4
+#define PWM_DEFAULT_FREQUENCY 1000
+#define PWM_MIN_FREQUENCY 100
+#define PWM_MAX_FREQUENCY 20000
+#define PWM_DEFAULT_VOLTAGE 12000
+
+/**
+ * PwmOutput is the output stage shared by all the led strips. The strips write
+ * the duty of each one of their channels in a frame and the frame is sent to
+ * the PWM backends once per loop with commit(), only for the channels that
+ * changed. Each channel is an output of a backend (a pin of the
+ * microcontroller or a channel of a PWM expander).
+ *
+ * Each channel has its own PWM frequency and, when the phase stagger is
+ * enabled, the channels start at evenly spaced instants of the PWM period so
+ * they do not all turn on at the same time (this reduces the in-rush peaks on
+ * the power supply).
+ *
+ * When a current budget is set, the current drawn by each frame is estimated
+ * from the current of each channel at full duty and, if the frame exceeds the
+ * budget, all the channels are scaled down by the same factor.
+ *
+ * The energy of each channel is integrated from the level sent to the pin,
+ * the time it was held and the power of the channel (current at full duty by
+ * the supply voltage). The integration is done only when the level changes or
+ * when the energy is read, so unchanged frames do not add any cost.
+ */
+class PwmOutput
+{
+  private:
+    PwmBackend *_backends[PWM_MAX_CHANNELS];
+    uint8_t _outputs[PWM_MAX_CHANNELS];
+    PwmBackend *_devices[PWM_MAX_BACKENDS];
+    uint8_t _device_count = 0;
+    uint16_t _frequency[PWM_MAX_CHANNELS];
+    uint8_t _phase[PWM_MAX_CHANNELS];
+    uint8_t _duty[PWM_MAX_CHANNELS];
+    uint8_t _applied[PWM_MAX_CHANNELS];
+    uint16_t _current[PWM_MAX_CHANNELS];
+    uint8_t _channels = 0;
+    uint32_t _inverted = 0;
+    uint16_t _current_budget = 0;
+    uint32_t _current_estimate = 0;
+    uint16_t _current_scale = 256;
+    uint16_t _voltage = PWM_DEFAULT_VOLTAGE;
+    uint64_t _energy_since[PWM_MAX_CHANNELS];
+    uint64_t _energy_acc[PWM_MAX_CHANNELS];
+    uint64_t _energy_rest[PWM_MAX_CHANNELS];
+    uint32_t _energy[PWM_MAX_CHANNELS];
+    bool _phase_stagger = true;
+    uint32_t _writes = 0;
+    uint32_t _commits = 0;
+
+    void updatePhases(void);
+    void apply(uint8_t, uint8_t);
+    void integrate(uint8_t);
+    void flush(void);
+
+  public:
+    PwmOutput(void);
+    int8_t attach(uint8_t, uint16_t);
+    int8_t attach(PwmBackend*, uint8_t, uint16_t);
+    uint8_t getChannelCount(void);
+    void setFrequency(uint8_t, uint16_t);
+    uint16_t getFrequency(uint8_t);
+    void setPhaseStagger(bool);
+    void setInverted(uint8_t, bool);
+    void setCurrent(uint8_t, uint16_t);
+    uint16_t getCurrent(uint8_t);
+    void setCurrentBudget(uint16_t);
+    uint16_t getCurrentBudget(void);
+    uint32_t getCurrentEstimate(void);
+    bool isLimiting(void);
+    void setVoltage(uint16_t);
+    uint16_t getVoltage(void);
+    uint32_t getEnergy(uint8_t);
+    void setEnergy(uint8_t, uint32_t);
+    void write(uint8_t, uint8_t);
+    uint8_t read(uint8_t);
+    void commit(void);
+    uint32_t getWriteCount(void);
+    uint32_t getCommitCount(void);
+};
+
+extern PwmOutput PwmOut;
+
+#endif /* PWM_OUTPUT_H_ */
@@ -0,0 +1,168 @@
+/*
+ * PwmPCA9685Backend.cpp
+ * Created by Jose Rivera, Jul 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include "PwmPCA9685Backend.h"
+#include <Arduino.h>
+#include <Wire.h>
+
+/**
+ * Constructor of the class.
+ * @param address I2C address of the expander
+ */
+PwmPCA9685Backend::PwmPCA9685Backend(uint8_t address)
+{
+  this->_address = address;
+  for(uint8_t i = 0; i < PCA9685_OUTPUTS; i++)
+  {
+    this->_registers[i * 4] = 0;
+    this->_registers[i * 4 + 1] = 0;
+    this->_registers[i * 4 + 2] = 0;
+    this->_registers[i * 4 + 3] = PCA9685_FULL;
+  }
+}
+
+void PwmPCA9685Backend::writeRegister(uint8_t reg, uint8_t value)
+{
+  Wire.beginTransmission(this->_address);
+  Wire.write(reg);
+  Wire.write(value);
+  Wire.endTransmission();
+  this->_transactions++;
+}
+
+/**
+ * The prescaler can only be written while the oscillator is stopped.
+ */
+void PwmPCA9685Backend::writePrescale(void)
+{
+  this->writeRegister(PCA9685_MODE1, PCA9685_MODE1_AI | PCA9685_MODE1_SLEEP);
+  this->writeRegister(PCA9685_PRE_SCALE, this->_prescale);
+  this->writeRegister(PCA9685_MODE1, PCA9685_MODE1_AI);
+  delayMicroseconds(500);
+  this->writeRegister(PCA9685_MODE1, PCA9685_MODE1_AI | PCA9685_MODE1_RESTART);
+  this->_prescale_changed = false;
+}
+
+/**
+ * Enable the auto increment and the totem pole outputs. Wire.begin() must be
+ * called before.
+ */
+void PwmPCA9685Backend::begin(void)
+{
+  this->writeRegister(PCA9685_MODE2, PCA9685_MODE2_OUTDRV);
+  if(this->_prescale != 0)
+  {
+    this->writePrescale();
+  }
+  else
+  {
+    this->writeRegister(PCA9685_MODE1, PCA9685_MODE1_AI);
+  }
+  this->_first_dirty = 0;
+  this->_last_dirty = PCA9685_OUTPUTS - 1;
+  this->flush();
+}
+
+void PwmPCA9685Backend::attach(uint8_t output)
+{
+}
+
+uint8_t PwmPCA9685Backend::getOutputCount(void)
+{
+  return PCA9685_OUTPUTS;
+}
+
+/**
+ * Set the frequency of the expander (shared by all the outputs), it is sent
+ * on the next flush.
+ */
+void PwmPCA9685Backend::setFrequency(uint8_t output, uint16_t frequency)
+{
+  uint32_t prescale = (PCA9685_OSCILLATOR + 2048UL * frequency) / (4096UL * frequency) - 1;
+  prescale = constrain(prescale, 3, 255);
+  if(prescale != this->_prescale)
+  {
+    this->_prescale = prescale;
+    this->_prescale_changed = true;
+  }
+}
+
+/**
+ * Stage the ON and OFF counters of the output, the duty (0-255) is scaled to
+ * the 12 bits of the expander and the output turns on at the phase offset.
+ */
+void PwmPCA9685Backend::write(uint8_t output, uint8_t duty, uint8_t phase)
+{
+  if(output >= PCA9685_OUTPUTS)
+  {
+    return;
+  }
+  uint16_t on = phase << 4;
+  uint16_t off = (on + (duty << 4) + (duty >> 4)) & 0x0FFF;
+  uint8_t *reg = &this->_registers[output * 4];
+  reg[0] = on & 0xFF;
+  reg[1] = on >> 8;
+  reg[2] = off & 0xFF;
+  reg[3] = off >> 8;
+  if(duty == 0)
+  {
+    reg[3] = PCA9685_FULL;
+  }
+  else if(duty == 255)
+  {
+    reg[1] = PCA9685_FULL;
+    reg[3] = 0;
+  }
+  if(this->_first_dirty < 0 || output < this->_first_dirty)
+  {
+    this->_first_dirty = output;
+  }
+  if(output > this->_last_dirty)
+  {
+    this->_last_dirty = output;
+  }
+  this->_writes++;
+}
+
+/**
+ * Send the registers of the outputs between the first and the last output
+ * written in a single transaction.
+ */
+void PwmPCA9685Backend::flush(void)
+{
+  if(this->_prescale_changed)
+  {
+    this->writePrescale();
+  }
+  if(this->_first_dirty < 0)
+  {
+    return;
+  }
+  Wire.beginTransmission(this->_address);
+  Wire.write(PCA9685_LED0_ON_L + this->_first_dirty * 4);
+  for(uint8_t i = this->_first_dirty * 4; i < (this->_last_dirty + 1) * 4; i++)
+  {
+    Wire.write(this->_registers[i]);
+  }
+  Wire.endTransmission();
+  this->_transactions++;
+  this->_first_dirty = -1;
+  this->_last_dirty = -1;
+}
+
+uint32_t PwmPCA9685Backend::getWriteCount(void)
+{
+  return this->_writes;
+}
+
+/**
+ * It allows to obtain the number of I2C transactions sent to the expander.
+ */
+uint32_t PwmPCA9685Backend::getTransactionCount(void)
+{
+  return this->_transactions;
+}
@@ -0,0 +1,67 @@
+/*
+ * PwmPCA9685Backend.h
+ * Created by Jose Rivera, Jul 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+
+#include <inttypes.h>
+#include "PwmBackend.h"
+
+#ifndef PWM_PCA9685_BACKEND_H_
+#define PWM_PCA9685_BACKEND_H_
+
+#define PCA9685_DEFAULT_ADDRESS 0x40
+#define PCA9685_OUTPUTS 16
+#define PCA9685_OSCILLATOR 25000000UL
+
+#define PCA9685_MODE1 0x00
+#define PCA9685_MODE2 0x01
+#define PCA9685_LED0_ON_L 0x06
+#define PCA9685_PRE_SCALE 0xFE
+
+#define PCA9685_MODE1_RESTART 0x80
+#define PCA9685_MODE1_AI 0x20
+#define PCA9685_MODE1_SLEEP 0x10
+#define PCA9685_MODE2_OUTDRV 0x04
+#define PCA9685_FULL 0x10
+
+/**
+ * PwmPCA9685Backend generates the PWM signals with a PCA9685 16 channel I2C
+ * expander, the outputs are the channels of the expander (0-15).
+ * The registers of the outputs written in a frame are sent in a single I2C
+ * transaction using the auto increment of the register address (65 bytes at
+ * most, the Wire buffer of the ESP8266 has 128 bytes). The phase
+ * offset is set with the ON time of each output.
+ * The PCA9685 has one prescaler, so all its outputs share the last frequency
+ * set (24 - 1526 Hz).
+ */
+class PwmPCA9685Backend : public PwmBackend
+{
+  private:
+    uint8_t _address;
+    uint8_t _prescale = 0;
+    bool _prescale_changed = false;
+    uint8_t _registers[PCA9685_OUTPUTS * 4];
+    int8_t _first_dirty = -1;
+    int8_t _last_dirty = -1;
+    uint32_t _writes = 0;
+    uint32_t _transactions = 0;
+
+    void writeRegister(uint8_t, uint8_t);
+    void writePrescale(void);
+
+  public:
+    PwmPCA9685Backend(uint8_t address = PCA9685_DEFAULT_ADDRESS);
+    void begin(void);
+    void attach(uint8_t);
+    uint8_t getOutputCount(void);
+    void setFrequency(uint8_t, uint16_t);
+    void write(uint8_t, uint8_t, uint8_t);
+    void flush(void);
+    uint32_t getWriteCount(void);
+    uint32_t getTransactionCount(void);
+};
+
+#endif /* PWM_PCA9685_BACKEND_H_ */
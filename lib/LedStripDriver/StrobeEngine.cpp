@@ -0,0 +1,181 @@
+/*
+ * StrobeEngine.cpp
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include "StrobeEngine.h"
+#include "PwmNativeBackend.h"
+#include <Arduino.h>
+
+// Minimum time in CPU cycles to program the next edge
+#define STROBE_MIN_CYCLES 200
+
+StrobeEngine Strobe;
+
+/**
+ * Interrupt of timer0 on each edge. With the duty 0 or 255 there are no
+ * edges, the level is kept and the interrupt comes once per period.
+ */
+void ICACHE_RAM_ATTR StrobeEngine::tick(void)
+{
+#if defined(ESP8266)
+  uint32_t now = ESP.getCycleCount();
+  uint32_t late = now - Strobe._next;
+  if(late > Strobe._jitter)
+  {
+    Strobe._jitter = late;
+  }
+  uint32_t on = Strobe._on_cycles;
+  uint32_t off = Strobe._off_cycles;
+  bool open;
+  if(on == 0 || off == 0)
+  {
+    open = on != 0;
+    Strobe._next += on + off;
+  }
+  else
+  {
+    open = !Strobe._open;
+    Strobe._next += open ? on : off;
+  }
+  Strobe._open = open;
+  PwmNative.gate(open);
+  if((int32_t) (Strobe._next - ESP.getCycleCount()) < STROBE_MIN_CYCLES)
+  {
+    // Too late (for example while writing the flash), start again from now
+    Strobe._next = ESP.getCycleCount() + STROBE_MIN_CYCLES;
+  }
+  timer0_write(Strobe._next);
+#endif
+}
+
+/**
+ * Compute the length of the edges, the change is applied from the next edge.
+ */
+void StrobeEngine::update(void)
+{
+  uint32_t period = ((uint64_t) F_CPU * 100) / this->_frequency;
+  uint32_t on = ((uint64_t) period * this->_duty) / 255;
+  noInterrupts();
+  this->_on_cycles = on;
+  this->_off_cycles = period - on;
+  interrupts();
+}
+
+/**
+ * Allow the engine to use timer0.
+ */
+void StrobeEngine::begin(void)
+{
+#if defined(ESP8266)
+  this->_timer = true;
+  this->update();
+#endif
+}
+
+/**
+ * Attach a native pin to the engine, it is turned on and off by the timer.
+ * @param pin Pin of the microcontroller (0-15)
+ * @param idle_high Level of the pin when it is off
+ * @return  false if the timer is not available, the strip must follow isOn()
+ */
+bool StrobeEngine::attach(uint8_t pin, bool idle_high)
+{
+#if defined(ESP8266)
+  if(!this->_timer || pin >= PWM_NATIVE_GATED_OUTPUTS)
+  {
+    return false;
+  }
+  PwmNative.setGate(pin, true, idle_high);
+  if(this->_pins == 0)
+  {
+    this->_open = this->_on_cycles != 0;
+    PwmNative.gate(this->_open);
+    this->_next = ESP.getCycleCount() + (this->_open ? this->_on_cycles : this->_off_cycles);
+    timer0_isr_init();
+    timer0_attachInterrupt(StrobeEngine::tick);
+    timer0_write(this->_next);
+  }
+  this->_pins |= 1UL << pin;
+  return true;
+#else
+  return false;
+#endif
+}
+
+void StrobeEngine::detach(uint8_t pin)
+{
+#if defined(ESP8266)
+  if(!(this->_pins & (1UL << pin)))
+  {
+    return;
+  }
+  this->_pins &= ~(1UL << pin);
+  if(this->_pins == 0)
+  {
+    timer0_detachInterrupt();
+  }
+  PwmNative.setGate(pin, false, false);
+#endif
+}
+
+/**
+ * Set the frequency of the strobe.
+ * @param frequency Frequency in hundredths of Hz (50-3000)
+ */
+void StrobeEngine::setFrequency(uint16_t frequency)
+{
+  this->_frequency = constrain(frequency, STROBE_MIN_FREQUENCY, STROBE_MAX_FREQUENCY);
+  this->update();
+}
+
+uint16_t StrobeEngine::getFrequency(void)
+{
+  return this->_frequency;
+}
+
+/**
+ * Set the part of the period the strips are on.
+ * @param duty Duty cycle (0-255)
+ */
+void StrobeEngine::setDuty(uint8_t duty)
+{
+  this->_duty = duty;
+  this->update();
+}
+
+uint8_t StrobeEngine::getDuty(void)
+{
+  return this->_duty;
+}
+
+/**
+ * It allows to know if the strips are on at a time, for the strips that are
+ * not driven by the timer.
+ * @param now Time in us
+ */
+bool StrobeEngine::isOn(uint64_t now)
+{
+  uint32_t period = 100000000UL / this->_frequency;
+  return (now % period) < ((uint64_t) period * this->_duty) / 255;
+}
+
+/**
+ * It allows to obtain the maximum delay of the edges since the last reset.
+ * @return  The delay in us
+ */
+uint32_t StrobeEngine::getJitter(void)
+{
+#if defined(ESP8266)
+  return this->_jitter / (F_CPU / 1000000);
+#else
+  return 0;
+#endif
+}
+
+void StrobeEngine::resetJitter(void)
+{
+  this->_jitter = 0;
+}
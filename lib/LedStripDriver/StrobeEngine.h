@@ -0,0 +1,64 @@
+/*
+ * StrobeEngine.h
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+
+#include <inttypes.h>
+
+#ifndef STROBE_ENGINE_H_
+#define STROBE_ENGINE_H_
+
+// Frequencies in hundredths of Hz (0.5 Hz to 30 Hz)
+#define STROBE_MIN_FREQUENCY 50
+#define STROBE_MAX_FREQUENCY 3000
+#define STROBE_DEFAULT_FREQUENCY 250
+#define STROBE_DEFAULT_DUTY 128
+
+/**
+ * StrobeEngine turns the strips in Strobe mode on and off at a frequency
+ * and duty cycle (0-255) independent of the loop.
+ *
+ * On the ESP8266 the edges are scheduled with timer0 in CPU cycles (timer1
+ * is used by the PWM waveforms), each edge is programmed from the previous
+ * one so the period does not drift, and the interrupt opens or closes the
+ * gate of the native pins attached. The delay of the interrupts against the
+ * scheduled edges is measured (getJitter()).
+ *
+ * timer0 is only used after begin(), when it is not available or the strip
+ * is not on the native pins, the strips follow isOn() on each loop.
+ */
+class StrobeEngine
+{
+  private:
+    uint16_t _frequency = STROBE_DEFAULT_FREQUENCY;
+    uint8_t _duty = STROBE_DEFAULT_DUTY;
+    bool _timer = false;
+    uint32_t _pins = 0;
+    volatile bool _open = true;
+    volatile uint32_t _next = 0;
+    volatile uint32_t _on_cycles = 0;
+    volatile uint32_t _off_cycles = 0;
+    volatile uint32_t _jitter = 0;
+
+    static void tick(void);
+    void update(void);
+
+  public:
+    void begin(void);
+    bool attach(uint8_t, bool);
+    void detach(uint8_t);
+    void setFrequency(uint16_t);
+    uint16_t getFrequency(void);
+    void setDuty(uint8_t);
+    uint8_t getDuty(void);
+    bool isOn(uint64_t);
+    uint32_t getJitter(void);
+    void resetJitter(void);
+};
+
+extern StrobeEngine Strobe;
+
+#endif /* STROBE_ENGINE_H_ */
@@ -0,0 +1,14 @@
+/*
+ * TimeSource.cpp
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include "TimeSource.h"
+#include <time.h>
+
+uint32_t SntpTimeSource::now(void)
+{
+  return time(nullptr);
+}
@@ -0,0 +1,72 @@
+/*
+ * TimeSource.h
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+
+#include <inttypes.h>
+
+#ifndef TIME_SOURCE_H_
+#define TIME_SOURCE_H_
+
+// Times before this (Jan 2018) mean that the clock was not synchronized yet
+#define TIME_VALID_EPOCH 1514764800UL
+
+/**
+ * Source of the wall clock time used by the scheduler.
+ */
+class TimeSource
+{
+  public:
+    /**
+     * It allows to obtain the current time.
+     * @return  The UTC time in seconds since the epoch
+     */
+    virtual uint32_t now(void) = 0;
+
+    /**
+     * It allows to know if the time was synchronized.
+     */
+    virtual bool isValid(void)
+    {
+      return this->now() >= TIME_VALID_EPOCH;
+    }
+};
+
+/**
+ * Time of the system clock, synchronized with SNTP by configTime().
+ */
+class SntpTimeSource : public TimeSource
+{
+  public:
+    uint32_t now(void);
+};
+
+/**
+ * Clock set by hand, for example to try the schedules at any time.
+ */
+class FakeTimeSource : public TimeSource
+{
+  private:
+    uint32_t _now = 0;
+
+  public:
+    uint32_t now(void)
+    {
+      return this->_now;
+    }
+
+    void set(uint32_t now)
+    {
+      this->_now = now;
+    }
+
+    void advance(uint32_t seconds)
+    {
+      this->_now += seconds;
+    }
+};
+
+#endif /* TIME_SOURCE_H_ */
@@ -0,0 +1,57 @@
+/*
+ * MonotonicClock.cpp
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include "MonotonicClock.h"
+#include <Arduino.h>
+
+MonotonicClock SystemClock;
+
+/**
+ * It allows to obtain the time since the start of the clock. It can be called
+ * with the interrupts disabled, their level is restored.
+ * @return  The time in us
+ */
+uint64_t MonotonicClock::micros64(void)
+{
+#if defined(ESP8266)
+  uint32_t ps = xt_rsil(15);
+#else
+  noInterrupts();
+#endif
+  uint32_t now = micros();
+  if(now < this->_last)
+  {
+    this->_rollovers++;
+  }
+  this->_last = now;
+  uint64_t time = ((uint64_t) this->_rollovers << 32) | now;
+#if defined(ESP8266)
+  xt_wsr_ps(ps);
+#else
+  interrupts();
+#endif
+  return time + this->_offset;
+}
+
+/**
+ * It allows to obtain the time since the start of the clock.
+ * @return  The time in ms
+ */
+uint64_t MonotonicClock::millis64(void)
+{
+  return this->micros64() / 1000;
+}
+
+/**
+ * Set the current time of the clock.
+ * @param start Time in ms
+ */
+void MonotonicClock::setStart(uint64_t start)
+{
+  this->_offset = 0;
+  this->_offset = start * 1000 - this->micros64();
+}
@@ -0,0 +1,38 @@
+/*
+ * MonotonicClock.h
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+
+#include <inttypes.h>
+
+#ifndef MONOTONIC_CLOCK_H_
+#define MONOTONIC_CLOCK_H_
+
+/**
+ * MonotonicClock extends micros() to 64 bits, counting its rollovers (each
+ * 71 minutes), so the time does not wrap and the intervals can be compared
+ * with a simple subtraction. It must be read at least once per rollover, the
+ * loop reads it many times per second.
+ *
+ * The clock can start at any value with setStart(), for example just before
+ * the 49.7 days rollover of millis() to check the timing code.
+ */
+class MonotonicClock
+{
+  private:
+    uint32_t _last = 0;
+    uint32_t _rollovers = 0;
+    uint64_t _offset = 0;
+
+  public:
+    uint64_t micros64(void);
+    uint64_t millis64(void);
+    void setStart(uint64_t);
+};
+
+extern MonotonicClock SystemClock;
+
+#endif /* MONOTONIC_CLOCK_H_ */
@@ -0,0 +1,141 @@
+/*
+ * MqttSession.cpp
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include "MqttSession.h"
+
+MqttSession::MqttSession(PubSubClient *client, ConnectionMonitor *monitor)
+{
+  this->_client = client;
+  this->_monitor = monitor;
+}
+
+/**
+ * Set the identity of the controller.
+ * @param client_id Client id, the same on each connection
+ * @param topic Topic of the controller, it is read again on each connection
+ * @param group Group of the controller, empty for none
+ * @param restore true to wait for the retained desired state
+ */
+void MqttSession::begin(const String &client_id, const char *topic, const char *group, bool restore)
+{
+  this->_client_id = client_id;
+  this->_topic = topic;
+  this->_group = group;
+  this->_restored = !restore;
+}
+
+/**
+ * Topic of the controller, {topic}{suffix}.
+ */
+String MqttSession::getTopic(const char *suffix)
+{
+  return String(this->_topic) + suffix;
+}
+
+/**
+ * The group and broadcast topics share the dispatch of the commands of the
+ * controller, one message controls all the controllers subscribed.
+ */
+void MqttSession::subscribeGroups(void)
+{
+  this->_client->subscribe(MQTT_SESSION_BROADCAST_TOPIC "/cmnd/#", 1);
+  if(this->_group.length() > 0)
+  {
+    String groupTopic = String(MQTT_SESSION_GROUP_TOPIC) + this->_group + "/cmnd/#";
+    this->_client->subscribe(groupTopic.c_str(), 1);
+  }
+}
+
+/**
+ * Connect to the broker, it should be called when the monitor allows an
+ * attempt. The subscriptions are kept by the broker, they are renewed in case
+ * the session was lost.
+ * @param now Current time in ms
+ * @return  true if connected
+ */
+bool MqttSession::connect(uint64_t now)
+{
+  String lwtTopic = this->getTopic("/tele/LWT");
+  if(!this->_client->connect(this->_client_id.c_str(), NULL, NULL, lwtTopic.c_str(), 1, true, "OFFLINE", false))
+  {
+    this->_monitor->failed(now);
+    return false;
+  }
+  this->_monitor->connected(now);
+  this->_client->publish(lwtTopic.c_str(), "ONLINE", true);
+  this->_client->subscribe(this->getTopic("/cmnd/#").c_str(), 1);
+  this->subscribeGroups();
+  if(!this->_restored)
+  {
+    this->_client->subscribe(this->getTopic("/stat/DESIRED").c_str());
+    this->_restore_start = now;
+  }
+  return true;
+}
+
+/**
+ * Change the group of the controller, the session is persistent so the
+ * subscription of the previous group is removed.
+ * @param group Group, empty for none
+ */
+void MqttSession::setGroup(const char *group)
+{
+  bool connected = this->_client->connected();
+  if(connected && this->_group.length() > 0)
+  {
+    String groupTopic = String(MQTT_SESSION_GROUP_TOPIC) + this->_group + "/cmnd/#";
+    this->_client->unsubscribe(groupTopic.c_str());
+  }
+  this->_group = group;
+  if(connected)
+  {
+    this->subscribeGroups();
+  }
+}
+
+/**
+ * It allows to know if the desired state was restored or is not awaited.
+ */
+bool MqttSession::isRestored(void)
+{
+  return this->_restored;
+}
+
+/**
+ * It allows to know if a message is the desired state awaited, it must be
+ * applied and restored() called.
+ */
+bool MqttSession::isRestoreMessage(const char *topic)
+{
+  return !this->_restored && this->getTopic("/stat/DESIRED") == topic;
+}
+
+/**
+ * Stop waiting for the desired state.
+ */
+void MqttSession::restored(void)
+{
+  this->_restored = true;
+  this->_client->unsubscribe(this->getTopic("/stat/DESIRED").c_str());
+}
+
+/**
+ * Stop waiting for the desired state when nothing is retained, the state of
+ * the boot is kept.
+ * @param now Current time in ms
+ * @return  true once, when the timeout expires
+ */
+bool MqttSession::restoreExpired(uint64_t now)
+{
+  if(this->_restored || !this->_client->connected() ||
+    now - this->_restore_start <= MQTT_SESSION_RESTORE_TIMEOUT)
+  {
+    return false;
+  }
+  this->restored();
+  return true;
+}
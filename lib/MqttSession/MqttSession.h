@@ -0,0 +1,60 @@
+/*
+ * MqttSession.h
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+
+#include <inttypes.h>
+#include <WString.h>
+#include <PubSubClient.h>
+#include "ConnectionMonitor.h"
+
+#ifndef MQTT_SESSION_H_
+#define MQTT_SESSION_H_
+
+// Time to wait for the retained desired state after the first connection
+#define MQTT_SESSION_RESTORE_TIMEOUT 3000
+// Commands received by all the controllers ({prefix}/cmnd/...) and by the
+// controllers of a group ({prefix}{group}/cmnd/...)
+#define MQTT_SESSION_BROADCAST_TOPIC "all"
+#define MQTT_SESSION_GROUP_TOPIC "group/"
+
+/**
+ * MqttSession keeps the session of the controller with the broker. The
+ * client id is stable and the session is persistent (cleanSession false), so
+ * the broker keeps the subscriptions (QoS 1) and queues the commands while
+ * the controller is offline. The broker publishes OFFLINE (retained) to
+ * {topic}/tele/LWT when the connection is lost, the controller publishes
+ * ONLINE when it connects.
+ *
+ * With the restore enabled, the retained desired state ({topic}/stat/DESIRED)
+ * is awaited after the first connection, until it arrives or the timeout.
+ */
+class MqttSession
+{
+  private:
+    PubSubClient *_client;
+    ConnectionMonitor *_monitor;
+    String _client_id;
+    const char *_topic = "";
+    String _group;
+    bool _restored = true;
+    uint64_t _restore_start = 0;
+
+    void subscribeGroups(void);
+
+  public:
+    MqttSession(PubSubClient*, ConnectionMonitor*);
+    void begin(const String&, const char*, const char*, bool);
+    bool connect(uint64_t);
+    void setGroup(const char*);
+    String getTopic(const char*);
+    bool isRestored(void);
+    bool isRestoreMessage(const char*);
+    void restored(void);
+    bool restoreExpired(uint64_t);
+};
+
+#endif /* MQTT_SESSION_H_ */
@@ -0,0 +1,100 @@
+/*
+ * HeatshrinkDecoder.cpp
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include "HeatshrinkDecoder.h"
+#include <string.h>
+
+#define HS_TAG 0
+#define HS_LITERAL 1
+#define HS_INDEX 2
+#define HS_COUNT 3
+
+HeatshrinkDecoder::~HeatshrinkDecoder(void)
+{
+  this->end();
+}
+
+/**
+ * Allocate the window and start a new stream.
+ * @return  false if there is no memory for the window
+ */
+bool HeatshrinkDecoder::begin(void)
+{
+  if(this->_window == nullptr)
+  {
+    this->_window = new uint8_t[HS_WINDOW_SIZE];
+  }
+  if(this->_window == nullptr)
+  {
+    return false;
+  }
+  memset(this->_window, 0, HS_WINDOW_SIZE);
+  this->_head = 0;
+  this->_state = HS_TAG;
+  this->_needed = 1;
+  this->_count = 0;
+  this->_bits = 0;
+  return true;
+}
+
+/**
+ * Release the window.
+ */
+void HeatshrinkDecoder::end(void)
+{
+  delete[] this->_window;
+  this->_window = nullptr;
+}
+
+/**
+ * Decompress a byte of the stream.
+ * @param input Byte of the compressed stream
+ * @param output Buffer for the bytes produced (HS_MAX_OUTPUT bytes)
+ * @return  The number of bytes written to the output
+ */
+uint8_t HeatshrinkDecoder::push(uint8_t input, uint8_t *output)
+{
+  uint8_t produced = 0;
+  for(int8_t bit = 7; bit >= 0; bit--)
+  {
+    this->_bits = (this->_bits << 1) | ((input >> bit) & 1);
+    if(++this->_count < this->_needed)
+    {
+      continue;
+    }
+    uint16_t value = this->_bits;
+    this->_bits = 0;
+    this->_count = 0;
+    switch (this->_state) {
+      case HS_TAG:
+        this->_state = value ? HS_LITERAL : HS_INDEX;
+        this->_needed = value ? 8 : HS_WINDOW_BITS;
+        break;
+      case HS_LITERAL:
+        this->_window[this->_head++ & (HS_WINDOW_SIZE - 1)] = value;
+        output[produced++] = value;
+        this->_state = HS_TAG;
+        this->_needed = 1;
+        break;
+      case HS_INDEX:
+        this->_index = value;
+        this->_state = HS_COUNT;
+        this->_needed = HS_LOOKAHEAD_BITS;
+        break;
+      default:
+        for(uint16_t i = 0; i <= value; i++)
+        {
+          uint8_t byte = this->_window[(this->_head - this->_index - 1) & (HS_WINDOW_SIZE - 1)];
+          this->_window[this->_head++ & (HS_WINDOW_SIZE - 1)] = byte;
+          output[produced++] = byte;
+        }
+        this->_state = HS_TAG;
+        this->_needed = 1;
+    }
+  }
+  return produced;
+}
@@ -0,0 +1,48 @@
+/*
+ * HeatshrinkDecoder.h
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+
+#include <inttypes.h>
+
+#ifndef HEATSHRINK_DECODER_H_
+#define HEATSHRINK_DECODER_H_
+
+#define HS_WINDOW_BITS 10
+#define HS_LOOKAHEAD_BITS 5
+#define HS_WINDOW_SIZE (1 << HS_WINDOW_BITS)
+// Bytes produced by one byte of input at most (a back reference)
+#define HS_MAX_OUTPUT (1 << HS_LOOKAHEAD_BITS)
+
+/**
+ * HeatshrinkDecoder decompresses a stream compressed by heatshrink (LZSS)
+ * with a window of 2^HS_WINDOW_BITS bytes and back references of up to
+ * 2^HS_LOOKAHEAD_BITS bytes (heatshrink -e -w 10 -l 5, or tools/ota_pack.py).
+ * The stream is a sequence of bits (most significant first), 1 and a byte is
+ * a literal, 0, the distance - 1 and the length - 1 is a back reference.
+ *
+ * The input is pushed a byte at a time, each byte completes a token at most.
+ * The window is allocated by begin() and released by end().
+ */
+class HeatshrinkDecoder
+{
+  private:
+    uint8_t *_window = nullptr;
+    uint16_t _head = 0;
+    uint8_t _state = 0;
+    uint8_t _needed = 1;
+    uint8_t _count = 0;
+    uint16_t _bits = 0;
+    uint16_t _index = 0;
+
+  public:
+    ~HeatshrinkDecoder(void);
+    bool begin(void);
+    void end(void);
+    uint8_t push(uint8_t, uint8_t*);
+};
+
+#endif /* HEATSHRINK_DECODER_H_ */
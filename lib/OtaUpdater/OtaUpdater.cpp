@@ -0,0 +1,276 @@
+/*
+ * OtaUpdater.cpp
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include "OtaUpdater.h"
+#include "MonotonicClock.h"
+#include <Arduino.h>
+#include <Updater.h>
+
+/**
+ * Start the download of an image, the headers of the response are received
+ * here (at most OTA_CONNECT_TIMEOUT ms, the lights stop meanwhile) and the
+ * body on each loop.
+ * @param url URL of the image (http://)
+ * @param md5 MD5 of the firmware in hex, required for the images not
+ *        compressed (the compressed images include it)
+ * @return  false if the download could not be started
+ */
+bool OtaUpdater::begin(const String &url, const String &md5)
+{
+  if(this->_state == OTA_DOWNLOAD)
+  {
+    return false;
+  }
+  this->_error = "";
+  this->_md5[0] = '\0';
+  if(md5.length() == 32)
+  {
+    md5.toCharArray(this->_md5, sizeof(this->_md5));
+  }
+  else if(md5.length() > 0)
+  {
+    this->fail(F("Invalid MD5"));
+    return false;
+  }
+  this->_compressed = false;
+  this->_started = false;
+  this->_header_length = 0;
+  this->_size = 0;
+  this->_written = 0;
+  this->_received = 0;
+  this->_buffered = 0;
+
+  this->_http.begin(url);
+  this->_http.setTimeout(OTA_CONNECT_TIMEOUT);
+  int code = this->_http.GET();
+  if(code != HTTP_CODE_OK)
+  {
+    this->fail("HTTP " + String(code));
+    return false;
+  }
+  this->_state = OTA_DOWNLOAD;
+  this->_last_data = SystemClock.millis64();
+  return true;
+}
+
+/**
+ * Start the write of the partition once the size of the firmware is known.
+ * The firmware is only written when its MD5 is known, so it is always
+ * verified before it boots.
+ */
+bool OtaUpdater::start(void)
+{
+  if(!this->_md5[0])
+  {
+    this->fail(F("MD5 required"));
+    return false;
+  }
+  if(this->_size == 0 || !Update.begin(this->_size))
+  {
+    this->fail(this->_size == 0 ? F("Unknown size") : F("No space"));
+    return false;
+  }
+  Update.setMD5(this->_md5);
+  this->_started = true;
+  return true;
+}
+
+/**
+ * Receive a byte of the header of the image.
+ * @return  false if the image is not valid
+ */
+bool OtaUpdater::header(uint8_t byte)
+{
+  if(this->_header_length == 0 && byte == OTA_IMAGE_MAGIC)
+  {
+    // Firmware as built, the size is the one of the response
+    this->_size = this->_http.getSize() > 0 ? this->_http.getSize() : 0;
+    return this->start() && this->output(&byte, 1);
+  }
+  ((uint8_t*) &this->_header)[this->_header_length++] = byte;
+  if(this->_header_length < sizeof(this->_header))
+  {
+    return true;
+  }
+  if(memcmp(this->_header.magic, OTA_MAGIC, 4) != 0 || this->_header.version != OTA_VERSION ||
+    this->_header.window_bits != HS_WINDOW_BITS || this->_header.lookahead_bits != HS_LOOKAHEAD_BITS)
+  {
+    this->fail(F("Invalid image"));
+    return false;
+  }
+  if(!this->_decoder.begin())
+  {
+    this->fail(F("No memory"));
+    return false;
+  }
+  for(uint8_t i = 0; i < 16; i++)
+  {
+    sprintf(this->_md5 + 2 * i, "%02x", this->_header.md5[i]);
+  }
+  this->_compressed = true;
+  this->_size = this->_header.size;
+  return this->start();
+}
+
+/**
+ * Add bytes of the firmware to the buffer, it is written to the partition
+ * when it is full.
+ */
+bool OtaUpdater::output(const uint8_t *data, uint16_t length)
+{
+  // The padding of the compressed stream is discarded
+  if(this->_written + this->_buffered + length > this->_size)
+  {
+    length = this->_size - this->_written - this->_buffered;
+  }
+  while(length > 0)
+  {
+    uint16_t count = min((uint16_t) (OTA_BUFFER - this->_buffered), length);
+    memcpy(this->_buffer + this->_buffered, data, count);
+    this->_buffered += count;
+    data += count;
+    length -= count;
+    if(this->_buffered == OTA_BUFFER && !this->flush())
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool OtaUpdater::flush(void)
+{
+  if(this->_buffered == 0)
+  {
+    return true;
+  }
+  if(Update.write(this->_buffer, this->_buffered) != this->_buffered)
+  {
+    this->fail(F("Write error"));
+    return false;
+  }
+  this->_written += this->_buffered;
+  this->_buffered = 0;
+  return true;
+}
+
+/**
+ * Verify the MD5 and select the new firmware to boot.
+ */
+void OtaUpdater::finish(void)
+{
+  this->_http.end();
+  this->_decoder.end();
+  if(!Update.end())
+  {
+    this->fail(Update.getError() == UPDATE_ERROR_MD5 ? F("MD5 mismatch") : F("Verify error"));
+    return;
+  }
+  this->_state = OTA_DONE;
+}
+
+void OtaUpdater::fail(const String &error)
+{
+  this->_error = error;
+  this->_state = OTA_ERROR;
+  this->_http.end();
+  this->_decoder.end();
+  if(this->_started)
+  {
+    // The partition is not selected to boot
+    Update.end(false);
+    this->_started = false;
+  }
+}
+
+/**
+ * Stop the download in progress, the current firmware is kept.
+ */
+void OtaUpdater::abort(void)
+{
+  if(this->_state == OTA_DOWNLOAD)
+  {
+    this->fail(F("Aborted"));
+  }
+}
+
+/**
+ * Process the bytes of the download received, at most OTA_CHUNK bytes. It
+ * should be called on each loop.
+ */
+void OtaUpdater::loop(void)
+{
+  if(this->_state != OTA_DOWNLOAD)
+  {
+    return;
+  }
+  WiFiClient *stream = this->_http.getStreamPtr();
+  uint64_t now = SystemClock.millis64();
+  size_t available = stream ? stream->available() : 0;
+  if(available == 0)
+  {
+    if(!stream || !stream->connected() || now - this->_last_data > OTA_TIMEOUT)
+    {
+      this->fail(F("Connection lost"));
+    }
+    return;
+  }
+  this->_last_data = now;
+
+  uint8_t input[OTA_CHUNK];
+  size_t length = stream->read(input, min(available, (size_t) OTA_CHUNK));
+  this->_received += length;
+  uint8_t decoded[HS_MAX_OUTPUT];
+  for(size_t i = 0; i < length && this->_state == OTA_DOWNLOAD; i++)
+  {
+    if(!this->_started)
+    {
+      this->header(input[i]);
+    }
+    else if(this->_compressed)
+    {
+      this->output(decoded, this->_decoder.push(input[i], decoded));
+    }
+    else
+    {
+      this->output(input + i, length - i);
+      break;
+    }
+  }
+
+  if(this->_state == OTA_DOWNLOAD && this->_size > 0 &&
+    this->_written + this->_buffered >= this->_size && this->flush())
+  {
+    this->finish();
+  }
+}
+
+OtaState OtaUpdater::getState(void)
+{
+  return this->_state;
+}
+
+/**
+ * It allows to obtain the part of the firmware written (0-100).
+ */
+uint8_t OtaUpdater::getProgress(void)
+{
+  return this->_size == 0 ? 0 : ((uint64_t) this->_written * 100) / this->_size;
+}
+
+/**
+ * It allows to obtain the bytes downloaded (compressed).
+ */
+uint32_t OtaUpdater::getReceived(void)
+{
+  return this->_received;
+}
+
+const String &OtaUpdater::getError(void)
+{
+  return this->_error;
+}
@@ -0,0 +1,99 @@
+/*
+ * OtaUpdater.h
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+
+#include <inttypes.h>
+#include <ESP8266HTTPClient.h>
+#include "HeatshrinkDecoder.h"
+
+#ifndef OTA_UPDATER_H_
+#define OTA_UPDATER_H_
+
+// Bytes of the download processed per loop
+#define OTA_CHUNK 512
+#define OTA_BUFFER 256
+#define OTA_TIMEOUT 15000
+// Longest wait for the connection and the headers of the response, begin()
+// blocks the loop meanwhile
+#define OTA_CONNECT_TIMEOUT 2000
+#define OTA_MAGIC "HSOT"
+#define OTA_VERSION 1
+#define OTA_HEADER_SIZE 28
+// First byte of a (not compressed) firmware image
+#define OTA_IMAGE_MAGIC 0xE9
+
+enum OtaState
+{
+  OTA_IDLE,
+  OTA_DOWNLOAD,
+  OTA_DONE,
+  OTA_ERROR
+};
+
+/**
+ * Header of the compressed images (tools/ota_pack.py), little endian.
+ */
+struct OtaHeader
+{
+  char magic[4];
+  uint8_t version;
+  uint8_t window_bits;
+  uint8_t lookahead_bits;
+  uint8_t reserved;
+  uint32_t size;        // size of the firmware
+  uint8_t md5[16];      // MD5 of the firmware
+};
+
+/**
+ * OtaUpdater downloads a firmware image from an HTTP server and writes it to
+ * the update partition. The download is processed OTA_CHUNK bytes per
+ * loop(), so the effects continue while it is in progress.
+ *
+ * The image is either a firmware as built (firmware.bin, the MD5 must be given
+ * to begin(), it is rejected otherwise) or an image compressed by
+ * tools/ota_pack.py, which includes its MD5, decompressed into the partition
+ * through a window of 1 KB. The MD5 of the firmware is verified before the new
+ * firmware is selected to boot; the restart is left to the application once
+ * the state is OTA_DONE.
+ */
+class OtaUpdater
+{
+  private:
+    HTTPClient _http;
+    HeatshrinkDecoder _decoder;
+    OtaState _state = OTA_IDLE;
+    String _error;
+    char _md5[33];
+    bool _compressed = false;
+    bool _started = false;
+    OtaHeader _header;
+    uint8_t _header_length = 0;
+    uint32_t _size = 0;
+    uint32_t _written = 0;
+    uint32_t _received = 0;
+    uint8_t _buffer[OTA_BUFFER];
+    uint16_t _buffered = 0;
+    uint64_t _last_data = 0;
+
+    bool start(void);
+    bool header(uint8_t);
+    bool output(const uint8_t*, uint16_t);
+    bool flush(void);
+    void finish(void);
+    void fail(const String&);
+
+  public:
+    bool begin(const String&, const String& = "");
+    void abort(void);
+    void loop(void);
+    OtaState getState(void);
+    uint8_t getProgress(void);
+    uint32_t getReceived(void);
+    const String &getError(void);
+};
+
+#endif /* OTA_UPDATER_H_ */
@@ -6,6 +6,7 @@
  * http://creativecommons.org/licenses/by/4.0/
  */
 #include "BtnHandler.h"
+#include "MonotonicClock.h"
 #include <Arduino.h>
 
 BtnHandler::BtnHandler(uint8_t pin, void(*shortFn)(void), void(*longFn)(void))
@@ -32,9 +33,9 @@ void BtnHandler::loop(void)
     if(this->_short_pressed == false)
     {
       this->_short_pressed = true;
-      this->_last_time_pressed = millis();
+      this->_last_time_pressed = SystemClock.millis64();
     }
-    if((millis() - this->_last_time_pressed > this->_long_press_delay) && !this->_long_pressed)
+    if((SystemClock.millis64() - this->_last_time_pressed > this->_long_press_delay) && !this->_long_pressed)
     {
       this->_long_pressed = true;
       this->_long_function_pointer();
@@ -50,7 +51,7 @@ void BtnHandler::loop(void)
       }
       else
       {
-        if((millis() - this->_last_time_pressed) > this->_debounce_delay)
+        if((SystemClock.millis64() - this->_last_time_pressed) > this->_debounce_delay)
         {
           this->_short_function_pointer();
         }
@@ -62,7 +63,7 @@ void BtnHandler::loop(void)
 
 void BtnHandler::interruption(void)
 {
-  if((millis() - this->_last_time_pressed) > this->_debounce_delay)
+  if((SystemClock.millis64() - this->_last_time_pressed) > this->_debounce_delay)
   {
     this->_short_function_pointer();
   }
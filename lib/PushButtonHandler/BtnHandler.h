@@ -17,7 +17,7 @@ private:
   uint8_t _pin;
   uint32_t _debounce_delay = 100;
   uint32_t _long_press_delay = 500;
-  uint32_t _last_time_pressed = 0;
+  uint64_t _last_time_pressed = 0;
   bool _short_pressed = false;
   bool _long_pressed = false;
   uint8_t _activate_with = 1;
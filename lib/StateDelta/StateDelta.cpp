@@ -0,0 +1,153 @@
+/*
+ * StateDelta.cpp
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include "StateDelta.h"
+
+/**
+ * Constructor of the class.
+ * @param keyframe_deltas Number of deltas between two keyframes
+ */
+StateDelta::StateDelta(uint16_t keyframe_deltas)
+{
+  this->_keyframe_deltas = keyframe_deltas;
+}
+
+/**
+ * Text of a value of the state, the values are compared as printed.
+ */
+static String jsonText(JsonVariant value)
+{
+  String text;
+  value.printTo(text);
+  return text;
+}
+
+/**
+ * Add to the delta the fields of the state that differ from the base, the
+ * fields removed from the state are null.
+ * @return  true if a field changed
+ */
+bool StateDelta::diff(JsonObject &base, JsonObject &state, JsonObject &delta)
+{
+  bool changed = false;
+  for(JsonObject::iterator it = state.begin(); it != state.end(); ++it)
+  {
+    if(it->value.is<JsonObject>() && base[it->key].is<JsonObject>())
+    {
+      JsonObject &nested = delta.createNestedObject(it->key);
+      if(StateDelta::diff(base[it->key].as<JsonObject>(), it->value.as<JsonObject>(), nested))
+      {
+        changed = true;
+      }
+      else
+      {
+        delta.remove(it->key);
+      }
+    }
+    else if(!base.containsKey(it->key) || jsonText(base[it->key]) != jsonText(it->value))
+    {
+      delta[it->key] = it->value;
+      changed = true;
+    }
+  }
+  for(JsonObject::iterator it = base.begin(); it != base.end(); ++it)
+  {
+    if(!state.containsKey(it->key))
+    {
+      delta[it->key] = (const char*) NULL;
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+/**
+ * It allows to know if the next message must be a keyframe: the first one,
+ * one each STATE_KEYFRAME_DELTAS deltas or when it is requested.
+ * @param keyframe true to request a keyframe
+ */
+bool StateDelta::isKeyframeDue(bool keyframe)
+{
+  return keyframe || this->_base.length() == 0 || this->_deltas >= this->_keyframe_deltas;
+}
+
+/**
+ * Add the sequence number to the message and print it.
+ */
+void StateDelta::finish(JsonObject &message, bool keyframe, String &output)
+{
+  message["seq"] = ++this->_seq;
+  if(keyframe)
+  {
+    message["key"] = true;
+    this->_deltas = 0;
+  }
+  else
+  {
+    this->_deltas++;
+  }
+  output = "";
+  message.printTo(output);
+}
+
+/**
+ * Encode a keyframe.
+ * @param state State compared by the next deltas
+ * @param full State sent, the compared state and the fields only sent in
+ *        the keyframes
+ * @param output The message
+ * @return  false if a state is not valid JSON
+ */
+bool StateDelta::keyframe(const String &state, const String &full, String &output)
+{
+  DynamicJsonBuffer jsonBuffer;
+  JsonObject &base = jsonBuffer.parseObject(state);
+  JsonObject &message = jsonBuffer.parseObject(full);
+  if(!base.success() || !message.success())
+  {
+    return false;
+  }
+  // The base is printed from the parsed state, as the values of the deltas
+  this->_base = "";
+  base.printTo(this->_base);
+  this->finish(message, true, output);
+  return true;
+}
+
+/**
+ * Encode the fields changed since the last message.
+ * @param state State compared
+ * @param output The message
+ * @return  false if nothing changed (no message) or the state is not valid
+ */
+bool StateDelta::delta(const String &state, String &output)
+{
+  DynamicJsonBuffer jsonBuffer;
+  JsonObject &current = jsonBuffer.parseObject(state);
+  JsonObject &base = jsonBuffer.parseObject(this->_base);
+  if(!current.success() || !base.success())
+  {
+    return false;
+  }
+  JsonObject &message = jsonBuffer.createObject();
+  if(!StateDelta::diff(base, current, message))
+  {
+    return false;
+  }
+  this->_base = "";
+  current.printTo(this->_base);
+  this->finish(message, false, output);
+  return true;
+}
+
+/**
+ * It allows to obtain the sequence number of the last message.
+ */
+uint32_t StateDelta::getSeq(void)
+{
+  return this->_seq;
+}
@@ -0,0 +1,49 @@
+/*
+ * StateDelta.h
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+
+#include <inttypes.h>
+#include <WString.h>
+#include <ArduinoJson.h>
+
+#ifndef STATE_DELTA_H_
+#define STATE_DELTA_H_
+
+// A keyframe (full state) is sent after this number of deltas
+#define STATE_KEYFRAME_DELTAS 50
+
+/**
+ * StateDelta encodes the changes of a state (a JSON object) as a sequence of
+ * messages: keyframes, with the full state, and deltas, with the fields
+ * changed since the message before (nested objects are compared field by
+ * field, a field removed is null). Each message has the next sequence number
+ * ("seq") and the keyframes are marked ("key": true), so a subscriber that
+ * lost a delta waits for the next keyframe (see tools/state_replay.py).
+ *
+ * The state compared is given apart from the state of the keyframes, so the
+ * fields that change on every read are only sent in the keyframes.
+ */
+class StateDelta
+{
+  private:
+    String _base;
+    uint32_t _seq = 0;
+    uint16_t _deltas = 0;
+    uint16_t _keyframe_deltas;
+
+    void finish(JsonObject&, bool, String&);
+
+  public:
+    StateDelta(uint16_t keyframe_deltas = STATE_KEYFRAME_DELTAS);
+    static bool diff(JsonObject&, JsonObject&, JsonObject&);
+    bool isKeyframeDue(bool = false);
+    bool keyframe(const String&, const String&, String&);
+    bool delta(const String&, String&);
+    uint32_t getSeq(void);
+};
+
+#endif /* STATE_DELTA_H_ */
@@ -0,0 +1,132 @@
+/*
+ * WidgetShadow.cpp
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include "WidgetShadow.h"
+
+/**
+ * Constructor of the class.
+ * @param writer Function that writes a value to a virtual pin
+ */
+WidgetShadow::WidgetShadow(ShadowWriter writer)
+{
+  this->_writer = writer;
+}
+
+/**
+ * Size of the message that writes a value to a pin, the pin and the value
+ * are sent as text.
+ */
+uint8_t WidgetShadow::messageSize(uint8_t pin, int32_t value)
+{
+  uint8_t size = SHADOW_MESSAGE_SIZE + 1;
+  do
+  {
+    size++;
+    pin /= 10;
+  } while(pin);
+  if(value < 0)
+  {
+    size++;
+  }
+  uint32_t digits = value < 0 ? -value : value;
+  do
+  {
+    size++;
+    digits /= 10;
+  } while(digits);
+  return size;
+}
+
+/**
+ * Set the value of a pin, it is written on the next window if it changed.
+ * @param pin Virtual pin (0 - SHADOW_MAX_PINS-1)
+ * @param value Value of the widget
+ * @param now Time in ms
+ */
+void WidgetShadow::set(uint8_t pin, int32_t value, uint64_t now)
+{
+  if(pin >= SHADOW_MAX_PINS)
+  {
+    return;
+  }
+  uint32_t bit = 1UL << pin;
+  this->_requested_bytes += messageSize(pin, value);
+  if((this->_known & bit) && this->_values[pin] == value)
+  {
+    return;
+  }
+  if(!this->_dirty)
+  {
+    this->_first_change = now;
+  }
+  this->_values[pin] = value;
+  this->_known |= bit;
+  this->_dirty |= bit;
+}
+
+/**
+ * Write again all the values on the next window, for example after the
+ * connection with the server is restored.
+ */
+void WidgetShadow::invalidate(uint64_t now)
+{
+  if(!this->_dirty)
+  {
+    this->_first_change = now;
+  }
+  this->_dirty = this->_known;
+}
+
+/**
+ * Write the pins that changed when the window ends, it should be called on
+ * each loop.
+ * @param now Time in ms
+ */
+void WidgetShadow::loop(uint64_t now)
+{
+  if(this->_dirty && now - this->_first_change >= SHADOW_WINDOW)
+  {
+    for(uint8_t pin = 0; pin < SHADOW_MAX_PINS; pin++)
+    {
+      if(this->_dirty & (1UL << pin))
+      {
+        this->_writer(pin, this->_values[pin]);
+        this->_sent_bytes += messageSize(pin, this->_values[pin]);
+      }
+    }
+    this->_dirty = 0;
+  }
+  if(now - this->_rate_start >= SHADOW_RATE_INTERVAL)
+  {
+    uint32_t saved = this->getSavedBytes();
+    this->_saved_rate = ((uint64_t) (saved - this->_rate_saved) * 1000) / (now - this->_rate_start);
+    this->_rate_saved = saved;
+    this->_rate_start = now;
+  }
+}
+
+uint32_t WidgetShadow::getSentBytes(void)
+{
+  return this->_sent_bytes;
+}
+
+/**
+ * It allows to obtain the bytes that were not sent because the values did
+ * not change.
+ */
+uint32_t WidgetShadow::getSavedBytes(void)
+{
+  return this->_requested_bytes > this->_sent_bytes ? this->_requested_bytes - this->_sent_bytes : 0;
+}
+
+/**
+ * It allows to obtain the bytes per second saved in the last interval.
+ */
+uint32_t WidgetShadow::getSavedRate(void)
+{
+  return this->_saved_rate;
+}
@@ -0,0 +1,56 @@
+/*
+ * WidgetShadow.h
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+
+#include <inttypes.h>
+
+#ifndef WIDGET_SHADOW_H_
+#define WIDGET_SHADOW_H_
+
+#define SHADOW_MAX_PINS 32
+#define SHADOW_WINDOW 100
+#define SHADOW_RATE_INTERVAL 10000
+// Header of a message and "vw" command of the Blynk protocol
+#define SHADOW_MESSAGE_SIZE 8
+
+typedef void (*ShadowWriter)(uint8_t, int32_t);
+
+/**
+ * WidgetShadow keeps the last value written to each virtual pin. The values
+ * set are only written when they differ from the last one written, and the
+ * changes are written together once per coalescing window (several changes
+ * of the same pin in the window are a single write).
+ * It counts the bytes of the messages that would have been sent writing all
+ * the values set and the ones actually sent.
+ */
+class WidgetShadow
+{
+  private:
+    ShadowWriter _writer;
+    int32_t _values[SHADOW_MAX_PINS];
+    uint32_t _known = 0;
+    uint32_t _dirty = 0;
+    uint64_t _first_change = 0;
+    uint32_t _requested_bytes = 0;
+    uint32_t _sent_bytes = 0;
+    uint64_t _rate_start = 0;
+    uint32_t _rate_saved = 0;
+    uint32_t _saved_rate = 0;
+
+    static uint8_t messageSize(uint8_t, int32_t);
+
+  public:
+    WidgetShadow(ShadowWriter writer);
+    void set(uint8_t, int32_t, uint64_t);
+    void invalidate(uint64_t);
+    void loop(uint64_t);
+    uint32_t getSentBytes(void);
+    uint32_t getSavedBytes(void);
+    uint32_t getSavedRate(void);
+};
+
+#endif /* WIDGET_SHADOW_H_ */
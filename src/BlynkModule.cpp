@@ -0,0 +1,226 @@
+/*
+ * BlynkModule.cpp
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include "BlynkModule.h"
+
+#ifdef MODULE_BLYNK
+
+#include <ESP8266WiFi.h>
+#include <BlynkSimpleEsp8266.h>   //http://www.blynk.cc
+
+#include "Driver.h"
+#include "WidgetShadow.h"
+
+// Zones addressed by the Blynk widgets
+uint8_t blynk_zones = 1;
+
+void blynkWrite(uint8_t pin, int32_t value)
+{
+  Blynk.virtualWrite(pin, value);
+}
+
+// Last values written to the widgets, only the changes are sent
+WidgetShadow widgets(blynkWrite);
+
+/*
+ * The values of the widgets are written by blynkLoop(), the LEDs V4-V7 are
+ * written as values (0-255) like WidgetLED does.
+ */
+void blynkUpdate(void)
+{
+  uint8_t zone = led_zones.first(blynk_zones);
+  LedStripRGB &strip_rgb = *led_zones.rgb(zone);
+  LedStrip *strip_w = led_zones.white(zone);
+  uint64_t now = SystemClock.millis64();
+  if(strip_w && strip_w->getState() == LedStripState::ON)
+  {
+    widgets.set(V4, strip_w->getIntensity(), now);
+    widgets.set(V8, 1, now);
+  } else {
+    widgets.set(V4, 0, now);
+    widgets.set(V8, 0, now);
+  }
+  if(strip_rgb.getState() == LedStripState::ON)
+  {
+    RGBColor color = strip_rgb.getRGBColor();
+    widgets.set(V5, color.red, now);
+    widgets.set(V6, color.green, now);
+    widgets.set(V7, color.blue, now);
+    widgets.set(V2, strip_rgb.getMode() + 1, now);
+    widgets.set(V10, strip_rgb.getSpeed(), now);
+  } else {
+    widgets.set(V5, 0, now);
+    widgets.set(V6, 0, now);
+    widgets.set(V7, 0, now);
+    widgets.set(V2, 0, now);
+  }
+}
+
+BLYNK_CONNECTED()
+{
+  // The application may show other values after a reconnection
+  widgets.invalidate(SystemClock.millis64());
+}
+
+BLYNK_WRITE(V0) // zeRGBa assigned to V0
+{
+  int red = param[0].asInt();
+  int green = param[1].asInt();
+  int blue = param[2].asInt();
+
+  red = (red & 0xFF) << 16;
+  green = (green & 0xFF) << 8;
+  blue = blue & 0xFF;
+
+  uint32_t color = red + green + blue;
+  for (uint8_t i = 0; i < led_zones.count(); i++)
+  {
+    if (blynk_zones & (1 << i))
+    {
+      led_zones.rgb(i)->setColor(color);
+    }
+  }
+  publishState(SOURCE_BLYNK);
+}
+
+BLYNK_WRITE(V1) // Slider (0 - 255) to V1
+{
+  // Light intensity
+  int intensity = param[0].asInt();
+  for (uint8_t i = 0; i < led_zones.count(); i++)
+  {
+    if ((blynk_zones & (1 << i)) && led_zones.white(i))
+    {
+      led_zones.white(i)->setIntensity(intensity);
+    }
+  }
+  publishState(SOURCE_BLYNK);
+}
+
+BLYNK_WRITE(V2) // Menu [Normal, Strobe, Flash, Fade]  to V2
+{
+  // Menu option selected
+  LedStripRgbMode mode;
+  switch (param[0].asInt())
+  {
+    case 1: // Normal
+      mode = LedStripRgbMode::NORMAL;
+      break;
+    case 2: // Strobe
+      mode = LedStripRgbMode::STROBE;
+      break;
+    case 3: // Flash
+      mode = LedStripRgbMode::FLASH;
+      break;
+    case 4: // Fade
+      mode = LedStripRgbMode::FADE;
+      break;
+#ifdef AUDIO_REACTIVE
+    case 5: // Audio
+      mode = LedStripRgbMode::AUDIO;
+      break;
+#endif
+    default:
+      return;
+  }
+  for (uint8_t i = 0; i < led_zones.count(); i++)
+  {
+    if (blynk_zones & (1 << i))
+    {
+      led_zones.rgb(i)->setMode(mode);
+      led_zones.rgb(i)->turnOn();
+    }
+  }
+  publishState(SOURCE_BLYNK);
+}
+
+BLYNK_WRITE(V8) // Switch button to V8
+{
+  for (uint8_t i = 0; i < led_zones.count(); i++)
+  {
+    LedStrip *strip_w = led_zones.white(i);
+    if ((blynk_zones & (1 << i)) && strip_w)
+    {
+      if (param[0].asInt() == 0) {
+        strip_w->turnOff();
+      } else {
+        strip_w->turnOn();
+      }
+    }
+  }
+  publishState(SOURCE_BLYNK);
+}
+
+BLYNK_WRITE(V9) // Menu [Zone 0, Zone 1, ..., All] to V9
+{
+  // Zone addressed by the rest of the widgets
+  uint8_t option = param[0].asInt();
+  if (option >= 1 && option <= led_zones.count())
+  {
+    blynk_zones = 1 << (option - 1);
+  }
+  else if (option == led_zones.count() + 1)
+  {
+    blynk_zones = led_zones.all();
+  }
+  publishState(SOURCE_BLYNK);
+}
+
+BLYNK_WRITE(V10) // Slider (0 - 1023) to V10
+{
+  // Speed of the Flash and Fade modes
+  uint16_t speed = constrain(param[0].asInt(), 0, SPEED_MAX);
+  for (uint8_t i = 0; i < led_zones.count(); i++)
+  {
+    if (blynk_zones & (1 << i))
+    {
+      led_zones.rgb(i)->setSpeed(speed);
+    }
+  }
+  publishState(SOURCE_BLYNK);
+}
+
+BLYNK_WRITE(V3) // Push button to V3
+{
+  if(param.asInt())
+  {
+    btnModeShortPressed();
+  }
+}
+
+/*
+ * Counters of the bytes sent to the Blynk server and saved by the shadow of
+ * the widgets.
+ */
+void blynkAddState(JsonObject &root)
+{
+  JsonObject &blynk = root.createNestedObject("blynk");
+  blynk["sent"] = widgets.getSentBytes();
+  blynk["saved"] = widgets.getSavedBytes();
+  blynk["saved_rate"] = widgets.getSavedRate();
+}
+
+void blynkSetup(void)
+{
+  Blynk.config(blynk_token, blynk_server, atoi(blynk_port));
+  Blynk.connectWiFi(WiFi.SSID().c_str(), WiFi.psk().c_str());
+  int counter = 0;
+  do
+  {
+    Serial.print("Connecting to the Blynk Server, try number ");
+    Serial.println(++counter);
+    Blynk.connect();
+  } while(!Blynk.connected() && counter < 4);
+}
+
+void blynkLoop(void)
+{
+  Blynk.run();
+  widgets.loop(SystemClock.millis64());
+}
+
+#endif
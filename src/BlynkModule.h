@@ -0,0 +1,27 @@
+/*
+ * BlynkModule.h
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+
+#ifndef BLYNK_MODULE_H_
+#define BLYNK_MODULE_H_
+
+#include <ArduinoJson.h>
+#include "Config.h"
+
+#ifdef MODULE_BLYNK
+void blynkSetup(void);
+void blynkLoop(void);
+void blynkUpdate(void);
+void blynkAddState(JsonObject&);
+#else
+inline void blynkSetup(void) {}
+inline void blynkLoop(void) {}
+inline void blynkUpdate(void) {}
+inline void blynkAddState(JsonObject&) {}
+#endif
+
+#endif /* BLYNK_MODULE_H_ */
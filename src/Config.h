@@ -0,0 +1,79 @@
+/*
+ * Config.h
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+
+/*
+ * Options of the firmware, they can also be defined by the build environment
+ * (build_flags of platformio.ini).
+ */
+
+#ifndef CONFIG_H_
+#define CONFIG_H_
+
+/*
+ * Integrations linked into the firmware, each environment of platformio.ini
+ * selects its own (and defines MODULES_SELECTED). All of them are linked when
+ * the sketch is built without selecting any.
+ *    MODULE_WIFI_MANAGER  configuration portal (otherwise the WiFi network is
+ *                         WIFI_SSID or the last one stored by the SDK)
+ *    MODULE_MQTT          MQTT commands and telemetry
+ *    MODULE_HASS          Home Assistant discovery of the zones as lights
+ *                         (requires MODULE_MQTT)
+ *    MODULE_BLYNK         Blynk application
+ *    MODULE_OTA           firmware update from an HTTP server
+ */
+#ifndef MODULES_SELECTED
+#define MODULE_WIFI_MANAGER
+#define MODULE_MQTT
+#define MODULE_HASS
+#define MODULE_BLYNK
+#define MODULE_OTA
+#endif
+
+#if defined(MODULE_HASS) && !defined(MODULE_MQTT)
+#error "MODULE_HASS requires MODULE_MQTT"
+#endif
+
+//uncomment these lines to connect to a network without the configuration
+//portal (MODULE_WIFI_MANAGER not defined)
+//#define WIFI_SSID "ssid"
+//#define WIFI_PASSWORD "password"
+
+//uncomment this line to keep the state of the zones retained in the MQTT
+//broker ({topic}/stat/DESIRED) and restore it after a restart
+//#define MQTT_RESTORE_STATE
+
+//uncomment this line to apply the commands of the group and broadcast topics
+//after a delay of 0 to 500 ms (derived from the chip id), so the controllers
+//of a group do not turn on at the same time
+//#define MQTT_GROUP_STAGGER 500
+
+//uncomment this line to move the history of changes to the file system when
+//the ring in RAM is full (up to 1024 records of 12 bytes) while it cannot be
+//uploaded
+//#define HISTORY_FLASH 1024
+
+//uncomment this line if using a Common Anode LED
+//#define COMMON_ANODE
+
+//uncomment this line if the strips are driven by a PCA9685 PWM expander
+//#define PWM_EXPANDER
+
+//uncomment this line to drive an addressable strip (WS2812) with 60 pixels
+//#define PIXEL_STRIP 60
+
+//uncomment this line to enable the audio reactive mode (audio signal on A0,
+//it replaces the potentiometer). The samples are taken during the 50 ms wait
+//of the loop, which then spins on yield() instead of sleeping, so the loop
+//is not delayed, and the last 64 samples are analyzed once per iteration
+//#define AUDIO_REACTIVE
+
+//uncomment this line to start the clock one minute before the rollover of the
+//32 bits millis(), to check the timing code (it does not change millis())
+//#define CLOCK_START 4294907296ULL
+
+#endif /* CONFIG_H_ */
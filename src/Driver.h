@@ -0,0 +1,49 @@
+/*
+ * Driver.h
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+
+/*
+ * Interface of the core of the firmware (the strips, the zones and the
+ * commands) used by the integration modules.
+ */
+
+#include <Arduino.h>
+#include <ArduinoJson.h>          //https://github.com/bblanchon/ArduinoJson
+
+#include "Config.h"
+#include "MonotonicClock.h"
+#include "LedStrip.h"
+#include "LedStripRGB.h"
+#include "LedZones.h"
+#include "LedHistory.h"
+
+#ifndef DRIVER_H_
+#define DRIVER_H_
+
+extern char mqtt_server[40];
+extern char mqtt_port[6];
+extern char mqtt_topic[50];
+extern char mqtt_group[32];
+extern char blynk_server[40];
+extern char blynk_port[6];
+extern char blynk_token[34];
+
+extern LedStripRGB led_strip_rgb;
+extern LedStrip led_strip_w;
+extern LedZones led_zones;
+extern LedHistory history;
+
+void saveConfig(void);
+String getState(uint8_t zone = 0, bool telemetry = true);
+String getDeviceState(bool telemetry = true);
+void applyCommand(uint8_t zones, String &command, String &value);
+void publishState(ChangeSource source);
+float getEnergyWh(int8_t channel);
+bool modeAvailable(LedStripRGB &strip_rgb, LedStripRgbMode mode);
+void btnModeShortPressed(void);
+
+#endif /* DRIVER_H_ */
@@ -0,0 +1,294 @@
+/*
+ * HassModule.cpp
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include "HassModule.h"
+
+#ifdef MODULE_HASS
+
+#include "Driver.h"
+#include "MqttModule.h"
+
+#define HASS_DISCOVERY_PREFIX "homeassistant"
+#define HASS_TOPIC_SIZE 96
+#define HASS_PAYLOAD_SIZE 1024
+#define HASS_EFFECTS_SIZE 80
+// Longest transition accepted, in seconds
+#define HASS_MAX_TRANSITION 3600
+
+/*
+ * Change of the color, the brightness and the white intensity of a zone in
+ * progress. A transition to OFF fades out the zone and turns it off at the end.
+ */
+struct HassTransition
+{
+  uint64_t start;
+  uint32_t duration;
+  RGBColor from_color;
+  RGBColor to_color;
+  uint8_t from_brightness;
+  uint8_t to_brightness;
+  uint8_t from_white;
+  uint8_t to_white;
+  uint8_t brightness;
+  bool off;
+};
+
+// Discovery config of the light of a zone (JSON schema), the abbreviations
+// are the ones documented by Home Assistant
+static const char HASS_CONFIG[] PROGMEM =
+  "{\"name\":\"Zone %u\",\"uniq_id\":\"drv5050_%06x_%u\",\"schema\":\"json\","
+  "\"cmd_t\":\"%s/cmnd/light/%u\",\"stat_t\":\"%s/stat/LIGHT%u\","
+  "\"avty_t\":\"%s/tele/LWT\",\"pl_avail\":\"ONLINE\",\"pl_not_avail\":\"OFFLINE\","
+  "\"brightness\":true,\"sup_clrm\":[\"%s\"],\"effect\":true,\"fx_list\":[%s],"
+  "\"dev\":{\"ids\":[\"drv5050_%06x\"],\"name\":\"Driver5050 %06x\","
+  "\"mf\":\"Novutek\",\"mdl\":\"5050 RGBW driver\"}}";
+
+static const char HASS_STATE[] PROGMEM =
+  "{\"state\":\"%s\",\"color_mode\":\"%s\",\"brightness\":%u,"
+  "\"color\":{\"r\":%u,\"g\":%u,\"b\":%u%s},\"effect\":\"%s\"}";
+
+char hassTopic[HASS_TOPIC_SIZE];
+char hassPayload[HASS_PAYLOAD_SIZE];
+char hassEffects[HASS_EFFECTS_SIZE];
+HassTransition hassTransitions[LED_MAX_ZONES];
+
+/*
+ * The effects are the modes of the RGB leds, the list is built from the names
+ * of the modes.
+ */
+void hassBuildEffects(void)
+{
+  uint8_t length = 0;
+  hassEffects[0] = '\0';
+  for (uint8_t i = 0; i < RGB_MODE_COUNT; i++)
+  {
+#ifndef AUDIO_REACTIVE
+    if (i == LedStripRgbMode::AUDIO)
+    {
+      continue;
+    }
+#endif
+    length += snprintf(hassEffects + length, HASS_EFFECTS_SIZE - length, "%s\"%s\"",
+      length ? "," : "", LedStripRGB::modeName((LedStripRgbMode) i));
+  }
+}
+
+/*
+ * Publish the retained discovery config of each zone, once per connection.
+ */
+void hassConnected(void)
+{
+  uint32_t chipId = ESP.getChipId();
+  hassBuildEffects();
+  for (uint8_t i = 0; i < led_zones.count(); i++)
+  {
+    snprintf(hassTopic, HASS_TOPIC_SIZE, "%s/light/drv5050_%06x_%u/config",
+      HASS_DISCOVERY_PREFIX, chipId, i);
+    snprintf_P(hassPayload, HASS_PAYLOAD_SIZE, HASS_CONFIG, i, chipId, i,
+      mqtt_topic, i, mqtt_topic, i, mqtt_topic,
+      led_zones.white(i) ? "rgbw" : "rgb", hassEffects, chipId, chipId);
+    mqttPublish(hassTopic, hassPayload, true);
+  }
+  hassSendState();
+}
+
+/*
+ * {topic}/stat/LIGHT{zone}, the white intensity is the white channel of the
+ * color.
+ */
+void hassSendState(void)
+{
+  for (uint8_t i = 0; i < led_zones.count(); i++)
+  {
+    LedStripRGB *rgb = led_zones.rgb(i);
+    LedStrip *white = led_zones.white(i);
+    bool rgbOn = rgb->getState() == LedStripState::ON;
+    bool whiteOn = white && white->getState() == LedStripState::ON;
+    RGBColor color = rgb->getRGBColor();
+    char channel[10] = "";
+    if (white)
+    {
+      snprintf(channel, sizeof(channel), ",\"w\":%u", whiteOn ? white->getIntensity() : 0);
+    }
+    snprintf(hassTopic, HASS_TOPIC_SIZE, "%s/stat/LIGHT%u", mqtt_topic, i);
+    snprintf_P(hassPayload, HASS_PAYLOAD_SIZE, HASS_STATE,
+      rgbOn || whiteOn ? "ON" : "OFF", white ? "rgbw" : "rgb",
+      rgb->getBrightness(), color.red, color.green, color.blue, channel,
+      LedStripRGB::modeName(rgb->getMode()));
+    mqttPublish(hassTopic, hassPayload, false);
+  }
+}
+
+uint8_t hassMix(uint8_t from, uint8_t to, uint16_t k)
+{
+  return from + ((int16_t) to - from) * k / 256;
+}
+
+void hassApply(uint8_t zone, RGBColor color, uint8_t brightness, uint8_t intensity)
+{
+  LedStripRGB *rgb = led_zones.rgb(zone);
+  LedStrip *white = led_zones.white(zone);
+  rgb->setColor(((uint32_t) color.red << 16) | ((uint32_t) color.green << 8) | color.blue);
+  rgb->setBrightness(brightness);
+  // setIntensity(0) turns off the strip when it is on, but turns it on when it
+  // is off
+  if (white && (intensity > 0 || white->getState() == LedStripState::ON))
+  {
+    white->setIntensity(intensity);
+  }
+}
+
+/*
+ * Apply the end of the transition of a zone.
+ */
+void hassFinish(uint8_t zone)
+{
+  HassTransition &t = hassTransitions[zone];
+  if (!t.duration)
+  {
+    return;
+  }
+  t.duration = 0;
+  LedStrip *white = led_zones.white(zone);
+  if (t.off)
+  {
+    // The brightness before the transition is kept for the next time
+    led_zones.rgb(zone)->turnOff();
+    if (white)
+    {
+      white->turnOff();
+    }
+    led_zones.rgb(zone)->setBrightness(t.brightness);
+  }
+  else
+  {
+    hassApply(zone, t.to_color, t.to_brightness, t.to_white);
+  }
+}
+
+/*
+ * {topic}/cmnd/light/{zone} {"state": "ON | OFF", "brightness": 0-255,
+ *    "color": {"r": 0-255, "g": 0-255, "b": 0-255, "w": 0-255},
+ *    "effect": name, "transition": seconds}
+ * @return  false if the topic is not a command of a light
+ */
+bool hassCommand(const char *topic, const char *payload)
+{
+  const char *light = strstr(topic, "/cmnd/light/");
+  if (!light)
+  {
+    return false;
+  }
+  uint8_t zone = atoi(light + 12);
+  if (zone >= led_zones.count())
+  {
+    return true;
+  }
+  StaticJsonBuffer<512> jsonBuffer;
+  JsonObject &root = jsonBuffer.parseObject(payload);
+  if (!root.success())
+  {
+    Serial.println(F("Invalid light command"));
+    return true;
+  }
+  hassFinish(zone);
+
+  LedStripRGB *rgb = led_zones.rgb(zone);
+  LedStrip *white = led_zones.white(zone);
+  bool rgbOn = rgb->getState() == LedStripState::ON;
+  bool whiteOn = white && white->getState() == LedStripState::ON;
+
+  HassTransition &t = hassTransitions[zone];
+  t.from_color = rgb->getRGBColor();
+  t.from_brightness = rgbOn ? rgb->getBrightness() : 0;
+  t.from_white = whiteOn ? white->getIntensity() : 0;
+  t.to_color = t.from_color;
+  t.to_brightness = rgb->getBrightness();
+  t.to_white = t.from_white;
+  t.brightness = rgb->getBrightness();
+  t.off = false;
+
+  const char *state = root["state"];
+  if (state && strcmp(state, "OFF") == 0)
+  {
+    t.off = true;
+    t.to_brightness = 0;
+    t.to_white = 0;
+  }
+  else
+  {
+    const char *effect = root["effect"];
+    LedStripRgbMode mode;
+    if (effect && LedStripRGB::parseMode(effect, mode) && modeAvailable(*rgb, mode))
+    {
+      rgb->setMode(mode);
+    }
+    if (root.containsKey("brightness"))
+    {
+      t.to_brightness = constrain(root["brightness"].as<int>(), 0, 255);
+    }
+    if (root.containsKey("color"))
+    {
+      JsonObject &color = root["color"];
+      t.to_color = { color["r"].as<uint8_t>(), color["g"].as<uint8_t>(), color["b"].as<uint8_t>() };
+      if (color.containsKey("w"))
+      {
+        t.to_white = constrain(color["w"].as<int>(), 0, 255);
+      }
+    }
+  }
+
+  if (!t.off)
+  {
+    // The transition starts from the current levels (0 if it was off)
+    rgb->setBrightness(t.from_brightness);
+    rgb->turnOn();
+  }
+  float transition = root["transition"].as<float>();
+  t.duration = constrain(transition, 0, HASS_MAX_TRANSITION) * 1000;
+  t.start = SystemClock.millis64();
+  if (t.duration == 0)
+  {
+    // Applied at once
+    t.duration = 1;
+    hassFinish(zone);
+  }
+  return true;
+}
+
+/*
+ * Update the transitions in progress, the state is published when they end.
+ */
+void hassLoop(void)
+{
+  uint64_t now = SystemClock.millis64();
+  for (uint8_t i = 0; i < led_zones.count(); i++)
+  {
+    HassTransition &t = hassTransitions[i];
+    if (!t.duration)
+    {
+      continue;
+    }
+    uint32_t elapsed = now - t.start;
+    if (elapsed >= t.duration)
+    {
+      hassFinish(i);
+      publishState(SOURCE_MQTT);
+      continue;
+    }
+    uint16_t k = (uint64_t) elapsed * 256 / t.duration;
+    RGBColor color = {
+      hassMix(t.from_color.red, t.to_color.red, k),
+      hassMix(t.from_color.green, t.to_color.green, k),
+      hassMix(t.from_color.blue, t.to_color.blue, k)
+    };
+    hassApply(i, color, hassMix(t.from_brightness, t.to_brightness, k),
+      hassMix(t.from_white, t.to_white, k));
+  }
+}
+
+#endif
@@ -0,0 +1,26 @@
+/*
+ * HassModule.h
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+
+#ifndef HASS_MODULE_H_
+#define HASS_MODULE_H_
+
+#include "Config.h"
+
+#ifdef MODULE_HASS
+void hassConnected(void);
+bool hassCommand(const char*, const char*);
+void hassSendState(void);
+void hassLoop(void);
+#else
+inline void hassConnected(void) {}
+inline bool hassCommand(const char*, const char*) { return false; }
+inline void hassSendState(void) {}
+inline void hassLoop(void) {}
+#endif
+
+#endif /* HASS_MODULE_H_ */
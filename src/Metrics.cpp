@@ -0,0 +1,171 @@
+/*
+ * Metrics.cpp
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include "Metrics.h"
+
+#include "Driver.h"
+#include "MqttModule.h"
+#include "PwmOutput.h"
+#include "MonotonicClock.h"
+
+// Upper bounds of the buckets in ms, the last bucket (+Inf) is implicit
+const uint16_t METRICS_LOOP_BOUNDS[METRICS_LOOP_BUCKETS] = { 1, 2, 5, 10, 20, 50, 100, 200 };
+
+uint32_t metricsLoopCounts[METRICS_LOOP_BUCKETS + 1] = { 0 };
+uint64_t metricsLoopSum = 0;
+
+size_t MetricsWriter::write(uint8_t c)
+{
+  if(this->_length == METRICS_CHUNK_SIZE)
+  {
+    this->flush();
+  }
+  this->_buffer[this->_length++] = c;
+  return 1;
+}
+
+size_t MetricsWriter::write(const uint8_t *buffer, size_t size)
+{
+  for(size_t i = 0; i < size; i++)
+  {
+    this->write(buffer[i]);
+  }
+  return size;
+}
+
+/*
+ * Send the pending bytes to the client.
+ */
+void MetricsWriter::flush(void)
+{
+  if(this->_length > 0)
+  {
+    this->_client.write((const uint8_t*) this->_buffer, this->_length);
+    this->_length = 0;
+  }
+}
+
+/*
+ * Add the duration of an iteration of the loop (without the delay) to the
+ * histogram.
+ */
+void metricsLoopTime(uint32_t us)
+{
+  uint8_t i = 0;
+  while(i < METRICS_LOOP_BUCKETS && us > METRICS_LOOP_BOUNDS[i] * 1000UL)
+  {
+    i++;
+  }
+  metricsLoopCounts[i]++;
+  metricsLoopSum += us;
+}
+
+void metricsHeader(Print &out, const __FlashStringHelper *name, const __FlashStringHelper *type,
+                   const __FlashStringHelper *help)
+{
+  out.print(F("# HELP "));
+  out.print(name);
+  out.print(' ');
+  out.println(help);
+  out.print(F("# TYPE "));
+  out.print(name);
+  out.print(' ');
+  out.println(type);
+}
+
+void metricsEnergy(Print &out, uint8_t zone, const char *channel, int8_t index)
+{
+  if(index < 0)
+  {
+    return;
+  }
+  out.print(F("driver_energy_wh_total{zone=\""));
+  out.print(zone);
+  out.print(F("\",channel=\""));
+  out.print(channel);
+  out.print(F("\"} "));
+  out.println(getEnergyWh(index), 3);
+}
+
+/*
+ * Print the metrics in the text format of Prometheus, the values are printed
+ * from the counters as they are written.
+ */
+void metricsWrite(Print &out)
+{
+  metricsHeader(out, F("driver_uptime_seconds"), F("counter"), F("Time since the start"));
+  out.print(F("driver_uptime_seconds "));
+  out.println((uint32_t) (SystemClock.millis64() / 1000));
+
+  metricsHeader(out, F("driver_loop_duration_seconds"), F("histogram"), F("Duration of the iterations of the loop"));
+  uint32_t count = 0;
+  for(uint8_t i = 0; i <= METRICS_LOOP_BUCKETS; i++)
+  {
+    count += metricsLoopCounts[i];
+    out.print(F("driver_loop_duration_seconds_bucket{le=\""));
+    if(i < METRICS_LOOP_BUCKETS)
+    {
+      out.print(METRICS_LOOP_BOUNDS[i] / 1000.0, 3);
+    }
+    else
+    {
+      out.print(F("+Inf"));
+    }
+    out.print(F("\"} "));
+    out.println(count);
+  }
+  out.print(F("driver_loop_duration_seconds_sum "));
+  out.println(metricsLoopSum / 1000000.0, 3);
+  out.print(F("driver_loop_duration_seconds_count "));
+  out.println(count);
+
+  metricsHeader(out, F("driver_heap_free_bytes"), F("gauge"), F("Free heap"));
+  out.print(F("driver_heap_free_bytes "));
+  out.println(ESP.getFreeHeap());
+
+  if(WiFi.status() == WL_CONNECTED)
+  {
+    metricsHeader(out, F("driver_wifi_rssi_dbm"), F("gauge"), F("Signal strength of the WiFi"));
+    out.print(F("driver_wifi_rssi_dbm "));
+    out.println(WiFi.RSSI());
+  }
+
+  metricsHeader(out, F("driver_pwm_writes_total"), F("counter"), F("Values written to the PWM channels"));
+  out.print(F("driver_pwm_writes_total "));
+  out.println(PwmOut.getWriteCount());
+  metricsHeader(out, F("driver_pwm_frames_total"), F("counter"), F("Frames committed to the PWM outputs"));
+  out.print(F("driver_pwm_frames_total "));
+  out.println(PwmOut.getCommitCount());
+  metricsHeader(out, F("driver_current_estimate_ma"), F("gauge"), F("Current estimated for the last frame"));
+  out.print(F("driver_current_estimate_ma "));
+  out.println(PwmOut.getCurrentEstimate());
+
+  metricsHeader(out, F("driver_changes_total"), F("counter"), F("Changes notified by source"));
+  for(uint8_t i = 0; i < SOURCE_COUNT; i++)
+  {
+    out.print(F("driver_changes_total{source=\""));
+    out.print(LedHistory::sourceName(i));
+    out.print(F("\"} "));
+    out.println(history.getCount(i));
+  }
+  metricsHeader(out, F("driver_history_lost_total"), F("counter"), F("History records lost before the upload"));
+  out.print(F("driver_history_lost_total "));
+  out.println(history.getLost());
+
+  metricsHeader(out, F("driver_energy_wh_total"), F("counter"), F("Energy consumed by channel"));
+  for(uint8_t i = 0; i < led_zones.count(); i++)
+  {
+    RGBColor channels = led_zones.rgb(i)->getChannels();
+    LedStrip *strip_w = led_zones.white(i);
+    metricsEnergy(out, i, "white", strip_w ? strip_w->getChannel() : -1);
+    metricsEnergy(out, i, "red", channels.red);
+    metricsEnergy(out, i, "green", channels.green);
+    metricsEnergy(out, i, "blue", channels.blue);
+  }
+
+  mqttAddMetrics(out);
+}
@@ -0,0 +1,41 @@
+/*
+ * Metrics.h
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <Arduino.h>
+#include <ESP8266WiFi.h>
+
+// Size of the chunks written to the socket
+#define METRICS_CHUNK_SIZE 512
+// Buckets of the histogram of the loop time, in ms
+#define METRICS_LOOP_BUCKETS 8
+
+/*
+ * Print that writes to a client in chunks of METRICS_CHUNK_SIZE bytes, the
+ * metrics are printed from the counters without building the whole text.
+ */
+class MetricsWriter : public Print
+{
+  private:
+    WiFiClient &_client;
+    uint8_t _buffer[METRICS_CHUNK_SIZE];
+    uint16_t _length = 0;
+
+  public:
+    MetricsWriter(WiFiClient &client) : _client(client) {}
+    size_t write(uint8_t);
+    size_t write(const uint8_t*, size_t);
+    void flush(void);
+};
+
+void metricsLoopTime(uint32_t);
+void metricsWrite(Print&);
+
+#endif /* METRICS_H_ */
@@ -0,0 +1,442 @@
+/*
+ * MqttModule.cpp
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include "MqttModule.h"
+
+#ifdef MODULE_MQTT
+
+#include <ESP8266WiFi.h>
+#include <PubSubClient.h>         //https://github.com/knolleary/pubsubclient
+#include "CommandQueue.h"
+#include "ConnectionMonitor.h"
+#include "MqttSession.h"
+#include "StateDelta.h"
+
+#include "Driver.h"
+#include "HassModule.h"
+
+// Send telemetry each 5 minutes // TODO: 300 000
+#define MQTT_TELEMETRY_INTERVAL 300000
+// Messages read from the socket on each loop
+#define MQTT_READ_BURST 16
+// The history is uploaded in batches when no command was received for 2 s
+#define MQTT_HISTORY_BATCH 16
+#define MQTT_HISTORY_IDLE 2000
+#define MQTT_HISTORY_INTERVAL 1000
+
+WiFiClient wifiClient;
+PubSubClient mqttClient(wifiClient);
+CommandQueue mqttQueue;
+// The connection is retried after 1 s, doubling the time up to 30 s
+ConnectionMonitor mqttMonitor;
+// Stable client id, persistent session and LWT
+MqttSession mqttSession(&mqttClient, &mqttMonitor);
+// A keyframe (full state) is published after STATE_KEYFRAME_DELTAS deltas
+StateDelta mqttStateDelta;
+
+uint64_t mqttLastMsg = 0;
+uint64_t mqttLastCommand = 0;
+uint64_t mqttLastHistory = 0;
+
+#ifdef MQTT_RESTORE_STATE
+String mqttLastDesired;
+#endif
+
+/*
+ * Topic of the device, {topic}{suffix}.
+ */
+String mqttTopic(const char *suffix)
+{
+  return String(mqtt_topic) + suffix;
+}
+
+/*
+ * Publish the state as a keyframe (the full state, retained on tele/STATE) or
+ * as a delta (the fields changed since the last message, on stat/STATE). Each
+ * message has the next sequence number, a delta applies to the state of the
+ * message before it. A keyframe is sent after STATE_KEYFRAME_DELTAS deltas so
+ * the subscribers that lost a delta or subscribed late resync. The state has
+ * all the zones (getDeviceState), a delta only the zones changed.
+ * The telemetry fields change on every read, they are only sent in the
+ * keyframes and the deltas compare the rest of the state.
+ */
+void mqttSendState(bool keyframe)
+{
+  String json;
+  keyframe = mqttStateDelta.isKeyframeDue(keyframe);
+  if (keyframe ? !mqttStateDelta.keyframe(getDeviceState(false), getDeviceState(), json) :
+    !mqttStateDelta.delta(getDeviceState(false), json))
+  {
+    return;
+  }
+  String topic = mqttTopic(keyframe ? "/tele/STATE" : "/stat/STATE");
+  Serial.printf("%s %s\r\n", topic.c_str(), json.c_str());
+  mqttClient.publish(topic.c_str(), json.c_str(), keyframe);
+}
+
+/*
+ * {topic}/tele/HISTORY {"lost": count, "records": [[time, source, zone,
+ * field, value, uptime], ...]}, a batch of the oldest changes not uploaded.
+ */
+void mqttSendHistory()
+{
+  uint64_t now = SystemClock.millis64();
+  if (!history.available() || mqttQueue.size() > 0 ||
+    now - mqttLastCommand < MQTT_HISTORY_IDLE || now - mqttLastHistory < MQTT_HISTORY_INTERVAL)
+  {
+    return;
+  }
+  mqttLastHistory = now;
+  const char *fields[] = { "rgb", "mode", "color", "speed", "brightness", "white" };
+  HistoryRecord records[MQTT_HISTORY_BATCH];
+  uint16_t count = history.read(records, MQTT_HISTORY_BATCH);
+  if (count == 0)
+  {
+    return;
+  }
+  DynamicJsonBuffer jsonBuffer;
+  JsonObject &root = jsonBuffer.createObject();
+  root["lost"] = history.getLost();
+  JsonArray &list = root.createNestedArray("records");
+  for (uint16_t i = 0; i < count; i++)
+  {
+    JsonArray &record = list.createNestedArray();
+    record.add(records[i].time);
+    record.add(LedHistory::sourceName(records[i].source));
+    record.add(records[i].zone);
+    record.add(records[i].field < HISTORY_FIELDS ? fields[records[i].field] : "");
+    record.add(records[i].value);
+    record.add(records[i].flags & HISTORY_UPTIME ? 1 : 0);
+  }
+  String json;
+  root.printTo(json);
+  if (mqttClient.publish(mqttTopic("/tele/HISTORY").c_str(), json.c_str()))
+  {
+    history.ack(count);
+  }
+}
+
+void mqttSendTele() {
+  uint64_t now = SystemClock.millis64();
+  if (now - mqttLastMsg > MQTT_TELEMETRY_INTERVAL) {
+    mqttLastMsg = now;
+    mqttSendState(true);
+  }
+}
+
+#ifdef MQTT_RESTORE_STATE
+/*
+ * The desired state of each zone is [rgb, mode, color, speed, brightness,
+ * white]. It is published retained when it changes, so it is restored from
+ * the broker after a power cut without writing the flash.
+ */
+String mqttDesiredState()
+{
+  DynamicJsonBuffer jsonBuffer;
+  JsonArray &root = jsonBuffer.createArray();
+  for (uint8_t i = 0; i < led_zones.count(); i++)
+  {
+    LedStripRGB *rgb = led_zones.rgb(i);
+    LedStrip *white = led_zones.white(i);
+    JsonArray &zone = root.createNestedArray();
+    zone.add(rgb->getState() == LedStripState::ON ? 1 : 0);
+    zone.add((uint8_t) rgb->getMode());
+    zone.add(rgb->getColor());
+    zone.add(rgb->getSpeed());
+    zone.add(rgb->getBrightness());
+    zone.add(white && white->getState() == LedStripState::ON ? white->getIntensity() : 0);
+  }
+  String json;
+  root.printTo(json);
+  return json;
+}
+
+void mqttSendDesired()
+{
+  if (!mqttSession.isRestored() || !mqttClient.connected())
+  {
+    return;
+  }
+  String json = mqttDesiredState();
+  if (json == mqttLastDesired)
+  {
+    return;
+  }
+  if (mqttClient.publish(mqttTopic("/stat/DESIRED").c_str(), json.c_str(), true))
+  {
+    mqttLastDesired = json;
+  }
+}
+
+/*
+ * Apply the retained desired state, the mode is applied before the state
+ * because it turns on the strip.
+ */
+void mqttRestore(const char *payload)
+{
+  DynamicJsonBuffer jsonBuffer;
+  JsonArray &root = jsonBuffer.parseArray(payload);
+  if (!root.success())
+  {
+    Serial.println(F("Invalid retained state"));
+    return;
+  }
+  for (uint8_t i = 0; i < root.size() && i < led_zones.count(); i++)
+  {
+    JsonArray &zone = root[i];
+    if (zone.size() < 6)
+    {
+      continue;
+    }
+    uint8_t mask = 1 << i;
+    led_zones.apply(mask, ZONE_RGB_MODE, zone[1].as<uint32_t>());
+    led_zones.apply(mask, ZONE_RGB_STATE, zone[0].as<uint32_t>());
+    led_zones.apply(mask, ZONE_RGB_COLOR, zone[2].as<uint32_t>());
+    led_zones.apply(mask, ZONE_RGB_SPEED, zone[3].as<uint32_t>());
+    led_zones.apply(mask, ZONE_BRIGHTNESS, zone[4].as<uint32_t>());
+    led_zones.apply(mask, ZONE_WHITE, zone[5].as<uint32_t>());
+  }
+  Serial.println(F("State restored"));
+}
+#endif
+
+bool mqttPublish(const char *topic, const char *payload, bool retained)
+{
+  return mqttClient.publish(topic, payload, retained);
+}
+
+void mqttSendStat()
+{
+  mqttSendState(false);
+  hassSendState();
+#ifdef MQTT_RESTORE_STATE
+  mqttSendDesired();
+#endif
+}
+
+/*
+ * Events are applied each one, the other commands set a value and only the
+ * latest one pending of each topic is applied.
+ */
+bool mqttCoalesced(const char *topic)
+{
+  const char *events[] = { "/rgb/notify", "/schedule/", "/show/", "/ota/", "/cmnd/light/" };
+  for (uint8_t i = 0; i < sizeof(events) / sizeof(events[0]); i++)
+  {
+    if (strstr(topic, events[i]))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+ * The commands are queued and applied from mqttLoop, a flood of messages does
+ * not apply (and publish the state) each one.
+ */
+void mqttCallback(char* topic, byte* payload, unsigned int length) {
+  char caPayload[length + 1];
+  memcpy(caPayload, payload, length);
+  caPayload[length] = '\0';
+
+#ifdef MQTT_RESTORE_STATE
+  if (mqttSession.isRestoreMessage(topic))
+  {
+    mqttRestore(caPayload);
+    mqttSession.restored();
+    publishState(SOURCE_MQTT);
+    return;
+  }
+#endif
+
+  uint64_t due = 0;
+#ifdef MQTT_GROUP_STAGGER
+  // A group command is applied by each controller at a different time
+  size_t topicLength = strlen(mqtt_topic);
+  if (strncmp(topic, mqtt_topic, topicLength) != 0 || topic[topicLength] != '/')
+  {
+    due = SystemClock.millis64() + ESP.getChipId() % MQTT_GROUP_STAGGER;
+  }
+#endif
+  if (!mqttQueue.push(topic, caPayload, mqttCoalesced(topic), due))
+  {
+    Serial.print(F("Command dropped "));
+    Serial.println(topic);
+  }
+}
+
+/*
+ * The topics {topic}/cmnd/zone/{zones}/... are applied to the zones listed
+ * ("all", "2" or "1,3"), the rest of the topics are applied to the zone 0.
+ */
+void mqttApply(String &strTopic, String &strPayload)
+{
+  Serial.print(strTopic);
+  Serial.print(" ");
+  Serial.println(strPayload);
+
+  // The commands of Home Assistant are JSON, they keep their case
+  if (hassCommand(strTopic.c_str(), strPayload.c_str()))
+  {
+    return;
+  }
+
+  strPayload.trim();
+  if (!strTopic.endsWith("/ota/update")) {
+    // The URL of the firmware keeps its case
+    strPayload.toLowerCase();
+  }
+
+  uint8_t zones = 1;
+  int zoneIndex = strTopic.indexOf("/cmnd/zone/");
+  if (zoneIndex >= 0)
+  {
+    String zone = strTopic.substring(zoneIndex + 11);
+    int slash = zone.indexOf('/');
+    zones = slash > 0 ? led_zones.parseMask(zone.substring(0, slash).c_str()) : 0;
+    strTopic = zone.substring(slash);
+  }
+  if (strTopic.endsWith("/mqtt/group"))
+  {
+    mqttSetGroup(strPayload.c_str());
+    return;
+  }
+  applyCommand(zones, strTopic, strPayload);
+}
+
+/*
+ * Change the group of the controller, the subscription of the previous group
+ * is removed.
+ */
+void mqttSetGroup(const char *group)
+{
+  mqttSession.setGroup(group);
+  strncpy(mqtt_group, group, sizeof(mqtt_group) - 1);
+  mqtt_group[sizeof(mqtt_group) - 1] = '\0';
+  saveConfig();
+}
+
+/*
+ * The session is persistent (see MqttSession), the commands sent while the
+ * controller was offline are received after the connection.
+ */
+void mqttConnect() {
+  uint64_t now = SystemClock.millis64();
+  if (!mqttMonitor.poll(now))
+  {
+    return;
+  }
+  Serial.print(F("Attempting MQTT connection..."));
+  uint32_t reconnects = mqttMonitor.getReconnects();
+  if (mqttSession.connect(now)) {
+    Serial.println(F("Connected"));
+    if (mqttMonitor.getReconnects() != reconnects)
+    {
+      Serial.printf("Recovered in %u ms\r\n", mqttMonitor.getRecoveryTime());
+    }
+    hassConnected();
+    // The deltas published while disconnected were lost
+    mqttSendState(true);
+  } else {
+    Serial.print(F("failed, rc="));
+    Serial.print(mqttClient.state());
+    Serial.print(F(" Try again in "));
+    Serial.print(mqttMonitor.getRetryInterval() / 1000.0);
+    Serial.println(F(" seconds"));
+  }
+}
+
+/*
+ * Reconnections and time from the loss of the connection to the next
+ * connection.
+ */
+void mqttAddState(JsonObject &root)
+{
+  JsonObject &mqtt = root.createNestedObject("mqtt");
+  mqtt["reconnects"] = mqttMonitor.getReconnects();
+  mqtt["recovery"] = mqttMonitor.getRecoveryTime();
+  mqtt["coalesced"] = mqttQueue.getCoalesced();
+  mqtt["dropped"] = mqttQueue.getDropped();
+}
+
+/*
+ * Counters of the connection and of the commands for the /metrics endpoint.
+ */
+void mqttAddMetrics(Print &out)
+{
+  out.println(F("# HELP driver_mqtt_reconnects_total Connections to the broker after a loss"));
+  out.println(F("# TYPE driver_mqtt_reconnects_total counter"));
+  out.print(F("driver_mqtt_reconnects_total "));
+  out.println(mqttMonitor.getReconnects());
+  out.println(F("# HELP driver_mqtt_recovery_seconds Time to the last reconnection"));
+  out.println(F("# TYPE driver_mqtt_recovery_seconds gauge"));
+  out.print(F("driver_mqtt_recovery_seconds "));
+  out.println(mqttMonitor.getRecoveryTime() / 1000.0, 3);
+  out.println(F("# HELP driver_mqtt_commands_total Commands received by outcome"));
+  out.println(F("# TYPE driver_mqtt_commands_total counter"));
+  out.print(F("driver_mqtt_commands_total{outcome=\"processed\"} "));
+  out.println(mqttQueue.getProcessed());
+  out.print(F("driver_mqtt_commands_total{outcome=\"coalesced\"} "));
+  out.println(mqttQueue.getCoalesced());
+  out.print(F("driver_mqtt_commands_total{outcome=\"dropped\"} "));
+  out.println(mqttQueue.getDropped());
+}
+
+void mqttSetup(void)
+{
+#ifdef MQTT_RESTORE_STATE
+  bool restore = true;
+#else
+  bool restore = false;
+#endif
+  mqttSession.begin("Driver5050-" + String(ESP.getChipId(), HEX), mqtt_topic, mqtt_group, restore);
+  mqttClient.setServer(mqtt_server, atoi(mqtt_port));
+  mqttClient.setCallback(mqttCallback);
+}
+
+void mqttLoop(void)
+{
+  if (!mqttClient.connected()) {
+    mqttConnect();
+  }
+  // The messages received are only queued, several are read on each loop so
+  // the commands of a flood are coalesced instead of waiting in the socket
+  mqttClient.loop();
+  for (uint8_t i = 1; i < MQTT_READ_BURST && wifiClient.available(); i++)
+  {
+    mqttClient.loop();
+  }
+
+  String topic;
+  String payload;
+  bool applied = false;
+  while (mqttQueue.pop(SystemClock.millis64(), topic, payload))
+  {
+    mqttApply(topic, payload);
+    applied = true;
+  }
+  if (applied)
+  {
+    mqttLastCommand = SystemClock.millis64();
+    publishState(SOURCE_MQTT);
+  }
+  mqttSendTele();
+  if (mqttClient.connected())
+  {
+    mqttSendHistory();
+  }
+#ifdef MQTT_RESTORE_STATE
+  // Nothing retained, the state of the boot is kept
+  if (mqttSession.restoreExpired(SystemClock.millis64()))
+  {
+    mqttSendDesired();
+  }
+#endif
+}
+
+#endif
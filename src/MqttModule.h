@@ -0,0 +1,34 @@
+/*
+ * MqttModule.h
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+
+#ifndef MQTT_MODULE_H_
+#define MQTT_MODULE_H_
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "Config.h"
+
+#ifdef MODULE_MQTT
+void mqttSetup(void);
+void mqttLoop(void);
+void mqttSendStat(void);
+void mqttAddState(JsonObject&);
+void mqttAddMetrics(Print&);
+bool mqttPublish(const char*, const char*, bool);
+void mqttSetGroup(const char*);
+#else
+inline void mqttSetup(void) {}
+inline void mqttLoop(void) {}
+inline void mqttSendStat(void) {}
+inline void mqttAddState(JsonObject&) {}
+inline void mqttAddMetrics(Print&) {}
+inline bool mqttPublish(const char*, const char*, bool) { return false; }
+inline void mqttSetGroup(const char*) {}
+#endif
+
+#endif /* MQTT_MODULE_H_ */
@@ -0,0 +1,85 @@
+/*
+ * OtaModule.cpp
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include "OtaModule.h"
+
+#ifdef MODULE_OTA
+
+#include "Driver.h"
+#include "OtaUpdater.h"
+
+// Time to publish the state before the restart with the new firmware
+#define OTA_RESTART_DELAY 1000
+
+OtaUpdater ota;
+OtaState otaLastState = OTA_IDLE;
+uint64_t otaDoneTime = 0;
+
+/*
+ * {topic}/cmnd/ota/update url[,md5] and {topic}/cmnd/ota/abort
+ */
+void otaCommand(String &command, String &value)
+{
+  if (command.endsWith("/ota/update"))
+  {
+    int comma = value.indexOf(',');
+    String url = comma < 0 ? value : value.substring(0, comma);
+    String md5 = comma < 0 ? "" : value.substring(comma + 1);
+    url.trim();
+    md5.trim();
+    md5.toLowerCase();
+    Serial.print(F("Update from "));
+    Serial.println(url);
+    ota.begin(url, md5);
+  } else if (command.endsWith("/ota/abort"))
+  {
+    ota.abort();
+  }
+}
+
+void otaAddState(JsonObject &root)
+{
+  const char *states[] = { "IDLE", "DOWNLOAD", "DONE", "ERROR" };
+  JsonObject &state = root.createNestedObject("ota");
+  state["state"] = states[ota.getState()];
+  state["progress"] = ota.getProgress();
+  if (ota.getState() == OTA_ERROR)
+  {
+    state["error"] = ota.getError();
+  }
+}
+
+/*
+ * The state is published when the update ends, the controller restarts with
+ * the new firmware a moment later.
+ */
+void otaLoop(void)
+{
+  ota.loop();
+  OtaState state = ota.getState();
+  if (state != otaLastState)
+  {
+    otaLastState = state;
+    if (state == OTA_ERROR)
+    {
+      Serial.print(F("Update failed: "));
+      Serial.println(ota.getError());
+    }
+    if (state == OTA_DONE)
+    {
+      Serial.println(F("Update done, restarting..."));
+      otaDoneTime = SystemClock.millis64();
+    }
+    publishState(SOURCE_SYSTEM);
+  }
+  if (state == OTA_DONE && SystemClock.millis64() - otaDoneTime > OTA_RESTART_DELAY)
+  {
+    ESP.restart();
+  }
+}
+
+#endif
@@ -0,0 +1,26 @@
+/*
+ * OtaModule.h
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+
+#ifndef OTA_MODULE_H_
+#define OTA_MODULE_H_
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "Config.h"
+
+#ifdef MODULE_OTA
+void otaLoop(void);
+void otaCommand(String&, String&);
+void otaAddState(JsonObject&);
+#else
+inline void otaLoop(void) {}
+inline void otaCommand(String&, String&) {}
+inline void otaAddState(JsonObject&) {}
+#endif
+
+#endif /* OTA_MODULE_H_ */
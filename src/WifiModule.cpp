@@ -0,0 +1,132 @@
+/*
+ * WifiModule.cpp
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include "WifiModule.h"
+
+#include <ESP8266WiFi.h>          //https://github.com/esp8266/Arduino
+
+#include "Driver.h"
+
+#ifdef MODULE_WIFI_MANAGER
+
+//needed for library
+#include <DNSServer.h>
+#include <ESP8266WebServer.h>
+#include <WiFiManager.h>         //https://github.com/tzapu/WiFiManager
+
+//flag for saving data
+bool shouldSaveConfig = false;
+
+// Callback notifying us of the need to save config
+void saveConfigCallback () {
+  Serial.println(F("Should save config."));
+  shouldSaveConfig = true;
+}
+
+void wifiSetup(void)
+{
+  // The extra parameters to be configured (can be either global or just in the setup)
+  // After connecting, parameter.getValue() will get you the configured value
+  // id/name placeholder/prompt default length
+#ifdef MODULE_MQTT
+  WiFiManagerParameter custom_mqtt_server("server", "MQTT Server", mqtt_server, 40);
+  WiFiManagerParameter custom_mqtt_port("port", "MQTT Port", mqtt_port, 6);
+  WiFiManagerParameter custom_mqtt_topic("topic", "MQTT Topic", mqtt_topic, 50);
+  WiFiManagerParameter custom_mqtt_group("group", "MQTT Group", mqtt_group, 32);
+#endif
+#ifdef MODULE_BLYNK
+  WiFiManagerParameter custom_blynk_server("blynk_server", "Blynk Server", blynk_server, 40);
+  WiFiManagerParameter custom_blynk_port("blynk_port", "Blynk Port", blynk_port, 6);
+  WiFiManagerParameter custom_blynk_token("token", "Blynk Token", blynk_token, 34);
+#endif
+
+  //WiFiManager
+  //Local intialization. Once its business is done, there is no need to keep it around
+  WiFiManager wifiManager;
+
+  //set config save notify callback
+  wifiManager.setSaveConfigCallback(saveConfigCallback);
+
+  //add all your parameters here
+#ifdef MODULE_MQTT
+  wifiManager.addParameter(&custom_mqtt_server);
+  wifiManager.addParameter(&custom_mqtt_port);
+  wifiManager.addParameter(&custom_mqtt_topic);
+  wifiManager.addParameter(&custom_mqtt_group);
+#endif
+#ifdef MODULE_BLYNK
+  wifiManager.addParameter(&custom_blynk_server);
+  wifiManager.addParameter(&custom_blynk_port);
+  wifiManager.addParameter(&custom_blynk_token);
+#endif
+
+  //reset saved settings
+  //wifiManager.resetSettings();
+
+  //set custom ip for portal
+  //wifiManager.setAPStaticIPConfig(IPAddress(10,0,1,1), IPAddress(10,0,1,1), IPAddress(255,255,255,0));
+
+  //fetches ssid and pass from eeprom and tries to connect
+  //if it does not connect it starts an access point with the specified name
+  //here  "AutoConnectAP"
+  //and goes into a blocking loop awaiting configuration
+  wifiManager.autoConnect("Driver 5050", "ledstrip");
+  //or use this for auto generated name ESP + ChipID
+  //wifiManager.autoConnect();
+
+  //if you get here you have connected to the WiFi
+  Serial.println("Connected :)");
+
+  //read updated parameters
+#ifdef MODULE_MQTT
+  strcpy(mqtt_server, custom_mqtt_server.getValue());
+  strcpy(mqtt_port, custom_mqtt_port.getValue());
+  strcpy(mqtt_topic, custom_mqtt_topic.getValue());
+  strcpy(mqtt_group, custom_mqtt_group.getValue());
+#endif
+#ifdef MODULE_BLYNK
+  strcpy(blynk_server, custom_blynk_server.getValue());
+  strcpy(blynk_port, custom_blynk_port.getValue());
+  strcpy(blynk_token, custom_blynk_token.getValue());
+#endif
+
+  //save the custom parameters to FS
+  if (shouldSaveConfig) {
+    saveConfig();
+  }
+}
+
+#else
+
+// Time to wait for the connection before continuing without network
+#define WIFI_CONNECT_TIMEOUT 20000
+
+#ifndef WIFI_PASSWORD
+#define WIFI_PASSWORD ""
+#endif
+
+/*
+ * Without the portal the network is WIFI_SSID or, when it is not defined,
+ * the last network stored by the SDK. The servers are set with the serial
+ * commands (mqttserver, blynkserver, ...).
+ */
+void wifiSetup(void)
+{
+  WiFi.mode(WIFI_STA);
+#ifdef WIFI_SSID
+  WiFi.begin(WIFI_SSID, WIFI_PASSWORD);
+#else
+  WiFi.begin();
+#endif
+  uint64_t start = SystemClock.millis64();
+  while (WiFi.status() != WL_CONNECTED && SystemClock.millis64() - start < WIFI_CONNECT_TIMEOUT) {
+    delay(100);
+  }
+  Serial.println(WiFi.status() == WL_CONNECTED ? F("Connected :)") : F("Not connected"));
+}
+
+#endif
@@ -0,0 +1,18 @@
+/*
+ * WifiModule.h
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+
+#ifndef WIFI_MODULE_H_
+#define WIFI_MODULE_H_
+
+/**
+ * Connect to the WiFi network, with the configuration portal when
+ * MODULE_WIFI_MANAGER is defined.
+ */
+void wifiSetup(void);
+
+#endif /* WIFI_MODULE_H_ */
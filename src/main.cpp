@@ -26,14 +26,16 @@
  *
  * Strobe mode
  * While in the color light mode, pressing the button switches to Strobe mode
- * using the same color as before, in the same way you can change the color with
- * the variation of the potentiometer.
+ * using the same color as before, the potentiometer changes the frequency of
+ * the strobe (0.5 Hz to 30 Hz). The strobe is timed by a hardware timer
+ * (timer0) that switches the pins of the strip at their full level, each
+ * channel of the color that is not off flashes at full brightness.
  *
  * Flash mode
  * While in Strobe mode, pressing the button switches to Flash mode which
  * displays a predefined color sequence (mainly primary colors), you can change
- * the speed of the color change of the sequence, varying the speed of the
- * potentiometer.
+ * the speed of the color change of the sequence, varying the value of the
+ * potentiometer (turning it up makes the sequence faster).
  *
  * Fade mode
  * While in Flash mode, pressing the button switches to Fade mode which displays
@@ -41,6 +43,11 @@
  * gradual than in Flash mode, but its speed can be modified by varying the
  * value of the potentiometer.
  *
+ * The speed of the Flash and Fade modes goes from 1 to 240 cycles per minute
+ * (a cycle is the whole sequence of colors) and each step of the
+ * potentiometer changes it by the same ratio. The effects are timed by the
+ * clock, so changing the speed does not restart them.
+ *
  * Off mode
  * If the button is held down for approximately one second, all the LEDs will
  * turn off. To turn on again you can press the button or modify the value of
@@ -51,81 +58,239 @@
  * it allows to configure the Host, port and topic of the MQTT server and
  * the Blynk Token.
  *
+ * The integrations are optional modules selected at compile time (see
+ * Config.h and the environments of platformio.ini): the configuration portal
+ * (MODULE_WIFI_MANAGER), MQTT (MODULE_MQTT), the Home Assistant discovery
+ * (MODULE_HASS), Blynk (MODULE_BLYNK) and the firmware update (MODULE_OTA). The
+ * modules use the core through Driver.h; the REST API, the serial commands,
+ * the button and the potentiometer are always available.
+ *
  * You can send instructions through the Blynk application using the following
  * virtual pins (virtual pin: Widget [description]):
  *    V0: zeRGBa [set color for RGB Led]
  *    V1: Slider [set intensity of the white Led 0-255]
- *    V2: Menu [to select the RGB Led mode 1-Normal, 2-Strobe, 3-Flash, 4-Fade]
+ *    V2: Menu [to select the RGB Led mode 1-Normal, 2-Strobe, 3-Flash, 4-Fade,
+ *        5-Audio]
  *    V3: Button (push) [set the next RGB LED mode]
  *    V4: Led [status of the white Led]
  *    V5: Led [status of the red LED]
  *    V6: Led [green Led status]
  *    V7: Led [blue Led status]
  *    V8: Button (switch) [turn on or off the white LED]
+ *    V9: Menu [zone addressed by the widgets 1-Zone 0, 2-Zone 1, ..., N+1-All]
+ *    V10: Slider [speed of the Flash and Fade modes 0-1023]
+ *
+ * Only the widgets whose value changed are written, once each 100 ms (see
+ * WidgetShadow).
+ *
+ * The RGBW channels are driven at PWM_FREQUENCY and their start inside the PWM
+ * period is staggered to avoid that all of them turn on at the same time.
+ * When PWM_EXPANDER is defined four RGBW zones are driven by a PCA9685
+ * expander connected to the I2C bus (SDA on D2 and SCL on D1), the zone N uses
+ * the outputs 4N to 4N+3 (red, green, blue and white).
+ * When PIXEL_STRIP is defined an addressable strip (WS2812) connected to D4
+ * (GPIO2, the TX of UART1) shows the modes of the zone 0 per pixel: the
+ * Fade mode is a rainbow moving along the strip, the flash of the Strobe mode
+ * sweeps the strip and the Flash mode shows its color sequence along it.
+ *
+ * Audio mode
+ * When AUDIO_REACTIVE is defined the A0 input (instead of the potentiometer)
+ * receives an audio signal that is sampled at 4 kHz while the loop waits for
+ * its next iteration (while a zone is in Audio mode) and the last 64 samples
+ * are analyzed with a 64 points FFT once per iteration, the bass, mid and
+ * treble bands set the red, green and blue of the color and the beats make
+ * the brightness pulse.
+ *
+ * Program mode
+ * Shows a user defined effect uploaded through MQTT. The effect is a small
+ * program (see EffectVM) compiled with tools/effectc.py, it is verified before
+ * being loaded and saved to the file system, so it is restored at boot.
+ * The programs that only depend on PHASE are rendered once per period into a
+ * table (see EffectCache) and the frames are interpolated from it, when the
+ * period fits in the table at its resolution.
  *
  * The status of the Leds is sent and commands can be received through MQTT
  * usign:
  *
- *  Telemetry
- *    {topic}/tele/STATE {"white": {"state": "ON | OFF", intensity: 0-1024},
- *          "rgb": {"state": "ON | OFF", "mode": 0-4 , "color": 0-16777215}}
- *  Status
- *    {topic}/stat/STATE {"white": {"state": "ON | OFF", intensity: 0-1024},
- *          "rgb": {"state": "ON | OFF", "mode": 0-4 , "color": 0-16777215}}
+ *  Telemetry (keyframe, retained, each 5 minutes, after 50 deltas and on
+ *  each connection)
+ *    {topic}/tele/STATE {"seq": N, "key": true,
+ *          "white": {"state": "ON | OFF", intensity: 0-1024},
+ *          "rgb": {"state": "ON | OFF", "mode": 0-4 , "color": 0-16777215,
+ *          "brightness": 0-255, "speed": 0-1023, "cpm": cycles per minute},
+ *          "power": {"current": mA, "limited": true | false},
+ *          "strobe": {"frequency": Hz, "duty": 0-255, "jitter": us},
+ *          "energy": {"white": Wh, "red": Wh, "green": Wh, "blue": Wh},
+ *          "mqtt": {"reconnects": count, "recovery": ms,
+ *                   "coalesced": count, "dropped": count},
+ *          "blynk": {"sent": bytes, "saved": bytes, "saved_rate": bytes/s},
+ *          "ota": {"state": "IDLE | DOWNLOAD | DONE | ERROR", "progress": 0-100}}
+ *  Status (delta, after each change)
+ *    {topic}/stat/STATE {"seq": N, ...} [only the fields of the state that
+ *          changed since the message N-1, a field removed is null; the state
+ *          is rebuilt with tools/state_replay.py]
+ *    {topic}/tele/HISTORY {"lost": count, "records": [[time, "button | pot |
+ *          mqtt | blynk | serial | rest | system", zone, "rgb | mode | color |
+ *          speed | brightness | white", value, uptime], ...]} [changes of the
+ *          zones and their source, in batches of 16 when no command was
+ *          received for 2 s; time is UTC seconds or, when uptime is 1, the
+ *          seconds since the start; lost counts the records overwritten]
+ *    {topic}/tele/LWT ONLINE | OFFLINE [retained, OFFLINE is published by
+ *          the broker when the connection is lost]
+ *    {topic}/stat/DESIRED [[rgb, mode, color, speed, brightness, white], ...]
+ *          [retained state of each zone (MQTT_RESTORE_STATE), applied when
+ *          the controller connects after a restart]
  *
  *  Commands
  *    {topic}/cmnd/white [ON | OFF]
  *    {topic}/cmnd/white/intensity [0-1024]
  *    {topic}/cmnd/rgb [ON | OFF]
- *    {topic}/cmnd/rgb/mode [Normal | Strobe | Fade | Flash]
+ *    {topic}/cmnd/rgb/mode [Normal | Strobe | Fade | Flash | Audio | Program]
  *    {topic}/cmnd/rgb/color 0-16777215
+ *    {topic}/cmnd/rgb/brightness 0-255 [master brightness of the RGB leds]
+ *    {topic}/cmnd/rgb/speed 0-1023 | Ncpm [speed of the Flash and Fade modes,
+ *          a value of the knob or the cycles per minute, for example 30cpm]
+ *    {topic}/cmnd/rgb/strobe Hz[,duty] [frequency 0.5-30 and duty 0-255 of the
+ *          Strobe mode, shared by all the zones, for example 12.5,64]
+ *    {topic}/cmnd/rgb/notify color[,count[,alpha | add | multiply[,0-255]]]
+ *          [blink a color count times (3 by default, 0 forever) over the
+ *          running mode, OFF clears it, for example 16711680,3]
+ *    {topic}/cmnd/rgb/program hex bytecode [user defined effect for the
+ *          Program mode, see tools/effectc.py, OFF removes it]
+ *
+ *    {topic}/cmnd/show/play file[,start] [play a show of the file system
+ *          created with tools/timeline.py, start is the UTC epoch in seconds
+ *          so several controllers start the same show at the same time]
+ *    {topic}/cmnd/show/stop
+ *    {topic}/cmnd/show/seek ms [continue the show from a position]
+ *    {topic}/cmnd/show/loop [ON | OFF]
+ *
+ *    {topic}/cmnd/schedule/add HH:MM[:SS],days,action,value[,ramp]
+ *          [apply an action at a time of the day (local time), days is daily,
+ *          once or the days of the week 0-6 (0 is Sunday, for example 12345),
+ *          action is rgb, mode, color, speed, brightness or white and ramp is
+ *          the seconds to reach the value (white and brightness), for example
+ *          06:30,12345,white,255,1800]
+ *    {topic}/cmnd/schedule/remove id
+ *    {topic}/cmnd/schedule/clear
+ *
+ *    {topic}/cmnd/ota/update url[,md5] [update the firmware from an HTTP
+ *          server, the image is the firmware.bin built (the MD5 is required)
+ *          or an image compressed by tools/ota_pack.py, which includes its
+ *          MD5; the effects continue during the download and the controller
+ *          restarts when the MD5 of the new firmware is verified]
+ *    {topic}/cmnd/ota/abort
+ *
+ *  The commands above address the zone 0, other zones are addressed with
+ *  {topic}/cmnd/zone/{zones}/..., where zones is "all", a zone number or a list
+ *  of zones separated by comma, for example {topic}/cmnd/zone/1,3/rgb/color.
  *
- * TODO: Rest API and Websockets
+ *  The same commands are received by all the controllers on all/cmnd/... and
+ *  by the controllers of a group on group/{group}/cmnd/..., for example
+ *  group/first_floor/cmnd/rgb off. The group is set in the configuration
+ *  portal, with the serial command "mqttgroup name" or with
+ *    {topic}/cmnd/mqtt/group name
+ *  With MQTT_GROUP_STAGGER each controller applies them after its own delay.
+ *
+ *  The commands are queued and applied at most 10 per second (bursts of 5). A
+ *  command that sets a value replaces the pending command of the same topic
+ *  (coalesced), the events (notify, schedule, show, ota and the lights of Home
+ *  Assistant) are applied each one; when the queue is full they are dropped.
+ *
+ *  Home Assistant (MODULE_HASS)
+ *    Each zone is discovered as a light (JSON schema) with the retained config
+ *    homeassistant/light/drv5050_{chip id}_{zone}/config, published on each
+ *    connection. The effects are the RGB modes.
+ *    {topic}/cmnd/light/{zone} {"state": "ON | OFF", "brightness": 0-255,
+ *          "color": {"r": 0-255, "g": 0-255, "b": 0-255, "w": 0-255},
+ *          "effect": "Normal | Strobe | Flash | Fade | ...",
+ *          "transition": seconds}
+ *    {topic}/stat/LIGHT{zone} {"state": "ON | OFF", "color_mode": "rgbw",
+ *          "brightness": 0-255, "color": {"r", "g", "b", "w"}, "effect": name}
+ *
+ * The Rest API is served on port 80:
+ *    GET /api/state?zone=N  [same JSON as {topic}/stat/STATE]
+ *    GET /api/energy?zone=N {"white": Wh, "red": Wh, "green": Wh, "blue": Wh}
+ *    POST /api/command?zone={zones}&command=rgb/color&value=16711680
+ *    GET /api/schedule [{"id": N, "days": 0-127, "time": "HH:MM:SS",
+ *          "zones": mask, "action": N, "value": N, "ramp": s, "next": UTC epoch}]
+ *    GET /metrics  [Prometheus text format: loop time, heap, RSSI, reconnections,
+ *          PWM writes, changes by source and energy by channel]
+ *
+ * TODO: Websockets
  */
 
 #include <Arduino.h>
 #include <FS.h>
 
+#include "Config.h"
+#include "Driver.h"
+#include "WifiModule.h"
+#include "MqttModule.h"
+#include "BlynkModule.h"
+#include "OtaModule.h"
+#include "HassModule.h"
+#include "Metrics.h"
+
 #include "BtnHandler.h"
-#include "LedStrip.h"
-#include "LedStripRGB.h"
+#include "LedTimeline.h"
+#include "LedScheduler.h"
+#include "TimeSource.h"
 
 #include <ESP8266WiFi.h>          //https://github.com/esp8266/Arduino
-
-//needed for library
-#include <DNSServer.h>
 #include <ESP8266WebServer.h>
-#include <WiFiManager.h>         //https://github.com/tzapu/WiFiManager
 
-#include <ArduinoJson.h>          //https://github.com/bblanchon/ArduinoJson
-#include <PubSubClient.h>         //https://github.com/knolleary/pubsubclient
-#include <BlynkSimpleEsp8266.h>   //http://www.blynk.cc
+#ifdef PWM_EXPANDER
+#include <Wire.h>
+#include "PwmPCA9685Backend.h"
+#endif
+
+#ifdef AUDIO_REACTIVE
+#include "AudioReactive.h"
+#endif
 
-//uncomment this line if using a Common Anode LED
-//#define COMMON_ANODE
+#ifdef PIXEL_STRIP
+#include <NeoPixelBus.h>          //https://github.com/Makuna/NeoPixelBus
+#include "LedPixels.h"
+#endif
 
 char mqtt_server[40];
 char mqtt_port[6];
 char mqtt_topic[50];
+char mqtt_group[32];
 char blynk_server[40];
 char blynk_port[6];
 char blynk_token[34];
 
-//flag for saving data
-bool shouldSaveConfig = false;
+ESP8266WebServer httpServer(80);
 
-WiFiClient wifiClient;
-PubSubClient mqttClient(wifiClient);
+// It allows to avoid that small variations of voltage turn on the light
+#define THRESHOLD_FOR_TURN_ON 100
 
-long mqttLastMsg = 0;
-long mqttLastConnect = 0;
+// Energy counters are saved to the journal each 15 minutes (only if changed)
+#define ENERGY_JOURNAL_INTERVAL 900000
+#define ENERGY_JOURNAL_RECORDS 64
 
-// Send telemetry each 5 minutes // TODO: 300 000
-#define MQTT_TELEMETRY_INTERVAL 300000
-#define MQTT_RETRY_CONNECT_INTERVAL 30000
+// Supply voltage of the led strips in mV, used for the energy counters
+#define POWER_SUPPLY_VOLTAGE 12000
 
-// It allows to avoid that small variations of voltage turn on the light
-#define THRESHOLD_FOR_TURN_ON 100
+// Time server used by the schedules and to start the shows at the same time on
+// several controllers
+#define SNTP_SERVER "pool.ntp.org"
+
+// Offset of the local time from UTC in seconds, the schedules use local time
+#define TIMEZONE_OFFSET -21600
+
+// PWM frequency of the led strips, high enough to avoid flicker on cameras
+#define PWM_FREQUENCY 2000
+
+// Current model of the led strip (mA per meter of each channel at full duty),
+// length of the strip and maximum current of the power supply. The output is
+// scaled down when a frame exceeds the budget (0 disables the limiter).
+#define LED_STRIP_RGB_CURRENT 400
+#define LED_STRIP_W_CURRENT 400
+#define LED_STRIP_LENGTH 500
+#define POWER_SUPPLY_CURRENT 3000
 
 const uint8_t RED_PIN = D2;
 const uint8_t GREEN_PIN = D1;
@@ -133,11 +298,18 @@ const uint8_t BTN_MODE_PIN = D3;
 const uint8_t BLUE_PIN = D7;
 const uint8_t WHITE_PIN = D6;
 const uint8_t POT_COLOR_PIN = A0;
+const uint8_t EXPANDER_SDA_PIN = D2;
+const uint8_t EXPANDER_SCL_PIN = D1;
 
 const char CONFIG_FILE[] = "/config.json";
+const char ENERGY_FILE[] = "/energy.bin";
+const char PROGRAM_FILE[] = "/program.bin";
+const char SCHEDULE_FILE[] = "/schedule.bin";
+const char HISTORY_FILE[] = "/history.bin";
 const char KEY_MQTT_SERVER[] = "mqtt_server";
 const char KEY_MQTT_PORT[] = "mqtt_port";
 const char KEY_MQTT_TOPIC[] = "mqtt_topic";
+const char KEY_MQTT_GROUP[] = "mqtt_group";
 const char KEY_BLYNK_SERVER[] = "blynk_server";
 const char KEY_BLYNK_PORT[] = "blynk_port";
 const char KEY_BLYNK_TOKEN[] = "blynk_token";
@@ -149,16 +321,50 @@ uint32_t last_color = COLOR_WHITE;
 // Allows validation if there is a change in voltage
 uint16_t last_pot_color_value = 1;
 
+#ifdef PWM_EXPANDER
+// Instance of the PCA9685 expander, each group of 4 outputs drives a RGBW zone
+PwmPCA9685Backend pwm_expander(PCA9685_DEFAULT_ADDRESS);
+// Instance that allows to handle the RGB leds of the strip of leds
+LedStripRGB led_strip_rgb(&pwm_expander, { 0, 1, 2 });
+// Instance that allows to handle the led of white light of the strip of leds
+LedStrip led_strip_w(&pwm_expander, 3);
+// Instances of the strips of the zones 1-3
+LedStripRGB led_strip_rgb_1(&pwm_expander, { 4, 5, 6 });
+LedStrip led_strip_w_1(&pwm_expander, 7);
+LedStripRGB led_strip_rgb_2(&pwm_expander, { 8, 9, 10 });
+LedStrip led_strip_w_2(&pwm_expander, 11);
+LedStripRGB led_strip_rgb_3(&pwm_expander, { 12, 13, 14 });
+LedStrip led_strip_w_3(&pwm_expander, 15);
+#else
 // Instance that allows to handle the RGB leds of the strip of leds
 LedStripRGB led_strip_rgb({ RED_PIN, GREEN_PIN, BLUE_PIN });
 // Instance that allows to handle the led of white light of the strip of leds
 LedStrip led_strip_w(WHITE_PIN);
-
-// Callback notifying us of the need to save config
-void saveConfigCallback () {
-  Serial.println(F("Should save config."));
-  shouldSaveConfig = true;
-}
+#endif
+
+#ifdef PIXEL_STRIP
+// Addressable strip, it follows the state of the zone 0. The frame is sent by
+// UART1 on GPIO2, the RX pin is kept for the commands of the serial port (the
+// DMA method would take it).
+LedPixels led_pixels(PIXEL_STRIP);
+NeoPixelBus<NeoGrbFeature, NeoEsp8266Uart1800KbpsMethod> pixel_bus(PIXEL_STRIP);
+#endif
+
+#ifdef AUDIO_REACTIVE
+// Analysis of the audio signal for the Audio mode
+AudioReactive audio(POT_COLOR_PIN);
+#endif
+
+// Zones driven by the controller, the zone 0 is led_strip_rgb and led_strip_w
+LedZones led_zones;
+
+// Light show played on the zones (events of a file of the file system)
+LedTimeline led_show(&led_zones);
+// Actions applied to the zones at a time of the day, the clock is set by SNTP
+SntpTimeSource time_source;
+LedScheduler scheduler(&led_zones, &time_source);
+// Changes of the state of the zones and their source, uploaded by MQTT
+LedHistory history(&led_zones, &time_source);
 
 void saveConfig() {
   Serial.println(F("Saving config... "));
@@ -167,6 +373,7 @@ void saveConfig() {
   json[KEY_MQTT_SERVER] = mqtt_server;
   json[KEY_MQTT_PORT] = mqtt_port;
   json[KEY_MQTT_TOPIC] = mqtt_topic;
+  json[KEY_MQTT_GROUP] = mqtt_group;
   json[KEY_BLYNK_SERVER] = blynk_server;
   json[KEY_BLYNK_PORT] = blynk_port;
   json[KEY_BLYNK_TOKEN] = blynk_token;
@@ -205,6 +412,10 @@ void mountFS() {
           strcpy(mqtt_server, json[KEY_MQTT_SERVER]);
           strcpy(mqtt_port, json[KEY_MQTT_PORT]);
           strcpy(mqtt_topic, json[KEY_MQTT_TOPIC]);
+          // The group was added later, the old configs do not have it
+          if (json.containsKey(KEY_MQTT_GROUP)) {
+            strcpy(mqtt_group, json[KEY_MQTT_GROUP]);
+          }
           strcpy(blynk_server, json[KEY_BLYNK_SERVER]);
           strcpy(blynk_port, json[KEY_BLYNK_PORT]);
           strcpy(blynk_token, json[KEY_BLYNK_TOKEN]);
@@ -219,27 +430,151 @@ void mountFS() {
   }
 }
 
-String getState()
+/*
+ * The energy counters are kept in a journal of fixed size records, the last
+ * valid record is restored at boot. A record is appended only when the
+ * counters changed, at most once each ENERGY_JOURNAL_INTERVAL, and the file is
+ * started again when it reaches ENERGY_JOURNAL_RECORDS.
+ */
+struct EnergyRecord
 {
-  StaticJsonBuffer<512> jsonBuffer;
-  JsonObject &root = jsonBuffer.createObject();
-  // root["uptime"] = millis();
+  uint32_t sequence;
+  uint32_t energy[PWM_MAX_CHANNELS];
+  uint32_t checksum;
+};
+
+EnergyRecord energy_record = { 0, { 0 }, 0 };
+uint64_t energyLastSave = 0;
+
+uint32_t energyChecksum(EnergyRecord &record)
+{
+  uint32_t checksum = 0x5050 ^ record.sequence;
+  for(uint8_t i = 0; i < PWM_MAX_CHANNELS; i++)
+  {
+    checksum = (checksum << 5 | checksum >> 27) ^ record.energy[i];
+  }
+  return checksum;
+}
+
+void loadEnergy() {
+  File energyFile = SPIFFS.open(ENERGY_FILE, "r");
+  if (!energyFile) {
+    return;
+  }
+  EnergyRecord record;
+  while (energyFile.read((uint8_t*) &record, sizeof(record)) == sizeof(record)) {
+    if (record.checksum == energyChecksum(record) &&
+      record.sequence >= energy_record.sequence) {
+      energy_record = record;
+    }
+  }
+  energyFile.close();
+  for(uint8_t i = 0; i < PwmOut.getChannelCount(); i++)
+  {
+    PwmOut.setEnergy(i, energy_record.energy[i]);
+  }
+  Serial.printf("Energy restored, record %u\r\n", energy_record.sequence);
+}
+
+void saveEnergy() {
+  uint64_t now = SystemClock.millis64();
+  if (now - energyLastSave < ENERGY_JOURNAL_INTERVAL) {
+    return;
+  }
+  energyLastSave = now;
+
+  bool changed = false;
+  for(uint8_t i = 0; i < PwmOut.getChannelCount(); i++)
+  {
+    uint32_t energy = PwmOut.getEnergy(i);
+    changed |= energy != energy_record.energy[i];
+    energy_record.energy[i] = energy;
+  }
+  if (!changed) {
+    return;
+  }
+  energy_record.sequence++;
+  energy_record.checksum = energyChecksum(energy_record);
+
+  bool full = energy_record.sequence % ENERGY_JOURNAL_RECORDS == 0;
+  File energyFile = SPIFFS.open(ENERGY_FILE, full ? "w" : "a");
+  if (!energyFile) {
+    Serial.println(F("Failed to open energy file for writing"));
+    return;
+  }
+  energyFile.write((const uint8_t*) &energy_record, sizeof(energy_record));
+  energyFile.close();
+}
+
+/*
+ * The effect of the Program mode is shared by all the zones, the last program
+ * uploaded is saved as is and loaded again at boot.
+ */
+void loadProgram() {
+  File programFile = SPIFFS.open(PROGRAM_FILE, "r");
+  if (!programFile) {
+    return;
+  }
+  uint8_t program[EFFECT_PROGRAM_SIZE];
+  uint16_t size = programFile.read(program, sizeof(program));
+  programFile.close();
+  bool loaded = false;
+  for (uint8_t i = 0; i < led_zones.count(); i++)
+  {
+    loaded = led_zones.rgb(i)->loadProgram(program, size);
+  }
+  Serial.println(loaded ? F("Program restored") : F("Invalid program file"));
+}
+
+void saveProgram(const uint8_t *program, uint16_t size) {
+  File programFile = SPIFFS.open(PROGRAM_FILE, "w");
+  if (!programFile) {
+    Serial.println(F("Failed to open program file for writing"));
+    return;
+  }
+  programFile.write(program, size);
+  programFile.close();
+}
+
+float getEnergyWh(int8_t channel)
+{
+  return channel < 0 ? 0 : PwmOut.getEnergy(channel) / 1000.0;
+}
+
+void addEnergy(JsonObject &energy, uint8_t zone)
+{
+  RGBColor channels = led_zones.rgb(zone)->getChannels();
+  LedStrip *strip_w = led_zones.white(zone);
+  energy["white"] = getEnergyWh(strip_w ? strip_w->getChannel() : -1);
+  energy["red"] = getEnergyWh(channels.red);
+  energy["green"] = getEnergyWh(channels.green);
+  energy["blue"] = getEnergyWh(channels.blue);
+}
+
+/*
+ * Add the state of the white and the RGB strips of a zone.
+ */
+void addZoneState(JsonObject &root, uint8_t zone)
+{
+  LedStripRGB &strip_rgb = *led_zones.rgb(zone);
+  LedStrip *strip_w = led_zones.white(zone);
+
   JsonObject &white = root.createNestedObject("white");
   JsonObject &rgb = root.createNestedObject("rgb");
 
-  if(led_strip_w.getState() == LedStripState::ON)
+  if(strip_w && strip_w->getState() == LedStripState::ON)
   {
     white["state"] = "ON";
-    white["intensity"] = led_strip_w.getIntensity();
+    white["intensity"] = strip_w->getIntensity();
   } else {
     white["state"] = "OFF";
     white["intensity"] = 0;
   }
 
-  if(led_strip_rgb.getState() == LedStripState::ON)
+  if(strip_rgb.getState() == LedStripState::ON)
   {
     rgb["state"] = "ON";
-    LedStripRgbMode mode = led_strip_rgb.getMode();
+    LedStripRgbMode mode = strip_rgb.getMode();
     switch (mode) {
       case LedStripRgbMode::NORMAL:
         rgb["mode"] = "NORMAL";
@@ -253,240 +588,530 @@ String getState()
       case LedStripRgbMode::FADE:
         rgb["mode"] = "FADE";
         break;
+      case LedStripRgbMode::AUDIO:
+        rgb["mode"] = "AUDIO";
+        break;
+      case LedStripRgbMode::PROGRAM:
+        rgb["mode"] = "PROGRAM";
+        break;
     }
   } else {
     rgb["state"] = "OFF";
     rgb["mode"] = "";
   }
-  RGBColor c = led_strip_rgb.getRGBColor();
+  RGBColor c = strip_rgb.getRGBColor();
   rgb["color"] = "#" + String(c.red, HEX) + String(c.green, HEX) + String(c.blue, HEX);
-
-  String json;
-  root.printTo(json);
-  return json;
+  rgb["brightness"] = strip_rgb.getBrightness();
+  rgb["speed"] = strip_rgb.getSpeed();
+  rgb["cpm"] = strip_rgb.getCyclesPerMinute() / 100.0;
 }
 
-void mqttSendTele() {
-  long now = millis();
-  if (now - mqttLastMsg > MQTT_TELEMETRY_INTERVAL) {
-    mqttLastMsg = now;
+/*
+ * Add the state shared by the zones (the energy is the one of the zone).
+ */
+void addDeviceState(JsonObject &root, uint8_t zone, bool telemetry)
+{
+  JsonObject &power = root.createNestedObject("power");
+  if(telemetry)
+  {
+    power["current"] = PwmOut.getCurrentEstimate();
+  }
+  power["limited"] = PwmOut.isLimiting();
 
-    String json = getState();
+  JsonObject &strobe = root.createNestedObject("strobe");
+  strobe["frequency"] = Strobe.getFrequency() / 100.0;
+  strobe["duty"] = Strobe.getDuty();
+  if(telemetry)
+  {
+    strobe["jitter"] = Strobe.getJitter();
+
+    JsonObject &energy = root.createNestedObject("energy");
+    addEnergy(energy, zone);
 
-    char teleTopic[] = "/tele/STATE";
-    char topic[sizeof(mqtt_topic) + sizeof(teleTopic) + 1];
-    sprintf(topic, "%s%s", mqtt_topic, teleTopic);
-    char payload[json.length() + 1];
-    json.toCharArray(payload, json.length() + 1);
-    Serial.printf("%s %s\r\n", topic, payload);
-    mqttClient.publish(topic, payload);
+    mqttAddState(root);
+    blynkAddState(root);
   }
+  otaAddState(root);
 }
 
-void mqttSendStat()
+/*
+ * State of a zone in JSON. The telemetry are the fields that change on every
+ * read (the current estimate, the jitter of the strobe, the energy and the
+ * counters of the modules), they are left out to compare the states.
+ */
+String getState(uint8_t zone, bool telemetry)
 {
-  String json = getState();
+  StaticJsonBuffer<1248> jsonBuffer;
+  JsonObject &root = jsonBuffer.createObject();
+  // root["uptime"] = millis();
+  addZoneState(root, zone);
+  addDeviceState(root, zone, telemetry);
 
-  char statTopic[] = "/stat/STATE";
-  char topic[sizeof(mqtt_topic) + sizeof(statTopic) + 1];
-  sprintf(topic, "%s%s", mqtt_topic, statTopic);
-  char payload[json.length() + 1];
-  json.toCharArray(payload, json.length() + 1);
-  Serial.printf("%s %s\r\n", topic, payload);
-  mqttClient.publish(topic, payload);
+  String json;
+  root.printTo(json);
+  return json;
 }
 
-WidgetLED whiteLed(V4);
-WidgetLED redLed(V5);
-WidgetLED greenLed(V6);
-WidgetLED blueLed(V7);
-
-void updateWidgets(void)
+/*
+ * State of all the zones in JSON: the state of the first zone and, with more
+ * zones, {"zones": {"1": {"white": ..., "rgb": ..., "energy": ...}, ...}}.
+ */
+String getDeviceState(bool telemetry)
 {
-  if(led_strip_w.getState() == LedStripState::ON)
+  DynamicJsonBuffer jsonBuffer;
+  JsonObject &root = jsonBuffer.createObject();
+  addZoneState(root, 0);
+  addDeviceState(root, 0, telemetry);
+  if(led_zones.count() > 1)
   {
-    whiteLed.setValue(led_strip_w.getIntensity());
-    Blynk.virtualWrite(V8, 1);
-  } else {
-    whiteLed.off();
-    Blynk.virtualWrite(V8, 0);
+    JsonObject &zones = root.createNestedObject("zones");
+    for(uint8_t zone = 1; zone < led_zones.count(); zone++)
+    {
+      JsonObject &state = zones.createNestedObject(String(zone));
+      addZoneState(state, zone);
+      if(telemetry)
+      {
+        JsonObject &energy = state.createNestedObject("energy");
+        addEnergy(energy, zone);
+      }
+    }
   }
-  if(led_strip_rgb.getState() == LedStripState::ON)
+
+  String json;
+  root.printTo(json);
+  return json;
+}
+
+uint8_t restZone()
+{
+  uint8_t zone = httpServer.arg("zone").toInt();
+  return zone < led_zones.count() ? zone : 0;
+}
+
+void restGetState()
+{
+  httpServer.send(200, "application/json", getState(restZone()));
+}
+
+void restGetSchedule()
+{
+  DynamicJsonBuffer jsonBuffer;
+  JsonArray &root = jsonBuffer.createArray();
+  ScheduleEntry entry;
+  for (uint8_t i = 0; i < SCHEDULE_MAX_ENTRIES; i++)
   {
-    RGBColor color = led_strip_rgb.getRGBColor();
-    redLed.setValue(color.red);
-    greenLed.setValue(color.green);
-    blueLed.setValue(color.blue);
-    Blynk.virtualWrite(V2, led_strip_rgb.getMode() + 1);
-  } else {
-    redLed.off();
-    greenLed.off();
-    blueLed.off();
-    Blynk.virtualWrite(V2, 0);
+    if (!scheduler.get(i, entry))
+    {
+      continue;
+    }
+    char time[9];
+    snprintf(time, sizeof(time), "%02u:%02u:%02u", entry.time / 3600, entry.time / 60 % 60, entry.time % 60);
+    JsonObject &item = root.createNestedObject();
+    item["id"] = i;
+    item["days"] = entry.days;
+    item["time"] = String(time);
+    item["zones"] = entry.zones;
+    item["action"] = entry.action;
+    item["value"] = entry.value;
+    item["ramp"] = entry.ramp;
+    item["next"] = scheduler.getExpiry(i);
   }
-  mqttSendStat();
+
+  String json;
+  root.printTo(json);
+  httpServer.send(200, "application/json", json);
 }
 
-void mqttCallback(char* topic, byte* payload, unsigned int length) {
+void restGetEnergy()
+{
+  StaticJsonBuffer<256> jsonBuffer;
+  JsonObject &root = jsonBuffer.createObject();
+  addEnergy(root, restZone());
 
-  Serial.print(topic);
-  Serial.print(" ");
+  String json;
+  root.printTo(json);
+  httpServer.send(200, "application/json", json);
+}
 
-  char caPayload[length];
+/*
+ * The metrics are written to the socket in chunks as they are printed, the
+ * response is closed at the end instead of sending its length.
+ */
+void restGetMetrics()
+{
+  WiFiClient client = httpServer.client();
+  client.print(F("HTTP/1.1 200 OK\r\n"
+                 "Content-Type: text/plain; version=0.0.4\r\n"
+                 "Connection: close\r\n\r\n"));
+  MetricsWriter writer(client);
+  metricsWrite(writer);
+  writer.flush();
+  client.stop();
+}
 
-  for (unsigned int i = 0; i < length; i++) {
-    caPayload[i] = payload[i];
-    Serial.print((char)payload[i]);
-  }
-  Serial.println();
+/*
+ * Send the state to the modules after a change (the widgets of Blynk and the
+ * stat topic of MQTT), the fields changed are recorded in the history.
+ */
+void publishState(ChangeSource source)
+{
+  history.record(source);
+  blynkUpdate();
+  mqttSendStat();
+}
 
-  String strTopic = String(topic);
-  String strPayload = String(caPayload);
+/*
+ * The Audio mode needs the audio input and the Program mode a loaded program.
+ */
+bool modeAvailable(LedStripRGB &strip_rgb, LedStripRgbMode mode)
+{
+#ifndef AUDIO_REACTIVE
+  if(mode == LedStripRgbMode::AUDIO)
+  {
+    return false;
+  }
+#endif
+  return mode != LedStripRgbMode::PROGRAM || strip_rgb.hasProgram();
+}
 
-  strPayload.trim();
-  strPayload.toLowerCase();
+/*
+ * Apply a command to the strips of a zone. The command is the path of the
+ * topic after cmnd (for example "/rgb/color").
+ */
+void applyZoneCommand(uint8_t zone, String &command, String &value)
+{
+  LedStripRGB &strip_rgb = *led_zones.rgb(zone);
+  LedStrip *strip_w = led_zones.white(zone);
 
-  if (strTopic.endsWith("/white"))
+  if (command.endsWith("/white") && strip_w)
   {
-    if (strPayload.startsWith("on"))
+    if (value.startsWith("on"))
     {
-      led_strip_w.turnOn();
-    } else if(strPayload.startsWith("off"))
+      strip_w->turnOn();
+    } else if(value.startsWith("off"))
     {
-      led_strip_w.turnOff();
+      strip_w->turnOff();
     }
-  } else if(strTopic.endsWith("/white/intensity"))
+  } else if(command.endsWith("/white/intensity") && strip_w)
   {
-    uint32_t intensity = strPayload.toInt();
-    led_strip_w.setIntensity(intensity);
-  } else if(strTopic.endsWith("/rgb"))
+    uint32_t intensity = value.toInt();
+    strip_w->setIntensity(intensity);
+  } else if(command.endsWith("/rgb"))
   {
-    if (strPayload.startsWith("on"))
+    if (value.startsWith("on"))
     {
-      led_strip_rgb.turnOn();
-    } else if(strPayload.startsWith("off"))
+      strip_rgb.turnOn();
+    } else if(value.startsWith("off"))
     {
-      led_strip_rgb.turnOff();
+      strip_rgb.turnOff();
     }
-  } else if(strTopic.endsWith("/rgb/mode"))
+  } else if(command.endsWith("/rgb/mode"))
   {
-    if(strPayload.startsWith("normal"))
+    LedStripRgbMode mode;
+    if(LedStripRGB::parseMode(value.c_str(), mode) && modeAvailable(strip_rgb, mode))
     {
-      led_strip_rgb.setMode(LedStripRgbMode::NORMAL);
-    } else if(strPayload.startsWith("strobe"))
+      strip_rgb.setMode(mode);
+    }
+    strip_rgb.turnOn();
+  } else if(command.endsWith("/rgb/color"))
+  {
+    uint32_t color = value.toInt();
+    strip_rgb.setColor(color);
+  } else if(command.endsWith("/rgb/brightness"))
+  {
+    strip_rgb.setBrightness(constrain(value.toInt(), 0, 255));
+  } else if(command.endsWith("/rgb/speed"))
+  {
+    // 0-1023 | Ncpm
+    if(value.endsWith("cpm"))
     {
-      led_strip_rgb.setMode(LedStripRgbMode::STROBE);
-    } else if(strPayload.startsWith("flash"))
+      strip_rgb.setCyclesPerMinute(value.toFloat() * 100);
+    } else
     {
-      led_strip_rgb.setMode(LedStripRgbMode::FLASH);
-    } else if(strPayload.startsWith("fade"))
+      strip_rgb.setSpeed(constrain(value.toInt(), 0, SPEED_MAX));
+    }
+  } else if(command.endsWith("/rgb/strobe"))
+  {
+    // Hz[,duty]
+    int comma = value.indexOf(',');
+    Strobe.setFrequency(value.toFloat() * 100);
+    if(comma > 0)
     {
-      led_strip_rgb.setMode(LedStripRgbMode::FADE);
+      Strobe.setDuty(constrain(value.substring(comma + 1).toInt(), 0, 255));
     }
-    led_strip_rgb.turnOn();
-  } else if(strTopic.endsWith("/rgb/color"))
-  {
-    uint32_t color = strPayload.toInt();
-    led_strip_rgb.setColor(color);
-  }
-  updateWidgets();
-}
-
-void mqttConnect() {
-  long now = millis();
-  if (now - mqttLastConnect > MQTT_RETRY_CONNECT_INTERVAL)
-  {
-    mqttLastConnect = millis();
-    Serial.print(F("Attempting MQTT connection..."));
-    // Create a random client ID
-    String clientId = "ESP8266Client-";
-    clientId += String(random(0xffff), HEX);
-    // Attempt to connect
-    if (mqttClient.connect(clientId.c_str())) {
-      Serial.println(F("Connected"));
-      // Once connected, publish an announcement...
-      char teleTopic[] = "/tele/LWT";
-      char topic[sizeof(mqtt_topic) + sizeof(teleTopic) + 1];
-      sprintf(topic, "%s%s", mqtt_topic, teleTopic);
-      Serial.printf("%s ONLINE\r\n", topic);
-      mqttClient.publish(topic, "ONLINE");
-      // ... and resubscribe
-      char cmndTopic[] = "/cmnd/#";
-      char subTopic[sizeof(mqtt_topic) + sizeof(cmndTopic) + 1];
-      sprintf(subTopic, "%s%s", mqtt_topic, cmndTopic);
-      Serial.print(F("Subscribe to "));
-      Serial.println(subTopic);
-      mqttClient.subscribe(subTopic);
-    } else {
-      Serial.print(F("failed, rc="));
-      Serial.print(mqttClient.state());
-      Serial.print(F(" Try again in "));
-      Serial.print(MQTT_RETRY_CONNECT_INTERVAL / 1000);
-      Serial.println(F(" seconds"));
-    }
-  }
-}
-
-BLYNK_WRITE(V0) // zeRGBa assigned to V0
-{
-  int red = param[0].asInt();
-  int green = param[1].asInt();
-  int blue = param[2].asInt();
+  } else if(command.endsWith("/rgb/notify"))
+  {
+    // color[,count[,alpha | add | multiply[,alpha]]]
+    if(value.startsWith("off"))
+    {
+      strip_rgb.clearNotification();
+      return;
+    }
+    int first = value.indexOf(',');
+    int second = first < 0 ? -1 : value.indexOf(',', first + 1);
+    int third = second < 0 ? -1 : value.indexOf(',', second + 1);
+    uint32_t color = value.toInt();
+    uint8_t count = first < 0 ? 3 : value.substring(first + 1).toInt();
+    String mode = second < 0 ? "" : value.substring(second + 1);
+    uint8_t alpha = third < 0 ? 255 : constrain(value.substring(third + 1).toInt(), 0, 255);
+    LedBlendMode blend = LedBlendMode::ALPHA;
+    if(mode.startsWith("add"))
+    {
+      blend = LedBlendMode::ADD;
+    } else if(mode.startsWith("multiply"))
+    {
+      blend = LedBlendMode::MULTIPLY;
+    }
+    strip_rgb.notify(color, count, blend, alpha);
+  }
+}
 
-  red = (red & 0xFF) << 16;
-  green = (green & 0xFF) << 8;
-  blue = blue & 0xFF;
+/*
+ * Load the program (hex bytecode) of the Program mode in the zones of the mask,
+ * it is saved only when it is valid.
+ */
+void applyProgram(uint8_t zones, String &value)
+{
+  if (value.startsWith("off"))
+  {
+    for (uint8_t i = 0; i < led_zones.count(); i++)
+    {
+      if ((zones & (1 << i)) && led_zones.rgb(i)->getMode() == LedStripRgbMode::PROGRAM)
+      {
+        led_zones.rgb(i)->setMode(LedStripRgbMode::NORMAL);
+      }
+    }
+    SPIFFS.remove(PROGRAM_FILE);
+    return;
+  }
+  uint8_t program[EFFECT_PROGRAM_SIZE];
+  uint16_t size = value.length() / 2;
+  if (size > EFFECT_PROGRAM_SIZE)
+  {
+    Serial.println(F("Program too large"));
+    return;
+  }
+  for (uint16_t i = 0; i < size; i++)
+  {
+    program[i] = strtoul(value.substring(2 * i, 2 * i + 2).c_str(), NULL, 16);
+  }
+  if (!EffectVM::verify(program, size))
+  {
+    Serial.println(F("Invalid program"));
+    return;
+  }
+  for (uint8_t i = 0; i < led_zones.count(); i++)
+  {
+    if (zones & (1 << i))
+    {
+      led_zones.rgb(i)->loadProgram(program, size);
+    }
+  }
+  saveProgram(program, size);
+}
 
-  uint32_t color = red + green + blue;
-  led_strip_rgb.setColor(color);
-  updateWidgets();
+/*
+ * The show addresses its own zones, the start time is converted from the UTC
+ * epoch (SNTP) to the time of SystemClock.
+ */
+void applyShow(String &command, String &value)
+{
+  if (command.endsWith("/show/play"))
+  {
+    int comma = value.indexOf(',');
+    String file = comma < 0 ? value : value.substring(0, comma);
+    if (!file.startsWith("/"))
+    {
+      file = "/" + file;
+    }
+    if (!led_show.open(file.c_str()))
+    {
+      Serial.println(F("Invalid show file"));
+      return;
+    }
+    uint64_t start = SystemClock.millis64();
+    uint32_t now = time_source.now();
+    uint32_t epoch = comma < 0 ? 0 : value.substring(comma + 1).toInt();
+    if (epoch > now && time_source.isValid())
+    {
+      start += (uint64_t) (epoch - now) * 1000;
+    }
+    led_show.play(start);
+  } else if (command.endsWith("/show/stop"))
+  {
+    led_show.stop();
+  } else if (command.endsWith("/show/seek"))
+  {
+    led_show.seek(value.toInt(), SystemClock.millis64());
+  } else if (command.endsWith("/show/loop"))
+  {
+    led_show.setLoop(value.startsWith("on"));
+  }
 }
 
-BLYNK_WRITE(V1) // Slider (0 - 255) to V1
+/*
+ * Parse an action of a schedule or a show (rgb, mode, color, speed,
+ * brightness or white) and its value.
+ * @return  false if the action is not valid
+ */
+bool parseZoneAction(String action, String value, uint8_t &zoneAction, uint32_t &zoneValue)
 {
-  // Light intensity
-  int intensity = param[0].asInt();
-  led_strip_w.setIntensity(intensity);
-  updateWidgets();
+  action.trim();
+  value.trim();
+  zoneValue = value.toInt();
+  if (action == "rgb")
+  {
+    zoneAction = ZONE_RGB_STATE;
+    zoneValue = value.startsWith("on");
+  } else if (action == "mode")
+  {
+    LedStripRgbMode mode;
+    zoneAction = ZONE_RGB_MODE;
+    if (!LedStripRGB::parseMode(value.c_str(), mode))
+    {
+      return false;
+    }
+    zoneValue = mode;
+  } else if (action == "color")
+  {
+    zoneAction = ZONE_RGB_COLOR;
+  } else if (action == "speed")
+  {
+    zoneAction = ZONE_RGB_SPEED;
+  } else if (action == "brightness")
+  {
+    zoneAction = ZONE_BRIGHTNESS;
+  } else if (action == "white")
+  {
+    zoneAction = ZONE_WHITE;
+  } else
+  {
+    return false;
+  }
+  return true;
 }
 
-BLYNK_WRITE(V2) // Menu [Normal, Strobe, Flash, Fade]  to V2
+/*
+ * The schedules apply to the zones of the mask, they are saved on each change.
+ */
+void applySchedule(uint8_t zones, String &command, String &value)
 {
-  // Menu option selected
-  switch (param[0].asInt())
+  if (command.endsWith("/schedule/add"))
   {
-    case 1: { // Normal
-      led_strip_rgb.setMode(LedStripRgbMode::NORMAL);
-      led_strip_rgb.turnOn();
-      break;
+    // HH:MM[:SS],days,action,value[,ramp]
+    int fields[4];
+    int from = 0;
+    for (uint8_t i = 0; i < 4; i++)
+    {
+      fields[i] = value.indexOf(',', from);
+      from = fields[i] + 1;
+      if (fields[i] < 0 && i < 3)
+      {
+        Serial.println(F("Invalid schedule"));
+        return;
+      }
     }
-    case 2: { // Strobe
-      led_strip_rgb.setMode(LedStripRgbMode::STROBE);
-      led_strip_rgb.turnOn();
-      break;
+    ScheduleEntry entry = { 0, SCHEDULE_DAILY, zones, 0, 0, 0, 0, 0 };
+    int colon = value.indexOf(':');
+    entry.time = value.substring(0, colon).toInt() * 3600 + value.substring(colon + 1).toInt() * 60;
+    int seconds = value.indexOf(':', colon + 1);
+    if (seconds > 0 && seconds < fields[0])
+    {
+      entry.time += value.substring(seconds + 1).toInt();
     }
-    case 3: { // Flash
-      led_strip_rgb.setMode(LedStripRgbMode::FLASH);
-      led_strip_rgb.turnOn();
-      break;
+    String days = value.substring(fields[0] + 1, fields[1]);
+    if (days.startsWith("once"))
+    {
+      entry.days = SCHEDULE_ONCE;
+    } else if (!days.startsWith("daily"))
+    {
+      entry.days = 0;
+      for (uint8_t i = 0; i < days.length(); i++)
+      {
+        if (days[i] >= '0' && days[i] <= '6')
+        {
+          entry.days |= 1 << (days[i] - '0');
+        }
+      }
     }
-    case 4: { // Fade
-      led_strip_rgb.setMode(LedStripRgbMode::FADE);
-      led_strip_rgb.turnOn();
-      break;
+    String action = value.substring(fields[1] + 1, fields[2]);
+    String actionValue = fields[3] < 0 ? value.substring(fields[2] + 1) : value.substring(fields[2] + 1, fields[3]);
+    uint32_t zoneValue;
+    if (!parseZoneAction(action, actionValue, entry.action, zoneValue))
+    {
+      Serial.println(F("Invalid schedule action"));
+      return;
+    }
+    entry.value = zoneValue;
+    entry.ramp = fields[3] < 0 ? 0 : value.substring(fields[3] + 1).toInt();
+    int8_t id = scheduler.add(entry);
+    Serial.printf("Schedule %d added\r\n", id);
+  } else if (command.endsWith("/schedule/remove"))
+  {
+    scheduler.remove(value.toInt());
+  } else if (command.endsWith("/schedule/clear"))
+  {
+    scheduler.clear();
+  }
+  scheduler.save(SCHEDULE_FILE);
+}
+
+/*
+ * Apply a command to each one of the zones of the mask.
+ */
+void applyCommand(uint8_t zones, String &command, String &value)
+{
+  if (command.endsWith("/rgb/program"))
+  {
+    applyProgram(zones, value);
+    return;
+  }
+  if (command.indexOf("/show/") >= 0)
+  {
+    applyShow(command, value);
+    return;
+  }
+  if (command.indexOf("/schedule/") >= 0)
+  {
+    applySchedule(zones, command, value);
+    return;
+  }
+  if (command.indexOf("/ota/") >= 0)
+  {
+    otaCommand(command, value);
+    return;
+  }
+  for (uint8_t i = 0; i < led_zones.count(); i++)
+  {
+    if (zones & (1 << i))
+    {
+      applyZoneCommand(i, command, value);
     }
   }
-  updateWidgets();
 }
 
-BLYNK_WRITE(V8) // Switch button to V8
+/*
+ * Rest API command, the arguments are the zones ("all", "2" or "1,3", zone 0
+ * by default), the command path (for example "rgb/color") and the value.
+ */
+void restCommand()
 {
-  if (param[0].asInt() == 0) {
-    led_strip_w.turnOff();
-  } else {
-    led_strip_w.turnOn();
+  String zone = httpServer.arg("zone");
+  uint8_t zones = zone.length() > 0 ? led_zones.parseMask(zone.c_str()) : 1;
+  String command = "/" + httpServer.arg("command");
+  String value = httpServer.arg("value");
+  value.trim();
+  if (!command.endsWith("/ota/update")) {
+    // The URL of the firmware keeps its case
+    value.toLowerCase();
+  }
+  if (zones == 0 || command.length() < 2) {
+    httpServer.send(400, "text/plain", "Invalid zone or command");
+    return;
   }
-  updateWidgets();
+  applyCommand(zones, command, value);
+  publishState(SOURCE_REST);
+  httpServer.send(200, "application/json", getState(led_zones.first(zones)));
 }
 
 /*
@@ -533,15 +1158,7 @@ void btnModeShortPressed(void)
   {
     led_strip_rgb.nextMode();
   }
-  updateWidgets();
-}
-
-BLYNK_WRITE(V3) // Push button to V3
-{
-  if(param.asInt())
-  {
-    btnModeShortPressed();
-  }
+  publishState(SOURCE_BUTTON);
 }
 
 /*
@@ -552,7 +1169,7 @@ void btnModeLongPressed(void)
 {
   led_strip_w.turnOff();
   led_strip_rgb.turnOff();
-  updateWidgets();
+  publishState(SOURCE_BUTTON);
 }
 
 // Instance to handle button press events.
@@ -599,7 +1216,7 @@ uint32_t color_mixer(uint16_t input_value)
  *  - When the RGB leds are turned on in Normal or Strobe mode, then change
  *  the color with the help of the color_mixer function.
  *  - If the RGB LEDs are on in Flash or Fade mode, then the speed of the color
- *    sequence is changed.
+ *    sequence is changed (see EffectClock), the sequence is not restarted.
  */
 void readPotValue(void)
 {
@@ -615,7 +1232,7 @@ void readPotValue(void)
           led_strip_rgb.setColor(color_mixer(new_pot_value));
           break;
         case LedStripRgbMode::STROBE:
-          led_strip_rgb.setColor(color_mixer(new_pot_value));
+          Strobe.setFrequency(map(new_pot_value, 0, 1023, STROBE_MIN_FREQUENCY, STROBE_MAX_FREQUENCY));
           break;
         case LedStripRgbMode::FLASH:
           led_strip_rgb.setSpeed(new_pot_value);
@@ -623,6 +1240,8 @@ void readPotValue(void)
         case LedStripRgbMode::FADE:
           led_strip_rgb.setSpeed(new_pot_value);
           break;
+        default:
+          break;
       }
     }
     else if(led_strip_w.getState() == LedStripState::ON)
@@ -639,10 +1258,92 @@ void readPotValue(void)
         led_strip_w.turnOn();
       }
     }
-    updateWidgets();
+    publishState(SOURCE_POT);
+  }
+}
+
+#ifdef AUDIO_REACTIVE
+/**
+ * Analyze the audio and set the color of the zones in Audio mode, the bands
+ * of the spectrum set the color and the beats make the brightness pulse. It
+ * is only rendered, the color of the zones (published and restored) is kept.
+ */
+bool audioActive(void)
+{
+  for (uint8_t i = 0; i < led_zones.count(); i++)
+  {
+    if (led_zones.rgb(i)->getMode() == LedStripRgbMode::AUDIO)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+void audioLoop(void)
+{
+  if(!audioActive() || !audio.analyze(SystemClock.millis64()))
+  {
+    return;
+  }
+  uint32_t color = audio.getColor();
+  for (uint8_t i = 0; i < led_zones.count(); i++)
+  {
+    if (led_zones.rgb(i)->getMode() == LedStripRgbMode::AUDIO)
+    {
+      led_zones.rgb(i)->setAudioColor(color);
+    }
   }
 }
 
+/**
+ * Wait until the next iteration of the loop, while a zone is in Audio mode
+ * the audio is sampled during the wait (the rest of the loop is not delayed)
+ * and the network keeps running through yield().
+ */
+void audioDelay(uint32_t ms)
+{
+  if(!audioActive())
+  {
+    delay(ms);
+    return;
+  }
+  uint32_t start = millis();
+  while(millis() - start < ms)
+  {
+    audio.sample(micros());
+    yield();
+  }
+}
+#endif
+
+#ifdef PIXEL_STRIP
+/**
+ * Render the addressable strip with the state of the zone 0 and send the
+ * frame when a new one is ready.
+ */
+void pixelsLoop(void)
+{
+  led_pixels.setState(led_strip_rgb.getState());
+  led_pixels.setMode(led_strip_rgb.getMode());
+  led_pixels.setColor(led_strip_rgb.getMode() == LedStripRgbMode::AUDIO ?
+    led_strip_rgb.getAudioColor() : led_strip_rgb.getColor());
+  led_pixels.setCyclesPerMinute(led_strip_rgb.getCyclesPerMinute());
+  led_pixels.setBrightness(led_strip_rgb.getBrightness());
+  if(led_pixels.loop() && pixel_bus.CanShow())
+  {
+    const uint8_t *red = led_pixels.getRed();
+    const uint8_t *green = led_pixels.getGreen();
+    const uint8_t *blue = led_pixels.getBlue();
+    for(uint16_t i = 0; i < led_pixels.count(); i++)
+    {
+      pixel_bus.SetPixelColor(i, RgbColor(red[i], green[i], blue[i]));
+    }
+    pixel_bus.Show();
+  }
+}
+#endif
+
 /**
  * Function that allows to verify the correct operation of each one of the RGBW leds.
  */
@@ -651,18 +1352,23 @@ void test_leds(void)
   led_strip_w.turnOn();
   led_strip_rgb.turnOff();
   led_strip_rgb.setMode(LedStripRgbMode::NORMAL);
+  PwmOut.commit();
   delay(500);
   led_strip_w.turnOff();
   led_strip_rgb.turnOn();
+  PwmOut.commit();
   delay(500);
   led_strip_rgb.setColor(COLOR_RED);
   led_strip_rgb.loop();
+  PwmOut.commit();
   delay(500);
   led_strip_rgb.setColor(COLOR_GREEN);
   led_strip_rgb.loop();
+  PwmOut.commit();
   delay(500);
   led_strip_rgb.setColor(COLOR_BLUE);
   led_strip_rgb.loop();
+  PwmOut.commit();
   delay(500);
 }
 
@@ -707,6 +1413,14 @@ void serialLoop() {
       led_strip_rgb.setMode(LedStripRgbMode::FADE);
       led_strip_rgb.turnOn();
     }
+#ifdef AUDIO_REACTIVE
+    else if(command.startsWith("audio"))
+    {
+      Serial.println(F("Audio mode"));
+      led_strip_rgb.setMode(LedStripRgbMode::AUDIO);
+      led_strip_rgb.turnOn();
+    }
+#endif
     else if(command.startsWith("next"))
     {
       Serial.println(F("Next mode"));
@@ -748,6 +1462,14 @@ void serialLoop() {
       command.toCharArray(mqtt_topic, 50);
       saveConfig();
     }
+    else if(command.startsWith("mqttgroup"))
+    {
+      command.remove(0, 10);
+      command.trim();
+      Serial.print(F("Set MQTT group "));
+      Serial.println(command);
+      mqttSetGroup(command.c_str());
+    }
     else if(command.startsWith("blynkserver"))
     {
       command.remove(0, 12);
@@ -775,7 +1497,7 @@ void serialLoop() {
       command.toCharArray(blynk_token, 34);
       saveConfig();
     }
-    updateWidgets();
+    publishState(SOURCE_SERIAL);
   }
 }
 
@@ -786,13 +1508,42 @@ void serialLoop() {
  * (white on, RGB off).
  */
 void setup() {
+#ifdef CLOCK_START
+  SystemClock.setStart(CLOCK_START);
+#endif
   Serial.begin(115200);
   Serial.println();
 
   btn_mode.activateWith(LOW);
   btn_mode.setup();
-  led_strip_w.setup();
-  led_strip_rgb.setup();
+#ifdef PWM_EXPANDER
+  Wire.begin(EXPANDER_SDA_PIN, EXPANDER_SCL_PIN);
+  Wire.setClock(400000);
+#endif
+  led_zones.add(&led_strip_rgb, &led_strip_w);
+#ifdef PWM_EXPANDER
+  led_zones.add(&led_strip_rgb_1, &led_strip_w_1);
+  led_zones.add(&led_strip_rgb_2, &led_strip_w_2);
+  led_zones.add(&led_strip_rgb_3, &led_strip_w_3);
+#endif
+  for (uint8_t i = 0; i < led_zones.count(); i++)
+  {
+    led_zones.white(i)->setPwmFrequency(PWM_FREQUENCY);
+    led_zones.rgb(i)->setPwmFrequency(PWM_FREQUENCY);
+    led_zones.white(i)->setCurrentModel(LED_STRIP_W_CURRENT, LED_STRIP_LENGTH);
+    led_zones.rgb(i)->setCurrentModel(LED_STRIP_RGB_CURRENT, LED_STRIP_LENGTH);
+  }
+  led_zones.setup();
+#ifdef AUDIO_REACTIVE
+  audio.begin();
+#endif
+  Strobe.begin();
+#ifdef PIXEL_STRIP
+  pixel_bus.Begin();
+  pixel_bus.Show();
+#endif
+  PwmOut.setCurrentBudget(POWER_SUPPLY_CURRENT);
+  PwmOut.setVoltage(POWER_SUPPLY_VOLTAGE);
 
   test_leds();
 
@@ -806,77 +1557,31 @@ void setup() {
   //read configuration from FS json
   Serial.println(F("Mounting FS..."));
   mountFS();
+  loadEnergy();
+  loadProgram();
+  scheduler.setTimezone(TIMEZONE_OFFSET);
+  scheduler.load(SCHEDULE_FILE);
+#ifdef HISTORY_FLASH
+  history.setSpillFile(HISTORY_FILE, HISTORY_FLASH);
+#endif
+  history.sync();
 
-  // The extra parameters to be configured (can be either global or just in the setup)
-  // After connecting, parameter.getValue() will get you the configured value
-  // id/name placeholder/prompt default length
-  WiFiManagerParameter custom_mqtt_server("server", "MQTT Server", mqtt_server, 40);
-  WiFiManagerParameter custom_mqtt_port("port", "MQTT Port", mqtt_port, 6);
-  WiFiManagerParameter custom_mqtt_topic("topic", "MQTT Topic", mqtt_topic, 50);
-  WiFiManagerParameter custom_blynk_server("blynk_server", "Blynk Server", blynk_server, 40);
-  WiFiManagerParameter custom_blynk_port("blynk_port", "Blynk Port", blynk_port, 6);
-  WiFiManagerParameter custom_blynk_token("token", "Blynk Token", blynk_token, 34);
-
-
-  //WiFiManager
-  //Local intialization. Once its business is done, there is no need to keep it around
-  WiFiManager wifiManager;
-
-  //set config save notify callback
-  wifiManager.setSaveConfigCallback(saveConfigCallback);
-
-  //add all your parameters here
-  wifiManager.addParameter(&custom_mqtt_server);
-  wifiManager.addParameter(&custom_mqtt_port);
-  wifiManager.addParameter(&custom_mqtt_topic);
-  wifiManager.addParameter(&custom_blynk_server);
-  wifiManager.addParameter(&custom_blynk_port);
-  wifiManager.addParameter(&custom_blynk_token);
-
-  //reset saved settings
-  //wifiManager.resetSettings();
-
-  //set custom ip for portal
-  //wifiManager.setAPStaticIPConfig(IPAddress(10,0,1,1), IPAddress(10,0,1,1), IPAddress(255,255,255,0));
-
-  //fetches ssid and pass from eeprom and tries to connect
-  //if it does not connect it starts an access point with the specified name
-  //here  "AutoConnectAP"
-  //and goes into a blocking loop awaiting configuration
-  wifiManager.autoConnect("Driver 5050", "ledstrip");
-  //or use this for auto generated name ESP + ChipID
-  //wifiManager.autoConnect();
-
-  //if you get here you have connected to the WiFi
-  Serial.println("Connected :)");
-
-  //read updated parameters
-  strcpy(mqtt_server, custom_mqtt_server.getValue());
-  strcpy(mqtt_port, custom_mqtt_port.getValue());
-  strcpy(mqtt_topic, custom_mqtt_topic.getValue());
-  strcpy(blynk_server, custom_blynk_server.getValue());
-  strcpy(blynk_port, custom_blynk_port.getValue());
-  strcpy(blynk_token, custom_blynk_token.getValue());
-
-  //save the custom parameters to FS
-  if (shouldSaveConfig) {
-    saveConfig();
-  }
+  wifiSetup();
 
   Serial.println();
 
-  mqttClient.setServer(mqtt_server, atoi(mqtt_port));
-  mqttClient.setCallback(mqttCallback);
+  configTime(0, 0, SNTP_SERVER);
 
-  Blynk.config(blynk_token, blynk_server, atoi(blynk_port));
-  Blynk.connectWiFi(WiFi.SSID().c_str(), WiFi.psk().c_str());
-  int counter = 0;
-  do
-  {
-    Serial.print("Connecting to the Blynk Server, try number ");
-    Serial.println(++counter);
-    Blynk.connect();
-  } while(!Blynk.connected() && counter < 4);
+  mqttSetup();
+
+  httpServer.on("/api/state", HTTP_GET, restGetState);
+  httpServer.on("/api/energy", HTTP_GET, restGetEnergy);
+  httpServer.on("/api/schedule", HTTP_GET, restGetSchedule);
+  httpServer.on("/api/command", HTTP_POST, restCommand);
+  httpServer.on("/metrics", HTTP_GET, restGetMetrics);
+  httpServer.begin();
+
+  blynkSetup();
 }
 
 /**
@@ -885,18 +1590,38 @@ void setup() {
  * and Fade modes, which vary their color in time).
  */
 void loop() {
+  uint32_t loop_start = micros();
   // readPotValue();
   serialLoop();
   btn_mode.loop();
-  led_strip_rgb.loop();
-
-  if (!mqttClient.connected()) {
-    mqttConnect();
+#ifdef AUDIO_REACTIVE
+  audioLoop();
+#endif
+  led_show.loop(SystemClock.millis64());
+  scheduler.loop();
+  if (scheduler.isChanged()) {
+    scheduler.save(SCHEDULE_FILE);
   }
-  mqttClient.loop();
-  mqttSendTele();
-
-  Blynk.run();
-
+  // The changes of the shows and the schedules are not recorded
+  history.sync();
+  led_zones.loop();
+#ifdef PIXEL_STRIP
+  pixelsLoop();
+#endif
+
+  mqttLoop();
+  hassLoop();
+
+  httpServer.handleClient();
+  saveEnergy();
+
+  blynkLoop();
+  otaLoop();
+
+  metricsLoopTime(micros() - loop_start);
+#ifdef AUDIO_REACTIVE
+  audioDelay(50);
+#else
   delay(50);
+#endif
 }
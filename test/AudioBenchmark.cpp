@@ -0,0 +1,221 @@
+/*
+ * AudioBenchmark.cpp
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include <Arduino.h>
+#include <math.h>
+#include <string.h>
+#include <vector>
+#include "AudioReactive.h"
+#include "HostTest.h"
+
+/*
+ * The analog input is played from a WAV file (16 bits PCM, the first channel,
+ * resampled to AUDIO_SAMPLE_RATE) to a loop that works LOOP_WORK ms and then
+ * samples the input while it waits LOOP_WAIT ms, as the loop of the driver
+ * does, and analyzes the last samples once per iteration. The time of the FFT
+ * and of the analysis of each burst is measured:
+ *
+ *   AudioBenchmark [file.wav]
+ *
+ * Without a file a WAV with a kick at 120 BPM over a tone is generated, and
+ * the beats detected are checked against the tempo.
+ */
+
+#define GENERATED_SECONDS 30
+#define GENERATED_BPM 120
+#define FFT_RUNS 10000
+#define LOOP_WORK 8
+#define LOOP_WAIT 50
+#define LOOP_YIELD 37
+
+static void writeLE(FILE *file, uint32_t value, uint8_t bytes)
+{
+  for(uint8_t i = 0; i < bytes; i++)
+  {
+    fputc((value >> (8 * i)) & 0xFF, file);
+  }
+}
+
+static uint32_t readLE(const uint8_t *data, uint8_t bytes)
+{
+  uint32_t value = 0;
+  for(uint8_t i = 0; i < bytes; i++)
+  {
+    value |= (uint32_t) data[i] << (8 * i);
+  }
+  return value;
+}
+
+/*
+ * Write a mono WAV at the sample rate of the analysis: a kick (a decaying
+ * 70 Hz tone) on each beat over a constant 800 Hz tone.
+ */
+static bool generateWav(const char *path)
+{
+  FILE *file = fopen(path, "wb");
+  if(!file)
+  {
+    return false;
+  }
+  uint32_t samples = GENERATED_SECONDS * AUDIO_SAMPLE_RATE;
+  fwrite("RIFF", 1, 4, file);
+  writeLE(file, 36 + samples * 2, 4);
+  fwrite("WAVEfmt ", 1, 8, file);
+  writeLE(file, 16, 4);
+  writeLE(file, 1, 2);
+  writeLE(file, 1, 2);
+  writeLE(file, AUDIO_SAMPLE_RATE, 4);
+  writeLE(file, AUDIO_SAMPLE_RATE * 2, 4);
+  writeLE(file, 2, 2);
+  writeLE(file, 16, 2);
+  fwrite("data", 1, 4, file);
+  writeLE(file, samples * 2, 4);
+  uint32_t beat = AUDIO_SAMPLE_RATE * 60 / GENERATED_BPM;
+  for(uint32_t i = 0; i < samples; i++)
+  {
+    double t = (double) i / AUDIO_SAMPLE_RATE;
+    double since = (double) (i % beat) / AUDIO_SAMPLE_RATE;
+    double kick = exp(-since / 0.08) * sin(2 * M_PI * 70 * since);
+    double tone = 0.1 * sin(2 * M_PI * 800 * t);
+    writeLE(file, (uint16_t) (int16_t) (20000 * (kick + tone)), 2);
+  }
+  fclose(file);
+  return true;
+}
+
+/*
+ * Read the first channel of a 16 bits PCM WAV resampled to the sample rate
+ * of the analysis, as the 10 bits values of the analog input.
+ */
+static bool readWav(const char *path, std::vector<uint16_t> &samples)
+{
+  FILE *file = fopen(path, "rb");
+  if(!file)
+  {
+    return false;
+  }
+  std::vector<uint8_t> data;
+  uint8_t buffer[4096];
+  size_t length;
+  while((length = fread(buffer, 1, sizeof(buffer), file)) > 0)
+  {
+    data.insert(data.end(), buffer, buffer + length);
+  }
+  fclose(file);
+  if(data.size() < 12 || memcmp(&data[0], "RIFF", 4) || memcmp(&data[8], "WAVE", 4))
+  {
+    return false;
+  }
+  uint16_t channels = 0;
+  uint32_t rate = 0;
+  for(size_t chunk = 12; chunk + 8 <= data.size();)
+  {
+    uint32_t size = readLE(&data[chunk + 4], 4);
+    const uint8_t *body = &data[chunk + 8];
+    if(!memcmp(&data[chunk], "fmt ", 4) && size >= 16)
+    {
+      if(readLE(body, 2) != 1 || readLE(body + 14, 2) != 16)
+      {
+        return false;
+      }
+      channels = readLE(body + 2, 2);
+      rate = readLE(body + 4, 4);
+    }
+    else if(!memcmp(&data[chunk], "data", 4) && channels && rate)
+    {
+      uint32_t frames = std::min<size_t>(size, data.size() - chunk - 8) / (2 * channels);
+      for(uint64_t i = 0; i * rate / AUDIO_SAMPLE_RATE < frames; i++)
+      {
+        int16_t value = readLE(body + (i * rate / AUDIO_SAMPLE_RATE) * 2 * channels, 2);
+        samples.push_back((value + 32768) >> 6);
+      }
+      return true;
+    }
+    chunk += 8 + size + (size & 1);
+  }
+  return false;
+}
+
+int main(int argc, char **argv)
+{
+  const char *path = argc > 1 ? argv[1] : "AudioBenchmark.wav";
+  if(argc <= 1)
+  {
+    CHECK(generateWav(path), "cannot write %s", path);
+  }
+  std::vector<uint16_t> samples;
+  if(!readWav(path, samples))
+  {
+    printf("%s is not a 16 bits PCM WAV\n", path);
+    return 1;
+  }
+
+  // FFT of a burst alone
+  int16_t re[AUDIO_FFT_SIZE];
+  int16_t im[AUDIO_FFT_SIZE];
+  uint64_t start = hostNanos();
+  for(uint32_t run = 0; run < FFT_RUNS; run++)
+  {
+    for(uint16_t i = 0; i < AUDIO_FFT_SIZE; i++)
+    {
+      re[i] = ((int16_t) samples[(run + i) % samples.size()] - 512) << 5;
+      im[i] = 0;
+    }
+    fixedWindow(re, AUDIO_FFT_BITS);
+    fixedFFT(re, im, AUDIO_FFT_BITS);
+  }
+  double fft = (hostNanos() - start) / 1000.0 / FFT_RUNS;
+
+  // The loop, the input plays the file from the time 0
+  AudioReactive audio(A0);
+  uint32_t bursts = 0;
+  uint32_t taken = 0;
+  uint32_t beats = 0;
+  uint32_t bass = 0;
+  uint64_t elapsed = 0;
+  uint64_t end = (uint64_t) samples.size() * 1000000 / AUDIO_SAMPLE_RATE;
+  hostSetMicros(0);
+  for(uint32_t iteration = 0; micros() + (LOOP_WORK + LOOP_WAIT) * 1000 < end; iteration++)
+  {
+    start = hostNanos();
+    bool analyzed = audio.analyze(millis());
+    elapsed += hostNanos() - start;
+    CHECK(analyzed || iteration == 0, "iteration %u not analyzed", iteration);
+    if(analyzed)
+    {
+      bursts++;
+      beats += audio.isBeat();
+      bass += audio.getBand(AudioBand::BASS) >= audio.getBand(AudioBand::MID);
+    }
+    delay(LOOP_WORK);
+    uint32_t wait = millis();
+    while(millis() - wait < LOOP_WAIT)
+    {
+      host_adc = samples[(uint64_t) micros() * AUDIO_SAMPLE_RATE / 1000000];
+      uint32_t before = micros();
+      taken += audio.sample(micros());
+      CHECK(micros() == before, "the sample waits");
+      delayMicroseconds(LOOP_YIELD);
+    }
+  }
+  double seconds = (double) samples.size() / AUDIO_SAMPLE_RATE;
+  // Each wait is sampled at the sample rate
+  double expected = (double) bursts * LOOP_WAIT * AUDIO_SAMPLE_RATE / 1000;
+  CHECK(taken > expected * 0.95 && taken < expected * 1.05, "%u samples instead of %.0f", taken, expected);
+  printf("%s: %.1f s, %u bursts, %u samples, %u beats (%.1f BPM)\n", path, seconds, bursts, taken, beats,
+         beats * 60 / seconds);
+  printf("FFT %.2f us per burst, analysis %.2f us per burst\n", fft, elapsed / 1000.0 / bursts);
+
+  if(argc <= 1)
+  {
+    double bpm = beats * 60 / seconds;
+    CHECK(bpm > GENERATED_BPM * 0.9 && bpm < GENERATED_BPM * 1.1, "%.1f BPM instead of %u", bpm, GENERATED_BPM);
+    CHECK(bass > 0, "the kick is not in the bass band");
+    remove(path);
+  }
+  return hostTestResult();
+}
@@ -0,0 +1,72 @@
+/*
+ * ClockRolloverTest.cpp
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include <Arduino.h>
+#include "MonotonicClock.h"
+#include "HostTest.h"
+
+/*
+ * The simulated micros() is moved across its 71 minutes rollover and the
+ * clock is started just before the 49.7 days rollover of millis(), the time
+ * must keep growing by the time simulated.
+ */
+
+#define MICROS_ROLLOVER (1ULL << 32)
+#define MILLIS_ROLLOVER (1ULL << 32)
+
+/*
+ * Advance the simulated time in steps and check that the clock follows.
+ */
+void checkSteps(MonotonicClock &clock, uint64_t step, uint32_t steps, const char *name)
+{
+  uint64_t before = clock.micros64();
+  uint32_t errors = 0;
+  for(uint32_t i = 0; i < steps; i++)
+  {
+    hostAdvance(step * (F_CPU / 1000000));
+    uint64_t now = clock.micros64();
+    errors += now - before != step;
+    before = now;
+  }
+  CHECK(errors == 0, "%s: %u steps not followed", name, errors);
+}
+
+int main(void)
+{
+  MonotonicClock clock;
+
+  // Across the rollover of micros()
+  hostSetMicros(MICROS_ROLLOVER - 5000);
+  uint64_t start = clock.micros64();
+  checkSteps(clock, 1000, 10, "micros rollover");
+  CHECK(clock.micros64() - start == 10000, "%llu us after the rollover",
+        (unsigned long long) (clock.micros64() - start));
+  CHECK(micros() < 10000, "micros() did not wrap");
+
+  // Several rollovers, read each 10 minutes
+  checkSteps(clock, 600000000ULL, 30, "several rollovers");
+
+  // Started just before the rollover of millis()
+  clock.setStart(MILLIS_ROLLOVER - 2000);
+  uint64_t before = clock.millis64();
+  CHECK(before >= MILLIS_ROLLOVER - 2000 && before < MILLIS_ROLLOVER - 1990, "start at %llu ms",
+        (unsigned long long) before);
+  checkSteps(clock, 500000, 10, "millis rollover");
+  uint64_t after = clock.millis64();
+  CHECK(after - before == 5000, "%llu ms elapsed instead of 5000", (unsigned long long) (after - before));
+  CHECK(after > MILLIS_ROLLOVER, "millis64 did not pass the rollover");
+  CHECK((uint32_t) after < (uint32_t) before, "the 32 bits time does not wrap");
+
+  // The level of the interrupts is restored, not enabled
+  xt_rsil(3);
+  clock.micros64();
+  CHECK(host_interrupt_level == 3, "interrupt level %u instead of 3", host_interrupt_level);
+  xt_rsil(0);
+  clock.micros64();
+  CHECK(host_interrupt_level == 0, "interrupt level %u instead of 0", host_interrupt_level);
+  return hostTestResult();
+}
@@ -0,0 +1,124 @@
+/*
+ * CommandFloodTest.cpp
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include <Arduino.h>
+#include <deque>
+#include "CommandQueue.h"
+#include "HostTest.h"
+
+/*
+ * A broker stand-in floods the controller with color and brightness commands
+ * (1000 per second during 10 s) mixed with notifications, as a slider of a
+ * dashboard does. The loop reads up to READ_BURST messages per iteration as
+ * MqttModule does, queues them and applies the commands the queue gives.
+ */
+
+#define LOOP_TIME 10
+#define READ_BURST 16
+#define FLOOD_TIME 10000
+#define FLOOD_RATE 1000
+#define NOTIFY_INTERVAL 200
+
+struct Message
+{
+  String topic;
+  String payload;
+  bool coalesce;
+};
+
+int main(void)
+{
+  CommandQueue queue;
+  std::deque<Message> socket;
+  uint32_t sent = 0;
+  uint32_t sent_events = 0;
+  uint32_t applied = 0;
+  uint32_t applied_events = 0;
+  uint32_t max_backlog = 0;
+  String last_color;
+  String last_brightness;
+  String applied_color;
+  String applied_brightness;
+  uint64_t start = hostNanos();
+
+  for(uint64_t now = 0; now < FLOOD_TIME + 5000; now += LOOP_TIME)
+  {
+    // Messages sent by the broker since the last loop
+    if(now < FLOOD_TIME)
+    {
+      for(uint32_t i = 0; i < FLOOD_RATE * LOOP_TIME / 1000; i++, sent++)
+      {
+        char value[12];
+        if(sent % 2)
+        {
+          snprintf(value, sizeof(value), "%06x", (unsigned) (sent * 2654435761UL) & 0xFFFFFF);
+          last_color = value;
+          socket.push_back({ "light/cmnd/rgb/color", value, true });
+        }
+        else
+        {
+          snprintf(value, sizeof(value), "%u", sent % 256);
+          last_brightness = value;
+          socket.push_back({ "light/cmnd/rgb/brightness", value, true });
+        }
+      }
+      if(now % NOTIFY_INTERVAL == 0)
+      {
+        socket.push_back({ "light/cmnd/rgb/notify", String((unsigned) sent_events), false });
+        sent_events++;
+        sent++;
+      }
+    }
+    max_backlog = max(max_backlog, (uint32_t) socket.size());
+
+    // Read a burst from the socket
+    for(uint8_t i = 0; i < READ_BURST && !socket.empty(); i++)
+    {
+      Message &message = socket.front();
+      queue.push(message.topic.c_str(), message.payload.c_str(), message.coalesce);
+      socket.pop_front();
+    }
+
+    // Apply the commands
+    String topic;
+    String payload;
+    while(queue.pop(now, topic, payload))
+    {
+      applied++;
+      if(topic == "light/cmnd/rgb/notify")
+      {
+        CHECK(payload == String((unsigned) applied_events), "notification %s out of order", payload.c_str());
+        applied_events++;
+      }
+      else if(topic == "light/cmnd/rgb/color")
+      {
+        applied_color = payload;
+      }
+      else
+      {
+        applied_brightness = payload;
+      }
+    }
+  }
+  double elapsed = (double) (hostNanos() - start) / sent;
+
+  printf("%u messages, %u applied, %u coalesced, %u dropped, socket backlog %u, %.1f ns per message\n", sent,
+         applied, queue.getCoalesced(), queue.getDropped(), max_backlog, elapsed);
+  uint32_t limit = COMMAND_RATE * (FLOOD_TIME + 5000) / 1000 + COMMAND_BURST;
+  CHECK(applied <= limit, "%u commands applied, more than %u", applied, limit);
+  CHECK(applied == queue.getProcessed(), "processed %u", queue.getProcessed());
+  CHECK(sent == applied + queue.getCoalesced() + queue.getDropped(), "%u messages lost", sent -
+        applied - queue.getCoalesced() - queue.getDropped());
+  CHECK(queue.size() == 0, "%u commands pending", queue.size());
+  CHECK(applied_color == last_color, "color %s instead of the last one %s", applied_color.c_str(), last_color.c_str());
+  CHECK(applied_brightness == last_brightness, "brightness %s instead of the last one %s", applied_brightness.c_str(),
+        last_brightness.c_str());
+  CHECK(applied_events == sent_events, "%u of %u notifications", applied_events, sent_events);
+  CHECK(queue.getDropped() == 0, "%u commands dropped", queue.getDropped());
+  CHECK(max_backlog <= READ_BURST, "the socket backs up to %u messages", max_backlog);
+  return hostTestResult();
+}
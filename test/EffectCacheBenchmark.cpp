@@ -0,0 +1,106 @@
+/*
+ * EffectCacheBenchmark.cpp
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include <Arduino.h>
+#include "EffectVM.h"
+#include "EffectCache.h"
+#include "HostTest.h"
+
+/*
+ * Time per frame of a periodic program rendered from the cache against the
+ * program run on each frame, the colors of both and the time across the
+ * rollover of the 32 bits milliseconds (49.7 days).
+ */
+
+#define FRAMES 200000
+#define STRIP_COLOR 0x20C040
+#define STRIP_SPEED 512
+#define ROLLOVER (1ULL << 32)
+
+// #FF0000 #0000FF phase:2000 sin mix end
+static const uint8_t PULSE[] = {
+  'F', 'X', 1, 0x03, 0x00, 0x00, 0xFF, 0x01, 0xFF, 0x05, 0xD0, 0x07, 0x06, 0x18, 0x00
+};
+// color phase:5000 sin scale end
+static const uint8_t SLOW_BREATHE[] = { 'F', 'X', 1, 0x1B, 0x05, 0x88, 0x13, 0x06, 0x17, 0x00 };
+
+static uint8_t distance(uint32_t a, uint32_t b)
+{
+  uint8_t result = 0;
+  for(uint8_t shift = 0; shift < 24; shift += 8)
+  {
+    int16_t difference = (int16_t) ((a >> shift) & 0xFF) - (int16_t) ((b >> shift) & 0xFF);
+    result = max(result, (uint8_t) abs(difference));
+  }
+  return result;
+}
+
+int main(void)
+{
+  EffectVM vm;
+  EffectCache cache;
+  CHECK(vm.load(PULSE, sizeof(PULSE)), "program not loaded");
+  CHECK(vm.getPeriod() == 2000, "period %u", vm.getPeriod());
+
+  // Fill the table
+  for(uint64_t time = 0; !cache.isReady() && time < 10000; time += 20)
+  {
+    cache.run(vm, time, STRIP_COLOR, STRIP_SPEED);
+  }
+  CHECK(cache.isReady(), "table not filled");
+
+  volatile uint32_t sink = 0;
+  uint32_t result = 0;
+  uint8_t error = 0;
+  uint64_t start = hostNanos();
+  for(uint32_t time = 0; time < FRAMES; time++)
+  {
+    result += cache.run(vm, time, STRIP_COLOR, STRIP_SPEED);
+  }
+  double cached = (double) (hostNanos() - start) / FRAMES;
+  start = hostNanos();
+  for(uint32_t time = 0; time < FRAMES; time++)
+  {
+    result += vm.run(time, STRIP_COLOR, STRIP_SPEED);
+  }
+  double live = (double) (hostNanos() - start) / FRAMES;
+  sink = sink + result;
+  for(uint32_t time = 0; time < 4000; time++)
+  {
+    error = max(error, distance(cache.run(vm, time, STRIP_COLOR, STRIP_SPEED), vm.run(time, STRIP_COLOR, STRIP_SPEED)));
+  }
+  printf("cached %.1f ns, live %.1f ns per frame (x%.1f), largest error %u\n", cached, live, live / cached, error);
+  CHECK(error <= 8, "cached colors %u away from the program", error);
+
+  // The same colors one period later, also across the rollover of 32 bits
+  uint32_t jumps = 0;
+  for(uint64_t time = ROLLOVER - 5000; time < ROLLOVER + 5000; time += 7)
+  {
+    uint64_t earlier = time % vm.getPeriod();
+    jumps += vm.run(time, STRIP_COLOR, STRIP_SPEED) != vm.run(earlier, STRIP_COLOR, STRIP_SPEED);
+    jumps += cache.run(vm, time, STRIP_COLOR, STRIP_SPEED) != cache.run(vm, earlier, STRIP_COLOR, STRIP_SPEED);
+  }
+  CHECK(jumps == 0, "%u frames out of phase across the rollover", jumps);
+
+  // A period that does not fit in the table at the resolution is run live
+  CHECK(vm.load(SLOW_BREATHE, sizeof(SLOW_BREATHE)), "slow program not loaded");
+  cache.invalidate();
+  uint32_t differences = 0;
+  for(uint64_t time = 0; time < 20000; time += 20)
+  {
+    differences += cache.run(vm, time, STRIP_COLOR, STRIP_SPEED) != vm.run(time, STRIP_COLOR, STRIP_SPEED);
+  }
+  CHECK(!cache.isReady(), "%u ms period cached at %u ms", vm.getPeriod(), cache.getResolution());
+  CHECK(differences == 0, "%u frames differ from the program", differences);
+  cache.setResolution(50);
+  for(uint64_t time = 0; time < 2000; time += 20)
+  {
+    cache.run(vm, time, STRIP_COLOR, STRIP_SPEED);
+  }
+  CHECK(cache.isReady(), "%u ms period not cached at %u ms", vm.getPeriod(), cache.getResolution());
+  return hostTestResult();
+}
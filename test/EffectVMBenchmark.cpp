@@ -0,0 +1,197 @@
+/*
+ * EffectVMBenchmark.cpp
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include <Arduino.h>
+#include <math.h>
+#include "EffectVM.h"
+#include "HostTest.h"
+
+/*
+ * Effects compiled with tools/effectc.py against the same effects written as
+ * native functions: the colors must match and the time per frame of the
+ * interpreter is compared with the native one.
+ */
+
+#define FRAMES 200000
+#define STRIP_COLOR 0x20C040
+#define STRIP_SPEED 512
+
+static uint8_t sine[256];
+
+static uint32_t mixNative(uint32_t a, uint32_t b, uint8_t amount)
+{
+  uint16_t t = amount + 1;
+  uint32_t result = 0;
+  for(uint8_t shift = 0; shift < 24; shift += 8)
+  {
+    uint16_t ca = (a >> shift) & 0xFF;
+    uint16_t cb = (b >> shift) & 0xFF;
+    result |= (uint32_t) ((ca * (256 - t) + cb * t) >> 8) << shift;
+  }
+  return result;
+}
+
+static uint32_t rgbNative(uint8_t red, uint8_t green, uint8_t blue)
+{
+  return ((uint32_t) red << 16) | ((uint32_t) green << 8) | blue;
+}
+
+static uint8_t phaseNative(uint32_t time, uint32_t period)
+{
+  return ((time % period) * 256) / period;
+}
+
+// color phase:3000 sin scale end
+static uint32_t breathe(uint32_t time)
+{
+  return mixNative(0, STRIP_COLOR, sine[phaseNative(time, 3000)]);
+}
+
+// phase:5000 255 255 hsv end
+static uint32_t rainbow(uint32_t time)
+{
+  uint8_t h = phaseNative(time, 5000);
+  uint8_t region = h / 43;
+  uint8_t remainder = (h - region * 43) * 6;
+  uint8_t p = 0;
+  uint8_t q = (255 * (255 - ((255 * remainder) >> 8))) >> 8;
+  uint8_t t = (255 * (255 - ((255 * (255 - remainder)) >> 8))) >> 8;
+  switch (region) {
+    case 0:
+      return rgbNative(255, t, p);
+    case 1:
+      return rgbNative(q, 255, p);
+    case 2:
+      return rgbNative(p, 255, t);
+    case 3:
+      return rgbNative(p, q, 255);
+    case 4:
+      return rgbNative(t, p, 255);
+    default:
+      return rgbNative(255, p, q);
+  }
+}
+
+// #FF0000 #0000FF phase:2000 sin mix end
+static uint32_t pulse(uint32_t time)
+{
+  return mixNative(0xFF0000, 0x0000FF, sine[phaseNative(time, 2000)]);
+}
+
+struct Effect
+{
+  const char *name;
+  const char *hex;
+  uint32_t (*native)(uint32_t);
+};
+
+static const Effect EFFECTS[] = {
+  { "breathe", "4658011B05B80B061700", breathe },
+  { "rainbow", "46580105881301FF01FF1500", rainbow },
+  { "pulse", "465801030000FF01FF05D007061800", pulse }
+};
+
+// Programs that overflow the arithmetic, it must wrap as on the device
+struct Overflow
+{
+  const char *name;
+  const char *hex;
+  uint64_t time;
+  uint32_t expected;
+};
+
+static const Overflow OVERFLOWS[] = {
+  // time 1000 mul end
+  { "time mul", "4658010402E8030A00", 0x7FFFFFFF, (uint32_t) (0x7FFFFFFFU * 1000U) & 0xFFFFFF },
+  // #FFFFFF #FFFFFF mul end
+  { "color mul", "46580103FFFFFF03FFFFFF0A00", 0, 0x000001 },
+  // 32768 dup mul 2 mul (INT32_MIN) 0 1 sub div end
+  { "min div", "465801020080100A01020A010001010B00", 0, 0x000000 },
+  // 32768 dup mul 2 mul 0 1 sub div 1 sub (INT32_MAX) end
+  { "min div sub", "465801020080100A01020A010001010B01010900", 0, 0xFFFFFF },
+  // 32768 dup mul 2 mul 0 1 sub mod end
+  { "min mod", "465801020080100A01020A010001010C00", 0, 0x000000 },
+  // 0 1 sub 0 1 sub add end
+  { "add", "465801010001010901000101090800", 0, 0xFFFFFE }
+};
+
+static uint16_t fromHex(const char *hex, uint8_t *program)
+{
+  uint16_t size = 0;
+  for(; hex[0] && hex[1]; hex += 2)
+  {
+    char byte[3] = { hex[0], hex[1], 0 };
+    program[size++] = strtoul(byte, nullptr, 16);
+  }
+  return size;
+}
+
+static bool similar(uint32_t a, uint32_t b)
+{
+  for(uint8_t shift = 0; shift < 24; shift += 8)
+  {
+    int16_t difference = (int16_t) ((a >> shift) & 0xFF) - (int16_t) ((b >> shift) & 0xFF);
+    if(difference < -1 || difference > 1)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(void)
+{
+  for(uint16_t i = 0; i < 256; i++)
+  {
+    sine[i] = lround(128 + 127 * sin(2 * M_PI * i / 256));
+  }
+
+  for(const Overflow &overflow : OVERFLOWS)
+  {
+    uint8_t program[EFFECT_PROGRAM_SIZE];
+    uint16_t size = fromHex(overflow.hex, program);
+    EffectVM vm;
+    CHECK(vm.load(program, size), "%s not loaded", overflow.name);
+    uint32_t result = vm.run(overflow.time, STRIP_COLOR, STRIP_SPEED);
+    CHECK(result == overflow.expected, "%s: %06X instead of %06X", overflow.name, result, overflow.expected);
+  }
+
+  // Results are accumulated so the loops are not removed
+  volatile uint32_t sink = 0;
+  for(const Effect &effect : EFFECTS)
+  {
+    uint8_t program[EFFECT_PROGRAM_SIZE];
+    uint16_t size = fromHex(effect.hex, program);
+    EffectVM vm;
+    CHECK(vm.load(program, size), "%s not loaded", effect.name);
+
+    uint32_t mismatches = 0;
+    for(uint32_t time = 0; time < 20000; time += 7)
+    {
+      mismatches += !similar(vm.run(time, STRIP_COLOR, STRIP_SPEED), effect.native(time));
+    }
+    CHECK(mismatches == 0, "%s: %u frames differ from the native effect", effect.name, mismatches);
+
+    uint64_t start = hostNanos();
+    uint32_t result = 0;
+    for(uint32_t time = 0; time < FRAMES; time++)
+    {
+      result += vm.run(time, STRIP_COLOR, STRIP_SPEED);
+    }
+    double interpreted = (double) (hostNanos() - start) / FRAMES;
+    start = hostNanos();
+    for(uint32_t time = 0; time < FRAMES; time++)
+    {
+      result += effect.native(time);
+    }
+    double native = (double) (hostNanos() - start) / FRAMES;
+    sink = sink + result;
+    printf("%-8s %2u steps, VM %6.1f ns, native %6.1f ns per frame (x%.1f)\n", effect.name,
+           vm.getSteps(), interpreted, native, interpreted / native);
+  }
+  return hostTestResult();
+}
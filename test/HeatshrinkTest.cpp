@@ -0,0 +1,153 @@
+/*
+ * HeatshrinkTest.cpp
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include <Arduino.h>
+#include <string>
+#include <vector>
+#include "HeatshrinkDecoder.h"
+#include "HostTest.h"
+
+/*
+ * Images packed by tools/ota_pack.py (run with PYTHON, both given by the
+ * build) are decompressed a byte at a time as the updater does, the output
+ * must be the original firmware:
+ *
+ *   HeatshrinkTest python3 tools/ota_pack.py
+ */
+
+#define HEADER_SIZE 28
+
+static uint32_t seed = 7;
+
+static uint8_t random8(void)
+{
+  seed = seed * 1103515245 + 12345;
+  return seed >> 16;
+}
+
+static bool writeFile(const std::string &path, const std::vector<uint8_t> &data)
+{
+  FILE *file = fopen(path.c_str(), "wb");
+  if(!file)
+  {
+    return false;
+  }
+  bool written = fwrite(data.data(), 1, data.size(), file) == data.size();
+  return fclose(file) == 0 && written;
+}
+
+static bool readFile(const std::string &path, std::vector<uint8_t> &data)
+{
+  FILE *file = fopen(path.c_str(), "rb");
+  if(!file)
+  {
+    return false;
+  }
+  uint8_t buffer[4096];
+  size_t length;
+  while((length = fread(buffer, 1, sizeof(buffer), file)) > 0)
+  {
+    data.insert(data.end(), buffer, buffer + length);
+  }
+  fclose(file);
+  return true;
+}
+
+/*
+ * Pack a firmware with the tool and decompress it.
+ */
+static void check(const char *python, const char *tool, const char *name, const std::vector<uint8_t> &firmware)
+{
+  std::string source = std::string("HeatshrinkTest_") + name + ".bin";
+  std::string target = std::string("HeatshrinkTest_") + name + ".hs";
+  CHECK(writeFile(source, firmware), "%s: cannot write %s", name, source.c_str());
+  std::string command = std::string(python) + " " + tool + " " + source + " " + target + " > /dev/null";
+  CHECK(system(command.c_str()) == 0, "%s: %s failed", name, command.c_str());
+  std::vector<uint8_t> image;
+  CHECK(readFile(target, image) && image.size() >= HEADER_SIZE, "%s: no image", name);
+  remove(source.c_str());
+  remove(target.c_str());
+  if(image.size() < HEADER_SIZE)
+  {
+    return;
+  }
+  uint32_t size = image[8] | (image[9] << 8) | (image[10] << 16) | ((uint32_t) image[11] << 24);
+  CHECK(!memcmp(image.data(), "HSOT", 4) && image[4] == 1, "%s: invalid header", name);
+  CHECK(image[5] == HS_WINDOW_BITS && image[6] == HS_LOOKAHEAD_BITS, "%s: window %u, lookahead %u",
+        name, image[5], image[6]);
+  CHECK(size == firmware.size(), "%s: size %u instead of %u", name, size, (unsigned) firmware.size());
+
+  HeatshrinkDecoder decoder;
+  CHECK(decoder.begin(), "%s: no window", name);
+  std::vector<uint8_t> output;
+  uint8_t decoded[HS_MAX_OUTPUT];
+  uint64_t start = hostNanos();
+  for(size_t i = HEADER_SIZE; i < image.size(); i++)
+  {
+    uint8_t length = decoder.push(image[i], decoded);
+    CHECK(length <= HS_MAX_OUTPUT, "%s: %u bytes from a byte", name, length);
+    output.insert(output.end(), decoded, decoded + length);
+  }
+  uint64_t elapsed = hostNanos() - start;
+  decoder.end();
+  // The padding of the last byte of the stream is discarded
+  CHECK(output.size() >= firmware.size() && output.size() < firmware.size() + HS_MAX_OUTPUT,
+        "%s: %u bytes decoded instead of %u", name, (unsigned) output.size(), (unsigned) firmware.size());
+  output.resize(firmware.size());
+  CHECK(output == firmware, "%s: the firmware decoded differs", name);
+  printf("%-10s %7u bytes, packed %7u (%5.1f%%), %.1f ns per byte\n", name, (unsigned) firmware.size(),
+         (unsigned) image.size(), 100.0 * image.size() / max(firmware.size(), (size_t) 1),
+         (double) elapsed / max(firmware.size(), (size_t) 1));
+}
+
+int main(int argc, char **argv)
+{
+  if(argc < 3)
+  {
+    printf("Usage: HeatshrinkTest python ota_pack.py\n");
+    return 1;
+  }
+  const char *python = argv[1];
+  const char *tool = argv[2];
+
+  check(python, tool, "byte", std::vector<uint8_t>(1, 0xE9));
+  check(python, tool, "zeros", std::vector<uint8_t>(20000, 0));
+
+  std::vector<uint8_t> random(5000);
+  for(uint8_t &byte : random)
+  {
+    byte = random8();
+  }
+  check(python, tool, "random", random);
+
+  // Like a firmware: code repeated with small changes, strings and padding
+  std::vector<uint8_t> firmware(1, 0xE9);
+  const char *text = "Driver 5050 RGB LED strip controller, MQTT topic %s/cmnd/rgb/color ";
+  while(firmware.size() < 60000)
+  {
+    uint8_t kind = random8() % 4;
+    if(kind == 0)
+    {
+      firmware.insert(firmware.end(), text, text + strlen(text));
+    }
+    else if(kind == 1)
+    {
+      firmware.insert(firmware.end(), random8() % 64, 0xFF);
+    }
+    else
+    {
+      size_t distance = 1 + random8() * 4;
+      size_t from = firmware.size() > distance ? firmware.size() - distance : 0;
+      for(uint8_t i = 0, length = 8 + random8() % 48; i < length; i++)
+      {
+        firmware.push_back((random8() % 16) ? firmware[from + i] : random8());
+      }
+    }
+  }
+  check(python, tool, "firmware", firmware);
+  return hostTestResult();
+}
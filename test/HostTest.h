@@ -0,0 +1,48 @@
+/*
+ * HostTest.h
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <chrono>
+
+#ifndef HOST_TEST_H_
+#define HOST_TEST_H_
+
+/*
+ * Checks of the host tests, a failed check is printed and the test returns 1.
+ */
+static int host_test_failures = 0;
+
+#define CHECK(condition, ...) \
+  do { \
+    if(!(condition)) \
+    { \
+      printf("%s:%d: FAILED %s: ", __FILE__, __LINE__, #condition); \
+      printf(__VA_ARGS__); \
+      printf("\n"); \
+      host_test_failures++; \
+    } \
+  } while(0)
+
+inline int hostTestResult(void)
+{
+  printf(host_test_failures ? "%d checks failed\n" : "OK\n", host_test_failures);
+  return host_test_failures ? 1 : 0;
+}
+
+/*
+ * Wall time of the host for the benchmarks.
+ * @return  The time in ns
+ */
+inline uint64_t hostNanos(void)
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+#endif /* HOST_TEST_H_ */
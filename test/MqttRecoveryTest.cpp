@@ -0,0 +1,273 @@
+/*
+ * MqttRecoveryTest.cpp
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include <Arduino.h>
+#include <PubSubClient.h>
+#include <string>
+#include <vector>
+#include "ConnectionMonitor.h"
+#include "MqttSession.h"
+#include "HostTest.h"
+
+/*
+ * The reconnection of the MQTT module against a broker stand-in that goes
+ * down for a time: the loop runs each LOOP_TIME ms, an attempt takes
+ * CONNECT_TIME ms when the broker is up and is refused at once when it is
+ * down. The time to recover is measured for outages of several lengths.
+ *
+ * The session is then run against the broker stand-in of the stubs
+ * (host_mqtt): the CONNECT (client id, persistent session, LWT), the
+ * subscriptions, the commands queued while offline and the restore of the
+ * retained desired state, as the loop of the MQTT module drives it.
+ */
+
+#define LOOP_TIME 10
+#define CONNECT_TIME 50
+
+struct Broker
+{
+  uint64_t down;
+  uint64_t up;
+
+  bool isUp(uint64_t now)
+  {
+    return now < this->down || now >= this->up;
+  }
+};
+
+/*
+ * Run the loop from a connected client until it is connected again after the
+ * outage of the broker.
+ * @return  The time of the end of the simulation
+ */
+static uint64_t simulate(ConnectionMonitor &monitor, Broker &broker, uint64_t now)
+{
+  bool connected = true;
+  bool lost = false;
+  for(; !(lost && connected); now += LOOP_TIME)
+  {
+    if(connected && !broker.isUp(now))
+    {
+      // The socket is closed by the loss of the network
+      connected = false;
+      lost = true;
+    }
+    if(!connected && monitor.poll(now))
+    {
+      if(broker.isUp(now))
+      {
+        now += CONNECT_TIME;
+        monitor.connected(now);
+        connected = true;
+      }
+      else
+      {
+        monitor.failed(now);
+      }
+    }
+  }
+  return now;
+}
+
+#define CLIENT_ID "Driver5050-c0ffee"
+#define DESIRED "[[1,0,16711680,512,255,0]]"
+
+static MqttSession *active = nullptr;
+static std::vector<std::string> received;
+static std::string restored;
+
+/*
+ * As the callback of the MQTT module: the desired state awaited is restored,
+ * the rest are commands.
+ */
+static void callback(char *topic, uint8_t *payload, unsigned int length)
+{
+  std::string text((const char*) payload, length);
+  if(active->isRestoreMessage(topic))
+  {
+    restored = text;
+    active->restored();
+    return;
+  }
+  received.push_back(std::string(topic) + " " + text);
+}
+
+static bool subscribed(const char *topic, uint8_t qos = 1)
+{
+  HostMqttSession *session = host_mqtt.session();
+  return session && session->subscriptions.count(topic) && session->subscriptions[topic] == qos;
+}
+
+/*
+ * Run the loop of the MQTT module each LOOP_TIME ms during a time.
+ */
+static uint64_t run(PubSubClient &client, ConnectionMonitor &monitor, MqttSession &session, uint64_t now,
+  uint64_t until)
+{
+  for(; now < until; now += LOOP_TIME)
+  {
+    if(!client.connected() && monitor.poll(now))
+    {
+      session.connect(now);
+    }
+    client.loop();
+    session.restoreExpired(now);
+  }
+  return now;
+}
+
+static void testSession(void)
+{
+  host_mqtt = HostMqttBroker();
+  host_mqtt.retained["device/stat/DESIRED"] = DESIRED;
+  PubSubClient client;
+  ConnectionMonitor monitor;
+  MqttSession session(&client, &monitor);
+  client.setCallback(callback);
+  active = &session;
+  received.clear();
+  restored.clear();
+  session.begin(CLIENT_ID, "device", "kitchen", true);
+
+  uint64_t now = run(client, monitor, session, 1000, 1100);
+  CHECK(host_mqtt.connects == 1 && client.connected(), "%u connections", host_mqtt.connects);
+  CHECK(host_mqtt.last.client_id == CLIENT_ID, "client id %s", host_mqtt.last.client_id.c_str());
+  CHECK(!host_mqtt.last.clean_session, "clean session");
+  CHECK(host_mqtt.last.will_topic == "device/tele/LWT" && host_mqtt.last.will_message == "OFFLINE" &&
+    host_mqtt.last.will_qos == 1 && host_mqtt.last.will_retain, "will %s %s", host_mqtt.last.will_topic.c_str(),
+    host_mqtt.last.will_message.c_str());
+  CHECK(host_mqtt.retained["device/tele/LWT"] == "ONLINE", "LWT %s", host_mqtt.retained["device/tele/LWT"].c_str());
+  CHECK(subscribed("device/cmnd/#") && subscribed("all/cmnd/#") && subscribed("group/kitchen/cmnd/#"),
+    "commands not subscribed with QoS 1");
+  // The retained state is applied once and not awaited any more
+  CHECK(restored == DESIRED && session.isRestored(), "desired state not restored: %s", restored.c_str());
+  CHECK(!host_mqtt.session()->subscriptions.count("device/stat/DESIRED"), "desired state still subscribed");
+
+  // An outage of the broker: the QoS 1 commands are queued for the session
+  host_mqtt.drop();
+  host_mqtt.up = false;
+  CHECK(host_mqtt.retained["device/tele/LWT"] == "OFFLINE", "no LWT after the loss");
+  host_mqtt.publish("device/cmnd/rgb/color", "ff0000", 1);
+  host_mqtt.publish("device/cmnd/rgb/mode", "fade", 0);
+  host_mqtt.publish("group/kitchen/cmnd/white", "50", 1);
+  host_mqtt.publish("group/hall/cmnd/white", "10", 1);
+  host_mqtt.publish("all/cmnd/rgb/state", "on", 1);
+  now = run(client, monitor, session, now, now + 5000);
+  CHECK(!client.connected() && host_mqtt.connects == 1, "connected to the broker down");
+  host_mqtt.up = true;
+  now = run(client, monitor, session, now, now + 5000);
+  CHECK(host_mqtt.connects == 2 && host_mqtt.session_present, "session not resumed");
+  CHECK(host_mqtt.last.client_id == CLIENT_ID && !host_mqtt.last.clean_session, "another session %s",
+    host_mqtt.last.client_id.c_str());
+  CHECK(monitor.getReconnects() == 1, "%u reconnections", monitor.getReconnects());
+  CHECK(host_mqtt.retained["device/tele/LWT"] == "ONLINE", "LWT %s", host_mqtt.retained["device/tele/LWT"].c_str());
+  const char *queued[] = { "device/cmnd/rgb/color ff0000", "group/kitchen/cmnd/white 50", "all/cmnd/rgb/state on" };
+  CHECK(received.size() == 3, "%zu commands received after the reconnection", received.size());
+  for(uint8_t i = 0; i < 3 && i < received.size(); i++)
+  {
+    CHECK(received[i] == queued[i], "command %u: %s", i, received[i].c_str());
+  }
+  CHECK(!host_mqtt.session()->subscriptions.count("device/stat/DESIRED"), "desired state awaited again");
+
+  // The group changes while connected
+  session.setGroup("hall");
+  CHECK(subscribed("group/hall/cmnd/#") && !host_mqtt.session()->subscriptions.count("group/kitchen/cmnd/#"),
+    "group not changed");
+  session.setGroup("");
+  CHECK(!host_mqtt.session()->subscriptions.count("group/hall/cmnd/#") && subscribed("all/cmnd/#"),
+    "group not removed");
+
+  // The broker lost the sessions (restarted), the subscriptions are renewed
+  host_mqtt.drop();
+  host_mqtt.sessions.clear();
+  received.clear();
+  now = run(client, monitor, session, now, now + 5000);
+  CHECK(host_mqtt.connects == 3 && !host_mqtt.session_present, "session present after the restart");
+  CHECK(subscribed("device/cmnd/#") && subscribed("all/cmnd/#"), "subscriptions not renewed");
+  host_mqtt.publish("device/cmnd/white", "100", 1);
+  client.loop();
+  CHECK(received.size() == 1 && received[0] == "device/cmnd/white 100", "command not received");
+}
+
+/*
+ * Nothing retained: the desired state is awaited MQTT_SESSION_RESTORE_TIMEOUT
+ * ms while connected, the state of the boot is kept.
+ */
+static void testRestoreTimeout(void)
+{
+  host_mqtt = HostMqttBroker();
+  PubSubClient client;
+  ConnectionMonitor monitor;
+  MqttSession session(&client, &monitor);
+  client.setCallback(callback);
+  active = &session;
+  session.begin(CLIENT_ID, "device", "", true);
+  CHECK(!session.isRestored(), "restored before the connection");
+  CHECK(!session.restoreExpired(100000), "expired before the connection");
+  CHECK(monitor.poll(1000) && session.connect(1000), "not connected");
+  CHECK(subscribed("device/stat/DESIRED", 0), "desired state not subscribed");
+  client.loop();
+  CHECK(!session.restoreExpired(1000 + MQTT_SESSION_RESTORE_TIMEOUT), "expired before the timeout");
+  CHECK(!session.isRestored(), "restored without a message");
+  host_mqtt.drop();
+  CHECK(!session.restoreExpired(1001 + MQTT_SESSION_RESTORE_TIMEOUT), "expired while disconnected");
+  CHECK(monitor.poll(1002 + MQTT_SESSION_RESTORE_TIMEOUT) && session.connect(1002 + MQTT_SESSION_RESTORE_TIMEOUT),
+    "not connected again");
+  // The wait starts again with the connection
+  CHECK(!session.restoreExpired(1002 + 2 * MQTT_SESSION_RESTORE_TIMEOUT), "expired before the timeout");
+  CHECK(session.restoreExpired(1003 + 2 * MQTT_SESSION_RESTORE_TIMEOUT), "not expired");
+  CHECK(session.isRestored() && !host_mqtt.session()->subscriptions.count("device/stat/DESIRED"),
+    "desired state still awaited");
+  CHECK(!session.restoreExpired(100000), "expired twice");
+
+  // Without the restore nothing is awaited
+  host_mqtt = HostMqttBroker();
+  MqttSession plain(&client, &monitor);
+  plain.begin(CLIENT_ID, "device", "", false);
+  CHECK(plain.isRestored() && plain.connect(200000), "not connected");
+  CHECK(!host_mqtt.session()->subscriptions.count("device/stat/DESIRED"), "desired state subscribed");
+  CHECK(host_mqtt.session()->subscriptions.size() == 2, "%zu subscriptions without a group",
+    host_mqtt.session()->subscriptions.size());
+}
+
+int main(void)
+{
+  const uint32_t outages[] = { 100, 500, 2000, 5000, 20000, 60000, 300000 };
+  ConnectionMonitor monitor;
+  uint64_t now = 1000;
+  monitor.connected(now);
+  CHECK(monitor.getReconnects() == 0, "the first connection is a reconnection");
+
+  printf("outage ms  recovery ms  attempts\n");
+  for(uint32_t outage : outages)
+  {
+    Broker broker = { now + 1000, now + 1000 + outage };
+    uint32_t attempts = monitor.getAttempts();
+    uint32_t reconnects = monitor.getReconnects();
+    now = simulate(monitor, broker, now);
+    uint32_t recovery = monitor.getRecoveryTime();
+    attempts = monitor.getAttempts() - attempts;
+    printf("%9u  %11u  %8u\n", outage, recovery, attempts);
+
+    CHECK(monitor.getReconnects() == reconnects + 1, "%u ms: not counted as a reconnection", outage);
+    CHECK(recovery >= outage, "%u ms: recovered in %u ms", outage, recovery);
+    // The broker is found at most one interval after it is up, the interval
+    // is at most the time it was down (doubled from the minimum) or the max
+    uint32_t interval = max(outage, (uint32_t) CONNECTION_RETRY_MIN_INTERVAL);
+    uint32_t bound = outage + min(interval, (uint32_t) CONNECTION_RETRY_MAX_INTERVAL) + LOOP_TIME + CONNECT_TIME;
+    CHECK(recovery <= bound, "%u ms: recovered in %u ms, more than %u ms", outage, recovery, bound);
+    // The broker is not flooded: about log2 of the outage plus one attempt
+    // each 30 s
+    uint32_t flood = 2 + 5 + outage / CONNECTION_RETRY_MAX_INTERVAL;
+    CHECK(attempts <= flood, "%u ms: %u attempts", outage, attempts);
+    CHECK(monitor.getRetryInterval() == CONNECTION_RETRY_MIN_INTERVAL, "the interval does not start again");
+  }
+
+  testSession();
+  testRestoreTimeout();
+  return hostTestResult();
+}
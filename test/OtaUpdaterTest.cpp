@@ -0,0 +1,255 @@
+/*
+ * OtaUpdaterTest.cpp
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include <Arduino.h>
+#include <string>
+#include <vector>
+#include <ESP8266HTTPClient.h>
+#include <Updater.h>
+#include "MonotonicClock.h"
+#include "OtaUpdater.h"
+#include "HostTest.h"
+
+/*
+ * Updates served by an HTTP server stand-in (host_http) in small chunks, the
+ * loop of the driver calls OtaUpdater::loop() each LOOP_TIME ms. A firmware
+ * is served raw (with its MD5) and packed by tools/ota_pack.py (run with
+ * PYTHON, both given by the build), and the failures: no MD5 or a wrong one,
+ * an invalid image, a server that stops sending or closes the connection and
+ * an abort. The new firmware must only boot when it is complete and verified:
+ *
+ *   OtaUpdaterTest python3 tools/ota_pack.py
+ */
+
+#define LOOP_TIME 10
+#define CHUNK 100
+#define FIRMWARE_SIZE 30000
+
+static uint32_t seed = 11;
+
+static uint8_t random8(void)
+{
+  seed = seed * 1103515245 + 12345;
+  return seed >> 16;
+}
+
+static bool writeFile(const std::string &path, const std::vector<uint8_t> &data)
+{
+  FILE *file = fopen(path.c_str(), "wb");
+  if(!file)
+  {
+    return false;
+  }
+  bool written = fwrite(data.data(), 1, data.size(), file) == data.size();
+  return fclose(file) == 0 && written;
+}
+
+static bool readFile(const std::string &path, std::vector<uint8_t> &data)
+{
+  FILE *file = fopen(path.c_str(), "rb");
+  if(!file)
+  {
+    return false;
+  }
+  uint8_t buffer[4096];
+  size_t length;
+  while((length = fread(buffer, 1, sizeof(buffer), file)) > 0)
+  {
+    data.insert(data.end(), buffer, buffer + length);
+  }
+  fclose(file);
+  return true;
+}
+
+/*
+ * Serve a body, the size of the response is given as Content-Length. The
+ * partition is erased.
+ */
+static void serve(const std::vector<uint8_t> &body)
+{
+  Update = UpdaterClass();
+  host_http = HostHttpServer();
+  host_http.body = body;
+  host_http.size = body.size();
+  host_http.chunk = CHUNK;
+}
+
+/*
+ * Run the loop until the update ends or time passes.
+ * @return  The number of loops
+ */
+static uint32_t run(OtaUpdater &ota, uint32_t time)
+{
+  uint32_t loops = 0;
+  for(uint32_t elapsed = 0; ota.getState() == OTA_DOWNLOAD && elapsed < time; elapsed += LOOP_TIME)
+  {
+    ota.loop();
+    delay(LOOP_TIME);
+    loops++;
+  }
+  return loops;
+}
+
+static void checkFailed(OtaUpdater &ota, const char *name, const char *error)
+{
+  CHECK(ota.getState() == OTA_ERROR, "%s: state %d", name, ota.getState());
+  CHECK(ota.getError() == error, "%s: error \"%s\" instead of \"%s\"", name, ota.getError().c_str(), error);
+  CHECK(!Update.booted, "%s: the firmware boots", name);
+  CHECK(!Update.running, "%s: the partition is not closed", name);
+}
+
+int main(int argc, char **argv)
+{
+  if(argc < 3)
+  {
+    printf("Usage: OtaUpdaterTest python ota_pack.py\n");
+    return 1;
+  }
+  std::vector<uint8_t> firmware(1, OTA_IMAGE_MAGIC);
+  while(firmware.size() < FIRMWARE_SIZE)
+  {
+    firmware.push_back(random8() % 8 ? firmware[firmware.size() / 2] : random8());
+  }
+  char md5[33];
+  hostMD5(firmware.data(), firmware.size(), md5);
+
+  std::vector<uint8_t> packed;
+  CHECK(writeFile("OtaUpdaterTest.bin", firmware), "cannot write the firmware");
+  std::string command = std::string(argv[1]) + " " + argv[2] + " OtaUpdaterTest.bin OtaUpdaterTest.hs > /dev/null";
+  CHECK(system(command.c_str()) == 0, "%s failed", command.c_str());
+  CHECK(readFile("OtaUpdaterTest.hs", packed) && packed.size() > OTA_HEADER_SIZE, "no packed image");
+  remove("OtaUpdaterTest.bin");
+  remove("OtaUpdaterTest.hs");
+  if(packed.size() <= OTA_HEADER_SIZE)
+  {
+    return hostTestResult();
+  }
+
+  OtaUpdater ota;
+
+  // Raw firmware with its MD5
+  serve(firmware);
+  CHECK(ota.begin("http://host/firmware.bin", md5), "raw: not started");
+  CHECK(host_http.timeout <= OTA_CONNECT_TIMEOUT, "raw: the GET waits %u ms", host_http.timeout);
+  uint32_t loops = run(ota, 60000);
+  CHECK(ota.getState() == OTA_DONE, "raw: state %d, %s", ota.getState(), ota.getError().c_str());
+  CHECK(Update.data == firmware, "raw: the firmware written differs");
+  CHECK(Update.booted, "raw: the firmware does not boot");
+  CHECK(ota.getProgress() == 100 && ota.getReceived() == firmware.size(), "raw: progress %u, received %u",
+        ota.getProgress(), ota.getReceived());
+  CHECK(host_http.ended > 0, "raw: the connection is not closed");
+  printf("raw      %6u bytes in %4u loops\n", (unsigned) firmware.size(), loops);
+
+  // Packed, the MD5 is the one of the header and the padding is discarded
+  serve(packed);
+  CHECK(ota.begin("http://host/firmware.hs"), "packed: not started");
+  loops = run(ota, 60000);
+  CHECK(ota.getState() == OTA_DONE, "packed: state %d, %s", ota.getState(), ota.getError().c_str());
+  CHECK(Update.size == firmware.size(), "packed: size %u", (unsigned) Update.size);
+  CHECK(Update.data == firmware, "packed: the firmware written differs");
+  CHECK(Update.booted, "packed: the firmware does not boot");
+  CHECK(ota.getReceived() == packed.size(), "packed: %u bytes received of %u", ota.getReceived(),
+        (unsigned) packed.size());
+  printf("packed   %6u bytes in %4u loops\n", (unsigned) packed.size(), loops);
+
+  // Bytes after the end of the stream (a server that adds a line break) are
+  // discarded with the padding
+  std::vector<uint8_t> trailing(packed);
+  trailing.insert(trailing.end(), 16, 0);
+  serve(trailing);
+  CHECK(ota.begin("http://host/firmware.hs"), "trailing: not started");
+  run(ota, 60000);
+  CHECK(ota.getState() == OTA_DONE, "trailing: state %d, %s", ota.getState(), ota.getError().c_str());
+  CHECK(Update.data == firmware && Update.booted, "trailing: the firmware written differs");
+
+  // The packed image in single bytes (the header is split)
+  serve(packed);
+  host_http.chunk = 1;
+  CHECK(ota.begin("http://host/firmware.hs"), "bytes: not started");
+  run(ota, 10000000);
+  CHECK(ota.getState() == OTA_DONE && Update.data == firmware, "bytes: state %d", ota.getState());
+
+  // Raw firmware without an MD5, or a wrong one
+  serve(firmware);
+  CHECK(ota.begin("http://host/firmware.bin"), "no MD5: not started");
+  run(ota, 60000);
+  checkFailed(ota, "no MD5", "MD5 required");
+
+  serve(firmware);
+  CHECK(!ota.begin("http://host/firmware.bin", "1234"), "short MD5: started");
+  checkFailed(ota, "short MD5", "Invalid MD5");
+  CHECK(host_http.requests == 0, "short MD5: requested");
+
+  std::string wrong(md5);
+  wrong[0] = wrong[0] == '0' ? '1' : '0';
+  serve(firmware);
+  CHECK(ota.begin("http://host/firmware.bin", wrong.c_str()), "wrong MD5: not started");
+  run(ota, 60000);
+  checkFailed(ota, "wrong MD5", "MD5 mismatch");
+
+  // A packed image corrupted after the header
+  std::vector<uint8_t> corrupted(packed);
+  for(size_t i = OTA_HEADER_SIZE + 100; i < corrupted.size(); i += 97)
+  {
+    corrupted[i] ^= 0x5A;
+  }
+  serve(corrupted);
+  CHECK(ota.begin("http://host/firmware.hs"), "corrupted: not started");
+  run(ota, 60000);
+  CHECK(ota.getState() == OTA_ERROR && !Update.booted, "corrupted: state %d", ota.getState());
+
+  // Invalid header
+  std::vector<uint8_t> invalid(packed);
+  invalid[4] = OTA_VERSION + 1;
+  serve(invalid);
+  CHECK(ota.begin("http://host/firmware.hs"), "version: not started");
+  run(ota, 60000);
+  checkFailed(ota, "version", "Invalid image");
+
+  // HTTP error
+  serve(firmware);
+  host_http.code = 404;
+  CHECK(!ota.begin("http://host/missing.bin", md5), "404: started");
+  checkFailed(ota, "404", "HTTP 404");
+
+  // The server stops sending, the timeout of the body
+  serve(packed);
+  host_http.stall = packed.size() / 2;
+  CHECK(ota.begin("http://host/firmware.hs"), "stall: not started");
+  while(ota.getState() == OTA_DOWNLOAD && ota.getReceived() < host_http.stall)
+  {
+    ota.loop();
+    delay(LOOP_TIME);
+  }
+  uint64_t start = SystemClock.millis64();
+  run(ota, OTA_TIMEOUT * 2);
+  uint64_t waited = SystemClock.millis64() - start;
+  checkFailed(ota, "stall", "Connection lost");
+  CHECK(waited > OTA_TIMEOUT && waited < OTA_TIMEOUT + 1000, "stall: failed after %u ms", (unsigned) waited);
+
+  // The server closes the connection
+  serve(packed);
+  host_http.stall = packed.size() / 3;
+  host_http.close = true;
+  CHECK(ota.begin("http://host/firmware.hs"), "close: not started");
+  run(ota, 60000);
+  checkFailed(ota, "close", "Connection lost");
+
+  // Abort in the middle, then an update again
+  serve(firmware);
+  CHECK(ota.begin("http://host/firmware.bin", md5), "abort: not started");
+  run(ota, 1000);
+  CHECK(ota.getState() == OTA_DOWNLOAD && ota.getProgress() > 0, "abort: progress %u", ota.getProgress());
+  CHECK(!ota.begin("http://host/firmware.bin", md5), "abort: started twice");
+  ota.abort();
+  checkFailed(ota, "abort", "Aborted");
+  serve(firmware);
+  CHECK(ota.begin("http://host/firmware.bin", md5), "again: not started");
+  run(ota, 60000);
+  CHECK(ota.getState() == OTA_DONE && Update.booted, "again: state %d", ota.getState());
+  return hostTestResult();
+}
@@ -0,0 +1,147 @@
+/*
+ * Pca9685Test.cpp
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include <Arduino.h>
+#include <Wire.h>
+#include "PwmOutput.h"
+#include "PwmPCA9685Backend.h"
+#include "HostTest.h"
+
+/*
+ * Four RGBW strips on the 16 outputs of an expander, the transactions sent
+ * through the simulated Wire are applied to the registers of a simulated
+ * PCA9685 (auto increment of the register address when MODE1.AI is set).
+ */
+
+#define OUTPUTS 16
+
+uint8_t registers[256];
+size_t applied = 0;
+
+/*
+ * Apply the transactions sent since the last call to the registers.
+ */
+void applyTransactions(void)
+{
+  for(; applied < Wire.transactions.size(); applied++)
+  {
+    HostI2CTransaction &transaction = Wire.transactions[applied];
+    CHECK(transaction.address == PCA9685_DEFAULT_ADDRESS, "address %02x", transaction.address);
+    if(transaction.data.empty())
+    {
+      continue;
+    }
+    uint8_t pointer = transaction.data[0];
+    for(size_t i = 1; i < transaction.data.size(); i++)
+    {
+      CHECK(i == 1 || (registers[PCA9685_MODE1] & PCA9685_MODE1_AI), "auto increment disabled");
+      registers[pointer] = transaction.data[i];
+      pointer++;
+    }
+  }
+}
+
+/*
+ * Check the ON and OFF counters of an output against the duty and the phase.
+ */
+void checkOutput(uint8_t output, uint8_t duty, uint8_t phase)
+{
+  uint8_t *reg = &registers[PCA9685_LED0_ON_L + output * 4];
+  uint16_t on = reg[0] | (reg[1] << 8);
+  uint16_t off = reg[2] | (reg[3] << 8);
+  uint16_t high;
+  if(off & (PCA9685_FULL << 8))
+  {
+    high = 0;
+  }
+  else if(on & (PCA9685_FULL << 8))
+  {
+    high = 4096;
+  }
+  else
+  {
+    high = (off - on) & 0x0FFF;
+    CHECK(on == phase << 4, "output %u starts at %u instead of %u", output, on, phase << 4);
+  }
+  uint16_t expected = (duty * 4096UL + 127) / 255;
+  CHECK(high + 16 >= expected && high <= expected + 16, "output %u high %u instead of %u", output, high, expected);
+}
+
+int main(void)
+{
+  PwmPCA9685Backend expander;
+  PwmOutput output;
+  for(uint8_t i = 0; i < OUTPUTS; i++)
+  {
+    CHECK(output.attach(&expander, i, 1000) == i, "channel %u", i);
+  }
+  applyTransactions();
+  CHECK(registers[PCA9685_PRE_SCALE] == 5, "prescale %u for 1000 Hz", registers[PCA9685_PRE_SCALE]);
+  CHECK(registers[PCA9685_MODE2] == PCA9685_MODE2_OUTDRV, "totem pole outputs");
+
+  // A frame that changes all the outputs is a single transaction
+  uint32_t before = expander.getTransactionCount();
+  size_t sent = Wire.transactions.size();
+  for(uint8_t i = 0; i < OUTPUTS; i++)
+  {
+    output.write(i, i * 16 + 7);
+  }
+  output.commit();
+  CHECK(expander.getTransactionCount() - before == 1, "%u transactions for a frame",
+        expander.getTransactionCount() - before);
+  CHECK(Wire.transactions.size() - sent == 1, "%u transactions on the bus", (unsigned) (Wire.transactions.size() - sent));
+  CHECK(Wire.transactions.back().data.size() == 1 + OUTPUTS * 4, "%u bytes",
+        (unsigned) Wire.transactions.back().data.size());
+  applyTransactions();
+  for(uint8_t i = 0; i < OUTPUTS; i++)
+  {
+    checkOutput(i, i * 16 + 7, (i * 256) / OUTPUTS);
+  }
+
+  // Only the range of the outputs changed is sent
+  output.write(5, 0);
+  output.write(9, 255);
+  output.commit();
+  CHECK(Wire.transactions.back().data.size() == 1 + 5 * 4, "%u bytes for outputs 5 to 9",
+        (unsigned) Wire.transactions.back().data.size());
+  CHECK(Wire.transactions.back().data[0] == PCA9685_LED0_ON_L + 5 * 4, "first register");
+  applyTransactions();
+  checkOutput(5, 0, 0);
+  checkOutput(9, 255, 0);
+
+  // An unchanged frame is not sent
+  sent = Wire.transactions.size();
+  output.commit();
+  CHECK(Wire.transactions.size() == sent, "unchanged frame sent");
+
+  // A fade of all the outputs, one transaction per frame
+  sent = Wire.transactions.size();
+  for(uint16_t frame = 0; frame < 100; frame++)
+  {
+    for(uint8_t i = 0; i < OUTPUTS; i++)
+    {
+      output.write(i, frame * 2 + i);
+    }
+    output.commit();
+  }
+  CHECK(Wire.transactions.size() - sent == 100, "%u transactions for 100 frames",
+        (unsigned) (Wire.transactions.size() - sent));
+  applyTransactions();
+  for(uint8_t i = 0; i < OUTPUTS; i++)
+  {
+    checkOutput(i, 99 * 2 + i, (i * 256) / OUTPUTS);
+  }
+
+  // The prescaler is written with the oscillator stopped, before the frame
+  output.setFrequency(0, 200);
+  applyTransactions();
+  CHECK(registers[PCA9685_PRE_SCALE] == 30, "prescale %u for 200 Hz", registers[PCA9685_PRE_SCALE]);
+  CHECK(Wire.overflows == 0, "%u bytes did not fit in the Wire buffer", Wire.overflows);
+
+  printf("%u transactions, %u frames\n", expander.getTransactionCount(), output.getCommitCount());
+  return hostTestResult();
+}
@@ -0,0 +1,154 @@
+/*
+ * PixelsBenchmark.cpp
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include <Arduino.h>
+#include "LedPixels.h"
+#include "HostTest.h"
+
+/*
+ * Render time of a frame of 300 pixels in each mode, and a check of the
+ * spatial variants of the modes and of the smoothing, which must settle at the
+ * color of the target.
+ */
+
+#define PIXELS 300
+#define FRAMES 5000
+
+const LedStripRgbMode MODES[] = {
+  LedStripRgbMode::NORMAL,
+  LedStripRgbMode::STROBE,
+  LedStripRgbMode::FLASH,
+  LedStripRgbMode::FADE
+};
+const char *const MODE_NAMES[] = { "Normal", "Strobe", "Flash", "Fade" };
+
+uint16_t litPixels(LedPixels &pixels)
+{
+  uint16_t lit = 0;
+  for(uint16_t i = 0; i < pixels.count(); i++)
+  {
+    RGBColor pixel = pixels.getPixel(i);
+    lit += (pixel.red | pixel.green | pixel.blue) != 0;
+  }
+  return lit;
+}
+
+/*
+ * Render the frames of the smoothing to a color in normal mode.
+ * @return  The frames until every byte of the pixels is the one expected
+ */
+uint16_t settle(LedPixels &pixels, uint32_t color, uint8_t expected, uint64_t &now)
+{
+  pixels.setMode(LedStripRgbMode::NORMAL);
+  pixels.setColor(color);
+  for(uint16_t frame = 1; frame <= 100; frame++)
+  {
+    pixels.render(now += LED_PIXELS_FRAME_DELAY);
+    bool settled = true;
+    for(uint16_t i = 0; i < pixels.count() && settled; i++)
+    {
+      RGBColor pixel = pixels.getPixel(i);
+      settled = pixel.red == expected && pixel.green == expected && pixel.blue == expected;
+    }
+    if(settled)
+    {
+      return frame;
+    }
+  }
+  return 0;
+}
+
+uint16_t distinctColors(LedPixels &pixels)
+{
+  uint32_t colors[PIXELS];
+  uint16_t count = 0;
+  for(uint16_t i = 0; i < pixels.count(); i++)
+  {
+    RGBColor pixel = pixels.getPixel(i);
+    uint32_t color = ((uint32_t) pixel.red << 16) | (pixel.green << 8) | pixel.blue;
+    bool known = false;
+    for(uint16_t j = 0; j < count && !known; j++)
+    {
+      known = colors[j] == color;
+    }
+    if(!known)
+    {
+      colors[count++] = color;
+    }
+  }
+  return count;
+}
+
+int main(void)
+{
+  LedPixels pixels(PIXELS);
+  pixels.setState(LedStripState::ON);
+  pixels.setColor(COLOR_RED);
+  pixels.setCyclesPerMinute(6000);
+  pixels.setBrightness(200);
+
+  printf("%u pixels, %u frames per mode\n", PIXELS, FRAMES);
+  uint64_t now = 1000;
+  for(uint8_t m = 0; m < 4; m++)
+  {
+    pixels.setMode(MODES[m]);
+    uint64_t start = hostNanos();
+    for(uint16_t frame = 0; frame < FRAMES; frame++)
+    {
+      now += LED_PIXELS_FRAME_DELAY;
+      pixels.render(now);
+    }
+    uint64_t elapsed = hostNanos() - start;
+    printf("%-8s %7.2f us per frame %6.1f ns per pixel\n", MODE_NAMES[m],
+           elapsed / 1000.0 / FRAMES, (double) elapsed / FRAMES / PIXELS);
+  }
+
+  // The flash of the strobe sweeps the strip, about the duty of the pixels
+  // are lit at any time
+  pixels.setMode(LedStripRgbMode::STROBE);
+  pixels.render(now);
+  uint16_t lit = litPixels(pixels);
+  CHECK(lit > PIXELS * 2 / 5 && lit < PIXELS * 3 / 5, "strobe lit %u of %u pixels", lit, PIXELS);
+  // A pixel away from the edges of the flash switches in half a period
+  uint32_t half = 100000 / Strobe.getFrequency() / 2;
+  pixels.render(now + half / 2);
+  RGBColor first = pixels.getPixel(0);
+  pixels.render(now + half / 2 + half);
+  RGBColor later = pixels.getPixel(0);
+  CHECK((first.red != 0) != (later.red != 0), "the strobe does not switch");
+
+  // The color sequence along the strip
+  pixels.setMode(LedStripRgbMode::FLASH);
+  for(uint8_t i = 0; i < 100; i++)
+  {
+    pixels.render(now += LED_PIXELS_FRAME_DELAY);
+  }
+  uint16_t colors = distinctColors(pixels);
+  CHECK(colors == FLASH_COLORS_SEQUENCE_LENGTH, "flash shows %u colors", colors);
+
+  // The rainbow along the strip
+  pixels.setMode(LedStripRgbMode::FADE);
+  for(uint8_t i = 0; i < 100; i++)
+  {
+    pixels.render(now += LED_PIXELS_FRAME_DELAY);
+  }
+  colors = distinctColors(pixels);
+  CHECK(colors > PIXELS / 2, "fade shows %u colors", colors);
+
+  // The smoothing settles at the color in both directions
+  const uint8_t levels[] = { 255, 0, 255, 128, 1, 0 };
+  for(uint8_t level : levels)
+  {
+    pixels.setBrightness(255);
+    uint16_t frames = settle(pixels, level * 0x010101, level, now);
+    CHECK(frames > 0 && frames < 40, "%u not settled (%u frames)", level, frames);
+  }
+  pixels.setBrightness(200);
+  uint16_t frames = settle(pixels, 0xFFFFFF, 200, now);
+  CHECK(frames > 0 && frames < 40, "brightness 200 not settled (%u frames)", frames);
+  return hostTestResult();
+}
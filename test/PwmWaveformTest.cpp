@@ -0,0 +1,107 @@
+/*
+ * PwmWaveformTest.cpp
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include <Arduino.h>
+#include <core_esp8266_waveform.h>
+#include "PwmOutput.h"
+#include "PwmNativeBackend.h"
+#include "HostTest.h"
+
+/*
+ * The four channels of a strip on the native pins, with the waveforms of the
+ * simulated core. The instantaneous current drawn from the supply is computed
+ * from the levels of the pins with and without the phase stagger.
+ */
+
+#define CHANNELS 4
+#define CHANNEL_CURRENT 1000
+#define FREQUENCY 1000
+#define CYCLES_PER_US (F_CPU / 1000000)
+
+const uint8_t PINS[CHANNELS] = { D2, D1, D7, D6 };
+
+struct SupplyCurrent
+{
+  uint32_t peak;
+  uint32_t mean;
+};
+
+/*
+ * Current of the channels sampled each us.
+ * @param length Time in us
+ */
+SupplyCurrent supplyCurrent(uint64_t length)
+{
+  SupplyCurrent result = { 0, 0 };
+  uint64_t sum = 0;
+  for(uint64_t us = 0; us < length; us++)
+  {
+    uint64_t cycle = host_cycles + us * CYCLES_PER_US;
+    uint32_t current = 0;
+    for(uint8_t i = 0; i < CHANNELS; i++)
+    {
+      current += hostPinLevel(PINS[i], cycle) ? CHANNEL_CURRENT : 0;
+    }
+    result.peak = max(result.peak, current);
+    sum += current;
+  }
+  result.mean = sum / length;
+  return result;
+}
+
+int main(void)
+{
+  hostSetMicros(1000);
+  PwmOutput output;
+  for(uint8_t i = 0; i < CHANNELS; i++)
+  {
+    CHECK(output.attach(PINS[i], FREQUENCY) == i, "channel %u", i);
+    output.setCurrent(i, CHANNEL_CURRENT);
+  }
+
+  // The channels turn on in different frames, the phases must not depend on
+  // the time of the write
+  uint64_t loop_time = 0;
+  for(uint8_t i = 0; i < CHANNELS; i++)
+  {
+    output.write(i, 64);
+    uint64_t start = host_cycles;
+    output.commit();
+    loop_time += host_cycles - start;
+    hostAdvance(137 * CYCLES_PER_US);
+  }
+  CHECK(loop_time == 0, "the writes blocked the loop %llu us", (unsigned long long) loop_time / CYCLES_PER_US);
+
+  SupplyCurrent staggered = supplyCurrent(20000);
+  output.setPhaseStagger(false);
+  SupplyCurrent aligned = supplyCurrent(20000);
+  printf("4 channels at 25%% duty, %u mA each: staggered peak %u mA mean %u mA, "
+         "aligned peak %u mA mean %u mA\n", CHANNEL_CURRENT, staggered.peak, staggered.mean,
+         aligned.peak, aligned.mean);
+  CHECK(staggered.peak == CHANNEL_CURRENT, "staggered peak %u", staggered.peak);
+  CHECK(aligned.peak == CHANNELS * CHANNEL_CURRENT, "aligned peak %u", aligned.peak);
+  CHECK(staggered.mean == aligned.mean, "mean %u != %u", staggered.mean, aligned.mean);
+
+  // A duty change keeps the phase of the running waveform
+  output.setPhaseStagger(true);
+  uint32_t starts = host_waveforms[PINS[1]].starts;
+  output.write(1, 32);
+  output.commit();
+  output.write(1, 64);
+  output.commit();
+  CHECK(host_waveforms[PINS[1]].starts == starts, "the waveform was restarted");
+  CHECK(supplyCurrent(20000).peak == CHANNEL_CURRENT, "phase lost after a duty change");
+
+  // A channel with another frequency is not aligned to the others
+  hostAdvance(1234 * CYCLES_PER_US);
+  output.setFrequency(3, 400);
+  CHECK(host_waveforms[PINS[3]].start == host_cycles, "aligned to a pin of another frequency");
+
+  CHECK(host_waveform_unsafe_calls == 0, "%u waveform calls with the interrupts disabled",
+        host_waveform_unsafe_calls);
+  return hostTestResult();
+}
@@ -0,0 +1,247 @@
+/*
+ * SchedulerTest.cpp
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include <Arduino.h>
+#include <FS.h>
+#include <vector>
+#include "LedScheduler.h"
+#include "HostTest.h"
+
+/*
+ * The scheduler runs on a FakeTimeSource moved one second per loop. The
+ * actions set the color of the zone 0 to a value of the entry, the loop
+ * records and clears it, so each expiration is seen at the second it fires.
+ */
+
+// Monday 3 Sep 2018 00:00:00 UTC
+#define START 1535932800UL
+#define DAY 86400UL
+#define MONDAY (1 << 1)
+#define FRIDAY (1 << 5)
+
+struct Fired
+{
+  uint32_t time;
+  uint32_t id;
+};
+
+static FakeTimeSource wallclock;
+static LedStripRGB rgb({ D1, D2, D6 });
+static LedStrip white(D7);
+static LedZones zones;
+
+static ScheduleEntry entry(uint8_t days, uint32_t time, uint8_t action, uint32_t value, uint16_t ramp = 0)
+{
+  ScheduleEntry entry = { 0, days, 1, action, time, value, ramp, 0 };
+  return entry;
+}
+
+/*
+ * Run the loop each second until a time, the colors set are recorded.
+ */
+static void run(LedScheduler &scheduler, uint32_t until, std::vector<Fired> &fired)
+{
+  while(wallclock.now() < until)
+  {
+    wallclock.advance(1);
+    scheduler.loop();
+    if(rgb.getColor())
+    {
+      fired.push_back({ wallclock.now(), rgb.getColor() });
+      rgb.setColor(0);
+    }
+  }
+}
+
+static uint32_t count(const std::vector<Fired> &fired, uint32_t id)
+{
+  uint32_t count = 0;
+  for(const Fired &f : fired)
+  {
+    count += f.id == id;
+  }
+  return count;
+}
+
+static bool firedAt(const std::vector<Fired> &fired, uint32_t id, uint32_t time)
+{
+  for(const Fired &f : fired)
+  {
+    if(f.id == id && f.time == time)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+ * The lists of zones of the commands.
+ */
+static void testParseMask(void)
+{
+  LedStripRGB rgb2({ D1, D2, D6 });
+  LedStrip white2(D7);
+  LedZones three;
+  three.add(&rgb, &white);
+  three.add(&rgb2, &white2);
+  three.add(&rgb2, &white2);
+  CHECK(three.parseMask("all") == 0x07, "all %02x", three.parseMask("all"));
+  CHECK(three.parseMask("0") == 0x01, "0 %02x", three.parseMask("0"));
+  CHECK(three.parseMask("1,2") == 0x06, "1,2 %02x", three.parseMask("1,2"));
+  // Zones not added are ignored
+  CHECK(three.parseMask("2,5") == 0x04, "2,5 %02x", three.parseMask("2,5"));
+  const char *bad[] = { "", "256", "257", "8", "4294967296", "1,256", "1,", ",1", "1;2", "a", "-1", "1 2", "allx" };
+  for(const char *list : bad)
+  {
+    CHECK(three.parseMask(list) == 0, "\"%s\" %02x", list, three.parseMask(list));
+  }
+}
+
+int main(void)
+{
+  testParseMask();
+  zones.add(&rgb, &white);
+  LedScheduler scheduler(&zones, &wallclock);
+
+  // Not synchronized: nothing is scheduled
+  wallclock.set(1000);
+  scheduler.add(entry(SCHEDULE_DAILY, 1010, ZONE_RGB_COLOR, 99));
+  std::vector<Fired> fired;
+  run(scheduler, 1100, fired);
+  CHECK(fired.empty() && scheduler.getExpiry(0) == 0, "fired before the clock is synchronized");
+  scheduler.clear();
+
+  // First synchronization, an entry of the past of the day is not applied
+  wallclock.set(START + 12 * 3600);
+  CHECK(scheduler.add(entry(SCHEDULE_DAILY, 6 * 3600, ZONE_RGB_COLOR, 1)) == 0, "not added");
+  scheduler.loop();
+  CHECK(scheduler.getExpiry(0) == START + DAY + 6 * 3600, "expiry %u", scheduler.getExpiry(0));
+
+  // Entries at the levels of the wheel and at their limits: seconds, minutes
+  // and hours (the times of the next day included)
+  uint32_t now = wallclock.now();
+  const uint32_t delays[] = { 1, 5, 63, 64, 65, 100, 4095, 4096, 4097, 7200, 43199, 43200, 80000 };
+  uint8_t first = 2;
+  for(uint8_t i = 0; i < sizeof(delays) / sizeof(delays[0]); i++)
+  {
+    int8_t id = scheduler.add(entry(SCHEDULE_ONCE, (now + delays[i]) % DAY, ZONE_RGB_COLOR, first + i));
+    CHECK(id >= 0, "entry %u not added", i);
+  }
+  // Weekly entries (days away, the upper level) and an entry removed before
+  // it fires
+  scheduler.add(entry(MONDAY, 8 * 3600, ZONE_RGB_COLOR, 50));
+  scheduler.add(entry(FRIDAY, 20 * 3600, ZONE_RGB_COLOR, 52));
+  int8_t removed = scheduler.add(entry(SCHEDULE_DAILY, 13 * 3600, ZONE_RGB_COLOR, 51));
+  CHECK(scheduler.remove(removed), "not removed");
+
+  // Save and load: the entries are the same and expire at the same times
+  CHECK(scheduler.save("/schedule.bin"), "not saved");
+  LedScheduler loaded(&zones, &wallclock);
+  CHECK(loaded.load("/schedule.bin"), "not loaded");
+  loaded.loop();
+  for(uint8_t i = 0; i < SCHEDULE_MAX_ENTRIES; i++)
+  {
+    ScheduleEntry a;
+    ScheduleEntry b;
+    bool used = scheduler.get(i, a);
+    CHECK(used == loaded.get(i, b), "entry %u: used %d", i, used);
+    CHECK(!used || !memcmp(&a, &b, sizeof(a)), "entry %u differs", i);
+    CHECK(scheduler.getExpiry(i) == loaded.getExpiry(i), "entry %u: expiry %u instead of %u", i,
+          loaded.getExpiry(i), scheduler.getExpiry(i));
+  }
+  LedScheduler invalid(&zones, &wallclock);
+  CHECK(!invalid.load("/missing.bin"), "a missing file is loaded");
+  File file = SPIFFS.open("/invalid.bin", "w");
+  file.write((const uint8_t*) "SC", 2);
+  file.close();
+  CHECK(!invalid.load("/invalid.bin"), "an invalid file is loaded");
+
+  // Nine days, second by second: the entries that run once fire once at their
+  // time (the ones of the next day too), the daily entry every day and the
+  // weekly one on the next Monday only
+  run(scheduler, START + 9 * DAY, fired);
+  for(uint8_t i = 0; i < sizeof(delays) / sizeof(delays[0]); i++)
+  {
+    CHECK(count(fired, first + i) == 1 && firedAt(fired, first + i, now + delays[i]), "+%u s: fired %u times",
+          delays[i], count(fired, first + i));
+    ScheduleEntry unused;
+    CHECK(!scheduler.get(i + 1, unused), "+%u s: not removed", delays[i]);
+  }
+  CHECK(scheduler.isChanged(), "the entries that ran are not saved");
+  CHECK(count(fired, 1) == 8, "daily: fired %u times", count(fired, 1));
+  for(uint32_t day = 1; day <= 8; day++)
+  {
+    CHECK(firedAt(fired, 1, START + day * DAY + 6 * 3600), "daily: not fired on day %u", day);
+  }
+  CHECK(count(fired, 50) == 1 && firedAt(fired, 50, START + 7 * DAY + 8 * 3600), "weekly: fired %u times",
+        count(fired, 50));
+  CHECK(count(fired, 52) == 1 && firedAt(fired, 52, START + 4 * DAY + 20 * 3600), "Friday: fired %u times",
+        count(fired, 52));
+  CHECK(count(fired, 51) == 0, "removed: fired %u times", count(fired, 51));
+  CHECK(count(fired, 99) == 0, "cleared: fired");
+
+  // Ramps: the white from 0 to 200 in 100 s, then down in the middle of it
+  scheduler.clear();
+  white.turnOff();
+  uint32_t start = wallclock.now() + 10;
+  scheduler.add(entry(SCHEDULE_ONCE, start % DAY, ZONE_WHITE, 200, 100));
+  scheduler.add(entry(SCHEDULE_ONCE, start % DAY, ZONE_BRIGHTNESS, 0, 50));
+  uint8_t previous = 0;
+  bool monotonic = true;
+  while(wallclock.now() < start + 100)
+  {
+    wallclock.advance(1);
+    scheduler.loop();
+    uint8_t level = white.getState() == LedStripState::ON ? white.getIntensity() : 0;
+    monotonic &= level >= previous;
+    previous = level;
+    if(wallclock.now() == start + 50)
+    {
+      CHECK(level >= 95 && level <= 105, "white %u in the middle of the ramp", level);
+      CHECK(rgb.getBrightness() == 0, "brightness %u at the end of its ramp", rgb.getBrightness());
+    }
+  }
+  CHECK(monotonic && white.getIntensity() == 200, "white ramp: %u", white.getIntensity());
+  run(scheduler, start + 200, fired);
+  CHECK(white.getIntensity() == 200 && rgb.getBrightness() == 0, "after the ramps: white %u, brightness %u",
+        white.getIntensity(), rgb.getBrightness());
+
+  // A gap of the loop shorter than SCHEDULE_MAX_CATCH_UP: the entries of the
+  // gap are applied; a longer jump (or backwards) skips them
+  fired.clear();
+  scheduler.clear();
+  now = wallclock.now();
+  scheduler.add(entry(SCHEDULE_DAILY, (now + 100) % DAY, ZONE_RGB_COLOR, 60));
+  scheduler.add(entry(SCHEDULE_DAILY, (now + 2000) % DAY, ZONE_RGB_COLOR, 61));
+  scheduler.add(entry(SCHEDULE_DAILY, (now + 9000) % DAY, ZONE_RGB_COLOR, 62));
+  wallclock.set(now + 1000);
+  scheduler.loop();
+  CHECK(rgb.getColor() == 60, "catch up: color %u", rgb.getColor());
+  rgb.setColor(0);
+  wallclock.set(now + 8000);
+  scheduler.loop();
+  CHECK(rgb.getColor() == 0, "jump: color %u", rgb.getColor());
+  CHECK(scheduler.getExpiry(1) == now + 2000 + DAY && scheduler.getExpiry(2) == now + 9000,
+        "jump: expiries %u %u", scheduler.getExpiry(1), scheduler.getExpiry(2));
+  wallclock.set(now + 500);
+  scheduler.loop();
+  CHECK(rgb.getColor() == 0 && scheduler.getExpiry(1) == now + 2000, "backwards: expiry %u",
+        scheduler.getExpiry(1));
+  run(scheduler, now + 2000, fired);
+  CHECK(count(fired, 61) == 1 && firedAt(fired, 61, now + 2000), "after the jump: fired %u times",
+        count(fired, 61));
+
+  // Time zone, the times of the day are local
+  scheduler.clear();
+  scheduler.setTimezone(2 * 3600);
+  scheduler.add(entry(SCHEDULE_DAILY, 6 * 3600, ZONE_RGB_COLOR, 70));
+  wallclock.set(START + 10 * DAY);
+  scheduler.loop();
+  CHECK(scheduler.getExpiry(0) == START + 10 * DAY + 4 * 3600, "time zone: expiry %u", scheduler.getExpiry(0));
+  return hostTestResult();
+}
@@ -0,0 +1,348 @@
+/*
+ * StateDeltaTest.cpp
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include <Arduino.h>
+#include "StateDelta.h"
+#include "HostTest.h"
+
+/*
+ * The delta telemetry of the MQTT module: random changes of a state like the
+ * one of getDeviceState() with ZONES zones are encoded by StateDelta and
+ * rebuilt from the messages, the state rebuilt must be the state encoded after
+ * each message. With a path
+ * the messages are written as the log of a subscriber, each one followed by
+ * the state expected ("expect {...}"), for tools/state_replay.py --verify.
+ */
+
+#define STEPS 20000
+#define KEYFRAME_STEP 3000
+#define ZONES 4
+
+static uint32_t seed = 3;
+
+static uint32_t random32(uint32_t max)
+{
+  seed = seed * 1103515245 + 12345;
+  return (seed >> 8) % max;
+}
+
+struct Zone
+{
+  bool white_on = false;
+  uint8_t intensity = 0;
+  const char *mode = "NORMAL";
+  uint32_t color = 0;
+  uint8_t brightness = 255;
+  uint16_t speed = 512;
+  // Telemetry
+  float energy = 0;
+};
+
+struct State
+{
+  Zone zones[ZONES];
+  bool limited = false;
+  const char *error = NULL;
+  // Telemetry
+  uint16_t current = 0;
+  uint8_t jitter = 0;
+  uint32_t coalesced = 0;
+};
+
+/*
+ * The state of a zone as addZoneState().
+ */
+static void renderZone(JsonObject &root, const Zone &zone, bool telemetry)
+{
+  JsonObject &white = root.createNestedObject("white");
+  white["state"] = zone.white_on ? "ON" : "OFF";
+  white["intensity"] = zone.intensity;
+  JsonObject &rgb = root.createNestedObject("rgb");
+  rgb["state"] = "ON";
+  rgb["mode"] = zone.mode;
+  rgb["color"] = zone.color;
+  rgb["brightness"] = zone.brightness;
+  rgb["speed"] = zone.speed;
+  if(telemetry)
+  {
+    JsonObject &energy = root.createNestedObject("energy");
+    energy["total"] = zone.energy;
+  }
+}
+
+/*
+ * The state as getDeviceState(telemetry).
+ */
+static String render(const State &state, bool telemetry)
+{
+  DynamicJsonBuffer jsonBuffer;
+  JsonObject &root = jsonBuffer.createObject();
+  renderZone(root, state.zones[0], false);
+  JsonObject &power = root.createNestedObject("power");
+  if(telemetry)
+  {
+    power["current"] = state.current;
+  }
+  power["limited"] = state.limited;
+  JsonObject &strobe = root.createNestedObject("strobe");
+  strobe["frequency"] = 0;
+  strobe["duty"] = 50;
+  if(telemetry)
+  {
+    strobe["jitter"] = state.jitter;
+    JsonObject &energy = root.createNestedObject("energy");
+    energy["total"] = state.zones[0].energy;
+    JsonObject &mqtt = root.createNestedObject("mqtt");
+    mqtt["reconnects"] = 0;
+    mqtt["coalesced"] = state.coalesced;
+  }
+  JsonObject &ota = root.createNestedObject("ota");
+  ota["state"] = "IDLE";
+  ota["progress"] = 0;
+  if(state.error)
+  {
+    ota["error"] = state.error;
+  }
+  JsonObject &zones = root.createNestedObject("zones");
+  for(uint8_t i = 1; i < ZONES; i++)
+  {
+    renderZone(zones.createNestedObject(String(i)), state.zones[i], telemetry);
+  }
+  String json;
+  root.printTo(json);
+  return json;
+}
+
+static State randomState(State state)
+{
+  static const char *modes[] = { "NORMAL", "FADE", "" };
+  // The telemetry changes on every read
+  state.current = random32(3000);
+  state.jitter = random32(40);
+  state.coalesced += random32(3);
+  for(Zone &zone : state.zones)
+  {
+    zone.energy += random32(1000) / 1000.0;
+  }
+  for(uint32_t i = random32(4); i > 0; i--)
+  {
+    Zone &zone = state.zones[random32(ZONES)];
+    switch (random32(4)) {
+      case 0:
+        zone.white_on = random32(2);
+        zone.intensity = random32(256);
+        break;
+      case 1:
+        if(random32(3) == 0)
+        {
+          zone.color = random32(1024);
+        }
+        else
+        {
+          zone.brightness = random32(256);
+        }
+        zone.mode = modes[random32(3)];
+        break;
+      case 2:
+        state.limited = random32(10) == 0;
+        break;
+      default:
+        state.error = state.error ? NULL : (random32(2) ? "HTTP 404" : "HTTP 500");
+    }
+  }
+  return state;
+}
+
+/*
+ * Apply a delta to a state, as StateReconstructor.merge.
+ */
+static void merge(JsonObject &state, JsonObject &delta)
+{
+  for(JsonObject::iterator it = delta.begin(); it != delta.end(); ++it)
+  {
+    if(it->value.type() == JsonVariant::NUL)
+    {
+      state.remove(it->key);
+    }
+    else if(it->value.is<JsonObject>() && state[it->key].is<JsonObject>())
+    {
+      merge(state[it->key].as<JsonObject>(), it->value.as<JsonObject>());
+    }
+    else if(it->value.is<JsonObject>())
+    {
+      // A copy of the object, the buffer of the message is dropped
+      merge(state.createNestedObject(it->key), it->value.as<JsonObject>());
+    }
+    else
+    {
+      state.set(it->key, it->value);
+    }
+  }
+}
+
+/*
+ * The same fields and values, in any order.
+ */
+static bool same(JsonObject &a, JsonObject &b)
+{
+  if(a.size() != b.size())
+  {
+    return false;
+  }
+  for(JsonObject::iterator it = a.begin(); it != a.end(); ++it)
+  {
+    if(!b.containsKey(it->key))
+    {
+      return false;
+    }
+    JsonVariant other = b[it->key];
+    if(it->value.is<JsonObject>() && other.is<JsonObject>())
+    {
+      if(!same(it->value.as<JsonObject>(), other.as<JsonObject>()))
+      {
+        return false;
+      }
+      continue;
+    }
+    String x, y;
+    it->value.printTo(x);
+    other.printTo(y);
+    if(x != y)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+ * The delta of two objects: changed, added, removed and nested fields.
+ */
+static void testDiff(void)
+{
+  DynamicJsonBuffer jsonBuffer;
+  JsonObject &base = jsonBuffer.parseObject("{\"a\":1,\"b\":{\"c\":\"x\",\"d\":true},\"e\":2,\"f\":{\"g\":0}}");
+  JsonObject &state = jsonBuffer.parseObject("{\"a\":1,\"b\":{\"c\":\"y\",\"d\":true},\"f\":{\"g\":0},\"h\":null}");
+  JsonObject &delta = jsonBuffer.createObject();
+  CHECK(StateDelta::diff(base, state, delta), "no change found");
+  String json;
+  delta.printTo(json);
+  CHECK(json == "{\"b\":{\"c\":\"y\"},\"h\":null,\"e\":null}", "delta %s", json.c_str());
+
+  JsonObject &empty = jsonBuffer.createObject();
+  CHECK(!StateDelta::diff(state, state, empty) && empty.size() == 0, "delta of the same state");
+}
+
+int main(int argc, char **argv)
+{
+  FILE *log = argc > 1 ? fopen(argv[1], "w") : NULL;
+  if(argc > 1 && !log)
+  {
+    printf("cannot write %s\n", argv[1]);
+    return 1;
+  }
+
+  testDiff();
+
+  StateDelta encoder;
+  DynamicJsonBuffer rebuiltBuffer;
+  JsonObject *rebuilt = NULL;
+  uint32_t seq = 0;
+  uint32_t changes = 0;
+  uint32_t keyframes = 0;
+  uint32_t deltas = 0;
+  uint32_t failures = 0;
+  size_t keyframeBytes = 0;
+  size_t deltaBytes = 0;
+  State state;
+  String previous;
+  for(uint32_t step = 0; step < STEPS; step++)
+  {
+    state = randomState(state);
+    String stable = render(state, false);
+    bool keyframe = encoder.isKeyframeDue(step % KEYFRAME_STEP == 0);
+    if(keyframe || stable != previous)
+    {
+      changes++;
+    }
+    previous = stable;
+
+    String message;
+    bool sent = keyframe ? encoder.keyframe(stable, render(state, true), message) :
+      encoder.delta(stable, message);
+    if(!sent)
+    {
+      continue;
+    }
+    if(log)
+    {
+      fprintf(log, "device%s %s\nexpect %s\n", keyframe ? "/tele/STATE" : "/stat/STATE",
+        message.c_str(), stable.c_str());
+    }
+
+    DynamicJsonBuffer jsonBuffer;
+    JsonObject &decoded = jsonBuffer.parseObject(message);
+    JsonObject &expected = jsonBuffer.parseObject(stable);
+    long number = decoded["seq"].as<long>();
+    CHECK(number == (long) ++seq, "step %u: seq %ld", step, number);
+    CHECK(decoded["key"].is<bool>() == keyframe, "step %u: key", step);
+    decoded.remove("seq");
+    decoded.remove("key");
+    if(keyframe)
+    {
+      // The keyframe carries the telemetry, the subscribers compare the rest
+      CHECK(decoded["energy"].is<JsonObject>() && decoded["power"].as<JsonObject>().containsKey("current"),
+        "step %u: keyframe without the telemetry", step);
+      decoded.remove("energy");
+      decoded.remove("mqtt");
+      decoded["power"].as<JsonObject>().remove("current");
+      decoded["strobe"].as<JsonObject>().remove("jitter");
+      JsonObject &zones = decoded["zones"].as<JsonObject>();
+      for(JsonObject::iterator it = zones.begin(); it != zones.end(); ++it)
+      {
+        CHECK(it->value.as<JsonObject>().containsKey("energy"), "step %u: zone %s without the energy", step, it->key);
+        it->value.as<JsonObject>().remove("energy");
+      }
+      rebuilt = &rebuiltBuffer.createObject();
+      merge(*rebuilt, decoded);
+      keyframes++;
+      keyframeBytes += message.length();
+    }
+    else
+    {
+      String zones;
+      decoded["zones"].printTo(zones);
+      CHECK(!decoded.containsKey("energy") && !decoded.containsKey("mqtt") && !strstr(zones.c_str(), "energy"),
+        "step %u: delta with the telemetry %s", step, message.c_str());
+      merge(*rebuilt, decoded);
+      deltas++;
+      deltaBytes += message.length();
+    }
+    if(!same(*rebuilt, expected) && failures++ < 5)
+    {
+      String json;
+      rebuilt->printTo(json);
+      CHECK(false, "step %u: rebuilt %s expected %s", step, json.c_str(), stable.c_str());
+    }
+  }
+  if(log)
+  {
+    fclose(log);
+  }
+
+  CHECK(seq == encoder.getSeq(), "seq %u of %u", seq, encoder.getSeq());
+  // Only the changes of the state are sent, not the telemetry
+  CHECK(keyframes + deltas <= changes + STEPS / STATE_KEYFRAME_DELTAS,
+    "%u messages for %u changes", keyframes + deltas, changes);
+  CHECK(deltas >= keyframes * (STATE_KEYFRAME_DELTAS / 2), "keyframes %u deltas %u", keyframes, deltas);
+  CHECK(deltas && keyframes && deltaBytes / deltas * 3 < keyframeBytes / keyframes,
+    "%zu bytes per delta, %zu per keyframe", deltas ? deltaBytes / deltas : 0,
+    keyframes ? keyframeBytes / keyframes : 0);
+  printf("keyframes %u deltas %u for %u changes, %zu bytes per delta, %zu per keyframe\n", keyframes, deltas,
+    changes, deltas ? deltaBytes / deltas : 0, keyframes ? keyframeBytes / keyframes : 0);
+  return hostTestResult();
+}
@@ -0,0 +1,218 @@
+/*
+ * StrobeJitterTest.cpp
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include <Arduino.h>
+#include <core_esp8266_waveform.h>
+#include <vector>
+#include "PwmNativeBackend.h"
+#include "StrobeEngine.h"
+#include "HostTest.h"
+
+/*
+ * An RGB strip on the native pins gated by the strobe engine. The compare of
+ * timer0 is simulated with a random latency of the interrupt (the interrupts
+ * disabled by the loop and the WiFi) and the edges of the pins at a constant
+ * level are traced to check the period, the duty and the jitter measured by
+ * the engine. The pins in PWM keep their duty and follow the gate from a loop
+ * run each LOOP_TIME us.
+ */
+
+#define RED 12
+#define GREEN 13
+#define BLUE 14
+#define CYCLES_PER_US (F_CPU / 1000000)
+// Longest delay of the interrupt simulated
+#define MAX_LATENCY (20 * CYCLES_PER_US)
+#define LOOP_TIME 5000
+
+struct Edge
+{
+  uint64_t cycle;
+  uint8_t pin;
+  bool level;
+};
+
+static std::vector<Edge> edges;
+static uint32_t seed = 1;
+static uint32_t past_compares = 0;
+static uint64_t next_loop = 0;
+// Loops with the gate open and the waveform of the pin in PWM not running
+static uint32_t dark_loops = 0;
+static uint32_t open_loops = 0;
+
+static uint32_t latency(void)
+{
+  seed = seed * 1103515245 + 12345;
+  return (seed >> 8) % (MAX_LATENCY + 1);
+}
+
+/*
+ * Run the interrupts of timer0 and the loop during a time and trace the edges
+ * of the pins set by the interrupt.
+ */
+static void simulate(uint64_t us, uint8_t pwm_pin)
+{
+  uint64_t end = host_cycles + us * CYCLES_PER_US;
+  while(true)
+  {
+    uint64_t fire = end + 1;
+    if(host_timer0_isr)
+    {
+      int32_t wait = (int32_t) (host_timer0_compare - (uint32_t) host_cycles);
+      if(wait < 0)
+      {
+        // The timer would only fire after the counter wraps
+        past_compares++;
+        wait = 0;
+      }
+      fire = host_cycles + wait + latency();
+    }
+    if(next_loop <= fire && next_loop <= end)
+    {
+      host_cycles = max(host_cycles, next_loop);
+      next_loop = host_cycles + LOOP_TIME * CYCLES_PER_US;
+      PwmNative.followGate();
+      if(digitalRead(RED) || digitalRead(BLUE))
+      {
+        open_loops++;
+        dark_loops += !host_waveforms[pwm_pin].running;
+      }
+      continue;
+    }
+    if(fire > end)
+    {
+      break;
+    }
+    host_cycles = fire;
+    uint32_t before = host_gpio;
+    host_in_interrupt = true;
+    host_timer0_isr();
+    host_in_interrupt = false;
+    uint32_t changed = before ^ host_gpio;
+    for(uint8_t pin = 0; pin < 16; pin++)
+    {
+      if(changed & (1UL << pin))
+      {
+        edges.push_back({ host_cycles, pin, ((host_gpio >> pin) & 1) != 0 });
+      }
+    }
+  }
+  host_cycles = end;
+}
+
+static uint32_t countEdges(uint8_t pin)
+{
+  uint32_t count = 0;
+  for(const Edge &edge : edges)
+  {
+    count += edge.pin == pin;
+  }
+  return count;
+}
+
+int main(void)
+{
+  PwmNative.begin();
+  const uint8_t pins[] = { RED, GREEN, BLUE };
+  for(uint8_t pin : pins)
+  {
+    PwmNative.attach(pin);
+    PwmNative.setFrequency(pin, 1000);
+  }
+  // Orange: red full, green in PWM, blue off
+  PwmNative.write(RED, 255, 0);
+  PwmNative.write(GREEN, 100, 0);
+  PwmNative.write(BLUE, 0, 0);
+  CHECK(host_waveforms[GREEN].running, "green waveform not running");
+
+  Strobe.begin();
+  Strobe.setFrequency(1000);
+  Strobe.setDuty(64);
+  uint64_t attached = host_cycles;
+  for(uint8_t pin : pins)
+  {
+    CHECK(Strobe.attach(pin, false), "pin %u not attached", pin);
+  }
+  CHECK(!host_waveforms[RED].running && !host_waveforms[BLUE].running, "waveform of a constant pin running");
+  CHECK(host_waveforms[GREEN].running, "waveform of the pin in PWM stopped");
+  CHECK(!Strobe.attach(16, false), "GPIO16 attached");
+
+  // 10 s at 10 Hz with a color change from the loop in the middle: red off,
+  // blue full
+  simulate(5000000, GREEN);
+  uint32_t red_edges = edges.size();
+  PwmNative.write(RED, 0, 0);
+  PwmNative.write(BLUE, 255, 0);
+  simulate(5000000, GREEN);
+
+  uint32_t period = F_CPU / 10;
+  uint32_t on = ((uint64_t) period * 64) / 255;
+  uint32_t rises = 0;
+  uint32_t errors = 0;
+  for(const Edge &edge : edges)
+  {
+    // Each edge is scheduled from the previous one, not from the interrupt,
+    // so the delays never accumulate
+    uint64_t offset = (edge.cycle - attached + period - (edge.level ? 0 : on)) % period;
+    errors += offset > MAX_LATENCY;
+    rises += edge.level;
+  }
+  uint32_t expected_rises = (host_cycles - attached) / period;
+  CHECK(rises + 1 >= expected_rises && rises <= expected_rises + 1, "%u flashes instead of %u", rises, expected_rises);
+  CHECK(errors == 0, "%u edges out of their time", errors);
+  CHECK(red_edges > 0 && countEdges(RED) == red_edges, "red not turned off from the loop");
+  CHECK(countEdges(BLUE) > 0 && countEdges(BLUE) + red_edges == edges.size(), "blue not turned on from the loop");
+  uint32_t jitter = Strobe.getJitter();
+  CHECK(jitter <= MAX_LATENCY / CYCLES_PER_US, "jitter %u us", jitter);
+  printf("%u flashes in 10 s, jitter %u us (latency up to %u us)\n", rises, jitter,
+         (unsigned) (MAX_LATENCY / CYCLES_PER_US));
+
+  // The pin in PWM is never driven at its full level by the interrupt, its
+  // waveform keeps the duty and is stopped and started by the loop
+  CHECK(countEdges(GREEN) == 0, "%u edges of green from the interrupt", countEdges(GREEN));
+  CHECK(host_waveforms[GREEN].high == 1000 * 100 / 255, "green high %u us", host_waveforms[GREEN].high);
+  CHECK(host_waveforms[GREEN].starts >= expected_rises - 1, "green started %u times for %u flashes",
+        host_waveforms[GREEN].starts, expected_rises);
+  CHECK(open_loops > 0 && dark_loops <= open_loops / 10, "green dark in %u of %u loops with the gate open",
+        dark_loops, open_loops);
+
+  // The duties 0 and 255 are constant levels, without pulses
+  Strobe.setDuty(0);
+  simulate(200000, GREEN);
+  edges.clear();
+  simulate(1000000, GREEN);
+  CHECK(countEdges(BLUE) == 0, "%u edges with the duty 0", countEdges(BLUE));
+  CHECK(!digitalRead(BLUE), "on with the duty 0");
+  CHECK(!host_waveforms[GREEN].running && !digitalRead(GREEN), "green on with the duty 0");
+  Strobe.setDuty(255);
+  simulate(200000, GREEN);
+  edges.clear();
+  simulate(1000000, GREEN);
+  CHECK(countEdges(BLUE) == 0, "%u edges with the duty 255", countEdges(BLUE));
+  CHECK(digitalRead(BLUE), "off with the duty 255");
+  CHECK(host_waveforms[GREEN].running, "green off with the duty 255");
+
+  // A pin in PWM that goes to a constant level is set by the interrupt
+  PwmNative.write(GREEN, 255, 0);
+  CHECK(!host_waveforms[GREEN].running && digitalRead(GREEN), "green not full");
+  PwmNative.write(GREEN, 100, 0);
+  CHECK(host_waveforms[GREEN].running, "green not in PWM again");
+
+  // The waveforms are started again outside of the interrupt
+  for(uint8_t pin : pins)
+  {
+    Strobe.detach(pin);
+  }
+  CHECK(host_timer0_isr == nullptr, "timer0 still attached");
+  CHECK(host_waveforms[GREEN].running, "green waveform not restored");
+  CHECK(!host_waveforms[BLUE].running && digitalRead(BLUE), "blue not full");
+  CHECK(!host_waveforms[RED].running && !digitalRead(RED), "red not off");
+  CHECK(host_waveform_unsafe_calls == 0, "%u waveform calls from the interrupt or with the interrupts disabled",
+        host_waveform_unsafe_calls);
+  CHECK(past_compares == 0, "%u compares programmed in the past", past_compares);
+  return hostTestResult();
+}
@@ -0,0 +1,99 @@
+/*
+ * TimelineTest.cpp
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include <Arduino.h>
+#include <FS.h>
+#include "LedTimeline.h"
+#include "HostTest.h"
+
+/*
+ * A show in loop of EVENTS events, one each PERIOD ms setting the color of
+ * the zone 0 to the number of the event plus one. The loop runs each ms, then
+ * stalls for many repetitions of the show: it must continue at the position
+ * of the show without playing the repetitions missed.
+ */
+
+#define EVENTS 40
+#define PERIOD 25
+#define DURATION (EVENTS * PERIOD)
+
+static LedStripRGB rgb({ D1, D2, D6 });
+static LedStrip white(D7);
+static LedZones zones;
+
+static void writeShow(const char *path)
+{
+  File file = SPIFFS.open(path, "w");
+  uint32_t duration = DURATION;
+  uint8_t header[TIMELINE_HEADER_SIZE] = { TIMELINE_MAGIC_0, TIMELINE_MAGIC_1, TIMELINE_VERSION, 0 };
+  memcpy(&header[4], &duration, sizeof(duration));
+  file.write(header, sizeof(header));
+  for(uint32_t i = 0; i < EVENTS; i++)
+  {
+    TimelineEvent event = { i * PERIOD, 1, ZONE_RGB_COLOR, 0, i + 1 };
+    file.write((const uint8_t*) &event, sizeof(event));
+  }
+  file.close();
+}
+
+/*
+ * The color of the show at a position.
+ */
+static uint32_t expected(uint64_t elapsed)
+{
+  return (elapsed % DURATION) / PERIOD + 1;
+}
+
+int main(void)
+{
+  zones.add(&rgb, &white);
+  writeShow("/show.tl");
+
+  LedTimeline timeline(&zones);
+  CHECK(timeline.open("/show.tl"), "show not opened");
+  CHECK(timeline.getDuration() == DURATION, "duration %u", timeline.getDuration());
+  timeline.setLoop(true);
+  uint64_t start = 1000;
+  timeline.play(start);
+
+  // Three repetitions played on time
+  uint64_t now = start;
+  uint32_t wrong = 0;
+  for(; now < start + 3 * DURATION; now++)
+  {
+    timeline.loop(now);
+    wrong += rgb.getColor() != expected(now - start);
+  }
+  CHECK(wrong == 0, "%u loops with the wrong color", wrong);
+
+  // A stall of 10000 repetitions and a half
+  uint32_t reads = File::reads;
+  uint32_t seeks = File::seeks;
+  now += 10000ULL * DURATION + DURATION / 2 + 3;
+  timeline.loop(now);
+  CHECK(rgb.getColor() == expected(now - start), "color %u after the stall, expected %u",
+    rgb.getColor(), expected(now - start));
+  CHECK(File::seeks - seeks <= 2 && File::reads - reads <= EVENTS, "%u seeks %u reads after the stall",
+    File::seeks - seeks, File::reads - reads);
+  CHECK(timeline.getPosition(now) < DURATION, "position %u", timeline.getPosition(now));
+
+  // And on time again
+  wrong = 0;
+  for(uint64_t end = now + 2 * DURATION; now < end; now++)
+  {
+    timeline.loop(now);
+    wrong += rgb.getColor() != expected(now - start);
+  }
+  CHECK(wrong == 0, "%u loops with the wrong color after the stall", wrong);
+
+  // Without the loop the show ends at its duration
+  timeline.setLoop(false);
+  now += 5 * DURATION;
+  timeline.loop(now);
+  CHECK(!timeline.isPlaying(), "still playing");
+  return hostTestResult();
+}
@@ -0,0 +1,113 @@
+/*
+ * Arduino.h
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <type_traits>
+#include "WString.h"
+
+#ifndef ARDUINO_H_
+#define ARDUINO_H_
+
+/*
+ * Simulated core of the ESP8266 for the host tests. The time is a counter of
+ * CPU cycles moved by the tests (hostAdvance), micros() and millis() wrap at
+ * 32 bits as on the device. The interrupt level, the timer0 compare, the
+ * outputs (GPOS / GPOC / digitalWrite) and the waveforms of the pins are kept
+ * so the tests can check what the libraries did with them.
+ */
+
+#define F_CPU 80000000L
+
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define LOW 0
+#define HIGH 1
+#define A0 17
+#define D1 5
+#define D2 4
+#define D6 12
+#define D7 13
+
+#define ICACHE_RAM_ATTR
+#define IRAM_ATTR
+#define PROGMEM
+#define PSTR(s) (s)
+#define F(s) (s)
+#define pgm_read_byte(a) (*(const uint8_t*)(a))
+#define pgm_read_word(a) (*(const uint16_t*)(a))
+#define pgm_read_dword(a) (*(const uint32_t*)(a))
+#define memcpy_P memcpy
+#define strlen_P strlen
+#define snprintf_P snprintf
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+template<typename T, typename U>
+inline typename std::common_type<T, U>::type min(T a, U b) { return a < b ? a : b; }
+template<typename T, typename U>
+inline typename std::common_type<T, U>::type max(T a, U b) { return a > b ? a : b; }
+
+typedef uint8_t byte;
+
+// Time
+extern uint64_t host_cycles;
+void hostSetMicros(uint64_t);
+void hostAdvance(uint64_t);
+unsigned long micros(void);
+unsigned long millis(void);
+void delay(unsigned long);
+void delayMicroseconds(unsigned int);
+void yield(void);
+
+// Interrupts, the level as the PS register (0 enabled, 15 disabled)
+extern uint32_t host_interrupt_level;
+extern bool host_in_interrupt;
+uint32_t xt_rsil(uint32_t);
+void xt_wsr_ps(uint32_t);
+void noInterrupts(void);
+void interrupts(void);
+
+// timer0 (compare against the cycle counter)
+typedef void (*timercallback)(void);
+extern timercallback host_timer0_isr;
+extern uint32_t host_timer0_compare;
+void timer0_isr_init(void);
+void timer0_attachInterrupt(timercallback);
+void timer0_detachInterrupt(void);
+void timer0_write(uint32_t);
+
+// Outputs
+extern uint32_t host_gpio;
+extern uint16_t host_adc;
+struct HostGpioSet { void operator=(uint32_t mask) { host_gpio |= mask; } };
+struct HostGpioClear { void operator=(uint32_t mask) { host_gpio &= ~mask; } };
+extern HostGpioSet GPOS;
+extern HostGpioClear GPOC;
+void pinMode(uint8_t, uint8_t);
+void digitalWrite(uint8_t, uint8_t);
+int digitalRead(uint8_t);
+void analogWrite(uint8_t, int);
+int analogRead(uint8_t);
+
+class EspClass
+{
+  public:
+    uint32_t getCycleCount(void) { return (uint32_t) host_cycles; }
+    uint32_t getFreeHeap(void) { return 40000; }
+    uint32_t getChipId(void) { return 0x123456; }
+};
+
+extern EspClass ESP;
+
+#endif /* ARDUINO_H_ */
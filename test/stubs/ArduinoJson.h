@@ -0,0 +1,540 @@
+/*
+ * ArduinoJson.h
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <deque>
+#include <list>
+#include <string>
+#include <vector>
+#include "WString.h"
+
+#ifndef ARDUINO_JSON_H_
+#define ARDUINO_JSON_H_
+
+/*
+ * The part of ArduinoJson 5 used by the libraries tested on the host: objects
+ * of scalars and objects, parsed and printed compact. The values are kept as
+ * printed (the numbers as their text) and the objects are owned by the buffer
+ * as on the device, the variants only refer to them.
+ */
+
+class JsonObject;
+class JsonObjectSubscript;
+
+// as<JsonObject>() returns a reference to the object
+template<typename T>
+struct JsonAs
+{
+  typedef T type;
+};
+
+template<>
+struct JsonAs<JsonObject>
+{
+  typedef JsonObject &type;
+};
+
+class JsonVariant
+{
+  public:
+    enum Type
+    {
+      UNDEFINED,
+      NUL,
+      BOOLEAN,
+      NUMBER,
+      STRING,
+      OBJECT
+    };
+
+  private:
+    Type _type = UNDEFINED;
+    std::string _text;
+    JsonObject *_object = nullptr;
+
+    void number(const char *format, long long value)
+    {
+      char text[24];
+      snprintf(text, sizeof(text), format, value);
+      this->_type = NUMBER;
+      this->_text = text;
+    }
+
+  public:
+    JsonVariant(void) {}
+    JsonVariant(const char *text)
+    {
+      this->_type = text ? STRING : NUL;
+      this->_text = text ? text : "";
+    }
+    JsonVariant(const String &text) : JsonVariant(text.c_str()) {}
+    JsonVariant(bool value)
+    {
+      this->_type = BOOLEAN;
+      this->_text = value ? "true" : "false";
+    }
+    JsonVariant(int value) { this->number("%lld", value); }
+    JsonVariant(unsigned int value) { this->number("%lld", value); }
+    JsonVariant(long value) { this->number("%lld", value); }
+    JsonVariant(unsigned long value) { this->number("%llu", value); }
+    JsonVariant(long long value) { this->number("%lld", value); }
+    JsonVariant(unsigned long long value) { this->number("%llu", value); }
+    JsonVariant(double value)
+    {
+      // Up to 6 decimals without the trailing zeros
+      char text[40];
+      snprintf(text, sizeof(text), "%.6f", value);
+      char *end = text + strlen(text) - 1;
+      while(*end == '0')
+      {
+        *end-- = '\0';
+      }
+      if(*end == '.')
+      {
+        *end = '\0';
+      }
+      this->_type = NUMBER;
+      this->_text = text;
+    }
+    JsonVariant(float value) : JsonVariant((double) value) {}
+    JsonVariant(JsonObject &object)
+    {
+      this->_type = OBJECT;
+      this->_object = &object;
+    }
+
+    static JsonVariant raw(Type type, const std::string &text)
+    {
+      JsonVariant variant;
+      variant._type = type;
+      variant._text = text;
+      return variant;
+    }
+
+    Type type(void) const { return this->_type; }
+    bool success(void) const { return this->_type != UNDEFINED; }
+    const char *text(void) const { return this->_text.c_str(); }
+
+    template<typename T>
+    bool is(void) const;
+    template<typename T>
+    typename JsonAs<T>::type as(void) const;
+
+    void print(std::string&) const;
+    size_t printTo(String &output) const
+    {
+      std::string text;
+      this->print(text);
+      output += String(text);
+      return text.length();
+    }
+};
+
+struct JsonPair
+{
+  const char *key;
+  JsonVariant value;
+};
+
+class JsonObject
+{
+  private:
+    std::list<std::string> _keys;
+    std::vector<JsonPair> _pairs;
+    std::deque<JsonObject> *_objects = nullptr;
+
+    JsonPair *find(const char *key)
+    {
+      for(JsonPair &pair : this->_pairs)
+      {
+        if(strcmp(pair.key, key) == 0)
+        {
+          return &pair;
+        }
+      }
+      return nullptr;
+    }
+
+  public:
+    typedef std::vector<JsonPair>::iterator iterator;
+
+    JsonObject(std::deque<JsonObject> *objects = nullptr) : _objects(objects) {}
+
+    static JsonObject &invalid(void)
+    {
+      static JsonObject object;
+      return object;
+    }
+
+    bool success(void) const { return this->_objects != nullptr; }
+    iterator begin(void) { return this->_pairs.begin(); }
+    iterator end(void) { return this->_pairs.end(); }
+    size_t size(void) const { return this->_pairs.size(); }
+
+    bool set(const char *key, const JsonVariant &value)
+    {
+      if(!this->success())
+      {
+        return false;
+      }
+      JsonPair *pair = this->find(key);
+      if(pair)
+      {
+        pair->value = value;
+        return true;
+      }
+      this->_keys.push_back(key);
+      this->_pairs.push_back({ this->_keys.back().c_str(), value });
+      return true;
+    }
+    JsonVariant get(const char *key)
+    {
+      JsonPair *pair = this->find(key);
+      return pair ? pair->value : JsonVariant();
+    }
+    bool containsKey(const char *key)
+    {
+      return this->find(key) != nullptr;
+    }
+    void remove(const char *key)
+    {
+      for(iterator it = this->_pairs.begin(); it != this->_pairs.end(); ++it)
+      {
+        if(strcmp(it->key, key) == 0)
+        {
+          std::string name(key);
+          this->_pairs.erase(it);
+          this->_keys.remove(name);
+          return;
+        }
+      }
+    }
+    JsonObject &createNestedObject(const char *key)
+    {
+      if(!this->success())
+      {
+        return JsonObject::invalid();
+      }
+      this->_objects->emplace_back(this->_objects);
+      JsonObject &object = this->_objects->back();
+      this->set(key, object);
+      return object;
+    }
+    JsonObject &createNestedObject(const String &key)
+    {
+      return this->createNestedObject(key.c_str());
+    }
+
+    JsonObjectSubscript operator[](const char*);
+    JsonObjectSubscript operator[](const String&);
+
+    void print(std::string &output)
+    {
+      output += '{';
+      for(size_t i = 0; i < this->_pairs.size(); i++)
+      {
+        if(i > 0)
+        {
+          output += ',';
+        }
+        JsonVariant(this->_pairs[i].key).print(output);
+        output += ':';
+        this->_pairs[i].value.print(output);
+      }
+      output += '}';
+    }
+    size_t printTo(String &output)
+    {
+      std::string text;
+      this->print(text);
+      output += String(text);
+      return text.length();
+    }
+};
+
+/*
+ * obj[key], a read of a missing key does not add it.
+ */
+class JsonObjectSubscript
+{
+  private:
+    JsonObject &_object;
+    std::string _key;
+
+  public:
+    JsonObjectSubscript(JsonObject &object, const char *key) : _object(object), _key(key) {}
+
+    operator JsonVariant(void) const { return this->_object.get(this->_key.c_str()); }
+    template<typename T>
+    JsonObjectSubscript &operator=(const T &value)
+    {
+      this->_object.set(this->_key.c_str(), JsonVariant(value));
+      return *this;
+    }
+    JsonObjectSubscript &operator=(const char *value)
+    {
+      this->_object.set(this->_key.c_str(), JsonVariant(value));
+      return *this;
+    }
+    template<typename T>
+    bool is(void) const { return JsonVariant(*this).is<T>(); }
+    template<typename T>
+    typename JsonAs<T>::type as(void) const { return JsonVariant(*this).as<T>(); }
+    size_t printTo(String &output) const { return JsonVariant(*this).printTo(output); }
+};
+
+inline JsonObjectSubscript JsonObject::operator[](const char *key)
+{
+  return JsonObjectSubscript(*this, key);
+}
+
+inline JsonObjectSubscript JsonObject::operator[](const String &key)
+{
+  return JsonObjectSubscript(*this, key.c_str());
+}
+
+template<>
+inline bool JsonVariant::is<JsonObject>(void) const
+{
+  return this->_type == OBJECT;
+}
+
+template<>
+inline bool JsonVariant::is<bool>(void) const
+{
+  return this->_type == BOOLEAN;
+}
+
+template<>
+inline bool JsonVariant::is<const char*>(void) const
+{
+  return this->_type == STRING;
+}
+
+template<>
+inline JsonObject &JsonVariant::as<JsonObject>(void) const
+{
+  return this->_type == OBJECT ? *this->_object : JsonObject::invalid();
+}
+
+template<>
+inline long JsonVariant::as<long>(void) const
+{
+  return this->_type == NUMBER ? atol(this->_text.c_str()) : 0;
+}
+
+template<>
+inline const char *JsonVariant::as<const char*>(void) const
+{
+  return this->_type == STRING ? this->_text.c_str() : nullptr;
+}
+
+inline void JsonVariant::print(std::string &output) const
+{
+  switch (this->_type) {
+    case OBJECT:
+      this->_object->print(output);
+      break;
+    case STRING:
+      output += '"';
+      for(char c : this->_text)
+      {
+        if(c == '"' || c == '\\')
+        {
+          output += '\\';
+          output += c;
+        }
+        else if(c == '\n')
+        {
+          output += "\\n";
+        }
+        else
+        {
+          output += c;
+        }
+      }
+      output += '"';
+      break;
+    case BOOLEAN:
+    case NUMBER:
+      output += this->_text;
+      break;
+    default:
+      output += "null";
+  }
+}
+
+/*
+ * Owner of the objects, parseObject() copies the text.
+ */
+class JsonBuffer
+{
+  private:
+    std::deque<JsonObject> _objects;
+
+    static void skip(const char *&p)
+    {
+      while(*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+      {
+        p++;
+      }
+    }
+
+    static bool parseString(const char *&p, std::string &text)
+    {
+      if(*p++ != '"')
+      {
+        return false;
+      }
+      while(*p && *p != '"')
+      {
+        if(*p == '\\')
+        {
+          p++;
+          switch (*p) {
+            case 'n':
+              text += '\n';
+              break;
+            case 't':
+              text += '\t';
+              break;
+            case 'r':
+              text += '\r';
+              break;
+            case '\0':
+              return false;
+            default:
+              text += *p;
+          }
+          p++;
+        }
+        else
+        {
+          text += *p++;
+        }
+      }
+      return *p++ == '"';
+    }
+
+    bool parseValue(const char *&p, JsonVariant &value)
+    {
+      skip(p);
+      if(*p == '{')
+      {
+        this->_objects.emplace_back(&this->_objects);
+        JsonObject &object = this->_objects.back();
+        value = JsonVariant(object);
+        return this->parseMembers(p, object);
+      }
+      if(*p == '"')
+      {
+        std::string text;
+        if(!parseString(p, text))
+        {
+          return false;
+        }
+        value = JsonVariant(String(text));
+        return true;
+      }
+      const char *words[] = { "true", "false", "null" };
+      for(const char *word : words)
+      {
+        if(strncmp(p, word, strlen(word)) == 0)
+        {
+          p += strlen(word);
+          value = word[0] == 'n' ? JsonVariant((const char*) nullptr) : JsonVariant(word[0] == 't');
+          return true;
+        }
+      }
+      const char *start = p;
+      while(*p == '-' || *p == '+' || *p == '.' || *p == 'e' || *p == 'E' || (*p >= '0' && *p <= '9'))
+      {
+        p++;
+      }
+      if(p == start)
+      {
+        return false;
+      }
+      value = JsonVariant::raw(JsonVariant::NUMBER, std::string(start, p - start));
+      return true;
+    }
+
+    bool parseMembers(const char *&p, JsonObject &object)
+    {
+      p++;
+      skip(p);
+      if(*p == '}')
+      {
+        p++;
+        return true;
+      }
+      while(true)
+      {
+        skip(p);
+        std::string key;
+        JsonVariant value;
+        if(!parseString(p, key))
+        {
+          return false;
+        }
+        skip(p);
+        if(*p++ != ':' || !this->parseValue(p, value))
+        {
+          return false;
+        }
+        object.set(key.c_str(), value);
+        skip(p);
+        if(*p == '}')
+        {
+          p++;
+          return true;
+        }
+        if(*p++ != ',')
+        {
+          return false;
+        }
+      }
+    }
+
+  public:
+    JsonObject &createObject(void)
+    {
+      this->_objects.emplace_back(&this->_objects);
+      return this->_objects.back();
+    }
+
+    JsonObject &parseObject(const char *json)
+    {
+      const char *p = json;
+      JsonVariant value;
+      skip(p);
+      if(*p != '{' || !this->parseValue(p, value))
+      {
+        return JsonObject::invalid();
+      }
+      return value.as<JsonObject>();
+    }
+
+    JsonObject &parseObject(const String &json)
+    {
+      return this->parseObject(json.c_str());
+    }
+};
+
+class DynamicJsonBuffer : public JsonBuffer
+{
+};
+
+template<size_t CAPACITY>
+class StaticJsonBuffer : public JsonBuffer
+{
+};
+
+#endif /* ARDUINO_JSON_H_ */
@@ -0,0 +1,106 @@
+/*
+ * ESP8266HTTPClient.h
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "WString.h"
+
+#ifndef ESP8266_HTTP_CLIENT_H_
+#define ESP8266_HTTP_CLIENT_H_
+
+#define HTTP_CODE_OK 200
+
+/*
+ * HTTP server stand-in: the response to the next GET. The body is received
+ * at most chunk bytes each time, as the packets of the network; the server
+ * stops sending at stall and closes the connection there if close is set.
+ */
+struct HostHttpServer
+{
+  int code = HTTP_CODE_OK;
+  std::vector<uint8_t> body;
+  int size = -1;
+  size_t chunk = 64;
+  size_t stall = SIZE_MAX;
+  bool close = false;
+  size_t sent = 0;
+  String url;
+  uint16_t timeout = 5000;
+  uint32_t requests = 0;
+  uint32_t ended = 0;
+
+  size_t available(void)
+  {
+    size_t end = this->stall < this->body.size() ? this->stall : this->body.size();
+    size_t left = end - this->sent;
+    return left < this->chunk ? left : this->chunk;
+  }
+};
+
+extern HostHttpServer host_http;
+
+class WiFiClient
+{
+  public:
+    size_t available(void)
+    {
+      return host_http.available();
+    }
+    bool connected(void)
+    {
+      return !(host_http.close && host_http.sent >= host_http.stall);
+    }
+    size_t read(uint8_t *buffer, size_t length)
+    {
+      length = length < host_http.available() ? length : host_http.available();
+      memcpy(buffer, host_http.body.data() + host_http.sent, length);
+      host_http.sent += length;
+      return length;
+    }
+};
+
+/*
+ * HTTPClient of the simulated core, it gets the responses from host_http.
+ */
+class HTTPClient
+{
+  private:
+    WiFiClient _client;
+
+  public:
+    bool begin(const String &url)
+    {
+      host_http.url = url;
+      return true;
+    }
+    void setTimeout(uint16_t timeout)
+    {
+      host_http.timeout = timeout;
+    }
+    int GET(void)
+    {
+      host_http.requests++;
+      host_http.sent = 0;
+      return host_http.code;
+    }
+    int getSize(void)
+    {
+      return host_http.size;
+    }
+    WiFiClient *getStreamPtr(void)
+    {
+      return &this->_client;
+    }
+    void end(void)
+    {
+      host_http.ended++;
+    }
+};
+
+#endif /* ESP8266_HTTP_CLIENT_H_ */
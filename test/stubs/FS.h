@@ -0,0 +1,151 @@
+/*
+ * FS.h
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifndef FS_H_
+#define FS_H_
+
+enum SeekMode
+{
+  SeekSet = 0,
+  SeekCur = 1,
+  SeekEnd = 2
+};
+
+typedef std::vector<uint8_t> HostFileData;
+
+/*
+ * File of the simulated file system, the content is shared with the file
+ * system so the writes are seen by the files opened later. The operations
+ * are counted (reads and seeks) so the tests can check the cost of a loop.
+ */
+class File
+{
+  private:
+    std::shared_ptr<HostFileData> _data;
+    size_t _position = 0;
+    bool _writable = false;
+
+  public:
+    static uint32_t reads;
+    static uint32_t seeks;
+
+    File(void) {}
+    File(std::shared_ptr<HostFileData> data, size_t position, bool writable) :
+      _data(data), _position(position), _writable(writable) {}
+
+    operator bool(void) const
+    {
+      return this->_data != nullptr;
+    }
+    size_t read(uint8_t *buffer, size_t length)
+    {
+      if(!this->_data || this->_position >= this->_data->size())
+      {
+        return 0;
+      }
+      File::reads++;
+      length = std::min(length, this->_data->size() - this->_position);
+      memcpy(buffer, this->_data->data() + this->_position, length);
+      this->_position += length;
+      return length;
+    }
+    size_t write(const uint8_t *buffer, size_t length)
+    {
+      if(!this->_data || !this->_writable)
+      {
+        return 0;
+      }
+      if(this->_data->size() < this->_position + length)
+      {
+        this->_data->resize(this->_position + length);
+      }
+      memcpy(this->_data->data() + this->_position, buffer, length);
+      this->_position += length;
+      return length;
+    }
+    bool seek(uint32_t position, SeekMode mode = SeekSet)
+    {
+      if(!this->_data)
+      {
+        return false;
+      }
+      size_t base = mode == SeekSet ? 0 : mode == SeekCur ? this->_position : this->_data->size();
+      if(base + position > this->_data->size())
+      {
+        return false;
+      }
+      File::seeks++;
+      this->_position = base + position;
+      return true;
+    }
+    size_t position(void) const
+    {
+      return this->_position;
+    }
+    size_t size(void) const
+    {
+      return this->_data ? this->_data->size() : 0;
+    }
+    int available(void)
+    {
+      return this->size() - this->_position;
+    }
+    void close(void)
+    {
+      this->_data = nullptr;
+    }
+};
+
+/*
+ * File system in memory, modes "r", "w" and "a".
+ */
+class FS
+{
+  private:
+    std::map<std::string, std::shared_ptr<HostFileData>> _files;
+
+  public:
+    bool begin(void)
+    {
+      return true;
+    }
+    File open(const char *path, const char *mode)
+    {
+      auto file = this->_files.find(path);
+      if(mode[0] == 'r')
+      {
+        return file == this->_files.end() ? File() : File(file->second, 0, false);
+      }
+      if(file == this->_files.end() || mode[0] == 'w')
+      {
+        this->_files[path] = std::make_shared<HostFileData>();
+      }
+      std::shared_ptr<HostFileData> data = this->_files[path];
+      return File(data, mode[0] == 'a' ? data->size() : 0, true);
+    }
+    bool exists(const char *path)
+    {
+      return this->_files.count(path) > 0;
+    }
+    bool remove(const char *path)
+    {
+      return this->_files.erase(path) > 0;
+    }
+};
+
+extern FS SPIFFS;
+
+#endif /* FS_H_ */
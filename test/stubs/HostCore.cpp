@@ -0,0 +1,208 @@
+/*
+ * HostCore.cpp
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+#include <Arduino.h>
+#include <core_esp8266_waveform.h>
+#include <Wire.h>
+#include <ESP8266HTTPClient.h>
+#include <Updater.h>
+#include <FS.h>
+#include <PubSubClient.h>
+
+#define CYCLES_PER_US (F_CPU / 1000000)
+
+uint64_t host_cycles = 0;
+uint32_t host_interrupt_level = 0;
+bool host_in_interrupt = false;
+timercallback host_timer0_isr = nullptr;
+uint32_t host_timer0_compare = 0;
+uint32_t host_gpio = 0;
+uint16_t host_adc = 512;
+HostGpioSet GPOS;
+HostGpioClear GPOC;
+EspClass ESP;
+TwoWire Wire;
+HostHttpServer host_http;
+HostMqttBroker host_mqtt;
+UpdaterClass Update;
+FS SPIFFS;
+uint32_t File::reads = 0;
+uint32_t File::seeks = 0;
+HostWaveform host_waveforms[17];
+uint32_t host_waveform_unsafe_calls = 0;
+
+void hostSetMicros(uint64_t us)
+{
+  host_cycles = us * CYCLES_PER_US;
+}
+
+void hostAdvance(uint64_t cycles)
+{
+  host_cycles += cycles;
+}
+
+unsigned long micros(void)
+{
+  return (uint32_t) (host_cycles / CYCLES_PER_US);
+}
+
+unsigned long millis(void)
+{
+  return (uint32_t) (host_cycles / CYCLES_PER_US / 1000);
+}
+
+void delay(unsigned long ms)
+{
+  hostAdvance((uint64_t) ms * 1000 * CYCLES_PER_US);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+  hostAdvance((uint64_t) us * CYCLES_PER_US);
+}
+
+void yield(void)
+{
+}
+
+uint32_t xt_rsil(uint32_t level)
+{
+  uint32_t previous = host_interrupt_level;
+  host_interrupt_level = level;
+  return previous;
+}
+
+void xt_wsr_ps(uint32_t ps)
+{
+  host_interrupt_level = ps;
+}
+
+void noInterrupts(void)
+{
+  xt_rsil(15);
+}
+
+void interrupts(void)
+{
+  xt_rsil(0);
+}
+
+void timer0_isr_init(void)
+{
+}
+
+void timer0_attachInterrupt(timercallback isr)
+{
+  host_timer0_isr = isr;
+}
+
+void timer0_detachInterrupt(void)
+{
+  host_timer0_isr = nullptr;
+}
+
+void timer0_write(uint32_t compare)
+{
+  host_timer0_compare = compare;
+}
+
+void pinMode(uint8_t, uint8_t)
+{
+}
+
+void digitalWrite(uint8_t pin, uint8_t level)
+{
+  if(level)
+  {
+    host_gpio |= 1UL << pin;
+  }
+  else
+  {
+    host_gpio &= ~(1UL << pin);
+  }
+}
+
+int digitalRead(uint8_t pin)
+{
+  return (host_gpio >> pin) & 1;
+}
+
+void analogWrite(uint8_t, int)
+{
+}
+
+int analogRead(uint8_t)
+{
+  return host_adc;
+}
+
+static bool waveformUnsafe(void)
+{
+  if(host_in_interrupt || host_interrupt_level != 0)
+  {
+    host_waveform_unsafe_calls++;
+    return true;
+  }
+  return false;
+}
+
+int startWaveform(uint8_t pin, uint32_t timeHighUS, uint32_t timeLowUS, uint32_t runTimeUS,
+                  int8_t alignPhase, uint32_t phaseOffsetUS, bool autoPwm)
+{
+  if(pin > 16 || waveformUnsafe())
+  {
+    return false;
+  }
+  HostWaveform &wave = host_waveforms[pin];
+  if(!wave.running)
+  {
+    wave.start = host_cycles;
+    if(alignPhase >= 0 && alignPhase <= 16 && host_waveforms[alignPhase].running)
+    {
+      HostWaveform &reference = host_waveforms[alignPhase];
+      uint64_t period = (uint64_t) (reference.high + reference.low) * CYCLES_PER_US;
+      // Start of the current period of the reference plus the offset
+      uint64_t elapsed = (host_cycles - reference.start) % period;
+      wave.start = host_cycles - elapsed + (uint64_t) phaseOffsetUS * CYCLES_PER_US;
+    }
+    wave.starts++;
+  }
+  wave.running = true;
+  wave.high = timeHighUS;
+  wave.low = timeLowUS;
+  return true;
+}
+
+int stopWaveform(uint8_t pin)
+{
+  if(pin > 16 || waveformUnsafe())
+  {
+    return false;
+  }
+  host_waveforms[pin].running = false;
+  return true;
+}
+
+void enablePhaseLockedWaveform(void)
+{
+}
+
+bool hostPinLevel(uint8_t pin, uint64_t cycle)
+{
+  HostWaveform &wave = host_waveforms[pin];
+  if(!wave.running)
+  {
+    return (host_gpio >> pin) & 1;
+  }
+  uint64_t period = (uint64_t) (wave.high + wave.low) * CYCLES_PER_US;
+  if(cycle < wave.start)
+  {
+    // Before the first period the pin is low
+    return false;
+  }
+  return (cycle - wave.start) % period < (uint64_t) wave.high * CYCLES_PER_US;
+}
@@ -0,0 +1,257 @@
+/*
+ * PubSubClient.h
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#ifndef PUB_SUB_CLIENT_H_
+#define PUB_SUB_CLIENT_H_
+
+#define MQTT_CONNECTED 0
+#define MQTT_CONNECT_UNAVAILABLE 3
+
+struct HostMqttMessage
+{
+  std::string topic;
+  std::string payload;
+  uint8_t qos;
+  bool retained;
+};
+
+/*
+ * The CONNECT packet of the client.
+ */
+struct HostMqttConnect
+{
+  std::string client_id;
+  std::string will_topic;
+  std::string will_message;
+  uint8_t will_qos;
+  bool will_retain;
+  bool clean_session;
+};
+
+struct HostMqttSession
+{
+  std::map<std::string, uint8_t> subscriptions;
+  // Messages not delivered yet, the QoS 1 messages wait while offline
+  std::deque<HostMqttMessage> queue;
+};
+
+/*
+ * The broker stand-in of the simulated core, for one client. The sessions
+ * are kept by client id unless the client connects with a clean session, the
+ * retained messages are delivered on subscribe and the will is published when
+ * the connection is lost (drop()). The other clients publish with publish().
+ */
+struct HostMqttBroker
+{
+  bool up = true;
+  bool connected = false;
+  uint32_t connects = 0;
+  bool session_present = false;
+  HostMqttConnect last;
+  std::map<std::string, HostMqttSession> sessions;
+  std::map<std::string, std::string> retained;
+  // Messages published by the client
+  std::vector<HostMqttMessage> published;
+
+  static bool matches(const std::string &filter, const std::string &topic)
+  {
+    if(filter.size() >= 2 && filter.compare(filter.size() - 2, 2, "/#") == 0)
+    {
+      return topic.compare(0, filter.size() - 1, filter, 0, filter.size() - 1) == 0;
+    }
+    return filter == topic;
+  }
+
+  HostMqttSession *session(void)
+  {
+    std::map<std::string, HostMqttSession>::iterator it = this->sessions.find(this->last.client_id);
+    return it == this->sessions.end() ? nullptr : &it->second;
+  }
+
+  void publish(const std::string &topic, const std::string &payload, uint8_t qos = 0, bool retain = false)
+  {
+    if(retain)
+    {
+      if(payload.empty())
+      {
+        this->retained.erase(topic);
+      }
+      else
+      {
+        this->retained[topic] = payload;
+      }
+    }
+    HostMqttSession *session = this->session();
+    if(!session)
+    {
+      return;
+    }
+    for(const std::pair<const std::string, uint8_t> &subscription : session->subscriptions)
+    {
+      if(matches(subscription.first, topic))
+      {
+        uint8_t granted = qos < subscription.second ? qos : subscription.second;
+        // The QoS 0 messages are lost while the client is offline
+        if(this->connected || granted > 0)
+        {
+          session->queue.push_back({ topic, payload, granted, false });
+        }
+        return;
+      }
+    }
+  }
+
+  /*
+   * The connection is lost without a DISCONNECT.
+   */
+  void drop(void)
+  {
+    if(!this->connected)
+    {
+      return;
+    }
+    this->connected = false;
+    this->publish(this->last.will_topic, this->last.will_message, this->last.will_qos, this->last.will_retain);
+    if(this->last.clean_session)
+    {
+      this->sessions.erase(this->last.client_id);
+    }
+  }
+};
+
+extern HostMqttBroker host_mqtt;
+
+#define MQTT_CALLBACK_SIGNATURE void (*callback)(char*, uint8_t*, unsigned int)
+
+class PubSubClient
+{
+  private:
+    MQTT_CALLBACK_SIGNATURE = nullptr;
+
+  public:
+    PubSubClient(void) {}
+    template<typename T>
+    PubSubClient(T&) {}
+
+    PubSubClient &setServer(const char*, uint16_t) { return *this; }
+    PubSubClient &setCallback(MQTT_CALLBACK_SIGNATURE)
+    {
+      this->callback = callback;
+      return *this;
+    }
+
+    bool connect(const char *id, const char *user, const char *pass, const char *willTopic, uint8_t willQos,
+      bool willRetain, const char *willMessage, bool cleanSession = true)
+    {
+      host_mqtt.drop();
+      if(!host_mqtt.up)
+      {
+        return false;
+      }
+      host_mqtt.last = { id, willTopic ? willTopic : "", willMessage ? willMessage : "", willQos, willRetain,
+        cleanSession };
+      host_mqtt.connects++;
+      host_mqtt.session_present = !cleanSession && host_mqtt.session();
+      if(!host_mqtt.session_present)
+      {
+        host_mqtt.sessions[id] = HostMqttSession();
+      }
+      host_mqtt.connected = true;
+      return true;
+    }
+    bool connect(const char *id)
+    {
+      return this->connect(id, nullptr, nullptr, nullptr, 0, false, nullptr, true);
+    }
+    void disconnect(void)
+    {
+      if(host_mqtt.connected && host_mqtt.last.clean_session)
+      {
+        host_mqtt.sessions.erase(host_mqtt.last.client_id);
+      }
+      host_mqtt.connected = false;
+    }
+    bool connected(void)
+    {
+      return host_mqtt.connected;
+    }
+    int state(void)
+    {
+      return host_mqtt.connected ? MQTT_CONNECTED : MQTT_CONNECT_UNAVAILABLE;
+    }
+
+    bool publish(const char *topic, const char *payload, bool retained = false)
+    {
+      if(!host_mqtt.connected)
+      {
+        return false;
+      }
+      host_mqtt.published.push_back({ topic, payload, 0, retained });
+      host_mqtt.publish(topic, payload, 0, retained);
+      return true;
+    }
+    bool subscribe(const char *topic, uint8_t qos = 0)
+    {
+      if(!host_mqtt.connected)
+      {
+        return false;
+      }
+      HostMqttSession *session = host_mqtt.session();
+      session->subscriptions[topic] = qos;
+      for(const std::pair<const std::string, std::string> &message : host_mqtt.retained)
+      {
+        if(HostMqttBroker::matches(topic, message.first))
+        {
+          session->queue.push_back({ message.first, message.second, qos, true });
+        }
+      }
+      return true;
+    }
+    bool unsubscribe(const char *topic)
+    {
+      if(!host_mqtt.connected)
+      {
+        return false;
+      }
+      host_mqtt.session()->subscriptions.erase(topic);
+      return true;
+    }
+
+    /*
+     * Deliver the messages queued for the client.
+     */
+    bool loop(void)
+    {
+      if(!host_mqtt.connected)
+      {
+        return false;
+      }
+      HostMqttSession *session = host_mqtt.session();
+      while(session && !session->queue.empty() && host_mqtt.connected)
+      {
+        HostMqttMessage message = session->queue.front();
+        session->queue.pop_front();
+        if(this->callback)
+        {
+          std::vector<char> topic(message.topic.begin(), message.topic.end());
+          topic.push_back('\0');
+          this->callback(topic.data(), (uint8_t*) message.payload.data(), message.payload.size());
+        }
+      }
+      return host_mqtt.connected;
+    }
+};
+
+#endif /* PUB_SUB_CLIENT_H_ */
@@ -0,0 +1,106 @@
+/*
+ * Updater.h
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <vector>
+
+#ifndef UPDATER_H_
+#define UPDATER_H_
+
+#define UPDATE_ERROR_OK 0
+#define UPDATE_ERROR_SPACE 4
+#define UPDATE_ERROR_MD5 8
+#define UPDATE_ERROR_ABORT 12
+
+// MD5 of the data in hex (32 characters and the terminator)
+void hostMD5(const uint8_t*, size_t, char*);
+
+/*
+ * Updater of the simulated core, the firmware written is kept and its MD5 is
+ * verified by end() as on the device. booted is set when the new firmware is
+ * selected to boot.
+ */
+class UpdaterClass
+{
+  private:
+    char _md5[33] = "";
+    uint8_t _error = UPDATE_ERROR_OK;
+
+  public:
+    size_t space = 1024 * 1024;
+    size_t size = 0;
+    std::vector<uint8_t> data;
+    bool running = false;
+    bool booted = false;
+
+    bool begin(size_t size)
+    {
+      this->data.clear();
+      this->booted = false;
+      this->_md5[0] = '\0';
+      if(size == 0 || size > this->space)
+      {
+        this->_error = UPDATE_ERROR_SPACE;
+        return false;
+      }
+      this->size = size;
+      this->running = true;
+      this->_error = UPDATE_ERROR_OK;
+      return true;
+    }
+    bool setMD5(const char *md5)
+    {
+      if(strlen(md5) != 32)
+      {
+        return false;
+      }
+      memcpy(this->_md5, md5, sizeof(this->_md5));
+      return true;
+    }
+    size_t write(uint8_t *data, size_t length)
+    {
+      if(!this->running || this->data.size() + length > this->size)
+      {
+        return 0;
+      }
+      this->data.insert(this->data.end(), data, data + length);
+      return length;
+    }
+    bool end(bool evenIfRemaining = false)
+    {
+      if(!this->running)
+      {
+        return false;
+      }
+      this->running = false;
+      if(this->data.size() < this->size && !evenIfRemaining)
+      {
+        this->_error = UPDATE_ERROR_ABORT;
+        return false;
+      }
+      char md5[33];
+      hostMD5(this->data.data(), this->data.size(), md5);
+      if(this->_md5[0] && strcmp(md5, this->_md5) != 0)
+      {
+        this->_error = UPDATE_ERROR_MD5;
+        return false;
+      }
+      this->booted = true;
+      return true;
+    }
+    uint8_t getError(void)
+    {
+      return this->_error;
+    }
+};
+
+extern UpdaterClass Update;
+
+#endif /* UPDATER_H_ */
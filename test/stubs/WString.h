@@ -0,0 +1,55 @@
+/*
+ * WString.h
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+
+#include <string>
+
+#ifndef WSTRING_H_
+#define WSTRING_H_
+
+/*
+ * The part of the String of Arduino used by the libraries tested on the host.
+ */
+class String
+{
+  private:
+    std::string _text;
+
+  public:
+    String(void) {}
+    String(const char *text) : _text(text ? text : "") {}
+    String(const std::string &text) : _text(text) {}
+    String(int value) : _text(std::to_string(value)) {}
+    String(unsigned int value) : _text(std::to_string(value)) {}
+    String(long value) : _text(std::to_string(value)) {}
+    String(unsigned long value) : _text(std::to_string(value)) {}
+
+    const char *c_str(void) const { return this->_text.c_str(); }
+    unsigned int length(void) const { return this->_text.length(); }
+    long toInt(void) const { return atol(this->_text.c_str()); }
+    float toFloat(void) const { return atof(this->_text.c_str()); }
+    bool operator==(const String &other) const { return this->_text == other._text; }
+    bool operator==(const char *other) const { return this->_text == other; }
+    bool operator!=(const String &other) const { return this->_text != other._text; }
+    String &operator+=(const String &other) { this->_text += other._text; return *this; }
+    String operator+(const String &other) const { return String(this->_text + other._text); }
+    void toCharArray(char *buffer, unsigned int size) const
+    {
+      if(size > 0)
+      {
+        size_t length = this->_text.copy(buffer, size - 1);
+        buffer[length] = '\0';
+      }
+    }
+};
+
+inline String operator+(const char *text, const String &other)
+{
+  return String(text) + other;
+}
+
+#endif /* WSTRING_H_ */
@@ -0,0 +1,71 @@
+/*
+ * Wire.h
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+#ifndef WIRE_H_
+#define WIRE_H_
+
+// Transmit buffer of the Wire of the ESP8266
+#define BUFFER_LENGTH 128
+
+/*
+ * I2C transaction sent to a device: the address and the bytes written.
+ */
+struct HostI2CTransaction
+{
+  uint8_t address;
+  std::vector<uint8_t> data;
+};
+
+/*
+ * Wire of the simulated core, the transactions are recorded. The bytes that
+ * do not fit in the buffer are refused as on the device.
+ */
+class TwoWire
+{
+  private:
+    HostI2CTransaction _current;
+    bool _transmitting = false;
+
+  public:
+    std::vector<HostI2CTransaction> transactions;
+    uint32_t overflows = 0;
+
+    void begin(void) {}
+    void begin(int, int) {}
+    void setClock(uint32_t) {}
+    void beginTransmission(uint8_t address)
+    {
+      this->_current.address = address;
+      this->_current.data.clear();
+      this->_transmitting = true;
+    }
+    size_t write(uint8_t value)
+    {
+      if(!this->_transmitting || this->_current.data.size() >= BUFFER_LENGTH)
+      {
+        this->overflows++;
+        return 0;
+      }
+      this->_current.data.push_back(value);
+      return 1;
+    }
+    uint8_t endTransmission(bool stop = true)
+    {
+      this->_transmitting = false;
+      this->transactions.push_back(this->_current);
+      return 0;
+    }
+};
+
+extern TwoWire Wire;
+
+#endif /* WIRE_H_ */
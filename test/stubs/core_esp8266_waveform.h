@@ -0,0 +1,41 @@
+/*
+ * core_esp8266_waveform.h
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+
+#include <stdint.h>
+
+#ifndef CORE_ESP8266_WAVEFORM_H_
+#define CORE_ESP8266_WAVEFORM_H_
+
+/*
+ * Waveforms of the simulated core, as the phase locked generator of the
+ * ESP8266 core 3.x: a waveform started with alignPhase starts its period
+ * phaseOffsetUS after the start of the period of that pin, a waveform already
+ * running keeps its phase when its high and low times change.
+ * The calls are rejected (and counted) from an interrupt or with the
+ * interrupts disabled, the generator of the core waits for timer1 there.
+ */
+struct HostWaveform
+{
+  bool running;
+  uint32_t high;      // us
+  uint32_t low;       // us
+  uint64_t start;     // cycle of the start of a period
+  uint32_t starts;
+};
+
+extern HostWaveform host_waveforms[17];
+extern uint32_t host_waveform_unsafe_calls;
+
+int startWaveform(uint8_t pin, uint32_t timeHighUS, uint32_t timeLowUS, uint32_t runTimeUS = 0,
+                  int8_t alignPhase = -1, uint32_t phaseOffsetUS = 0, bool autoPwm = false);
+int stopWaveform(uint8_t pin);
+void enablePhaseLockedWaveform(void);
+// Level of the pin at a cycle, from its waveform or its output
+bool hostPinLevel(uint8_t pin, uint64_t cycle);
+
+#endif /* CORE_ESP8266_WAVEFORM_H_ */
@@ -0,0 +1,17 @@
+/*
+ * core_version.h
+ * Created by Jose Rivera, Sep 2018.
+ *
+ * This work is licensed under a Creative Commons Attribution 4.0 International License.
+ * http://creativecommons.org/licenses/by/4.0/
+ */
+
+#ifndef CORE_VERSION_H_
+#define CORE_VERSION_H_
+
+// The simulated core has the phase locked waveforms of the core 3.x
+#define ARDUINO_ESP8266_MAJOR 3
+#define ARDUINO_ESP8266_MINOR 1
+#define ARDUINO_ESP8266_REVISION 2
+
+#endif /* CORE_VERSION_H_ */
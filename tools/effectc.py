@@ -0,0 +1,99 @@
+#!/usr/bin/env python3
+#
+# effectc.py
+# Created by Jose Rivera, Sep 2018.
+#
+# This work is licensed under a Creative Commons Attribution 4.0 International License.
+# http://creativecommons.org/licenses/by/4.0/
+#
+# Compiler of the effects for the Program mode (see EffectVM.h). The source is
+# a list of words in reverse polish notation:
+#
+#   123, 0x1F4     push a number
+#   #FF8000        push a color
+#   time, color, speed, sin, noise, add, sub, mul, div, mod, lt, gt, dup,
+#   swap, drop, clamp, rgb, hsv, palette, scale, mix, end
+#   phase:2000     push the position (0-255) inside a period of 2000 ms
+#   jz:label       jump to label if the top is 0
+#   jmp:label      jump to label
+#   label:         define a label (the jumps are forward only)
+#   ; comment      until the end of the line
+#
+# Example, a breathing effect with the color of the strip:
+#
+#   color phase:3000 sin scale end
+#
+# Usage: effectc.py effect.fx  (prints the hex payload for cmnd/rgb/program)
+
+import sys
+
+HEADER = b'FX\x01'
+MAX_SIZE = 256
+
+OPS = {
+    'end': 0x00, 'time': 0x04, 'sin': 0x06, 'noise': 0x07, 'add': 0x08,
+    'sub': 0x09, 'mul': 0x0A, 'div': 0x0B, 'mod': 0x0C, 'lt': 0x0D,
+    'gt': 0x0E, 'dup': 0x10, 'swap': 0x11, 'drop': 0x12, 'clamp': 0x13,
+    'rgb': 0x14, 'hsv': 0x15, 'palette': 0x16, 'scale': 0x17, 'mix': 0x18,
+    'color': 0x1B, 'speed': 0x1C
+}
+PUSH8, PUSH16, PUSH24, PHASE, JZ, JMP = 0x01, 0x02, 0x03, 0x05, 0x19, 0x1A
+
+
+class CompileError(Exception):
+    pass
+
+
+def push(value):
+    if value < 0 or value > 0xFFFFFF:
+        raise CompileError('value out of range: %d' % value)
+    if value <= 0xFF:
+        return bytes([PUSH8, value])
+    if value <= 0xFFFF:
+        return bytes([PUSH16]) + value.to_bytes(2, 'little')
+    return bytes([PUSH24]) + value.to_bytes(3, 'little')
+
+
+def compile_effect(source):
+    code = bytearray(HEADER)
+    labels = {}
+    fixups = []
+    for line in source.splitlines():
+        for word in line.split(';')[0].split():
+            word = word.lower()
+            if word.endswith(':'):
+                labels[word[:-1]] = len(code)
+            elif word.startswith('#'):
+                code += push(int(word[1:], 16))
+            elif word[0].isdigit():
+                code += push(int(word, 0))
+            elif word.startswith('phase:'):
+                code += bytes([PHASE]) + int(word[6:], 0).to_bytes(2, 'little')
+            elif word.startswith('jz:') or word.startswith('jmp:'):
+                name, label = word.split(':')
+                code += bytes([JZ if name == 'jz' else JMP, 0])
+                fixups.append((len(code) - 1, label))
+            elif word in OPS:
+                code.append(OPS[word])
+            else:
+                raise CompileError('unknown word: %s' % word)
+    for offset, label in fixups:
+        if label not in labels:
+            raise CompileError('unknown label: %s' % label)
+        distance = labels[label] - (offset + 1)
+        if distance < 0 or distance > 0xFF:
+            raise CompileError('jump out of range: %s' % label)
+        code[offset] = distance
+    if len(code) > MAX_SIZE:
+        raise CompileError('program too large: %d bytes' % len(code))
+    return bytes(code)
+
+
+if __name__ == '__main__':
+    if len(sys.argv) != 2:
+        sys.exit('usage: effectc.py effect.fx')
+    try:
+        with open(sys.argv[1]) as f:
+            print(compile_effect(f.read()).hex().upper())
+    except CompileError as e:
+        sys.exit('error: %s' % e)
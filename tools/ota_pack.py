@@ -0,0 +1,155 @@
+#!/usr/bin/env python3
+#
+# ota_pack.py
+# Created by Jose Rivera, Sep 2018.
+#
+# This work is licensed under a Creative Commons Attribution 4.0 International License.
+# http://creativecommons.org/licenses/by/4.0/
+#
+# Compresses a firmware image for the streaming update (see OtaUpdater.h).
+# The output is a header (magic "HSOT", version, window and lookahead bits,
+# size and MD5 of the firmware) followed by the firmware compressed with
+# heatshrink (window of 2^10 bytes, back references of up to 2^5 bytes), the
+# controller verifies the MD5 before switching to the new firmware.
+#
+# Usage: ota_pack.py firmware.bin firmware.hs [--check]
+#        (pio run builds .pioenvs/<env>/firmware.bin)
+# The file is served by any HTTP server (python3 -m http.server) and the
+# update is started with {topic}/cmnd/ota/update http://host:8000/firmware.hs
+#
+
+import hashlib
+import struct
+import sys
+
+MAGIC = b"HSOT"
+VERSION = 1
+WINDOW_BITS = 10
+LOOKAHEAD_BITS = 5
+MIN_MATCH = 3
+MAX_CANDIDATES = 64
+
+
+class BitWriter(object):
+    def __init__(self):
+        self.data = bytearray()
+        self.current = 0
+        self.count = 0
+
+    def write(self, value, bits):
+        for bit in range(bits - 1, -1, -1):
+            self.current = (self.current << 1) | ((value >> bit) & 1)
+            self.count += 1
+            if self.count == 8:
+                self.data.append(self.current)
+                self.current = 0
+                self.count = 0
+
+    def flush(self):
+        if self.count:
+            self.data.append(self.current << (8 - self.count))
+            self.current = 0
+            self.count = 0
+        return bytes(self.data)
+
+
+def compress(data, window_bits=WINDOW_BITS, lookahead_bits=LOOKAHEAD_BITS):
+    """Greedy LZSS in the bit format of heatshrink."""
+    window = 1 << window_bits
+    longest = 1 << lookahead_bits
+    writer = BitWriter()
+    positions = {}
+    i = 0
+    while i < len(data):
+        best_length = 0
+        best_distance = 0
+        key = data[i:i + MIN_MATCH]
+        if len(key) == MIN_MATCH:
+            candidates = positions.get(key, [])
+            for start in reversed(candidates):
+                distance = i - start
+                if distance > window:
+                    break
+                length = 0
+                while (length < longest and i + length < len(data) and
+                       data[start + length] == data[i + length]):
+                    length += 1
+                if length > best_length:
+                    best_length = length
+                    best_distance = distance
+                    if length == longest:
+                        break
+        if best_length >= MIN_MATCH:
+            writer.write(0, 1)
+            writer.write(best_distance - 1, window_bits)
+            writer.write(best_length - 1, lookahead_bits)
+            step = best_length
+        else:
+            writer.write(1, 1)
+            writer.write(data[i], 8)
+            step = 1
+        for j in range(i, i + step):
+            key = data[j:j + MIN_MATCH]
+            if len(key) == MIN_MATCH:
+                candidates = positions.setdefault(key, [])
+                candidates.append(j)
+                if len(candidates) > MAX_CANDIDATES:
+                    del candidates[0]
+        i += step
+    return writer.flush()
+
+
+def decompress(data, size, window_bits=WINDOW_BITS, lookahead_bits=LOOKAHEAD_BITS):
+    """Reference decoder, the same state machine of HeatshrinkDecoder."""
+    output = bytearray()
+    bits = []
+    for byte in data:
+        bits.extend((byte >> bit) & 1 for bit in range(7, -1, -1))
+    position = 0
+
+    def read(count):
+        nonlocal position
+        value = 0
+        for _ in range(count):
+            value = (value << 1) | bits[position]
+            position += 1
+        return value
+
+    while len(output) < size:
+        if read(1):
+            output.append(read(8))
+        else:
+            distance = read(window_bits) + 1
+            length = read(lookahead_bits) + 1
+            for _ in range(length):
+                output.append(output[-distance] if distance <= len(output) else 0)
+    return bytes(output[:size])
+
+
+def pack(firmware):
+    header = MAGIC + struct.pack("<BBBBI", VERSION, WINDOW_BITS, LOOKAHEAD_BITS, 0, len(firmware))
+    return header + hashlib.md5(firmware).digest() + compress(firmware)
+
+
+def main(argv):
+    if len(argv) < 3:
+        print("Usage: ota_pack.py firmware.bin firmware.hs [--check]")
+        return 1
+    with open(argv[1], "rb") as source:
+        firmware = source.read()
+    image = pack(firmware)
+    with open(argv[2], "wb") as target:
+        target.write(image)
+    print("%d bytes, compressed %d bytes (%.1f%%), md5 %s" % (
+        len(firmware), len(image), 100.0 * len(image) / max(len(firmware), 1),
+        hashlib.md5(firmware).hexdigest()))
+    if "--check" in argv[3:]:
+        if decompress(image[28:], len(firmware)) != firmware:
+            print("Check failed")
+            return 1
+        print("Check passed")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
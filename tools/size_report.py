@@ -0,0 +1,103 @@
+#
+# size_report.py
+# Created by Jose Rivera, Sep 2018.
+#
+# This work is licensed under a Creative Commons Attribution 4.0 International License.
+# http://creativecommons.org/licenses/by/4.0/
+#
+# PlatformIO extra script (post) that prints the size of each module of the
+# firmware after the build: flash (code, constants and initial values of the
+# data), .data and .bss. The sizes are the ones of the objects and libraries
+# linked, before the linker removes the unused sections, so they are an upper
+# bound; the totals of the firmware are printed too. The report is also saved
+# to size_report.txt in the build folder.
+#
+
+from __future__ import print_function
+
+import os
+import subprocess
+from collections import OrderedDict
+
+Import("env")
+
+# Objects (src/) and libraries of each optional module, the rest is the core
+# or the framework
+MODULES = OrderedDict([
+    ("wifi_manager", ["WifiModule", "WifiManager", "DNSServer"]),
+    ("mqtt", ["MqttModule", "PubSubClient", "CommandQueue"]),
+    ("hass", ["HassModule"]),
+    ("blynk", ["BlynkModule", "Blynk", "WidgetShadow"]),
+    ("ota", ["OtaModule", "OtaUpdater", "ESP8266HTTPClient"]),
+])
+FRAMEWORK = ["FrameworkArduino", "FrameworkArduinoVariant"]
+
+
+def size_tool(env):
+    tool = env.subst("$SIZETOOL")
+    if tool:
+        return tool
+    return env.subst("$CC").replace("gcc", "size")
+
+
+def group(path, build_dir):
+    """Name of the module of an object file or a library archive."""
+    name = os.path.basename(path)
+    if name.endswith(".a"):
+        name = name[3:-2] if name.startswith("lib") else name[:-2]
+    else:
+        name = name.split(".")[0]
+    relative = os.path.relpath(path, build_dir).split(os.sep)
+    for module, names in MODULES.items():
+        if name in names or any(part in names for part in relative[:-1]):
+            return module
+    if name in FRAMEWORK:
+        return "framework"
+    return "core"
+
+
+def measure(tool, path):
+    """Sum of text, data and bss of an object or all the members of an archive."""
+    try:
+        output = subprocess.check_output([tool, "-B", path]).decode("utf-8", "replace")
+    except (OSError, subprocess.CalledProcessError):
+        return (0, 0, 0)
+    text = data = bss = 0
+    for line in output.splitlines()[1:]:
+        fields = line.split()
+        if len(fields) >= 3 and fields[0].isdigit():
+            text += int(fields[0])
+            data += int(fields[1])
+            bss += int(fields[2])
+    return (text, data, bss)
+
+
+def size_report(target, source, env):
+    build_dir = env.subst("$BUILD_DIR")
+    tool = size_tool(env)
+    totals = OrderedDict((name, [0, 0, 0]) for name in ["core"] + list(MODULES) + ["framework"])
+    for root, dirs, files in os.walk(build_dir):
+        for name in files:
+            path = os.path.join(root, name)
+            # The objects of the libraries are also in their archives
+            if name.endswith(".a") or (name.endswith(".o") and
+                                       os.path.relpath(root, build_dir).split(os.sep)[0] == "src"):
+                text, data, bss = measure(tool, path)
+                sizes = totals[group(path, build_dir)]
+                sizes[0] += text
+                sizes[1] += data
+                sizes[2] += bss
+
+    lines = ["%-14s %10s %10s %10s" % ("module", "flash", ".data", ".bss")]
+    for name, (text, data, bss) in totals.items():
+        lines.append("%-14s %10d %10d %10d" % (name, text + data, data, bss))
+    firmware = measure(tool, str(target[0]))
+    lines.append("%-14s %10d %10d %10d" % ("firmware", firmware[0] + firmware[1], firmware[1], firmware[2]))
+
+    report = "\n".join(lines)
+    print("\nSize report (%s)\n%s" % (env.subst("$PIOENV"), report))
+    with open(os.path.join(build_dir, "size_report.txt"), "w") as output:
+        output.write(report + "\n")
+
+
+env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", size_report)
@@ -0,0 +1,292 @@
+#!/usr/bin/env python3
+#
+# state_replay.py
+# Created by Jose Rivera, Sep 2018.
+#
+# This work is licensed under a Creative Commons Attribution 4.0 International License.
+# http://creativecommons.org/licenses/by/4.0/
+#
+# Rebuilds the state of a controller from the delta telemetry (see
+# lib/StateDelta and mqttSendState in src/MqttModule.cpp). The keyframes ({topic}/tele/STATE,
+# "key": true) carry the full state, the deltas ({topic}/stat/STATE) only the
+# fields changed since the message before them (null is a field removed).
+# Each message has the next sequence number, after a lost delta the state is
+# unknown until the next keyframe. The telemetry fields (TELEMETRY) change on
+# every read and are only sent in the keyframes, their values are the ones of
+# the last keyframe. The zones after the first one are in "zones" ({"1":
+# {"white": ..., "rgb": ..., "energy": ...}, ...}), their energy is telemetry.
+#
+# Usage: state_replay.py log.txt
+#        (mosquitto_sub -v -t '{topic}/tele/STATE' -t '{topic}/stat/STATE' > log.txt)
+#        Prints the state rebuilt at the end of the log and the sequence gaps.
+#        state_replay.py --verify log.txt
+#        Replays a log written by test/StateDeltaTest (the messages of the
+#        encoder of the controller, each one followed by "expect {state}") and
+#        verifies the state rebuilt after each message.
+#        state_replay.py --check
+#        Replays random changes of a state through a port of the encoder, when
+#        the host tests cannot be built.
+#
+# It can be used as a library: StateReconstructor().apply(payload).
+#
+
+import copy
+import json
+import random
+import sys
+
+# Fields left out of the deltas, None is the whole object
+TELEMETRY = {"power": ["current"], "strobe": ["jitter"], "energy": None, "mqtt": None, "blynk": None}
+ZONE_TELEMETRY = ["energy"]
+
+
+class StateReconstructor(object):
+
+    def __init__(self):
+        self.state = None
+        self.seq = None
+        self.keyframes = 0
+        self.deltas = 0
+        self.gaps = 0
+
+    @staticmethod
+    def merge(state, delta):
+        for key, value in delta.items():
+            if value is None:
+                state.pop(key, None)
+            elif isinstance(value, dict) and isinstance(state.get(key), dict):
+                StateReconstructor.merge(state[key], value)
+            else:
+                state[key] = copy.deepcopy(value)
+
+    def apply(self, payload):
+        """
+        Apply a message (text or dict), it returns the state rebuilt or None
+        while it is unknown.
+        """
+        message = json.loads(payload) if isinstance(payload, str) else copy.deepcopy(payload)
+        seq = message.pop("seq")
+        keyframe = message.pop("key", False)
+        if keyframe:
+            self.state = message
+            self.seq = seq
+            self.keyframes += 1
+        elif self.state is not None and seq == self.seq + 1:
+            self.merge(self.state, message)
+            self.seq = seq
+            self.deltas += 1
+        else:
+            if self.state is not None:
+                self.gaps += 1
+            self.state = None
+            self.seq = None
+        return self.state
+
+
+def text(value):
+    return json.dumps(value, separators=(",", ":"))
+
+
+def diff(base, state):
+    """
+    Fields of the state that differ from the base, as StateDelta::diff.
+    """
+    delta = {}
+    for key, value in state.items():
+        if isinstance(value, dict) and isinstance(base.get(key), dict):
+            nested = diff(base[key], value)
+            if nested:
+                delta[key] = nested
+        elif key not in base or text(base[key]) != text(value):
+            delta[key] = value
+    for key in base:
+        if key not in state:
+            delta[key] = None
+    return delta
+
+
+def stable(state):
+    """
+    The state without the telemetry, as getDeviceState(false).
+    """
+    state = copy.deepcopy(state)
+    for key, fields in TELEMETRY.items():
+        if fields is None:
+            state.pop(key, None)
+        elif isinstance(state.get(key), dict):
+            for field in fields:
+                state[key].pop(field, None)
+    for zone in state.get("zones", {}).values():
+        for field in ZONE_TELEMETRY:
+            zone.pop(field, None)
+    return state
+
+
+class StateEncoder(object):
+    """
+    Port of StateDelta and mqttSendState, it returns the messages of each
+    state.
+    """
+
+    def __init__(self, keyframe_deltas=50):
+        self.keyframe_deltas = keyframe_deltas
+        self.base = None
+        self.seq = 0
+        self.deltas = 0
+
+    def send(self, state, keyframe=False):
+        keyframe = keyframe or self.base is None or self.deltas >= self.keyframe_deltas
+        message = copy.deepcopy(state)
+        if not keyframe:
+            message = diff(self.base, stable(state))
+            if not message:
+                return None
+        self.base = stable(state)
+        self.seq += 1
+        message["seq"] = self.seq
+        if keyframe:
+            message["key"] = True
+            self.deltas = 0
+        else:
+            self.deltas += 1
+        return text(message)
+
+
+def random_state(rng, state):
+    state = copy.deepcopy(state)
+    # The telemetry changes on every read
+    state["power"]["current"] = rng.randint(0, 3000)
+    state["strobe"]["jitter"] = rng.randint(0, 40)
+    state["energy"]["total"] += rng.random()
+    state["mqtt"]["coalesced"] += rng.randint(0, 2)
+    for zone in state["zones"].values():
+        zone["energy"]["total"] += rng.random()
+    for _ in range(rng.randint(0, 3)):
+        field = rng.choice(["white", "rgb", "power", "ota"])
+        # The first zone or one of the others
+        zone = rng.choice([state] + list(state["zones"].values()))
+        if field == "white":
+            zone["white"] = {"state": rng.choice(["ON", "OFF"]), "intensity": rng.randint(0, 255)}
+        elif field == "rgb":
+            zone["rgb"][rng.choice(["color", "brightness", "speed"])] = rng.randint(0, 1023)
+            zone["rgb"]["mode"] = rng.choice(["NORMAL", "FADE", ""])
+        elif field == "power":
+            state["power"]["limited"] = rng.random() < 0.1
+        elif "error" in state["ota"]:
+            del state["ota"]["error"]
+        else:
+            state["ota"]["error"] = "HTTP %d" % rng.randint(400, 599)
+    return state
+
+
+def check(steps=20000, seed=1):
+    rng = random.Random(seed)
+    encoder = StateEncoder()
+    reconstructor = StateReconstructor()
+    late = StateReconstructor()
+    changes = 0
+    state = {"white": {"state": "OFF", "intensity": 0},
+             "rgb": {"state": "ON", "mode": "NORMAL", "color": 0, "brightness": 255, "speed": 512},
+             "power": {"current": 0, "limited": False}, "strobe": {"frequency": 0, "duty": 50, "jitter": 0},
+             "energy": {"total": 0.0}, "mqtt": {"reconnects": 0, "coalesced": 0},
+             "ota": {"state": "IDLE", "progress": 0}, "zones": {}}
+    for zone in range(1, 4):
+        state["zones"][str(zone)] = {"white": {"state": "OFF", "intensity": 0},
+                                     "rgb": {"state": "ON", "mode": "NORMAL", "color": 0, "brightness": 255,
+                                             "speed": 512},
+                                     "energy": {"total": 0.0}}
+    for step in range(steps):
+        previous = state
+        state = random_state(rng, state)
+        keyframe = step % 3000 == 0
+        if keyframe or stable(state) != stable(previous):
+            changes += 1
+        message = encoder.send(state, keyframe)
+        if message is None:
+            continue
+        if stable(reconstructor.apply(message)) != stable(state):
+            print("step %d: state rebuilt differs" % step)
+            return False
+        # A subscriber that starts late and loses some messages
+        if step > steps // 2 and rng.random() > 0.01:
+            late.apply(message)
+    if reconstructor.gaps:
+        print("gaps %d" % reconstructor.gaps)
+        return False
+    # Only the changes of the state are sent, not the telemetry
+    if reconstructor.keyframes + reconstructor.deltas > changes + steps // encoder.keyframe_deltas:
+        print("%d messages for %d changes" % (reconstructor.keyframes + reconstructor.deltas, changes))
+        return False
+    if late.state is not None and stable(late.state) != stable(state):
+        print("late subscriber differs")
+        return False
+    print("keyframes %d deltas %d, late subscriber keyframes %d gaps %d: OK" %
+          (reconstructor.keyframes, reconstructor.deltas, late.keyframes, late.gaps))
+    return True
+
+
+def replay(path):
+    reconstructor = StateReconstructor()
+    with open(path) as log:
+        for line in log:
+            line = line.strip()
+            if not line or " " not in line:
+                continue
+            topic, payload = line.split(" ", 1)
+            if not topic.endswith("/tele/STATE") and not topic.endswith("/stat/STATE"):
+                continue
+            try:
+                reconstructor.apply(payload)
+            except (ValueError, KeyError):
+                print("%s: not a delta telemetry message" % topic)
+    print("keyframes %d deltas %d gaps %d" %
+          (reconstructor.keyframes, reconstructor.deltas, reconstructor.gaps))
+    if reconstructor.state is None:
+        print("state unknown, waiting for a keyframe")
+        return False
+    print(json.dumps(reconstructor.state, indent=2, sort_keys=True))
+    return True
+
+
+def verify(path):
+    reconstructor = StateReconstructor()
+    late = StateReconstructor()
+    state = None
+    messages = 0
+    with open(path) as log:
+        for number, line in enumerate(log, 1):
+            topic, payload = line.rstrip("\n").split(" ", 1)
+            if topic == "expect":
+                if state is None or stable(state) != json.loads(payload):
+                    print("%s:%d: state rebuilt differs" % (path, number))
+                    return False
+                continue
+            state = reconstructor.apply(payload)
+            messages += 1
+            # A subscriber that loses a message of each hundred
+            if messages % 100 != 37:
+                late.apply(payload)
+    if not messages or reconstructor.gaps:
+        print("%d messages, gaps %d" % (messages, reconstructor.gaps))
+        return False
+    if late.state is None or stable(late.state) != stable(state) or not late.gaps:
+        print("late subscriber differs")
+        return False
+    print("keyframes %d deltas %d, lossy subscriber keyframes %d gaps %d: OK" %
+          (reconstructor.keyframes, reconstructor.deltas, late.keyframes, late.gaps))
+    return True
+
+
+def main(argv):
+    if len(argv) == 2 and argv[1] == "--check":
+        return 0 if check() else 1
+    if len(argv) == 3 and argv[1] == "--verify":
+        return 0 if verify(argv[2]) else 1
+    if len(argv) != 2:
+        print("Usage: state_replay.py log.txt | --verify log.txt | --check")
+        return 2
+    return 0 if replay(argv[1]) else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -0,0 +1,128 @@
+#!/usr/bin/env python3
+#
+# timeline.py
+# Created by Jose Rivera, Sep 2018.
+#
+# This work is licensed under a Creative Commons Attribution 4.0 International License.
+# http://creativecommons.org/licenses/by/4.0/
+#
+# Converts a cue list into a show for the timeline player (see LedTimeline.h).
+# The cue list is a CSV file with the columns time, zones, action and value:
+#
+#   time     ms (1500), seconds (1.5s), minutes and seconds (1:02.5) or, with
+#            --bpm, beats (bar.beat, for example 4.1 is the first beat of the
+#            bar 4, 4 beats per bar like a MIDI sequencer)
+#   zones    all, a zone or a list of zones separated by spaces ("1 3")
+#   action   rgb (on | off), mode (normal | strobe | flash | fade | audio |
+#            program), color (#RRGGBB or 0-16777215), speed (0-1024),
+#            brightness (0-255), white (0-255, 0 turns off) or end (the
+#            duration of the show, by default the time of the last cue)
+#
+# Lines starting with # are comments. Example:
+#
+#   0,all,color,#FF0000
+#   0,all,mode,normal
+#   1:30,1 2,mode,fade
+#   3:00,all,end,
+#
+# Usage: timeline.py [--bpm N] cues.csv show.tl
+# The show is uploaded to the data folder (pio run -t uploadfs).
+
+import argparse
+import csv
+import struct
+import sys
+
+HEADER = b'TL\x01\x00'
+EVENT = struct.Struct('<IBBHI')
+MAX_ZONES = 8
+
+ACTIONS = {'rgb': 0, 'mode': 1, 'color': 2, 'speed': 3, 'brightness': 4, 'white': 5}
+MODES = ['normal', 'strobe', 'flash', 'fade', 'audio', 'program']
+
+
+class CueError(Exception):
+    pass
+
+
+def parse_time(text, bpm):
+    text = text.strip().lower()
+    if bpm:
+        bar, _, beat = text.partition('.')
+        beats = (int(bar) - 1) * 4 + (int(beat or 1) - 1)
+        return round(beats * 60000 / bpm)
+    if ':' in text:
+        minutes, seconds = text.split(':')
+        return round((int(minutes) * 60 + float(seconds)) * 1000)
+    if text.endswith('s'):
+        return round(float(text[:-1]) * 1000)
+    return int(text)
+
+
+def parse_zones(text):
+    text = text.strip().lower()
+    if text == 'all':
+        return (1 << MAX_ZONES) - 1
+    mask = 0
+    for zone in text.split():
+        if int(zone) >= MAX_ZONES:
+            raise CueError('invalid zone: %s' % zone)
+        mask |= 1 << int(zone)
+    return mask
+
+
+def parse_value(action, text):
+    text = text.strip().lower()
+    if action == 'rgb':
+        return 1 if text == 'on' else 0
+    if action == 'mode':
+        if text not in MODES:
+            raise CueError('invalid mode: %s' % text)
+        return MODES.index(text)
+    if action == 'color' and text.startswith('#'):
+        return int(text[1:], 16)
+    return int(text, 0)
+
+
+def convert(rows, bpm=None):
+    events = []
+    duration = None
+    for number, row in enumerate(rows, 1):
+        if not row or row[0].strip().startswith('#'):
+            continue
+        try:
+            time = parse_time(row[0], bpm)
+            action = row[2].strip().lower()
+            if action == 'end':
+                duration = time
+                continue
+            if action not in ACTIONS:
+                raise CueError('invalid action: %s' % action)
+            value = parse_value(action, row[3] if len(row) > 3 else '')
+            events.append((time, parse_zones(row[1]), ACTIONS[action], value))
+        except (CueError, ValueError, IndexError) as e:
+            raise CueError('line %d: %s' % (number, e))
+    # The player expects the events sorted, cues at the same time keep their order
+    events.sort(key=lambda event: event[0])
+    last = events[-1][0] if events else 0
+    duration = max(duration or 0, last)
+    data = HEADER + struct.pack('<I', duration)
+    for time, zones, action, value in events:
+        data += EVENT.pack(time, zones, action, 0, value)
+    return data
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Convert a cue list into a show')
+    parser.add_argument('--bpm', type=float, help='the times are bar.beat at this tempo')
+    parser.add_argument('cues')
+    parser.add_argument('show')
+    args = parser.parse_args()
+    try:
+        with open(args.cues, newline='') as f:
+            data = convert(csv.reader(f), args.bpm)
+    except CueError as e:
+        sys.exit('error: %s' % e)
+    with open(args.show, 'wb') as f:
+        f.write(data)
+    print('%s: %d events, %d bytes' % (args.show, (len(data) - 8) // EVENT.size, len(data)))